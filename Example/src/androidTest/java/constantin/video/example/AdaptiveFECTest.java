@@ -0,0 +1,20 @@
+package constantin.video.example;
+
+// Replay a loss trace with clean and bursty phases on the FEC wrapped stream and check that adaptive FEC loses fewer frames
+// than the lowest fixed overhead while sending less than the highest fixed overhead
+
+import org.junit.Test;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class AdaptiveFECTest {
+
+    @Test
+    public void adaptiveFECTest(){
+        final String report=VideoTransmitter.nativeTestAdaptiveFEC(10,150,2000);
+        assertTrue(report,report.contains("less frame loss than fixed min:yes"));
+        assertTrue(report,report.contains("less overhead than fixed max:yes"));
+    }
+}
@@ -0,0 +1,20 @@
+package constantin.video.example;
+
+// Send synthetic frames over the loopback interface packet by packet, batched (sendmmsg) and batched with UDP GSO,
+// and check that all packets arrive unchanged and in order with fewer send calls when batching
+
+import org.junit.Test;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class BatchSendTest {
+
+    @Test
+    public void batchSendTest(){
+        final String report=VideoTransmitter.nativeTestBatchSend(60);
+        assertTrue(report,report.contains("intact:yes"));
+        assertTrue(report,report.contains("fewer send calls:yes"));
+    }
+}
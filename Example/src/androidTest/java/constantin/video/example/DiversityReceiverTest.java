@@ -0,0 +1,20 @@
+package constantin.video.example;
+
+// Feed duplicate and interleaved rtp packets from two paths into a DiversityReceiver and check
+// the deduplicated output (no duplicates, first copies in arrival order, sequence number wrap around)
+
+import org.junit.Test;
+
+import constantin.video.core.TestUDPReceiver;
+
+import static org.junit.Assert.assertTrue;
+
+public class DiversityReceiverTest {
+
+    @Test
+    public void deduplicatesTest(){
+        final String report=TestUDPReceiver.nativeTestDiversityReceiver(500);
+        assertTrue(report,report.contains("duplicates:0"));
+        assertTrue(report,report.contains("order:yes"));
+    }
+}
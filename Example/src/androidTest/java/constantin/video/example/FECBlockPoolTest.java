@@ -0,0 +1,19 @@
+package constantin.video.example;
+
+// Once warmed up, the FEC encoder and decoder have to reuse their blocks instead of allocating new ones
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class FECBlockPoolTest {
+
+    @Test
+    public void noSteadyStateAllocationsTest(){
+        final String report=TestFEC.nativeBenchmarkFECBlockPool();
+        assertTrue(report,report.contains("steady-state block allocations encoder:0 decoder:0"));
+        assertTrue(report,report.contains("bit-exact:yes"));
+    }
+}
@@ -0,0 +1,18 @@
+package constantin.video.example;
+
+// Decoding with the cached (inverted) decode matrices has to produce the same data as decoding without the cache
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class FECDecodeCacheTest {
+
+    @Test
+    public void bitExactTest(){
+        final String report=TestFEC.nativeBenchmarkFECDecodeCache();
+        assertTrue(report,report.contains("bit-exact:yes"));
+    }
+}
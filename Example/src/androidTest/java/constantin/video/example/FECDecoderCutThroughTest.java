@@ -0,0 +1,20 @@
+package constantin.video.example;
+
+// A data block has to be released by the FEC decoder as soon as all earlier data blocks were released or declared lost,
+// e.g. a gap that can not be filled anymore must not hold back the following data blocks
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class FECDecoderCutThroughTest {
+
+    @Test
+    public void cutThroughTest(){
+        final String report=TestFEC.nativeBenchmarkFECDecoderCutThrough();
+        assertTrue(report,report.contains("less delay:yes"));
+        assertTrue(report,report.contains("in-order:yes"));
+    }
+}
@@ -0,0 +1,21 @@
+package constantin.video.example;
+
+// Blocks that arrive out of order (over a second, delayed path) have to be used by the FEC decoder,
+// the data blocks have to be output in order
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class FECDecoderReorderTest {
+
+    @Test
+    public void reorderTest(){
+        final String report=TestFEC.nativeTestFECDecoderReorder();
+        assertTrue(report,report.contains("in-order:yes"));
+        assertTrue(report,report.contains("more data with multiple open groups:yes"));
+        assertTrue(report,report.contains("deadline:yes"));
+    }
+}
@@ -0,0 +1,30 @@
+package constantin.video.example;
+
+// Send synthetic frames of several slices with FEC over the loopback interface to a receiver with burst loss and check that
+// one FEC group per frame results in more complete frames than one FEC group per slice (NALU) at the same FEC ratio
+
+import org.junit.Test;
+
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class FECFrameGroupingTest {
+
+    private static float getFrameLoss(final String report,final String mode){
+        final Matcher matcher=Pattern.compile("(?m)^"+mode+" .* frame loss:([\\d.]+)%").matcher(report);
+        assertTrue(report,matcher.find());
+        return Float.parseFloat(matcher.group(1));
+    }
+
+    @Test
+    public void frameGroupingReducesFrameLossTest(){
+        // Bursts of ~3 packets, 50% FEC, 8 slices per frame
+        final String report=VideoTransmitter.nativeTestFECFrameGrouping(0.01f,0.3f,50,300,8);
+        assertTrue(report,report.contains("more complete frames per frame:yes"));
+        assertTrue(report,getFrameLoss(report,"per frame")<getFrameLoss(report,"per NALU"));
+    }
+}
@@ -0,0 +1,20 @@
+package constantin.video.example;
+
+// All GF(256) kernels the device supports have to produce the same FEC blocks as the table version
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+public class FECKernelTest {
+
+    @Test
+    public void kernelsAreBitExactTest(){
+        final String report=TestFEC.nativeBenchmarkFECKernels();
+        assertTrue(report,report.contains("table bit-exact:yes"));
+        assertFalse(report,report.contains("bit-exact:no"));
+    }
+}
@@ -0,0 +1,89 @@
+package constantin.video.example;
+
+// Start the VideoPlayer with the 'rtp inside FEC' protocol on the UDP source, send it FEC groups with one lost block each
+// over the loopback interface and check that the player reports the loss back to the sender (RTCP APP 'FECL')
+
+import android.content.Context;
+
+import androidx.test.platform.app.InstrumentationRegistry;
+
+import org.junit.Test;
+
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.net.InetAddress;
+import java.net.SocketTimeoutException;
+
+import constantin.video.core.player.VideoPlayer;
+import constantin.video.core.player.VideoSettings;
+
+import static org.junit.Assert.assertTrue;
+
+public class FECLossReportPlayerTest {
+    private static final int VS_PORT=5600;
+    private static final int VIDEO_DATA_TYPE_CUSTOM2=5;
+    private static final int N_BLOCKS=4;
+    private static final int N_FEC_BLOCKS=2;
+
+    // FECHeader (seq_num, block, n_blocks, n_fec_blocks, little endian length) followed by the data
+    private static byte[] createFECBlock(final int seqNum,final int block){
+        final int length=100;
+        final byte[] ret=new byte[6+length];
+        ret[0]=(byte)seqNum;
+        ret[1]=(byte)block;
+        ret[2]=(byte)N_BLOCKS;
+        ret[3]=(byte)N_FEC_BLOCKS;
+        ret[4]=(byte)(length & 0xFF);
+        ret[5]=(byte)(length>>8);
+        return ret;
+    }
+
+    private static boolean isFECLossReport(final DatagramPacket packet){
+        final byte[] data=packet.getData();
+        return packet.getLength()>=24 && (data[1] & 0xFF)==204 && data[8]=='F' && data[9]=='E' && data[10]=='C' && data[11]=='L';
+    }
+
+    @Test
+    public void reportsLossTest() throws Exception {
+        final Context context=InstrumentationRegistry.getInstrumentation().getTargetContext();
+        VideoSettings.setVS_SOURCE(context,VideoSettings.VS_SOURCE.UDP);
+        VideoSettings.setVS_PROTOCOL(context,VIDEO_DATA_TYPE_CUSTOM2);
+        VideoSettings.setVS_DIVERSITY_PORT(context,0);
+        VideoSettings.setVS_RTP_NACK_MAX_DELAY_MS(context,0);
+        VideoSettings.setVS_FEC_LOSS_REPORT_INTERVAL_MS(context,50);
+        final long player=VideoPlayer.nativeInitialize(context,VideoSettings.getDirectoryToSaveDataTo());
+        VideoPlayer.nativeStart(player,context);
+        int nReports=0;
+        long nLost=0;
+        try(final DatagramSocket socket=new DatagramSocket()){
+            socket.setSoTimeout(5);
+            final InetAddress localhost=InetAddress.getByName("127.0.0.1");
+            for(int group=0;group<200;group++){
+                // The sender skips sequence number 0
+                final int seqNum=group%255+1;
+                for(int block=0;block<N_BLOCKS+N_FEC_BLOCKS;block++){
+                    if(block==1)continue;
+                    final byte[] data=createFECBlock(seqNum,block);
+                    socket.send(new DatagramPacket(data,data.length,localhost,VS_PORT));
+                }
+                final DatagramPacket reply=new DatagramPacket(new byte[1500],1500);
+                try{
+                    socket.receive(reply);
+                    if(isFECLossReport(reply)){
+                        nReports++;
+                        final byte[] r=reply.getData();
+                        nLost+=((r[16] & 0xFFL)<<24) | ((r[17] & 0xFF)<<16) | ((r[18] & 0xFF)<<8) | (r[19] & 0xFF);
+                    }
+                }catch (SocketTimeoutException ignored){}
+            }
+        }finally {
+            VideoPlayer.nativeStop(player,context);
+            VideoPlayer.nativeFinalize(player);
+            VideoSettings.setVS_FEC_LOSS_REPORT_INTERVAL_MS(context,0);
+            VideoSettings.setVS_PROTOCOL(context,0);
+        }
+        final String summary="FEC loss reports:"+nReports+" lost:"+nLost;
+        assertTrue(summary,nReports>0);
+        assertTrue(summary,nLost>0);
+    }
+}
@@ -0,0 +1,97 @@
+package constantin.video.example;
+
+// Replay a test video trough the simulated bad link and check that the results do not change
+
+import android.content.Context;
+
+import androidx.test.platform.app.InstrumentationRegistry;
+
+import org.junit.Test;
+
+import java.io.IOException;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+import constantin.video.core.TestImpairedRTP;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNotEquals;
+import static org.junit.Assert.assertTrue;
+
+public class ImpairedRTPReplayTest {
+    private static final String TEST_FILE="rpi_cam/1/test.h264";
+
+    private static String replay(final int seed,final float loss,final float geGoodToBad,final float geBadToGood,
+                                 final float reorder,final int reorderDepth,final float duplicate,final int jitterUs){
+        return replay(TEST_FILE,false,false,seed,loss,geGoodToBad,geBadToGood,reorder,reorderDepth,duplicate,jitterUs);
+    }
+
+    private static String replay(final String assetFilename,final boolean isH265,final boolean aggregate,final int seed,final float loss,final float geGoodToBad,final float geBadToGood,
+                                 final float reorder,final int reorderDepth,final float duplicate,final int jitterUs){
+        final Context context=InstrumentationRegistry.getInstrumentation().getTargetContext();
+        return TestImpairedRTP.nativeRunReplay(context,assetFilename,isH265,aggregate,seed,loss,geGoodToBad,geBadToGood,reorder,reorderDepth,duplicate,jitterUs);
+    }
+
+    @Test
+    public void perfectLinkTest(){
+        final String report=replay(0,0,0,0,0,0,0,0);
+        assertTrue(report,report.contains("dropped:0 "));
+        assertTrue(report,report.contains("corrupted NALUs:0"));
+    }
+
+    // Every h265 test video has to survive rtp h265 packetization and depacketization bit-exact
+    @Test
+    public void perfectLinkH265Test() throws IOException {
+        perfectLinkH265(false);
+    }
+
+    // Same, but VPS/SPS/PPS are sent (and depacketized) as one aggregation packet
+    @Test
+    public void perfectLinkH265AggregationTest() throws IOException {
+        perfectLinkH265(true);
+    }
+
+    private static void perfectLinkH265(final boolean aggregate) throws IOException {
+        final Context context=InstrumentationRegistry.getInstrumentation().getTargetContext();
+        final String[] files=context.getAssets().list("x265");
+        assertTrue(files!=null && files.length>0);
+        for(final String file:files){
+            final String report=replay("x265/"+file,true,aggregate,0,0,0,0,0,0,0,0);
+            assertTrue(report,report.contains("dropped:0 "));
+            assertTrue(report,report.contains("corrupted NALUs:0"));
+            assertTrue(report,report.contains("not received:0"));
+            assertFalse(report,report.contains("Frames:0 "));
+            assertTrue(report,aggregate != report.contains("Aggregation packets:0 "));
+        }
+    }
+
+    // All slices of a frame have to share one rtp timestamp (the one of the capture time of the frame)
+    @Test
+    public void rtpTimestampPerAccessUnitTest() throws IOException {
+        final Context context=InstrumentationRegistry.getInstrumentation().getTargetContext();
+        final String[] dirs=context.getAssets().list("jetson/h264");
+        assertTrue(dirs!=null && dirs.length>0);
+        final Pattern pattern=Pattern.compile("Access units:(\\d+) RTP timestamps:(\\d+) wrong RTP timestamps:(\\d+)");
+        for(final String dir:dirs){
+            final String report=replay("jetson/h264/"+dir+"/test.h264",false,false,0,0,0,0,0,0,0,0);
+            final Matcher matcher=pattern.matcher(report);
+            assertTrue(report,matcher.find());
+            assertNotEquals(report,"0",matcher.group(1));
+            assertEquals(report,matcher.group(1),matcher.group(2));
+            assertEquals(report,"0",matcher.group(3));
+        }
+    }
+
+    @Test
+    public void deterministicTest(){
+        // Bernoulli loss, reordering, duplication and jitter
+        final String report1=replay(1234,0.01f,0,0,0.01f,3,0.01f,5000);
+        final String report2=replay(1234,0.01f,0,0,0.01f,3,0.01f,5000);
+        assertEquals(report1,report2);
+        // Gilbert-Elliott (burst) loss
+        final String report3=replay(42,0.001f,0.01f,0.3f,0,0,0,0);
+        final String report4=replay(42,0.001f,0.01f,0.3f,0,0,0,0);
+        assertEquals(report3,report4);
+    }
+}
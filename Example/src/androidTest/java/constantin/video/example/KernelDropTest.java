@@ -0,0 +1,20 @@
+package constantin.video.example;
+
+// Overflow the receive buffer of a UDPReceiver and check that the packets the OS dropped (SO_RXQ_OVFL)
+// are exactly the ones that did not arrive, and that the receive buffer grows
+
+import org.junit.Test;
+
+import constantin.video.core.TestUDPReceiver;
+
+import static org.junit.Assert.assertTrue;
+
+public class KernelDropTest {
+
+    @Test
+    public void kernelDropsTest(){
+        final String report=TestUDPReceiver.nativeTestKernelDrops(5000,4*1024);
+        assertTrue(report,report.contains("match:yes"));
+        assertTrue(report,report.contains("growth:yes"));
+    }
+}
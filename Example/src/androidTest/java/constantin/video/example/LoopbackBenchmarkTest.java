@@ -0,0 +1,42 @@
+package constantin.video.example;
+
+// Send a test video through the VideoTransmitter over the loopback interface into the receive stack of the VideoPlayer
+// and check that every NALU arrives bit-exact (the benchmark numbers are only printed)
+
+import android.content.Context;
+
+import androidx.test.platform.app.InstrumentationRegistry;
+
+import org.junit.Test;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class LoopbackBenchmarkTest {
+    private static final int MODE_RAW=0;
+    private static final int MODE_RTP=1;
+    private static final int MODE_RTP_FEC=2;
+
+    private static String benchmark(final String assetFilename,final int mode,final boolean isH265){
+        final Context context=InstrumentationRegistry.getInstrumentation().getTargetContext();
+        final String report=VideoTransmitter.nativeBenchmarkLoopback(context,assetFilename,mode,isH265,0);
+        return report;
+    }
+
+    @Test
+    public void h264BitExactTest(){
+        for(final int mode:new int[]{MODE_RAW,MODE_RTP,MODE_RTP_FEC}){
+            final String report=benchmark("rpi_cam/1/test.h264",mode,false);
+            assertTrue(report,report.contains("bit-exact:yes"));
+        }
+    }
+
+    @Test
+    public void h265BitExactTest(){
+        for(final int mode:new int[]{MODE_RAW,MODE_RTP}){
+            final String report=benchmark("jetson/h265/1/test.h265",mode,true);
+            assertTrue(report,report.contains("bit-exact:yes"));
+        }
+    }
+}
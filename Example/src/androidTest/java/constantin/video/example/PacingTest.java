@@ -0,0 +1,33 @@
+package constantin.video.example;
+
+// Send synthetic frames over the loopback interface with and without pacing and check that pacing
+// keeps the (simulated) bottleneck queue small
+
+import org.junit.Test;
+
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class PacingTest {
+
+    private static long getPeakQueue(final String report,final String mode){
+        final Matcher matcher=Pattern.compile("(?m)^"+mode+" peak queue:(\\d+) bytes").matcher(report);
+        assertTrue(report,matcher.find());
+        return Long.parseLong(matcher.group(1));
+    }
+
+    @Test
+    public void pacingReducesPeakQueueTest(){
+        final int burstKB=16;
+        final String report=VideoTransmitter.nativeTestPacing(10,burstKB,90);
+        final long unpaced=getPeakQueue(report,"unpaced");
+        final long paced=getPeakQueue(report,"paced");
+        assertTrue(report,paced<unpaced);
+        // The queue can only grow beyond the burst size because of scheduling jitter
+        assertTrue(report,paced<burstKB*1024*4);
+    }
+}
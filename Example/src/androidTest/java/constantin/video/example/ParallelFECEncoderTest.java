@@ -0,0 +1,19 @@
+package constantin.video.example;
+
+// The ParallelFECEncoder has to create the same packets in the same order as the FECEncoder, for any n of worker threads
+// (the scaling numbers are only printed)
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class ParallelFECEncoderTest {
+
+    @Test
+    public void bitExactTest(){
+        final String report=TestFEC.nativeBenchmarkParallelFECEncoder();
+        assertTrue(report,report.contains("bit-exact:yes"));
+    }
+}
@@ -0,0 +1,22 @@
+package constantin.video.example;
+
+// A telemetry link with a higher priority than a saturating video link must not wait behind the video backlog,
+// and with a lower priority it must not wait longer than the aging bound
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class PrioritySchedulingTest {
+
+    @Test
+    public void tailLatencyTest(){
+        final String report=TestFEC.nativeTestPriorityScheduling();
+        assertTrue(report,report.contains("lower tail latency:yes"));
+        assertTrue(report,report.contains("link saturated:yes"));
+        assertTrue(report,report.contains("aging bound:yes"));
+        assertTrue(report,report.contains("flush kept:yes"));
+    }
+}
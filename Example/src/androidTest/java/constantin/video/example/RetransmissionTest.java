@@ -0,0 +1,25 @@
+package constantin.video.example;
+
+// Send synthetic frames over the loopback interface to a receiver that drops packets
+// and check that NACK based retransmission recovers (almost) all of them
+
+import org.junit.Test;
+
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class RetransmissionTest {
+
+    @Test
+    public void recoverLostPacketsTest(){
+        final String report=VideoTransmitter.nativeTestRetransmission(0.05f,90,20);
+        final Matcher matcher=Pattern.compile("recovered ratio:([0-9.]+)").matcher(report);
+        assertTrue(report,matcher.find());
+        assertTrue(report,Float.parseFloat(matcher.group(1))>0.9f);
+        assertTrue(report,report.contains("NACK NALUs:90 "));
+    }
+}
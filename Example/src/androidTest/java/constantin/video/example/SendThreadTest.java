@@ -0,0 +1,36 @@
+package constantin.video.example;
+
+// Send synthetic frames to a link that is slower than the video bitrate and check that the send thread keeps
+// the encoder-facing call short and drops the least important NALUs first
+
+import org.junit.Test;
+
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+public class SendThreadTest {
+
+    private static long getSendTimeUs(final String report,final String mode,final String value){
+        final Matcher matcher=Pattern.compile("(?m)^"+mode+" send\\(\\) avg:(\\d+)us max:(\\d+)us").matcher(report);
+        assertTrue(report,matcher.find());
+        return Long.parseLong(matcher.group(value.equals("avg") ? 1 : 2));
+    }
+
+    @Test
+    public void sendThreadDoesNotBlockEncoderTest(){
+        final String report=VideoTransmitter.nativeTestSendThread(1,64,150);
+        final long inlineMax=getSendTimeUs(report,"inline","max");
+        final long asyncAvg=getSendTimeUs(report,"async","avg");
+        final long asyncMax=getSendTimeUs(report,"async","max");
+        assertTrue(report,asyncMax<inlineMax);
+        assertTrue(report,asyncAvg<1000);
+        // The link is too slow, but parameter sets and key frames are never dropped as long as anything else is queued
+        assertTrue(report,report.contains("parameter sets:0 key frames:0"));
+        assertFalse(report,report.contains("non-reference:0)"));
+    }
+}
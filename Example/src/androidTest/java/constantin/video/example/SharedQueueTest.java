@@ -0,0 +1,19 @@
+package constantin.video.example;
+
+// The lock-free SharedQueue has to deliver every item that was not dropped exactly once and in order per producer,
+// for 1 to 4 producers (the throughput numbers are only printed)
+
+import org.junit.Test;
+
+import constantin.video.core.TestFEC;
+
+import static org.junit.Assert.assertTrue;
+
+public class SharedQueueTest {
+
+    @Test
+    public void consistentTest(){
+        final String report=TestFEC.nativeBenchmarkSharedQueue();
+        assertTrue(report,report.contains("consistent:yes"));
+    }
+}
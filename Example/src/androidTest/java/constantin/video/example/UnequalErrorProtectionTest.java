@@ -0,0 +1,35 @@
+package constantin.video.example;
+
+// Send synthetic GOPs with FEC over the loopback interface to a receiver with burst loss and check that
+// unequal error protection results in more decodable frames than a flat FEC ratio at the same overhead
+
+import org.junit.Test;
+
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+import constantin.video.transmitter.VideoTransmitter;
+
+import static org.junit.Assert.assertTrue;
+
+public class UnequalErrorProtectionTest {
+
+    private static float getValue(final String report,final String mode,final String name){
+        final Matcher matcher=Pattern.compile("(?m)^"+mode+" .* "+name+":([\\d.]+)%").matcher(report);
+        assertTrue(report,matcher.find());
+        return Float.parseFloat(matcher.group(1));
+    }
+
+    @Test
+    public void unequalProtectionReducesFrameLossTest(){
+        // Bursts of ~3 packets, 25% overhead
+        final String report=VideoTransmitter.nativeTestUnequalErrorProtection(0.01f,0.3f,25,30);
+        final float flatFrameLoss=getValue(report,"flat","frame loss");
+        final float unequalFrameLoss=getValue(report,"unequal","frame loss");
+        assertTrue(report,unequalFrameLoss<flatFrameLoss);
+        // Both have to use (about) the same overhead
+        final float flatOverhead=getValue(report,"flat","overhead");
+        final float unequalOverhead=getValue(report,"unequal","overhead");
+        assertTrue(report,Math.abs(flatOverhead-unequalOverhead)<5);
+    }
+}
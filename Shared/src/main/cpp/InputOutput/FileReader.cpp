@@ -17,6 +17,7 @@
 #include "FileReaderMP4.hpp"
 #include "FileReaderRAW.hpp"
 #include "FileReaderFPV.h"
+#include "FileReaderPCAP.hpp"
 #include <NDKThreadHelper.hpp>
 
 //return -1 if no valid telemetry filename, else the telemetry type
@@ -102,6 +103,29 @@ void FileReader::receiveLoop(std::future<void> shouldTerminate) {
            // MLOGD<<"Raw chunck h265";
             splitDataInChunks(shouldTerminate,data, data_length,GroundRecorderFPV::PACKET_TYPE_VIDEO_H265);
         },shouldTerminate);
+    }else if(FileHelper::endsWith(FILEPATH, ".pcap") || FileHelper::endsWith(FILEPATH, ".pcapng")){
+        // Each UDP payload is passed as it is (not split into chunks), e.g. one rtp packet stays one rtp packet
+        const bool loopAtEOF=assetManager!=nullptr;
+        bool anyPacket;
+        do{
+            anyPacket=false;
+            const auto start=std::chrono::steady_clock::now();
+            std::chrono::nanoseconds firstTimestamp(0);
+            FileReaderPCAP::readPcapAssetOrFile(assetManager,FILEPATH,mPcapUdpPort,[this,&shouldTerminate,&start,&firstTimestamp,&anyPacket](const FileReaderPCAP::UDPPacket& packet) {
+                if(!anyPacket){
+                    firstTimestamp=packet.timestamp;
+                    anyPacket=true;
+                }
+                if(mPcapSpeed>0){
+                    // wait until the time the packet was captured at (relative to the first packet), scaled by the speed
+                    const auto offset=std::chrono::duration_cast<std::chrono::steady_clock::duration>((packet.timestamp-firstTimestamp)/mPcapSpeed);
+                    if(shouldTerminate.wait_until(start+offset) != std::future_status::timeout){
+                        return;
+                    }
+                }
+                passChunk(packet.data,packet.data_length,GroundRecorderFPV::PACKET_TYPE_UDP_PAYLOAD);
+            },shouldTerminate);
+        }while(loopAtEOF && anyPacket && shouldTerminate.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout);
     }else if(isTelemetryFilename(FILEPATH) != -1) {
         //Telemetry ends with .ltm, .mavlink usw
         const auto packetType=(GroundRecorderFPV::PACKET_TYPE)isTelemetryFilename(FILEPATH);
@@ -40,6 +40,9 @@ private:
     std::promise<void> exitSignal;
     bool started=false;
     std::mutex mMutexStartStop;
+    // Only used for .pcap / .pcapng files
+    uint16_t mPcapUdpPort=5600;
+    float mPcapSpeed=1.0f;
 public:
     /**
      * Does nothing until startReading is called
@@ -54,6 +57,16 @@ public:
     void setCallBack(const int idx,const RAW_DATA_CALLBACK cb){
         onDataReceivedCallbacks.at(idx)=cb;
     }
+    /**
+     * Options for network captures (.pcap / .pcapng), the payload of each UDP packet is forwarded as one PACKET_TYPE_UDP_PAYLOAD
+     * @param udpPort only UDP packets with this destination port are forwarded, 0 for all
+     * @param speed 1.0 replays with the original timing, 2.0 twice as fast and so on. 0 replays as fast as possible
+     * Call before startReading()
+     */
+    void setPcapOptions(const uint16_t udpPort,const float speed){
+        mPcapUdpPort=udpPort;
+        mPcapSpeed=speed;
+    }
     /**
      * Create and start the receiving thread, which will run until stopReading() is called.
      * @param assetManager use nullptr for 'normal' files, else a valid android asset manager
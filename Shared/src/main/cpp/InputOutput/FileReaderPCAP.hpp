@@ -0,0 +1,311 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_FILEREADERPCAP_HPP
+#define LIVEVIDEO10MS_FILEREADERPCAP_HPP
+
+#include <android/asset_manager.h>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <future>
+#include <functional>
+#include <cstring>
+#include <AndroidLogger.hpp>
+
+/**
+ * Namespace with utility functions for reading network captures (e.g. from tcpdump / wireshark)
+ * Supports classic pcap (us and ns resolution, both byte orders) and pcapng.
+ * Only the payload of (not fragmented) UDP packets over IPv4 / IPv6 is extracted, the payload is not modified
+ * such that replaying a capture reproduces exactly what the receiver got.
+ */
+namespace FileReaderPCAP {
+    struct UDPPacket{
+        // capture timestamp
+        std::chrono::nanoseconds timestamp;
+        uint16_t dstPort;
+        const uint8_t* data;
+        std::size_t data_length;
+    };
+    typedef std::function<void(const UDPPacket&)> UDP_PACKET_CALLBACK;
+    // Read up to n bytes into buff, return the n of bytes actually read
+    typedef std::function<std::size_t(uint8_t* buff,std::size_t n)> READ_FUNCTION;
+
+    static constexpr uint32_t PCAP_MAGIC_US=0xa1b2c3d4;
+    static constexpr uint32_t PCAP_MAGIC_NS=0xa1b23c4d;
+    static constexpr uint32_t PCAPNG_BLOCK_SHB=0x0A0D0D0A;
+    static constexpr uint32_t PCAPNG_BLOCK_IDB=1;
+    static constexpr uint32_t PCAPNG_BLOCK_SPB=3;
+    static constexpr uint32_t PCAPNG_BLOCK_EPB=6;
+    static constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC=0x1A2B3C4D;
+    // Longer records (and pcapng blocks, which also hold headers and options) are only found in corrupt files
+    static constexpr uint32_t MAX_RECORD_SIZE=256*1024;
+    static constexpr uint32_t MAX_BLOCK_SIZE=MAX_RECORD_SIZE+4*1024;
+    // https://www.tcpdump.org/linktypes.html
+    static constexpr uint32_t LINKTYPE_NULL=0;
+    static constexpr uint32_t LINKTYPE_ETHERNET=1;
+    static constexpr uint32_t LINKTYPE_RAW=101;
+    static constexpr uint32_t LINKTYPE_LOOP=108;
+    static constexpr uint32_t LINKTYPE_LINUX_SLL=113;
+    static constexpr uint32_t LINKTYPE_IPV4=228;
+    static constexpr uint32_t LINKTYPE_IPV6=229;
+    static constexpr uint32_t LINKTYPE_LINUX_SLL2=276;
+
+    static uint16_t readBE16(const uint8_t* p){
+        return (uint16_t)((p[0]<<8) | p[1]);
+    }
+    static uint32_t bswap32(const uint32_t v){
+        return __builtin_bswap32(v);
+    }
+
+    /**
+     * Extract the UDP payload from one captured link layer frame
+     * @param dstPort only packets with this destination port are extracted, 0 for all ports
+     * @return false if the frame is not a (complete, not fragmented) UDP packet or has the wrong port
+     */
+    static bool extractUDPPayload(const uint32_t linkType,const uint8_t* frame,const std::size_t frameLength,const uint16_t dstPort,UDPPacket& out){
+        std::size_t offset;
+        switch (linkType) {
+            case LINKTYPE_ETHERNET:{
+                offset=14;
+                if(frameLength<offset)return false;
+                uint16_t etherType=readBE16(&frame[12]);
+                // skip VLAN tag(s)
+                while((etherType==0x8100 || etherType==0x88A8) && frameLength>=offset+4){
+                    etherType=readBE16(&frame[offset+2]);
+                    offset+=4;
+                }
+                if(etherType!=0x0800 && etherType!=0x86DD)return false;
+            }break;
+            case LINKTYPE_LINUX_SLL:offset=16;break;
+            case LINKTYPE_LINUX_SLL2:offset=20;break;
+            case LINKTYPE_NULL:
+            case LINKTYPE_LOOP:offset=4;break;
+            case LINKTYPE_RAW:
+            case LINKTYPE_IPV4:
+            case LINKTYPE_IPV6:offset=0;break;
+            default:
+                return false;
+        }
+        if(frameLength<offset+1)return false;
+        const uint8_t* ip=&frame[offset];
+        const std::size_t ipLength=frameLength-offset;
+        const uint8_t* udp;
+        std::size_t udpLength;
+        const int ipVersion=ip[0]>>4;
+        if(ipVersion==4){
+            if(ipLength<20)return false;
+            const std::size_t headerLength=(ip[0]&0x0F)*4;
+            // Protocol 17 is UDP. Fragments (MF flag or fragment offset set) cannot be forwarded bit-exact
+            if(ip[9]!=17 || (readBE16(&ip[6]) & 0x3FFF)!=0)return false;
+            const std::size_t totalLength=std::min((std::size_t)readBE16(&ip[2]),ipLength);
+            if(totalLength<headerLength)return false;
+            udp=&ip[headerLength];
+            udpLength=totalLength-headerLength;
+        }else if(ipVersion==6){
+            // Extension headers are not supported, the next header has to be UDP
+            if(ipLength<40 || ip[6]!=17)return false;
+            udp=&ip[40];
+            udpLength=std::min((std::size_t)readBE16(&ip[4]),ipLength-40);
+        }else{
+            return false;
+        }
+        if(udpLength<8)return false;
+        const uint16_t port=readBE16(&udp[2]);
+        if(dstPort!=0 && port!=dstPort)return false;
+        // The UDP length field also covers the 8 byte header. If the capture was truncated (snaplen) the payload is incomplete
+        const std::size_t udpLengthField=readBE16(&udp[4]);
+        if(udpLengthField<8 || udpLengthField>udpLength)return false;
+        out.dstPort=port;
+        out.data=&udp[8];
+        out.data_length=udpLengthField-8;
+        return true;
+    }
+
+    /**
+     * Read a pcap or pcapng capture and pass the payload of all UDP packets with the given destination port
+     * to the callback in the order they were captured.
+     * Returns at EOF, on error or if shouldTerminate becomes ready
+     */
+    static void readPcap(const READ_FUNCTION& read,const uint16_t dstPort,const UDP_PACKET_CALLBACK& callback,const std::future<void>& shouldTerminate){
+        uint32_t magic;
+        if(read((uint8_t*)&magic,4)!=4){
+            MLOGE<<"Cannot read pcap magic";
+            return;
+        }
+        std::vector<uint8_t> buffer;
+        UDPPacket packet{};
+        long nPackets=0,nUDPPackets=0;
+        if(magic==PCAPNG_BLOCK_SHB){
+            bool swap=false;
+            // Each interface has its own link type and timestamp resolution (in units per second)
+            struct Interface{
+                uint32_t linkType;
+                uint64_t tsUnitsPerSecond;
+            };
+            std::vector<Interface> interfaces;
+            std::chrono::nanoseconds lastTimestamp(0);
+            uint32_t blockType=magic;
+            bool firstBlock=true;
+            while(shouldTerminate.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout){
+                if(!firstBlock){
+                    if(read((uint8_t*)&blockType,4)!=4)break;
+                    if(swap)blockType=bswap32(blockType);
+                }
+                firstBlock=false;
+                uint32_t blockLength;
+                if(read((uint8_t*)&blockLength,4)!=4)break;
+                if(blockType==PCAPNG_BLOCK_SHB){
+                    // A new section can change the byte order
+                    uint32_t byteOrderMagic;
+                    if(read((uint8_t*)&byteOrderMagic,4)!=4)break;
+                    swap=byteOrderMagic!=PCAPNG_BYTE_ORDER_MAGIC;
+                    if(swap && bswap32(byteOrderMagic)!=PCAPNG_BYTE_ORDER_MAGIC){
+                        MLOGE<<"Invalid pcapng byte order magic";
+                        return;
+                    }
+                    if(swap)blockLength=bswap32(blockLength);
+                    interfaces.clear();
+                    if(blockLength<16 || blockLength%4!=0 || blockLength>MAX_BLOCK_SIZE){
+                        MLOGE<<"Invalid pcapng section header length "<<blockLength;
+                        return;
+                    }
+                    buffer.resize(blockLength-12);
+                    if(read(buffer.data(),buffer.size())!=buffer.size())break;
+                    continue;
+                }
+                if(swap)blockLength=bswap32(blockLength);
+                if(blockLength<12 || blockLength%4!=0 || blockLength>MAX_BLOCK_SIZE){
+                    MLOGE<<"Invalid pcapng block length "<<blockLength;
+                    return;
+                }
+                // The body and the trailing length
+                buffer.resize(blockLength-8);
+                if(read(buffer.data(),buffer.size())!=buffer.size())break;
+                const auto u32=[&buffer,swap](const std::size_t off){
+                    uint32_t v;
+                    memcpy(&v,&buffer[off],4);
+                    return swap ? bswap32(v) : v;
+                };
+                const std::size_t bodyLength=buffer.size()-4;
+                if(blockType==PCAPNG_BLOCK_IDB && bodyLength>=8){
+                    uint16_t linkType;
+                    memcpy(&linkType,&buffer[0],2);
+                    if(swap)linkType=__builtin_bswap16(linkType);
+                    Interface interface{linkType,1000*1000};
+                    // look for the if_tsresol option
+                    std::size_t off=8;
+                    while(off+4<=bodyLength){
+                        uint16_t code,length;
+                        memcpy(&code,&buffer[off],2);
+                        memcpy(&length,&buffer[off+2],2);
+                        if(swap){
+                            code=__builtin_bswap16(code);
+                            length=__builtin_bswap16(length);
+                        }
+                        if(code==0)break;
+                        if(code==9 && length==1 && off+5<=bodyLength){
+                            const uint8_t tsresol=buffer[off+4];
+                            const uint64_t base=(tsresol&0x80) ? 2 : 10;
+                            interface.tsUnitsPerSecond=1;
+                            for(int i=0;i<(tsresol&0x7F);i++)interface.tsUnitsPerSecond*=base;
+                        }
+                        off+=4+((length+3)/4)*4;
+                    }
+                    interfaces.push_back(interface);
+                }else if(blockType==PCAPNG_BLOCK_EPB && bodyLength>=20){
+                    nPackets++;
+                    const uint32_t interfaceId=u32(0);
+                    const uint64_t ts=((uint64_t)u32(4)<<32) | u32(8);
+                    const uint32_t capturedLength=u32(12);
+                    // bodyLength>=20 here, e.g. the subtraction cannot wrap (unlike 20+capturedLength)
+                    if(interfaceId>=interfaces.size() || capturedLength>bodyLength-20)continue;
+                    const Interface& interface=interfaces[interfaceId];
+                    lastTimestamp=std::chrono::nanoseconds((int64_t)((long double)ts*1000000000.0L/interface.tsUnitsPerSecond));
+                    packet.timestamp=lastTimestamp;
+                    if(extractUDPPayload(interface.linkType,&buffer[20],capturedLength,dstPort,packet)){
+                        nUDPPackets++;
+                        callback(packet);
+                    }
+                }else if(blockType==PCAPNG_BLOCK_SPB && bodyLength>=4){
+                    // Simple packets have no timestamp and always belong to the first interface
+                    nPackets++;
+                    const uint32_t capturedLength=std::min((std::size_t)u32(0),bodyLength-4);
+                    if(interfaces.empty())continue;
+                    packet.timestamp=lastTimestamp;
+                    if(extractUDPPayload(interfaces[0].linkType,&buffer[4],capturedLength,dstPort,packet)){
+                        nUDPPackets++;
+                        callback(packet);
+                    }
+                }
+            }
+        }else{
+            const bool swap=magic==bswap32(PCAP_MAGIC_US) || magic==bswap32(PCAP_MAGIC_NS);
+            if(swap)magic=bswap32(magic);
+            if(magic!=PCAP_MAGIC_US && magic!=PCAP_MAGIC_NS){
+                MLOGE<<"Not a pcap / pcapng file";
+                return;
+            }
+            const bool nanoseconds=magic==PCAP_MAGIC_NS;
+            // version(4) thiszone(4) sigfigs(4) snaplen(4) network(4)
+            uint32_t header[5];
+            if(read((uint8_t*)header,sizeof(header))!=sizeof(header))return;
+            const uint32_t linkType=(swap ? bswap32(header[4]) : header[4]) & 0x0FFFFFFF;
+            while(shouldTerminate.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout){
+                // ts_sec, ts_usec (or ts_nsec), incl_len, orig_len
+                uint32_t recordHeader[4];
+                if(read((uint8_t*)recordHeader,sizeof(recordHeader))!=sizeof(recordHeader))break;
+                if(swap){
+                    for(auto& v:recordHeader)v=bswap32(v);
+                }
+                const uint32_t capturedLength=recordHeader[2];
+                if(capturedLength>MAX_RECORD_SIZE){
+                    MLOGE<<"Invalid pcap record length "<<capturedLength;
+                    return;
+                }
+                buffer.resize(capturedLength);
+                if(read(buffer.data(),capturedLength)!=capturedLength)break;
+                nPackets++;
+                packet.timestamp=std::chrono::seconds(recordHeader[0])+
+                        (nanoseconds ? std::chrono::nanoseconds(recordHeader[1]) : std::chrono::microseconds(recordHeader[1]));
+                if(extractUDPPayload(linkType,buffer.data(),capturedLength,dstPort,packet)){
+                    nUDPPackets++;
+                    callback(packet);
+                }
+            }
+        }
+        MLOGD<<"Pcap: "<<nPackets<<" packets, "<<nUDPPackets<<" UDP packets with port "<<dstPort;
+    }
+
+    /**
+     * Same as above, but opens the file (assetManager==nullptr) or asset
+     */
+    static void readPcapAssetOrFile(AAssetManager *assetManager,const std::string &PATH,const uint16_t dstPort,const UDP_PACKET_CALLBACK& callback,const std::future<void>& shouldTerminate){
+        if(assetManager!=nullptr){
+            AAsset *asset = AAssetManager_open(assetManager,PATH.c_str(),AASSET_MODE_STREAMING);
+            if (!asset) {
+                MLOGE<<"Cannot open Asset:"<<PATH;
+                return;
+            }
+            readPcap([asset](uint8_t* buff,std::size_t n){
+                const auto len=AAsset_read(asset,buff,n);
+                return len>0 ? (std::size_t)len : 0;
+            },dstPort,callback,shouldTerminate);
+            AAsset_close(asset);
+        }else{
+            std::ifstream file(PATH.c_str(), std::ios::in | std::ios::binary);
+            if (!file.is_open()) {
+                MLOGE<<"Cannot open file "<<PATH;
+                return;
+            }
+            readPcap([&file](uint8_t* buff,std::size_t n){
+                file.read((char*)buff,n);
+                return (std::size_t)file.gcount();
+            },dstPort,callback,shouldTerminate);
+        }
+    }
+}
+
+#endif //LIVEVIDEO10MS_FILEREADERPCAP_HPP
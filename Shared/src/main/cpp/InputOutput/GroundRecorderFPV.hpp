@@ -66,6 +66,8 @@ public:
     static constexpr uint8_t PACKET_TYPE_TELEMETRY_ANDROD_GPS=6;
     static constexpr uint8_t PACKET_TYPE_MJPEG_ROTG02=7;
     static constexpr uint8_t PACKET_TYPE_VIDEO_H265=8;
+    // One UDP payload from a network capture (.pcap / .pcapng). Only created by the FileReader, never written to .fpv files
+    static constexpr uint8_t PACKET_TYPE_UDP_PAYLOAD=9;
     using PACKET_TYPE=uint8_t;
     using TIMESTAMP_MS=unsigned int;
     // Each time I write raw data to the file it is prefixed by this header
@@ -0,0 +1,54 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_TOKENBUCKETPACER_HPP
+#define LIVEVIDEO10MS_TOKENBUCKETPACER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * Token bucket: On average, packets are released at RATE bytes per second and at most BURST bytes can be released at once.
+ * Implemented as virtual scheduling (GCRA), e.g. every packet gets an absolute release deadline. Waiting until this deadline
+ * (instead of sleeping for a fixed time between packets) means that oversleeping does not add up over time.
+ * Not thread safe.
+ */
+class TokenBucketPacer{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    /**
+     * @param rateBytesPerSecond average rate, should be higher than the video bitrate
+     * (else the pacer adds more and more latency)
+     * @param burstBytes how many bytes can be sent at line rate after the link has been idle
+     */
+    TokenBucketPacer(const uint64_t rateBytesPerSecond,const uint64_t burstBytes):
+    RATE_BYTES_PER_SECOND(std::max(rateBytesPerSecond,(uint64_t)1)),
+    BURST_DURATION(durationForBytes(burstBytes)){}
+    /**
+     * Returns the earliest time the next packet may be sent at. This does not depend on the packet size,
+     * its tokens are only accounted for by onPacketReleased() once the packet was actually sent.
+     */
+    TimePoint getDeadline(const TimePoint now)const{
+        const TimePoint tat=std::max(theoreticalArrivalTime,now);
+        return std::max(tat-BURST_DURATION,now);
+    }
+    // Consume the tokens of one packet that was sent at time 'now'
+    void onPacketReleased(const TimePoint now,const std::size_t packetSize){
+        theoreticalArrivalTime=std::max(theoreticalArrivalTime,now)+durationForBytes(packetSize);
+    }
+    uint64_t getRateBytesPerSecond()const{
+        return RATE_BYTES_PER_SECOND;
+    }
+private:
+    std::chrono::nanoseconds durationForBytes(const uint64_t bytes)const{
+        return std::chrono::nanoseconds(bytes*1000*1000*1000/RATE_BYTES_PER_SECOND);
+    }
+    const uint64_t RATE_BYTES_PER_SECOND;
+    const std::chrono::nanoseconds BURST_DURATION;
+    // Time when the bucket is full again (if nothing else is sent)
+    TimePoint theoreticalArrivalTime{};
+};
+
+#endif //LIVEVIDEO10MS_TOKENBUCKETPACER_HPP
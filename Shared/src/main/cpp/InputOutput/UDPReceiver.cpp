@@ -5,6 +5,7 @@
 #include <vector>
 #include <sstream>
 #include <array>
+#include <algorithm>
 #include <StringHelper.hpp>
 
 #ifdef __ANDROID__
@@ -12,19 +13,38 @@
 #include <NDKThreadHelper.hpp>
 #endif
 
-UDPReceiver::UDPReceiver(JavaVM* javaVm,int port,std::string name,int CPUPriority,DATA_CALLBACK  onDataReceivedCallback,size_t WANTED_RCVBUF_SIZE):
-        mPort(port),mName(std::move(name)),WANTED_RCVBUF_SIZE(WANTED_RCVBUF_SIZE),mCPUPriority(CPUPriority),onDataReceivedCallback(std::move(onDataReceivedCallback)),javaVm(javaVm){
+// Not exposed by all (older) ndk / libc headers, value is the same for all linux architectures
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+UDPReceiver::UDPReceiver(JavaVM* javaVm,int port,std::string name,int CPUPriority,DATA_CALLBACK  onDataReceivedCallback,size_t WANTED_RCVBUF_SIZE,size_t MAX_RCVBUF_SIZE):
+        onDataReceivedCallback(std::move(onDataReceivedCallback)),mPort(port),mCPUPriority(CPUPriority),WANTED_RCVBUF_SIZE(WANTED_RCVBUF_SIZE),MAX_RCVBUF_SIZE(MAX_RCVBUF_SIZE),mName(std::move(name)),javaVm(javaVm){
 }
 
 void UDPReceiver::registerOnSourceIPFound(SOURCE_IP_CALLBACK onSourceIP1) {
     this->onSourceIP=std::move(onSourceIP1);
 }
 
+void UDPReceiver::registerOnTimerTick(TIMER_CALLBACK onTimerTick1,std::chrono::milliseconds interval) {
+    this->onTimerTick=std::move(onTimerTick1);
+    this->mTimerInterval=interval;
+}
+
 long UDPReceiver::getNReceivedBytes()const {
     return nReceivedBytes;
 }
 
+long UDPReceiver::getNKernelDroppedPackets()const {
+    return nKernelDroppedPackets;
+}
+
+size_t UDPReceiver::getCurrentRcvBufSize()const {
+    return mCurrentRcvBufSize;
+}
+
 std::string UDPReceiver::getSourceIPAddress()const {
+    std::lock_guard<std::mutex> lock(mSenderIPMutex);
     return senderIP;
 }
 
@@ -62,13 +82,29 @@ void UDPReceiver::receiveFromUDPLoop() {
     MLOGD<<"Default socket recv buffer is "<<StringHelper::memorySizeReadable(recvBufferSize);
 
     if(WANTED_RCVBUF_SIZE>recvBufferSize){
-        recvBufferSize=WANTED_RCVBUF_SIZE;
         if(setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &WANTED_RCVBUF_SIZE,len)) {
             MLOGD<<"Cannot increase buffer size to "<<StringHelper::memorySizeReadable(WANTED_RCVBUF_SIZE);
         }
         getsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &recvBufferSize, &len);
         MLOGD<<"Wanted "<<StringHelper::memorySizeReadable(WANTED_RCVBUF_SIZE)<<" Set "<<StringHelper::memorySizeReadable(recvBufferSize);
     }
+    // What the OS actually applied, it might have limited the size (e.g. net.core.rmem_max)
+    mCurrentRcvBufSize=recvBufferSize;
+    mRequestedRcvBufSize=std::max(WANTED_RCVBUF_SIZE,(size_t)recvBufferSize/2);
+    mRcvBufSizeAtOSLimit=false;
+    nKernelDroppedPackets=0;
+    // Ask the OS to attach the n of packets dropped on this socket (because the receive buffer was full) to each received packet
+    if(setsockopt(mSocket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(int)) < 0){
+        MLOGD<<"Error setting SO_RXQ_OVFL";
+    }
+    if(onTimerTick!=nullptr){
+        // Wake up regularly even if no data arrives
+        const auto usec=std::chrono::duration_cast<std::chrono::microseconds>(mTimerInterval).count();
+        timeval timeout{(time_t)(usec/1000000),(suseconds_t)(usec%1000000)};
+        if(setsockopt(mSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0){
+            MLOGD<<"Error setting SO_RCVTIMEO";
+        }
+    }
     if(javaVm!=nullptr){
 #ifdef __ANDROID__
          NDKThreadHelper::setProcessThreadPriorityAttachDetach(javaVm, mCPUPriority, mName.c_str());
@@ -86,40 +122,109 @@ void UDPReceiver::receiveFromUDPLoop() {
     //wrap into unique pointer to avoid running out of stack
     const auto buff=std::make_unique<std::array<uint8_t,UDP_PACKET_MAX_SIZE>>();
 
-    sockaddr_in source;
-    socklen_t sourceLen= sizeof(sockaddr_in);
-    
+    // Space for the SO_RXQ_OVFL control message (one uint32_t)
+    std::array<uint8_t,CMSG_SPACE(sizeof(uint32_t))> controlBuff{};
+    struct iovec iov{buff->data(),UDP_PACKET_MAX_SIZE};
+    auto lastTimerTick=std::chrono::steady_clock::now();
+
     while (receiving) {
         //TODO investigate: does a big buffer size create latency with MSG_WAITALL ?
         //I do not think so. recvfrom should return as soon as new data arrived,not when the buffer is full
         //But with a bigger buffer we do not loose packets when the receiver thread cannot keep up for a short amount of time
         // MSG_WAITALL does not wait until we have __n data, but a new UDP packet (that can be smaller than __n)
-        const ssize_t message_length = recvfrom(mSocket,buff->data(),UDP_PACKET_MAX_SIZE, MSG_WAITALL,(sockaddr*)&source,&sourceLen);
+        // recvmsg instead of recvfrom such that we also get the control message(s). The lengths have to be reset every time
+        struct msghdr msg{};
+        msg.msg_name=&mSourceAddress;
+        msg.msg_namelen=sizeof(sockaddr_in);
+        msg.msg_iov=&iov;
+        msg.msg_iovlen=1;
+        msg.msg_control=controlBuff.data();
+        msg.msg_controllen=controlBuff.size();
+        const ssize_t message_length = recvmsg(mSocket,&msg,MSG_WAITALL);
         //ssize_t message_length = recv(mSocket, buff, (size_t) mBuffsize, MSG_WAITALL);
         if (message_length > 0) { //else -1 was returned;timeout/No data received
             //LOGD("Data size %d",(int)message_length);
+            checkForKernelDrops(msg);
             onDataReceivedCallback(buff->data(), (size_t)message_length);
 
             nReceivedBytes+=message_length;
             //The source ip stuff
-            const char* p=inet_ntoa(source.sin_addr);
+            const char* p=inet_ntoa(mSourceAddress.sin_addr);
             std::string s1=std::string(p);
             if(senderIP!=s1){
-                MLOGE<<s1<<": THIS IP IS NOT ALLOWED";
-                break;
-            }
-            if(onSourceIP!=nullptr){
-                onSourceIP(p);
+                // First packet (or the sender changed its IP)
+                {
+                    std::lock_guard<std::mutex> lock(mSenderIPMutex);
+                    senderIP=s1;
+                }
+                if(onSourceIP!=nullptr){
+                    onSourceIP(p);
+                }
             }
         }else{
             if(errno != EWOULDBLOCK) {
                 MLOGE<<"Error on recvfrom. errno="<<errno<<" "<<strerror(errno);
             }
         }
+        if(onTimerTick!=nullptr){
+            const auto now=std::chrono::steady_clock::now();
+            if(now-lastTimerTick>=mTimerInterval){
+                lastTimerTick=now;
+                onTimerTick();
+            }
+        }
     }
     close(mSocket);
 }
 
+void UDPReceiver::checkForKernelDrops(msghdr& msg) {
+    for(cmsghdr* cmsg=CMSG_FIRSTHDR(&msg);cmsg!=nullptr;cmsg=CMSG_NXTHDR(&msg,cmsg)){
+        if(cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_RXQ_OVFL){
+            uint32_t dropCounter;
+            memcpy(&dropCounter,CMSG_DATA(cmsg),sizeof(uint32_t));
+            // The counter is cumulative since the option was enabled on this socket
+            const long newDrops=(long)dropCounter-nKernelDroppedPackets;
+            if(newDrops>0){
+                nKernelDroppedPackets=dropCounter;
+                MLOGD<<"OS dropped "<<newDrops<<" packets (rcvbuf full). Total:"<<dropCounter;
+                increaseRcvBufSizeIfAllowed();
+            }
+        }
+    }
+}
+
+void UDPReceiver::increaseRcvBufSizeIfAllowed() {
+    if(mRcvBufSizeAtOSLimit || MAX_RCVBUF_SIZE<=mRequestedRcvBufSize){
+        return;
+    }
+    const size_t newSize=std::min(mRequestedRcvBufSize*2,MAX_RCVBUF_SIZE);
+    const int newSizeInt=(int)newSize;
+    if(setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &newSizeInt,sizeof(int))) {
+        MLOGD<<"Cannot increase buffer size to "<<StringHelper::memorySizeReadable(newSize);
+        mRcvBufSizeAtOSLimit=true;
+        return;
+    }
+    mRequestedRcvBufSize=newSize;
+    int recvBufferSize=0;
+    socklen_t len=sizeof(recvBufferSize);
+    if(getsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &recvBufferSize, &len)){
+        return;
+    }
+    MLOGD<<"Increased rcvbuf. Wanted "<<StringHelper::memorySizeReadable(newSize)<<" Set "<<StringHelper::memorySizeReadable(recvBufferSize);
+    // The OS silently caps the size (net.core.rmem_max), requesting more would not change anything
+    if((size_t)recvBufferSize<=mCurrentRcvBufSize){
+        MLOGD<<"rcvbuf cannot grow beyond "<<StringHelper::memorySizeReadable(recvBufferSize);
+        mRcvBufSizeAtOSLimit=true;
+    }
+    mCurrentRcvBufSize=recvBufferSize;
+}
+
+void UDPReceiver::sendToSource(const uint8_t *data,const size_t data_length) {
+    if(sendto(mSocket,data,data_length,MSG_DONTWAIT,(sockaddr*)&mSourceAddress,sizeof(sockaddr_in))<0){
+        MLOGD<<"Cannot send to source "<<strerror(errno);
+    }
+}
+
 int UDPReceiver::getPort() const {
     return mPort;
 }
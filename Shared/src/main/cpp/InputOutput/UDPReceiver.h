@@ -9,6 +9,8 @@
 #include <iostream>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <mutex>
 //
 #ifdef __ANDROID__
 #include <jni.h>
@@ -21,6 +23,7 @@ class UDPReceiver {
 public:
     typedef std::function<void(const uint8_t[],size_t)> DATA_CALLBACK;
     typedef std::function<void(const std::string)> SOURCE_IP_CALLBACK;
+    typedef std::function<void()> TIMER_CALLBACK;
 public:
     /**
      * @param javaVm used to set thread priority (attach and then detach) for android,
@@ -31,12 +34,19 @@ public:
      * @param WANTED_RCVBUF_SIZE: The buffer allocated by the OS might not be sufficient to buffer incoming data when receiving at a high data rate
      * If @param WANTED_RCVBUF_SIZE is bigger than the size allocated by the OS a bigger buffer is requested, but it is not
      * guaranteed that the size is actually increased. Use 0 to leave the buffer size untouched
+     * @param MAX_RCVBUF_SIZE: If bigger than @param WANTED_RCVBUF_SIZE, the buffer is doubled each time the OS reports
+     * that it had to drop packets because the buffer was full, until this cap is reached. Use 0 to disable
      */
-    UDPReceiver(JavaVM* javaVm,int port,std::string name,int CPUPriority,DATA_CALLBACK onDataReceivedCallback,size_t WANTED_RCVBUF_SIZE=0);
+    UDPReceiver(JavaVM* javaVm,int port,std::string name,int CPUPriority,DATA_CALLBACK onDataReceivedCallback,size_t WANTED_RCVBUF_SIZE=0,size_t MAX_RCVBUF_SIZE=0);
     /**
      * Register a callback that is called once and contains the IP address of the first received packet's sender
      */
     void registerOnSourceIPFound(SOURCE_IP_CALLBACK onSourceIP1);
+    /**
+     * Register a callback that is called on the receiver thread about every @param interval, also when no data arrives
+     * (e.g. to release data that was held back for missing packets when the stream stalls). Call before startReceiving()
+     */
+    void registerOnTimerTick(TIMER_CALLBACK onTimerTick1,std::chrono::milliseconds interval);
     /**
      * Start receiver thread,which opens UDP port
      */
@@ -49,20 +59,45 @@ public:
     long getNReceivedBytes()const;
     std::string getSourceIPAddress()const;
     int getPort()const;
+    // N of packets the OS dropped because the socket receive buffer was full (reported via SO_RXQ_OVFL).
+    // These packets were not lost on the link, but because the receiver thread could not keep up
+    long getNKernelDroppedPackets()const;
+    // The receive buffer size as applied by the OS (can grow when MAX_RCVBUF_SIZE is set).
+    // Note that linux reports (and enforces) twice the requested size, the rest is used for bookkeeping
+    size_t getCurrentRcvBufSize()const;
+    // Send data back to the sender of the last received packet (e.g. RTCP feedback) using the receive socket.
+    // Only call from within onDataReceivedCallback
+    void sendToSource(const uint8_t* data,size_t data_length);
 private:
     void receiveFromUDPLoop();
+    // Read the SO_RXQ_OVFL drop counter (if present) from the control message of a received packet
+    void checkForKernelDrops(msghdr& msg);
+    // Double the requested receive buffer size if allowed by MAX_RCVBUF_SIZE, until the OS does not increase it anymore
+    void increaseRcvBufSizeIfAllowed();
     const DATA_CALLBACK onDataReceivedCallback=nullptr;
     SOURCE_IP_CALLBACK onSourceIP= nullptr;
+    TIMER_CALLBACK onTimerTick= nullptr;
+    std::chrono::milliseconds mTimerInterval{0};
     const int mPort;
     const int mCPUPriority;
     // Hmm....
     const size_t WANTED_RCVBUF_SIZE;
+    const size_t MAX_RCVBUF_SIZE;
     const std::string mName;
     ///We need this reference to stop the receiving thread
     int mSocket=0;
+    // Only written by the receiver thread, read by getSourceIPAddress() from any thread
     std::string senderIP="0.0.0.0";
+    mutable std::mutex mSenderIPMutex;
+    sockaddr_in mSourceAddress{};
     std::atomic<bool> receiving=false;
     std::atomic<long> nReceivedBytes=0;
+    std::atomic<long> nKernelDroppedPackets=0;
+    std::atomic<size_t> mCurrentRcvBufSize=0;
+    // The size last passed to SO_RCVBUF (the OS applies / reports twice this value). Only used by the receiver thread
+    size_t mRequestedRcvBufSize=0;
+    // Set once the OS stopped increasing the buffer (e.g. net.core.rmem_max), no more attempts after that
+    bool mRcvBufSizeAtOSLimit=false;
     std::unique_ptr<std::thread> mUDPReceiverThread;
     //https://en.wikipedia.org/wiki/User_Datagram_Protocol
     //65,507 bytes (65,535 − 8 byte UDP header − 20 byte IP header).
@@ -5,15 +5,28 @@
 #include "UDPSender.h"
 #include <jni.h>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
 #include <pthread.h>
 #include <cerrno>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <endian.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <AndroidLogger.hpp>
 #include <StringHelper.hpp>
 
+// Older NDK headers do not define it
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
 
 UDPSender::UDPSender(const std::string &IP,const int Port,const int WANTED_SNDBUFF_SIZE):
         WANTED_SNDBUFF_SIZE(WANTED_SNDBUFF_SIZE)
@@ -40,6 +53,12 @@ UDPSender::UDPSender(const std::string &IP,const int Port,const int WANTED_SNDBU
         getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, &len);
         MLOGD<<"Wanted "<<StringHelper::memorySizeReadable(WANTED_SNDBUFF_SIZE)<<" Set "<<StringHelper::memorySizeReadable(sendBufferSize);
     }
+    mBatchBuffer.resize(MAX_BATCH_SIZE_BYTES);
+    mBatchPackets.reserve(MAX_BATCH_SIZE_PACKETS);
+    mBatchIovecs.reserve(MAX_BATCH_SIZE_PACKETS*2);
+    mMessages.resize(MAX_BATCH_SIZE_PACKETS);
+    mMessageControls.resize(MAX_BATCH_SIZE_PACKETS);
+    mMessageNPackets.resize(MAX_BATCH_SIZE_PACKETS);
 }
 
 void UDPSender::mySendTo(const uint8_t* data, ssize_t data_length) {
@@ -52,6 +71,7 @@ void UDPSender::mySendTo(const uint8_t* data, ssize_t data_length) {
     timeSpentSending.start();
     const auto result= sendto(sockfd, data, data_length, 0, (struct sockaddr *) &(address),
                                 sizeof(struct sockaddr_in));
+    nSendCalls++;
     if(result<0){
         MLOGE<<"Cannot send data "<<data_length<<" "<<strerror(errno);
     }else{
@@ -64,6 +84,200 @@ void UDPSender::mySendTo(const uint8_t* data, ssize_t data_length) {
     }
 }
 
+void UDPSender::sendImmediately(const uint8_t *data,const std::size_t data_length) {
+    const auto result=sendto(sockfd,data,data_length,0,(struct sockaddr *)&address,sizeof(struct sockaddr_in));
+    if(result<0){
+        MLOGE<<"Cannot send data "<<data_length<<" "<<strerror(errno);
+    }
+}
+
+ssize_t UDPSender::receiveFeedback(uint8_t *buff,const std::size_t buffSize,const std::chrono::milliseconds timeout) {
+    pollfd fds{sockfd,POLLIN,0};
+    if(poll(&fds,1,(int)timeout.count())<=0){
+        return 0;
+    }
+    return recv(sockfd,buff,buffSize,MSG_DONTWAIT);
+}
+
+void UDPSender::flushIfFull(const std::size_t nIovecs,const std::size_t nBytesToCopy) {
+    if(mBatchPackets.size()>=MAX_BATCH_SIZE_PACKETS || mBatchIovecs.size()+nIovecs>mBatchIovecs.capacity() ||
+       mBatchBufferSize+nBytesToCopy>MAX_BATCH_SIZE_BYTES){
+        flush();
+    }
+}
+
+void UDPSender::queue(const uint8_t *data,const std::size_t data_length) {
+    if(data_length>UDP_PACKET_MAX_SIZE){
+        MLOGE<<"Data size exceeds UDP packet size";
+        return;
+    }
+    flushIfFull(1,data_length);
+    uint8_t* dst=&mBatchBuffer[mBatchBufferSize];
+    std::memcpy(dst,data,data_length);
+    mBatchBufferSize+=data_length;
+    nCopiedBytes+=data_length;
+    mBatchPackets.push_back({mBatchIovecs.size(),1,data_length});
+    mBatchIovecs.push_back({dst,data_length});
+}
+
+void UDPSender::queueZeroCopy(const uint8_t *header,const std::size_t header_length,const uint8_t *payload,const std::size_t payload_length) {
+    if(header_length+payload_length>UDP_PACKET_MAX_SIZE){
+        MLOGE<<"Data size exceeds UDP packet size";
+        return;
+    }
+    flushIfFull(2,header_length);
+    uint8_t* dst=&mBatchBuffer[mBatchBufferSize];
+    std::memcpy(dst,header,header_length);
+    mBatchBufferSize+=header_length;
+    nCopiedBytes+=header_length;
+    mBatchPackets.push_back({mBatchIovecs.size(),2,header_length+payload_length});
+    mBatchIovecs.push_back({dst,header_length});
+    mBatchIovecs.push_back({const_cast<uint8_t*>(payload),payload_length});
+}
+
+std::size_t UDPSender::buildMessages(const std::size_t firstPacket,const std::size_t endPacket) {
+    std::size_t nMessages=0;
+    std::size_t i=firstPacket;
+    while(i<endPacket){
+        const std::size_t segmentSize=mBatchPackets[i].size;
+        std::size_t runLength=1;
+        std::size_t runBytes=segmentSize;
+        std::size_t runIovecs=mBatchPackets[i].nIovecs;
+        if(mUseGSO){
+            // All segments of a GSO buffer have the same size, only the last one can be smaller.
+            // The kernel splits the concatenation of all iovecs of the message into segments
+            while(i+runLength<endPacket && runLength<MAX_GSO_SEGMENTS){
+                const QueuedPacket& next=mBatchPackets[i+runLength];
+                if(next.size>segmentSize || runBytes+next.size>UDP_PACKET_MAX_SIZE)break;
+                runLength++;
+                runBytes+=next.size;
+                runIovecs+=next.nIovecs;
+                if(next.size<segmentSize)break;
+            }
+        }
+        mmsghdr& msg=mMessages[nMessages];
+        msg={};
+        msg.msg_hdr.msg_name=&address;
+        msg.msg_hdr.msg_namelen=sizeof(sockaddr_in);
+        msg.msg_hdr.msg_iov=&mBatchIovecs[mBatchPackets[i].firstIovec];
+        msg.msg_hdr.msg_iovlen=runIovecs;
+        if(runLength>1){
+            auto& control=mMessageControls[nMessages];
+            msg.msg_hdr.msg_control=control.buf;
+            msg.msg_hdr.msg_controllen=sizeof(control.buf);
+            cmsghdr* cm=CMSG_FIRSTHDR(&msg.msg_hdr);
+            cm->cmsg_level=SOL_UDP;
+            cm->cmsg_type=UDP_SEGMENT;
+            cm->cmsg_len=CMSG_LEN(sizeof(uint16_t));
+            const auto gsoSize=(uint16_t)segmentSize;
+            std::memcpy(CMSG_DATA(cm),&gsoSize,sizeof(uint16_t));
+        }
+        mMessageNPackets[nMessages]=runLength;
+        nMessages++;
+        i+=runLength;
+    }
+    return nMessages;
+}
+
+void UDPSender::sendPackets(const std::size_t firstPacket,const std::size_t endPacket) {
+    const auto sendStart=std::chrono::steady_clock::now();
+    std::size_t nMessages=buildMessages(firstPacket,endPacket);
+    std::size_t msgIdx=0;
+    std::size_t packetIdx=firstPacket;
+    while(msgIdx<nMessages){
+        const int result=sendmmsg(sockfd,&mMessages[msgIdx],nMessages-msgIdx,0);
+        nBatchSyscalls++;
+        nSendCalls++;
+        if(result<0){
+            const bool usedGSO=mMessageNPackets[msgIdx]>1;
+            if(usedGSO && (errno==EIO || errno==EINVAL || errno==ENOPROTOOPT || errno==EOPNOTSUPP)){
+                // Kernel or network interface does not support UDP GSO. Send the remaining packets without it
+                MLOGE<<"UDP GSO not supported, disabling it "<<strerror(errno);
+                mUseGSO=false;
+                nMessages=buildMessages(packetIdx,endPacket);
+                msgIdx=0;
+                continue;
+            }
+            MLOGE<<"Cannot send data "<<mBatchPackets[packetIdx].size<<" "<<strerror(errno);
+            packetIdx+=mMessageNPackets[msgIdx];
+            msgIdx++;
+            continue;
+        }
+        if(result==0)break;
+        for(int i=0;i<result;i++){
+            packetIdx+=mMessageNPackets[msgIdx+i];
+            if(mMessageNPackets[msgIdx+i]>1)nGSOBuffers++;
+        }
+        msgIdx+=result;
+    }
+    mTimeSpentInSyscalls+=std::chrono::steady_clock::now()-sendStart;
+}
+
+void UDPSender::flush() {
+    const std::size_t nPackets=mBatchPackets.size();
+    if(nPackets==0)return;
+    mTimeSpentInSyscalls=std::chrono::nanoseconds(0);
+    if(mPacer==nullptr){
+        sendPackets(0,nPackets);
+    }else{
+        // Send all packets whose deadline has passed with one call, then wait until the deadline of the next packet
+        const auto flushStart=std::chrono::steady_clock::now();
+        std::size_t idx=0;
+        while(idx<nPackets){
+            auto now=std::chrono::steady_clock::now();
+            std::size_t end=idx;
+            while(end<nPackets && mPacer->getDeadline(now)<=now){
+                mPacer->onPacketReleased(now,mBatchPackets[end].size);
+                end++;
+            }
+            if(end==idx){
+                std::this_thread::sleep_until(mPacer->getDeadline(now));
+                continue;
+            }
+            sendPackets(idx,end);
+            const auto pacingDelay=now-flushStart;
+            for(std::size_t i=idx;i<end;i++){
+                pacingDelayPerPacket.add(pacingDelay);
+            }
+            maxPacingDelay=std::max(maxPacingDelay,std::chrono::duration_cast<std::chrono::nanoseconds>(pacingDelay));
+            idx=end;
+        }
+    }
+    timeSpentSendingBatch.add(mTimeSpentInSyscalls);
+    timeSpentSendingPerPacket.add(mTimeSpentInSyscalls/nPackets);
+    for(const auto& packet:mBatchPackets){
+        nSentBytes+=packet.size;
+    }
+    nBatches++;
+    nBatchPackets+=nPackets;
+    mBatchBufferSize=0;
+    mBatchPackets.clear();
+    mBatchIovecs.clear();
+    if(timeSpentSendingBatch.getNSamples()>100){
+        MLOGD<<"TimeSS batch "<<timeSpentSendingBatch.getAvgReadable()<<" per packet "<<timeSpentSendingPerPacket.getAvgReadable(true)
+             <<" packets/batch "<<((float)nBatchPackets/nBatches)<<" syscalls/batch "<<((float)nBatchSyscalls/nBatches)<<" GSO "<<(mUseGSO ? "on" : "off");
+        if(mPacer!=nullptr){
+            MLOGD<<"Pacing delay "<<pacingDelayPerPacket.getAvgReadable(true)<<" max "<<MyTimeHelper::R(maxPacingDelay);
+        }
+        timeSpentSendingBatch.reset();
+        timeSpentSendingPerPacket.reset();
+        pacingDelayPerPacket.reset();
+        maxPacingDelay=std::chrono::nanoseconds(0);
+        nBatches=0;
+        nBatchPackets=0;
+        nBatchSyscalls=0;
+    }
+}
+
+void UDPSender::setPacing(const uint64_t rateBytesPerSecond,const uint64_t burstBytes) {
+    if(rateBytesPerSecond==0){
+        mPacer=nullptr;
+        return;
+    }
+    mPacer=std::make_unique<TokenBucketPacer>(rateBytesPerSecond,burstBytes);
+    MLOGD<<"Pacing with "<<(rateBytesPerSecond*8/1024/1024)<<" MBit/s burst "<<StringHelper::memorySizeReadable(burstBytes);
+}
+
 UDPSender::~UDPSender() {
     //TODO
 }
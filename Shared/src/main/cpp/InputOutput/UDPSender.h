@@ -8,10 +8,16 @@
 #include <string>
 #include <arpa/inet.h>
 #include <array>
+#include <vector>
+#include <memory>
+#include <sys/socket.h>
 #include <TimeHelper.hpp>
+#include "TokenBucketPacer.hpp"
 
 /**
  * Allows sending UDP data on the current thread. No extra thread for sending is created (make sure to not call mySendTo() on the UI thread)
+ * Packets can either be sent one by one (mySendTo) or in batches (queue() then flush()). A batch is sent with one sendmmsg() call,
+ * and runs of equal sized packets are sent as one UDP_SEGMENT (GSO) buffer if the kernel supports it.
  */
 class UDPSender{
 public:
@@ -28,16 +34,89 @@ public:
     // Do not rename to sendto() because this method also exists from the linux socket lib
     // (This method does nothing else than validate the data size, then call sendto()
     void mySendTo(const uint8_t* data, ssize_t data_length);
+    // Copy one udp packet into the current batch. Nothing is sent until flush() is called
+    // (or the batch is full, in which case it is flushed automatically)
+    void queue(const uint8_t* data,std::size_t data_length);
+    // Add one udp packet consisting of a (small) header and a payload to the current batch.
+    // Only the header is copied, the payload is passed to the kernel directly (scatter-gather)
+    // and therefore has to stay valid until flush() is called
+    void queueZeroCopy(const uint8_t* header,std::size_t header_length,const uint8_t* payload,std::size_t payload_length);
+    // Send all packets of the current batch, usually one call per video frame
+    void flush();
+    // Enable / disable generic segmentation offload for batches (enabled by default).
+    // If the kernel does not support it, GSO is disabled automatically on the first failure
+    void setUseGSO(const bool useGSO){mUseGSO=useGSO;}
+    // Optional: spread the packets of a batch in time with a token bucket (see TokenBucketPacer),
+    // instead of sending the whole batch (e.g. a key frame) as one line-rate burst.
+    // flush() then blocks until the last packet of the batch was released. rateBytesPerSecond==0 disables pacing
+    void setPacing(uint64_t rateBytesPerSecond,uint64_t burstBytes);
+    // Send one packet right away, bypassing the batch. Unlike mySendTo() no statistics are touched,
+    // so this can be called from another thread while queue()/flush() are in use (e.g. for retransmissions)
+    void sendImmediately(const uint8_t* data,std::size_t data_length);
+    // Receive one datagram sent back to the local port of this socket (e.g. RTCP feedback from the receiver).
+    // Blocks until data arrives or the timeout elapsed. Returns the n of received bytes or <=0 on timeout / error.
+    // Can be called from another thread than the sending one
+    ssize_t receiveFeedback(uint8_t* buff,std::size_t buffSize,std::chrono::milliseconds timeout);
     //https://en.wikipedia.org/wiki/User_Datagram_Protocol
     //65,507 bytes (65,535 − 8 byte UDP header − 20 byte IP header).
     static constexpr const size_t UDP_PACKET_MAX_SIZE=65507;
     std::size_t nSentBytes=0;
+    // Bytes memcpy'd into the batch buffer (excluding the copy the kernel makes)
+    std::size_t nCopiedBytes=0;
+    // sendto() / sendmmsg() calls of mySendTo() and flush(). Unlike the logged batch statistics never reset
+    std::size_t nSendCalls=0;
+    // Messages that were sent as one GSO buffer of more than one packet
+    std::size_t nGSOBuffers=0;
     static constexpr std::size_t EXAMPLE_MEDIUM_SNDBUFF_SIZE=1024*1024;
+    static constexpr std::size_t MAX_BATCH_SIZE_BYTES=512*1024;
+    static constexpr std::size_t MAX_BATCH_SIZE_PACKETS=512;
+    // The kernel does not accept more segments for one GSO buffer
+    static constexpr std::size_t MAX_GSO_SEGMENTS=64;
 private:
     int sockfd;
     sockaddr_in address{};
     Chronometer timeSpentSending;
     const int WANTED_SNDBUFF_SIZE;
+    // Copied data (packets or headers) is stored in mBatchBuffer. Each queued packet consists of
+    // one or more consecutive iovecs, such that a run of packets can be sent as one GSO buffer without copying
+    std::vector<uint8_t> mBatchBuffer;
+    std::size_t mBatchBufferSize=0;
+    struct QueuedPacket{
+        std::size_t firstIovec;
+        std::size_t nIovecs;
+        std::size_t size;
+    };
+    std::vector<QueuedPacket> mBatchPackets;
+    std::vector<iovec> mBatchIovecs;
+    // Flush if the next packet (with n iovecs and n bytes to copy) does not fit into the batch anymore
+    void flushIfFull(std::size_t nIovecs,std::size_t nBytesToCopy);
+    // One message for each packet or run of packets (GSO)
+    struct MessageControl{
+        union{
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            cmsghdr align;
+        };
+    };
+    std::vector<mmsghdr> mMessages;
+    std::vector<MessageControl> mMessageControls;
+    std::vector<std::size_t> mMessageNPackets;
+    bool mUseGSO=true;
+    // Build the messages for the packets [firstPacket,endPacket)
+    // Returns the n of messages
+    std::size_t buildMessages(std::size_t firstPacket,std::size_t endPacket);
+    // Send the packets [firstPacket,endPacket) with as few syscalls as possible
+    void sendPackets(std::size_t firstPacket,std::size_t endPacket);
+    std::unique_ptr<TokenBucketPacer> mPacer;
+    // Statistics for batches
+    AvgCalculator timeSpentSendingBatch;
+    AvgCalculator timeSpentSendingPerPacket;
+    long nBatches=0;
+    long nBatchPackets=0;
+    long nBatchSyscalls=0;
+    std::chrono::nanoseconds mTimeSpentInSyscalls{0};
+    // How long packets were held back by the pacer
+    AvgCalculator pacingDelayPerPacket;
+    std::chrono::nanoseconds maxPacingDelay{0};
 };
 
 
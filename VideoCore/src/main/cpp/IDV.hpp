@@ -15,6 +15,13 @@ public:
     static constexpr const char* VS_VIDEO_VIEW_TYPE="VS_VIDEO_VIEW_TYPE";
     static constexpr const char* VS_360_VIDEO_FOV="VS_360_VIDEO_FOV";
     static constexpr const char* VS_ENABLE_H264_SPS_VUI_FIX="VS_ENABLE_H264_SPS_VUI_FIX";
+    static constexpr const char* VS_DIVERSITY_PORT="VS_DIVERSITY_PORT";
+    static constexpr const char* VS_REBROADCAST_DESTINATIONS="VS_REBROADCAST_DESTINATIONS";
+    static constexpr const char* VS_PCAP_UDP_PORT="VS_PCAP_UDP_PORT";
+    static constexpr const char* VS_PCAP_PAYLOAD_TYPE="VS_PCAP_PAYLOAD_TYPE";
+    static constexpr const char* VS_PCAP_SPEED="VS_PCAP_SPEED";
+    static constexpr const char* VS_RTP_NACK_MAX_DELAY_MS="VS_RTP_NACK_MAX_DELAY_MS";
+    static constexpr const char* VS_FEC_LOSS_REPORT_INTERVAL_MS="VS_FEC_LOSS_REPORT_INTERVAL_MS";
 };
 
 #endif //CONSTI_10_100_IDV
@@ -19,9 +19,46 @@ private:
     std::unique_ptr<NALU> PPS;
     // VPS are only used in H265
     std::unique_ptr<NALU> VPS;
+    // All slices of the latest IDR frame. Only saved when SAVE_IDR_FRAME is set (copying them is expensive)
+    const bool SAVE_IDR_FRAME;
+    std::vector<std::unique_ptr<NALU>> IDR;
+    bool lastNALUWasIDR=false;
+    // Set when the IDR frame has more slices than MAX_IDR_SLICES, the remaining slices are not saved
+    bool dropIDRSlices=false;
+    // More slices than any encoder we know of uses for one frame
+    static constexpr size_t MAX_IDR_SLICES=64;
+    // first_mb_in_slice==0 (H264) or first_slice_segment_in_pic_flag (H265), the first slice of a new frame
+    static bool isFirstSliceOfFrame(const NALU& nalu){
+        const uint8_t* nal=nalu.getDataWithoutPrefix();
+        if(nalu.IS_H265_PACKET){
+            return nalu.getDataSizeWithoutPrefix()>=3 && (nal[2] & 0x80)!=0;
+        }
+        return nalu.getDataSizeWithoutPrefix()>=2 && (nal[1] & 0x80)!=0;
+    }
 public:
+    explicit KeyFrameFinder(const bool SAVE_IDR_FRAME=false):SAVE_IDR_FRAME(SAVE_IDR_FRAME){}
     void saveIfKeyFrame(const NALU &nalu){
         if(nalu.getSize()<=0)return;
+        if(SAVE_IDR_FRAME){
+            const bool isIDR=nalu.isIDR();
+            if(isIDR){
+                // The first slice of a new IDR frame replaces the old IDR frame. Consecutive IDR frames
+                // (e.g. all-intra streams) are only separated by the first slice flag
+                if(!lastNALUWasIDR || isFirstSliceOfFrame(nalu)){
+                    IDR.clear();
+                    dropIDRSlices=false;
+                }
+                if(IDR.size()>=MAX_IDR_SLICES){
+                    // Not a valid frame (e.g. the first slice was lost), do not keep an incomplete one either
+                    IDR.clear();
+                    dropIDRSlices=true;
+                }
+                if(!dropIDRSlices){
+                    IDR.push_back(std::make_unique<NALU>(nalu));
+                }
+            }
+            lastNALUWasIDR=isIDR;
+        }
         if(nalu.isSPS()){
             SPS=std::make_unique<NALU>(nalu);
             //MLOGD<<"SPS found";
@@ -49,6 +86,14 @@ public:
     const NALU& getCSD1()const{
         return *PPS;
     }
+    //VPS (h265 only)
+    const NALU& getVPS()const{
+        return *VPS;
+    }
+    // Only valid if SAVE_IDR_FRAME is set. Empty if no IDR frame was found yet
+    const std::vector<std::unique_ptr<NALU>>& getIDRFrame()const{
+        return IDR;
+    }
     static void appendNaluData(std::vector<uint8_t>& buff,const NALU& nalu){
         buff.insert(buff.begin(),nalu.getData(),nalu.getData()+nalu.getSize());
     }
@@ -56,6 +101,9 @@ public:
         SPS=nullptr;
         PPS=nullptr;
         VPS=nullptr;
+        IDR.clear();
+        lastNALUWasIDR=false;
+        dropIDRSlices=false;
     }
 public:
     // Some of these params are only supported on the latest Android versions
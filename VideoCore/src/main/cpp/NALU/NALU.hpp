@@ -122,6 +122,14 @@ public:
         assert(IS_H265_PACKET);
         return get_nal_unit_type()==NALUnitType::H265::NAL_UNIT_VPS;
     }
+    // Coded slice of an IDR picture (decoding can start here)
+    bool isIDR()const{
+        if(IS_H265_PACKET){
+            return get_nal_unit_type()==NALUnitType::H265::NAL_UNIT_CODED_SLICE_IDR_W_RADL ||
+                   get_nal_unit_type()==NALUnitType::H265::NAL_UNIT_CODED_SLICE_IDR_N_LP;
+        }
+        return (get_nal_unit_type() == NAL_UNIT_TYPE_CODED_SLICE_IDR);
+    }
     bool isAUD()const{
         if(IS_H265_PACKET){
             return get_nal_unit_type()==NALUnitType::H265:: NAL_UNIT_ACCESS_UNIT_DELIMITER;
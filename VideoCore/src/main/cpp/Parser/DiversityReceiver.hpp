@@ -0,0 +1,177 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_DIVERSITYRECEIVER_HPP
+#define LIVEVIDEO10MS_DIVERSITYRECEIVER_HPP
+
+#include <UDPReceiver.h>
+#include <AndroidLogger.hpp>
+#include "RTP.hpp"
+#include <bitset>
+#include <vector>
+#include <mutex>
+#include <sstream>
+
+/*********************************************
+ ** Merges multiple copies of the same rtp stream (e.g. received by two radios / on different ports)
+ ** by the rtp sequence number. The first copy of each packet is forwarded, all later copies are dropped.
+ ** Since a packet is only lost if it is lost on all paths, the loss is the intersection of the paths' losses.
+**********************************************/
+class RTPDeduplicator{
+public:
+    // How many sequence numbers back a duplicate is still detected
+    static constexpr const int WINDOW_SIZE=1024;
+    struct PathStats{
+        // All rtp packets received on this path
+        long nPackets=0;
+        // Packets where this path delivered the first (and therefore forwarded) copy
+        long nFirstCopies=0;
+        // Packets that were already delivered by another path (or were received twice on this path)
+        long nDuplicates=0;
+    };
+    explicit RTPDeduplicator(const std::size_t nPaths):mPathStats(nPaths){}
+    /**
+     * @return true if this is the first copy of the packet (forward it), false if it is a duplicate or too old
+     */
+    bool isNewPacket(const std::size_t pathIdx,const uint8_t* rtp_data,const size_t data_length){
+        if(data_length<sizeof(rtp_header_t)){
+            return false;
+        }
+        PathStats& stats=mPathStats.at(pathIdx);
+        stats.nPackets++;
+        const RTP::RTPPacket rtpPacket(rtp_data,data_length);
+        const uint16_t seqNr=rtpPacket.header.getSequence();
+        if(highestSeqNr==-1){
+            // first packet in stream
+            markAsReceived(seqNr);
+            highestSeqNr=seqNr;
+            stats.nFirstCopies++;
+            return true;
+        }
+        // Don't forget that the sequence number loops every UINT16_MAX packets
+        const int delta=(int16_t)(seqNr-(uint16_t)highestSeqNr);
+        if(delta>0){
+            // Newer than anything seen so far, clear the window positions we skip over
+            if(delta>=WINDOW_SIZE){
+                mReceived.reset();
+            }else{
+                for(int i=1;i<delta;i++){
+                    mReceived.reset(((uint16_t)highestSeqNr+i)%WINDOW_SIZE);
+                }
+            }
+            markAsReceived(seqNr);
+            highestSeqNr=seqNr;
+            nTooOldInARow=0;
+            stats.nFirstCopies++;
+            return true;
+        }
+        if(-delta>=WINDOW_SIZE){
+            // Way too old to tell if it is a duplicate. If this keeps happening the sender was probably restarted
+            nTooOldInARow++;
+            if(nTooOldInARow>100){
+                MLOGD<<"Resetting deduplicator";
+                reset();
+            }
+            stats.nDuplicates++;
+            return false;
+        }
+        if(mReceived.test(seqNr%WINDOW_SIZE)){
+            stats.nDuplicates++;
+            return false;
+        }
+        // Late (reordered) but first copy
+        markAsReceived(seqNr);
+        stats.nFirstCopies++;
+        return true;
+    }
+    const PathStats& getPathStats(const std::size_t pathIdx)const{
+        return mPathStats.at(pathIdx);
+    }
+    std::size_t getNPaths()const{
+        return mPathStats.size();
+    }
+    void reset(){
+        mReceived.reset();
+        highestSeqNr=-1;
+        nTooOldInARow=0;
+    }
+private:
+    void markAsReceived(const uint16_t seqNr){
+        mReceived.set(seqNr%WINDOW_SIZE);
+    }
+    // 65536 is a multiple of WINDOW_SIZE, therefore the bit position of a sequence number does not jump when it wraps around
+    static_assert((65536 % WINDOW_SIZE)==0);
+    std::bitset<WINDOW_SIZE> mReceived;
+    int highestSeqNr=-1;
+    int nTooOldInARow=0;
+    std::vector<PathStats> mPathStats;
+};
+
+/*********************************************
+ ** Listens on N ports (one UDPReceiver each) for the same rtp stream and
+ ** forwards the deduplicated packets to one callback. The callback is never called concurrently.
+**********************************************/
+class DiversityReceiver{
+public:
+    DiversityReceiver(JavaVM* javaVm,const std::vector<int>& ports,int CPUPriority,UDPReceiver::DATA_CALLBACK onDataReceivedCallback,
+                      size_t WANTED_RCVBUF_SIZE=0,size_t MAX_RCVBUF_SIZE=0):
+            onDataReceivedCallback(std::move(onDataReceivedCallback)),
+            mDeduplicator(ports.size()){
+        for(std::size_t i=0;i<ports.size();i++){
+            const std::string name="V_UDP_R"+std::to_string(i);
+            mUDPReceivers.push_back(std::make_unique<UDPReceiver>(javaVm,ports[i],name,CPUPriority,[this,i](const uint8_t* data, size_t data_length) {
+                onNewPacket(i,data,data_length);
+            },WANTED_RCVBUF_SIZE,MAX_RCVBUF_SIZE));
+        }
+    }
+    void startReceiving(){
+        mDeduplicator.reset();
+        for(auto& receiver:mUDPReceivers){
+            receiver->startReceiving();
+        }
+    }
+    void stopReceiving(){
+        for(auto& receiver:mUDPReceivers){
+            receiver->stopReceiving();
+        }
+    }
+    long getNReceivedBytes()const{
+        long ret=0;
+        for(const auto& receiver:mUDPReceivers){
+            ret+=receiver->getNReceivedBytes();
+        }
+        return ret;
+    }
+    long getNKernelDroppedPackets()const{
+        long ret=0;
+        for(const auto& receiver:mUDPReceivers){
+            ret+=receiver->getNKernelDroppedPackets();
+        }
+        return ret;
+    }
+    // Which path delivered what
+    std::string getPathStatsAsString(){
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::stringstream ss;
+        for(std::size_t i=0;i<mUDPReceivers.size();i++){
+            const auto& stats=mDeduplicator.getPathStats(i);
+            ss<<"\nPort "<<mUDPReceivers[i]->getPort()<<" rx: "<<stats.nPackets<<" first: "<<stats.nFirstCopies<<" dup: "<<stats.nDuplicates;
+        }
+        return ss.str();
+    }
+private:
+    void onNewPacket(const std::size_t pathIdx,const uint8_t* data,const size_t data_length){
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(mDeduplicator.isNewPacket(pathIdx,data,data_length)){
+            onDataReceivedCallback(data,data_length);
+        }
+    }
+    const UDPReceiver::DATA_CALLBACK onDataReceivedCallback;
+    std::vector<std::unique_ptr<UDPReceiver>> mUDPReceivers;
+    // Protects the deduplicator and serializes the callback (each UDPReceiver has its own thread)
+    std::mutex mMutex;
+    RTPDeduplicator mDeduplicator;
+};
+
+#endif //LIVEVIDEO10MS_DIVERSITYRECEIVER_HPP
@@ -0,0 +1,185 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_FECLOSSREPORT_HPP
+#define LIVEVIDEO10MS_FECLOSSREPORT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <bitset>
+#include <functional>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <wifibroadcast/fec.hh>
+
+/*********************************************
+ ** Loss feedback for the 'rtp inside FEC' stream, used by the sender to adapt its FEC overhead (see AdaptiveFEC.hpp).
+ ** Receiver: FECLossMonitor looks at the FEC header of each received packet (before the FEC decoder) and counts
+ ** the expected, the lost packets and the n of loss bursts on the link. The counts since the last report are sent
+ ** back as a RTCP APP message (https://tools.ietf.org/html/rfc3550#section-6.7) on the same back channel as the NACKs.
+**********************************************/
+namespace RTCPFECLossReport{
+    static constexpr uint8_t RTCP_PT_APP=204;
+    static constexpr uint8_t SUBTYPE=0;
+    static constexpr char NAME[4]={'F','E','C','L'};
+    struct Report{
+        // Packets (data and FEC blocks) sent by the sender / lost on the link since the last report
+        uint32_t nExpected=0;
+        uint32_t nLost=0;
+        // Runs of consecutive lost packets
+        uint32_t nBursts=0;
+    };
+    static void writeU32(std::vector<uint8_t>& buff,const std::size_t offset,const uint32_t value){
+        buff[offset]=(uint8_t)(value>>24);
+        buff[offset+1]=(uint8_t)(value>>16);
+        buff[offset+2]=(uint8_t)(value>>8);
+        buff[offset+3]=(uint8_t)(value & 0xFF);
+    }
+    static uint32_t readU32(const uint8_t* data){
+        return ((uint32_t)data[0]<<24) | ((uint32_t)data[1]<<16) | ((uint32_t)data[2]<<8) | data[3];
+    }
+    static std::vector<uint8_t> create(const uint32_t senderSSRC,const Report& report){
+        std::vector<uint8_t> ret(24);
+        ret[0]=(uint8_t)(0x80 | SUBTYPE);
+        ret[1]=RTCP_PT_APP;
+        // length in 32 bit words minus one
+        ret[2]=0;
+        ret[3]=(uint8_t)(ret.size()/4-1);
+        writeU32(ret,4,senderSSRC);
+        std::memcpy(&ret[8],NAME,sizeof(NAME));
+        writeU32(ret,12,report.nExpected);
+        writeU32(ret,16,report.nLost);
+        writeU32(ret,20,report.nBursts);
+        return ret;
+    }
+    /**
+     * Calls cb for each FEC loss report in a (compound) RTCP packet. Other RTCP messages are skipped.
+     * Returns false if the data is not a valid RTCP packet
+     */
+    static bool parse(const uint8_t* data,const std::size_t data_length,const std::function<void(const Report&)>& cb){
+        std::size_t offset=0;
+        while(offset+4<=data_length){
+            const uint8_t* msg=&data[offset];
+            if((msg[0]>>6)!=2)return false;
+            const std::size_t msgLength=(((msg[2]<<8) | msg[3])+1)*4;
+            if(offset+msgLength>data_length)return false;
+            if(msg[1]==RTCP_PT_APP && (msg[0] & 0x1F)==SUBTYPE && msgLength>=24 && std::memcmp(&msg[8],NAME,sizeof(NAME))==0){
+                Report report;
+                report.nExpected=readU32(&msg[12]);
+                report.nLost=readU32(&msg[16]);
+                report.nBursts=readU32(&msg[20]);
+                cb(report);
+            }
+            offset+=msgLength;
+        }
+        return offset==data_length;
+    }
+}
+
+/**
+ * Receiver side: Counts the packets of each FEC group (n_blocks+n_fec_blocks, or one if the group has no FEC blocks)
+ * that did not arrive. A group is evaluated once a group that is more than reorderGroups newer arrived, sequence numbers
+ * that were never seen count as one lost group of the average size. Not thread safe.
+ */
+class FECLossMonitor{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    struct Options{
+        std::chrono::milliseconds reportInterval=std::chrono::milliseconds(100);
+        int reorderGroups=4;
+        // A bigger jump of the sequence number is handled as a restart of the stream
+        int maxGap=64;
+    };
+    explicit FECLossMonitor(const Options& options):mOptions(options){}
+    void input(const uint8_t* data,const std::size_t data_length){
+        if(data_length<sizeof(FECHeader))return;
+        const auto& header=*(const FECHeader*)data;
+        // The sender skips sequence number 0
+        if(header.seq_num==0)return;
+        const int total=header.n_fec_blocks>0 ? header.n_blocks+header.n_fec_blocks : 1;
+        const int position=header.n_fec_blocks>0 ? header.block : 0;
+        if(position>=total)return;
+        if(mHighest<0){
+            restart(header.seq_num);
+        }
+        // Extend the sequence number relative to the highest one received so far (255 values, 0 is skipped)
+        int diff=((header.seq_num-1)-(int)(mHighest%255)+255)%255;
+        if(diff>127)diff-=255;
+        if(diff>mOptions.maxGap || -diff>mOptions.maxGap){
+            restart(header.seq_num);
+            diff=0;
+        }
+        const int64_t seq=mHighest+diff;
+        // Already evaluated (late or duplicated)
+        if(seq<=mLastEvaluated)return;
+        auto& group=mGroups[seq];
+        group.total=total;
+        group.received[position]=true;
+        if(seq>mHighest){
+            mHighest=seq;
+            evaluateUntil(mHighest-mOptions.reorderGroups);
+        }
+    }
+    // Returns true (and the counts since the last report) once per report interval
+    bool getReport(const TimePoint now,RTCPFECLossReport::Report& report){
+        if(now-mLastReport<mOptions.reportInterval)return false;
+        mLastReport=now;
+        report=mReport;
+        mReport={};
+        return report.nExpected>0;
+    }
+    static constexpr uint32_t RECEIVER_SSRC=1;
+private:
+    struct Group{
+        int total=0;
+        std::bitset<256> received;
+    };
+    void restart(const uint8_t seqNum){
+        mGroups.clear();
+        mHighest=seqNum-1;
+        mLastEvaluated=mHighest-1;
+        mLastWasLost=false;
+    }
+    void lost(const int n){
+        mReport.nExpected+=n;
+        mReport.nLost+=n;
+        if(!mLastWasLost)mReport.nBursts++;
+        mLastWasLost=true;
+    }
+    void evaluateUntil(const int64_t seq){
+        while(mLastEvaluated<seq){
+            mLastEvaluated++;
+            const auto it=mGroups.find(mLastEvaluated);
+            if(it==mGroups.end()){
+                lost(std::max((int)std::lround(mAvgGroupSize),1));
+                continue;
+            }
+            const Group& group=it->second;
+            for(int i=0;i<group.total;i++){
+                if(group.received[i]){
+                    mReport.nExpected++;
+                    mLastWasLost=false;
+                }else{
+                    lost(1);
+                }
+            }
+            mAvgGroupSize+=(group.total-mAvgGroupSize)*0.1f;
+            mGroups.erase(it);
+        }
+    }
+    const Options mOptions;
+    // Extended (not wrapping) sequence numbers
+    int64_t mHighest=-1;
+    int64_t mLastEvaluated=-1;
+    std::map<int64_t,Group> mGroups;
+    float mAvgGroupSize=1;
+    bool mLastWasLost=false;
+    RTCPFECLossReport::Report mReport;
+    TimePoint mLastReport{};
+};
+
+#endif //LIVEVIDEO10MS_FECLOSSREPORT_HPP
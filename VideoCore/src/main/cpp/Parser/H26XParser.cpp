@@ -141,14 +141,20 @@ void H26XParser::parseCustom(const uint8_t *data, const std::size_t data_length)
 void H26XParser::parseCustomRTPinsideFEC(const uint8_t *data, const std::size_t data_len) {
 
     mFECDecoder.add_block(data, data_len);
-    //std::vector<uint8_t> obuf;
-    //obuf.reserve(1024*1024);
-    for (std::shared_ptr<FECBlock> sblk = mFECDecoder.get_block(); sblk; sblk = mFECDecoder.get_block()) {
+    parseDecodedFECBlocks();
+}
+
+void H26XParser::releaseExpiredFECBlocks() {
+    mFECDecoder.release_expired();
+    parseDecodedFECBlocks();
+}
+
+void H26XParser::parseDecodedFECBlocks() {
+    for (FECBlockPtr sblk = mFECDecoder.get_block(); sblk; sblk = mFECDecoder.get_block()) {
         // One block should be equal to one rtp packet
         const uint8_t* sblkData=sblk->data();
         const size_t sblkDataLength=sblk->data_length();
         if(sblkDataLength>10){
-            MLOGD<<"Parsing rtp "<<sblkDataLength;
             const auto* rtp_header=(rtp_header_t*)sblkData;
             const auto seqNr=rtp_header->getSequence();
             debugSequenceNumbers(seqNr);
@@ -156,14 +162,6 @@ void H26XParser::parseCustomRTPinsideFEC(const uint8_t *data, const std::size_t
         }else{
             MLOGD<<"Weird packet"<<sblkDataLength;
         }
-
-        //std::copy(sblk->data(), sblk->data() + sblk->data_length(),
-        //          std::back_inserter(obuf));
     }
-    /*if(obuf.size()>0){
-        MLOGD<<"Got rtp packet";
-        //parse_raw_h264_stream(obuf.data(),obuf.size());
-        mDecodeRTP.parseRTPtoNALU(obuf.data(),obuf.size());
-    }*/
 }
 
@@ -49,14 +49,24 @@ public:
     //
     void parseCustom(const uint8_t* data,const size_t data_len);
     void parseCustomRTPinsideFEC(const uint8_t* data, const size_t data_len);
+    // The FEC decoder only releases the blocks held back for a missing block on new input.
+    // Call regularly such that they are released after the max latency even if the stream stalls
+    void releaseExpiredFECBlocks();
     void reset();
 public:
     long nParsedNALUs=0;
     long nParsedKonfigurationFrames=0;
+    // Packets lost on the link (gaps in the rtp sequence numbers)
+    long getNMissingRTPPackets()const{return mDecodeRTP.getNMissingPackets();}
+    // RTP aggregation packets (h264 STAP-A / h265 AP) and the NALUs they contained
+    long getNRTPAggregationPackets()const{return mDecodeRTP.getNAggregationPackets();}
+    long getNRTPAggregatedNALUs()const{return mDecodeRTP.getNAggregatedNALUs();}
     //For live video set to -1 (no fps limitation), else additional latency will be generated
     void setLimitFPS(int maxFPS);
 private:
     void newNaluExtracted(const NALU& nalu);
+    // Parse all blocks the FEC decoder has released (one rtp packet each)
+    void parseDecodedFECBlocks();
     const NALU_DATA_CALLBACK onNewNALU;
     std::chrono::steady_clock::time_point lastFrameLimitFPS=std::chrono::steady_clock::now();
     std::chrono::steady_clock::time_point lastTimeOnNewNALUCalled=std::chrono::steady_clock::now();
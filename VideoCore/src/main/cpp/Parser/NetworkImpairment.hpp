@@ -0,0 +1,164 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_NETWORKIMPAIRMENT_HPP
+#define LIVEVIDEO10MS_NETWORKIMPAIRMENT_HPP
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <list>
+#include <random>
+#include <functional>
+#include <sstream>
+#include <algorithm>
+
+/*********************************************
+ ** Simulates a bad network link between a packet source and the receive side (rtp decoder, fec decoder, parser).
+ ** Supports loss (Bernoulli or Gilbert-Elliott), reordering, duplication and delay jitter.
+ ** Runs on a virtual clock and only uses its own seeded random number generator, e.g. the same seed and the
+ ** same input always produce the same output on every device - this is needed to catch regressions.
+**********************************************/
+class NetworkImpairment{
+public:
+    struct Options{
+        uint32_t seed=0;
+        // Bernoulli loss: each packet is lost independently with this probability
+        float lossProbability=0;
+        // Gilbert-Elliott loss (burst loss). Only used if geGoodToBad>0.
+        // In the good state the loss is lossProbability, in the bad state geLossBad
+        float geGoodToBad=0;
+        float geBadToGood=0;
+        float geLossBad=1.0f;
+        // With this probability a packet is held back until reorderDepth later packets have been delivered
+        float reorderProbability=0;
+        int reorderDepth=0;
+        // With this probability a packet is delivered twice
+        float duplicateProbability=0;
+        // Each packet is delayed by baseDelayUs + a random value in [0,jitterUs).
+        // Packets never overtake each other because of jitter (use reordering for that)
+        int64_t baseDelayUs=0;
+        int64_t jitterUs=0;
+    };
+    struct Stats{
+        long nInputPackets=0;
+        long nLostPackets=0;
+        long nReorderedPackets=0;
+        long nDuplicatedPackets=0;
+        long nDeliveredPackets=0;
+    };
+    // called with the packet and the (virtual) time the packet is delivered at
+    typedef std::function<void(const uint8_t* data,std::size_t data_length,int64_t deliveryTimeUs)> PACKET_CALLBACK;
+public:
+    NetworkImpairment(const Options& options,PACKET_CALLBACK cb):
+    mOptions(options),mCB(std::move(cb)),mRandom(options.seed){}
+    /**
+     * Pass a packet trough the simulated link. The packet is copied.
+     * @param nowUs current (virtual) time, must not decrease between calls
+     */
+    void input(const uint8_t* data,const std::size_t data_length,const int64_t nowUs){
+        stats.nInputPackets++;
+        // Every packet consumes the same amount of random numbers, independent of the options.
+        // This way changing one impairment does not change the random pattern of the others
+        const float rLoss=nextFloat();
+        const float rGilbert=nextFloat();
+        const float rReorder=nextFloat();
+        const float rDuplicate=nextFloat();
+        const float rJitter=nextFloat();
+        advanceTo(nowUs);
+        if(isLost(rLoss,rGilbert)){
+            stats.nLostPackets++;
+            return;
+        }
+        std::vector<uint8_t> packet(data,data+data_length);
+        const int64_t deliveryTimeUs=std::max(nowUs+mOptions.baseDelayUs+(int64_t)(rJitter*mOptions.jitterUs),lastScheduledTimeUs);
+        lastScheduledTimeUs=deliveryTimeUs;
+        const bool duplicate=rDuplicate<mOptions.duplicateProbability;
+        if(rReorder<mOptions.reorderProbability && mOptions.reorderDepth>0){
+            stats.nReorderedPackets++;
+            mHeldBack.push_back({mOptions.reorderDepth,std::move(packet)});
+            if(duplicate){
+                stats.nDuplicatedPackets++;
+                mHeldBack.push_back(mHeldBack.back());
+            }
+            return;
+        }
+        if(duplicate){
+            stats.nDuplicatedPackets++;
+            schedule(deliveryTimeUs,packet);
+        }
+        schedule(deliveryTimeUs,std::move(packet));
+        // Held back packets are released behind the packet that was just scheduled
+        for(auto it=mHeldBack.begin();it!=mHeldBack.end();){
+            it->nPacketsToWait--;
+            if(it->nPacketsToWait<=0){
+                schedule(deliveryTimeUs,std::move(it->data));
+                it=mHeldBack.erase(it);
+            }else{
+                ++it;
+            }
+        }
+    }
+    // Deliver all packets whose delivery time is <= nowUs
+    void advanceTo(const int64_t nowUs){
+        while(!mScheduled.empty() && mScheduled.begin()->first<=nowUs){
+            deliver(mScheduled.begin());
+        }
+    }
+    // Deliver everything that is still in flight (including held back packets)
+    void flush(){
+        for(auto& held:mHeldBack){
+            schedule(lastScheduledTimeUs,std::move(held.data));
+        }
+        mHeldBack.clear();
+        while(!mScheduled.empty()){
+            deliver(mScheduled.begin());
+        }
+    }
+    std::string getStatsAsString()const{
+        std::stringstream ss;
+        ss<<"in:"<<stats.nInputPackets<<" lost:"<<stats.nLostPackets<<" reordered:"<<stats.nReorderedPackets
+          <<" duplicated:"<<stats.nDuplicatedPackets<<" delivered:"<<stats.nDeliveredPackets;
+        return ss.str();
+    }
+    Stats stats;
+private:
+    struct HeldBackPacket{
+        int nPacketsToWait;
+        std::vector<uint8_t> data;
+    };
+    bool isLost(const float rLoss,const float rGilbert){
+        if(mOptions.geGoodToBad>0){
+            if(inBadState){
+                if(rGilbert<mOptions.geBadToGood)inBadState=false;
+            }else{
+                if(rGilbert<mOptions.geGoodToBad)inBadState=true;
+            }
+            return rLoss<(inBadState ? mOptions.geLossBad : mOptions.lossProbability);
+        }
+        return rLoss<mOptions.lossProbability;
+    }
+    void schedule(const int64_t deliveryTimeUs,std::vector<uint8_t> data){
+        // multimap keeps the insertion order for packets with the same delivery time
+        mScheduled.emplace(deliveryTimeUs,std::move(data));
+    }
+    void deliver(std::multimap<int64_t,std::vector<uint8_t>>::iterator it){
+        stats.nDeliveredPackets++;
+        mCB(it->second.data(),it->second.size(),it->first);
+        mScheduled.erase(it);
+    }
+    // std::uniform_real_distribution is implementation defined, this is not
+    float nextFloat(){
+        return (mRandom()>>8)*(1.0f/16777216.0f);
+    }
+    const Options mOptions;
+    const PACKET_CALLBACK mCB;
+    std::mt19937 mRandom;
+    bool inBadState=false;
+    int64_t lastScheduledTimeUs=0;
+    std::multimap<int64_t,std::vector<uint8_t>> mScheduled;
+    std::list<HeldBackPacket> mHeldBack;
+};
+
+#endif //LIVEVIDEO10MS_NETWORKIMPAIRMENT_HPP
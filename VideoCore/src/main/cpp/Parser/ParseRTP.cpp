@@ -10,6 +10,9 @@ RTPDecoder::RTPDecoder(NALU_DATA_CALLBACK cb): cb(std::move(cb)){
 
 void RTPDecoder::reset(){
     mNALU_DATA_LENGTH=0;
+    nMissingPackets=0;
+    nAggregationPackets=0;
+    nAggregatedNALUs=0;
     //nalu_data.reserve(NALU::NALU_MAXLEN);
 }
 
@@ -20,23 +23,35 @@ bool RTPDecoder::validateRTPPacket(const rtp_header_t& rtp_header) {
     }
     // Testing regarding sequence numbers.This stuff can be removed without issues
     const int seqNr=rtp_header.getSequence();
-    if(seqNr==lastSequenceNumber){
-        // duplicate. This should never happen for 'normal' rtp streams, but can be usefully when testing bitrates
-        // (Since you can send the same packet multiple times to emulate a higher bitrate)
-        MLOGD<<"Same seqNr";
-        return false;
-    }
     if(lastSequenceNumber==-1){
         // first packet in stream
         flagPacketHasGoneMissing=false;
-    }else{
-        // Don't forget that the sequence number loops every UINT16_MAX packets
-        if(seqNr != ((lastSequenceNumber+1) % UINT16_MAX)){
-            // We are missing a Packet !
-            MLOGD<<"missing a packet. Last:"<<lastSequenceNumber<<" Curr:"<<seqNr<<" Diff:"<<(seqNr-(int)lastSequenceNumber);
-            //flagPacketHasGoneMissing=true;
+        lastSequenceNumber=seqNr;
+        mReceivedSequenceNumbers=1;
+        return true;
+    }
+    // Don't forget that the sequence number loops every UINT16_MAX packets
+    const int diff=(int16_t)(seqNr-lastSequenceNumber);
+    if(diff<=0){
+        // Late (reordered) or duplicated packet. Duplicates should never happen for 'normal' rtp streams, but the
+        // transmitter can send packets multiple times (to emulate a higher bitrate or to protect important NALUs)
+        if(-diff<SEQUENCE_WINDOW_SIZE){
+            const uint64_t bit=(uint64_t)1<<(-diff);
+            if(mReceivedSequenceNumbers & bit){
+                MLOGD<<"Same seqNr";
+                return false;
+            }
+            mReceivedSequenceNumbers|=bit;
         }
+        return true;
     }
+    if(diff>1){
+        // We are missing a Packet !
+        MLOGD<<"missing a packet. Last:"<<lastSequenceNumber<<" Curr:"<<seqNr<<" Diff:"<<diff;
+        nMissingPackets+=diff-1;
+        //flagPacketHasGoneMissing=true;
+    }
+    mReceivedSequenceNumbers= diff<SEQUENCE_WINDOW_SIZE ? (mReceivedSequenceNumbers<<diff) | 1 : 1;
     lastSequenceNumber=seqNr;
     return true;
 }
@@ -59,6 +74,10 @@ void RTPDecoder::parseRTPH264toNALU(const uint8_t* rtp_data, const size_t data_l
         const auto& fu_header=rtpPacket.getFuHeader();
         const auto fu_payload=rtpPacket.getFuPayload();
         const auto fu_payload_size=rtpPacket.getFuPayloadSize();
+        if(fu_header.s != 1 && mNALU_DATA_LENGTH==0){
+            // The start of this fu-a was lost, the rest of it cannot be used
+            return;
+        }
         if (fu_header.e == 1) {
             //MLOGD<<"End of fu-a";
             /* end of fu-a */
@@ -116,6 +135,13 @@ void RTPDecoder::parseRTPH264toNALU(const uint8_t* rtp_data, const size_t data_l
         mNALU_DATA_LENGTH+= data_length - 13;
         forwardNALU(timePointStartOfReceivingNALU);
         mNALU_DATA_LENGTH=0;
+    }else if(nalu_header.type==24){
+        // STAP-A, usually SPS,PPS (and SEI) in one packet
+        if(flagPacketHasGoneMissing){
+            MLOGD<<"Got STAP-A - clearing missing packet flag";
+            flagPacketHasGoneMissing= false;
+        }
+        parseAggregationPacket(&rtpPacket.rtpPayload[sizeof(nalu_header_t)],rtpPacket.rtpPayloadSize-sizeof(nalu_header_t),false);
     }else{
         MLOGE<<"Got unsupported H264 RTP packet. NALU type:"<<nalu_header.type;
     }
@@ -146,15 +172,22 @@ void RTPDecoder::parseRTPH265toNALU(const uint8_t* rtp_data, const size_t data_l
         return;
     }
     if(nal_unit_header_h265.type==48){
-        // Aggregation packets are not supported yet (and never used in gstreamer / ffmpeg anyways)
-        MLOGE<<"Unsupported RTP H265 packet (Aggregation packet)";
-        return;
+        // Aggregation packet, usually VPS,SPS and PPS in one packet
+        if(flagPacketHasGoneMissing){
+            MLOGD<<"Got AP - clearing missing packet flag";
+            flagPacketHasGoneMissing= false;
+        }
+        parseAggregationPacket(&rtpPacket.rtpPayload[sizeof(nal_unit_header_h265_t)],rtpPacket.rtpPayloadSize-sizeof(nal_unit_header_h265_t),true);
     }else if(nal_unit_header_h265.type==49){
         // FU-X packet
         //MLOGD<<"Got partial nal";
         const auto& fu_header=rtpPacket.getFuHeader();
         const auto fu_payload=rtpPacket.getFuPayload();
         const auto fu_payload_size=rtpPacket.getFuPayloadSize();
+        if(!fu_header.s && mNALU_DATA_LENGTH==0){
+            // The start of this fu was lost, the rest of it cannot be used
+            return;
+        }
         if(fu_header.e){
             //MLOGD<<"end of fu packetization";
             appendNALUData(fu_payload, fu_payload_size);
@@ -207,6 +240,32 @@ void RTPDecoder::parseRTPH265toNALU(const uint8_t* rtp_data, const size_t data_l
     }
 }
 
+void RTPDecoder::parseAggregationPacket(const uint8_t *payload,const size_t payload_size,const bool isH265) {
+    nAggregationPackets++;
+    const auto now=std::chrono::steady_clock::now();
+    // I do not know what about the 'DONL' field (h265) but it seems to be never present
+    size_t offset=0;
+    while(offset+2<=payload_size){
+        const size_t nalu_size=(payload[offset]<<8) | payload[offset+1];
+        offset+=2;
+        if(nalu_size==0 || offset+nalu_size>payload_size){
+            MLOGE<<"Invalid NALU size in aggregation packet "<<nalu_size;
+            break;
+        }
+        // Any partially received fu is lost at this point (same as for single NALUs)
+        mNALU_DATA[0]=0;
+        mNALU_DATA[1]=0;
+        mNALU_DATA[2]=0;
+        mNALU_DATA[3]=1;
+        mNALU_DATA_LENGTH=4;
+        appendNALUData(&payload[offset], nalu_size);
+        forwardNALU(now,isH265);
+        nAggregatedNALUs++;
+        offset+=nalu_size;
+    }
+    mNALU_DATA_LENGTH=0;
+}
+
 void RTPDecoder::forwardNALU(const std::chrono::steady_clock::time_point creationTime,const bool isH265) {
     if(cb!= nullptr){
         const size_t minNaluSize=NALU::getMinimumNaluSize(isH265);
@@ -234,6 +293,39 @@ void RTPDecoder::appendNALUData(const uint8_t *data, size_t data_len) {
 
 // xxxxxxxxxxxxxxxxxxxxxxxxxxx RTPEncoder part xxxxxxxxxxxxxxxxxxxxxxxxxxx
 
+bool AccessUnitDetector::isFirstNALUOfAccessUnit(const uint8_t *nal,const size_t nal_len,const bool isH265) {
+    bool isVCL;
+    bool canStartAccessUnit;
+    if(isH265){
+        const uint8_t type=(nal[0]>>1) & 0x3F;
+        isVCL=type<32;
+        // first_slice_segment_in_pic_flag is the first bit after the 2 byte nal unit header
+        // Else VPS,SPS,PPS,AUD,prefix SEI and reserved types 41..44,48..55 (H.265 7.4.2.4.4)
+        canStartAccessUnit= isVCL ? (nal_len>2 && (nal[2] & 0x80)) :
+                (type<=35 || type==39 || (type>=41 && type<=44) || (type>=48 && type<=55));
+    }else{
+        const uint8_t type=nal[0] & 0x1F;
+        isVCL=type>=1 && type<=5;
+        // first_mb_in_slice==0 is coded as a single '1' bit (ue(v))
+        // Else SEI,SPS,PPS,AUD and types 14..18 (H.264 7.4.1.2.3)
+        canStartAccessUnit= isVCL ? (nal_len>1 && (nal[1] & 0x80)) :
+                (type==6 || type==7 || type==8 || type==9 || (type>=14 && type<=18));
+    }
+    // Only the first of these NALUs after a slice starts the new access unit (e.g. SPS,PPS,IDR is one access unit)
+    const bool ret=canStartAccessUnit && lastNALUWasVCL;
+    if(isVCL || canStartAccessUnit){
+        lastNALUWasVCL=isVCL;
+    }
+    return ret;
+}
+
+void RTPEncoder::updateTimestamp(const int framerate,const uint8_t *nal,const size_t nal_len,const bool isH265) {
+    const bool newAccessUnit=mAccessUnitDetector.isFirstNALUOfAccessUnit(nal,nal_len,isH265);
+    if(newAccessUnit && !mUseCaptureTime){
+        ts_current += (90000 / framerate);  /* 90000 / 25 = 3600 */
+    }
+}
+
 int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const size_t nalu_data_len) {
     // Watch out for not enough data (else algorithm might crash)
     if(nalu_data_len <= 5){
@@ -243,7 +335,7 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
     const uint8_t *nalu_buf_without_prefix = &nalu_data[4];
     const size_t nalu_len_without_prefix= nalu_data_len - 4;
 
-    ts_current += (90000 / framerate);  /* 90000 / 25 = 3600 */
+    updateTimestamp(framerate,nalu_buf_without_prefix,nalu_len_without_prefix,false);
 
     if (nalu_len_without_prefix <= RTP_PAYLOAD_MAX_SIZE) {
         /*
@@ -265,7 +357,7 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
         rtp_hdr->payload = RTP_PAYLOAD_TYPE_H264_H265;
         // rtp_hdr->marker = (pstStream->u32PackCount - 1 == i) ? 1 : 0;   /* If the packet is the end of a frame, set it to 1, otherwise it is 0. rfc 1889 does not specify the purpose of this bit*/
         rtp_hdr->marker=0;
-        rtp_hdr->sequence = htons(++seq_num % UINT16_MAX);
+        rtp_hdr->sequence = htons(++seq_num);
         rtp_hdr->timestamp = htonl(ts_current);
         //rtp_hdr->timestamp=0;
         rtp_hdr->sources = htonl(MY_SSRC_NUM);
@@ -277,14 +369,9 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
         nalu_hdr->type = (nalu_buf_without_prefix[0] & 0x1f);
         //MLOGD<<"ENC NALU hdr type"<<((int)nalu_hdr->type);
         /*
-         * 3.Fill nal content
+         * 3. Forward the RTP packet (header + nal content without the nalu header)
          */
-        memcpy(mRTP_BUFF_SEND + 13, nalu_buf_without_prefix + 1, nalu_len_without_prefix - 1);    /* 不拷贝nalu头 */
-        /*
-         * 4. Forward the RTP packet
-         */
-        const size_t len_sendbuf = 12 + nalu_len_without_prefix;
-        forwardRTPPacket(mRTP_BUFF_SEND, len_sendbuf);
+        forwardRTPPacket(mRTP_BUFF_SEND, 13, nalu_buf_without_prefix + 1, nalu_len_without_prefix - 1);
         //
         //MLOGD<<"NALU <RTP_PAYLOAD_MAX_SIZE";
     } else {    /* nalu_len > RTP_PAYLOAD_MAX_SIZE */
@@ -323,7 +410,7 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
                 rtp_hdr->version = 2;
                 rtp_hdr->payload = RTP_PAYLOAD_TYPE_H264_H265;
                 rtp_hdr->marker = 0;    /* If the packet is the end of a frame, set it to 1, otherwise it is 0. rfc 1889 does not specify the purpose of this bit*/
-                rtp_hdr->sequence = htons(++seq_num % UINT16_MAX);
+                rtp_hdr->sequence = htons(++seq_num);
                 rtp_hdr->timestamp = htonl(ts_current);
                 rtp_hdr->sources = htonl(MY_SSRC_NUM);
                 /*
@@ -338,14 +425,9 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
                 fu_hdr->r = 0;
                 fu_hdr->type = nalu_buf_without_prefix[0] & 0x1f;
                 /*
-                 * 3. 填充nalu内容
-                 */
-                memcpy(mRTP_BUFF_SEND + 14, nalu_buf_without_prefix + 1, RTP_PAYLOAD_MAX_SIZE - 1);    /* 不拷贝nalu头 */
-                /*
-                 * 4. 发送打包好的rtp包到客户端
+                 * 3. 发送打包好的rtp包到客户端 (rtp头 + fu头 + nalu内容, 不拷贝nalu头)
                  */
-                const size_t len_sendbuf = 12 + 2 + (RTP_PAYLOAD_MAX_SIZE - 1);  /* rtp头 + nalu头 + nalu内容 */
-                forwardRTPPacket(mRTP_BUFF_SEND, len_sendbuf);
+                forwardRTPPacket(mRTP_BUFF_SEND, 12 + 2, nalu_buf_without_prefix + 1, RTP_PAYLOAD_MAX_SIZE - 1);
 
             } else if (fu_seq < fu_pack_num - 1) { /* 中间的FU-A */
                 /*
@@ -357,7 +439,7 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
                 rtp_hdr->version = 2;
                 rtp_hdr->payload = RTP_PAYLOAD_TYPE_H264_H265;
                 rtp_hdr->marker = 0;    /* 该包为一帧的结尾则置为1, 否则为0. rfc 1889 没有规定该位的用途 */
-                rtp_hdr->sequence = htons(++seq_num % UINT16_MAX);
+                rtp_hdr->sequence = htons(++seq_num);
                 rtp_hdr->timestamp = htonl(ts_current);
                 rtp_hdr->sources = htonl(MY_SSRC_NUM);
                 /*
@@ -372,14 +454,9 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
                 fu_hdr->r = 0;
                 fu_hdr->type = nalu_buf_without_prefix[0] & 0x1f;
                 /*
-                 * 3. 填充nalu内容
+                 * 3. 发送打包好的rtp包到客户端
                  */
-                memcpy(mRTP_BUFF_SEND + 14, nalu_buf_without_prefix + RTP_PAYLOAD_MAX_SIZE * fu_seq, RTP_PAYLOAD_MAX_SIZE);    /* 不拷贝nalu头 */
-                /*
-                 * 4. 发送打包好的rtp包到客户端
-                 */
-                const size_t len_sendbuf = 12 + 2 + RTP_PAYLOAD_MAX_SIZE;
-                forwardRTPPacket(mRTP_BUFF_SEND, len_sendbuf);
+                forwardRTPPacket(mRTP_BUFF_SEND, 12 + 2, nalu_buf_without_prefix + RTP_PAYLOAD_MAX_SIZE * fu_seq, RTP_PAYLOAD_MAX_SIZE);
             } else { /* 最后一个FU-A */
                 /*
                  * 1. 设置 rtp 头
@@ -390,7 +467,7 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
                 rtp_hdr->version = 2;
                 rtp_hdr->payload = RTP_PAYLOAD_TYPE_H264_H265;
                 rtp_hdr->marker = 1;    /* 该包为一帧的结尾则置为1, 否则为0. rfc 1889 没有规定该位的用途 */
-                rtp_hdr->sequence = htons(++seq_num % UINT16_MAX);
+                rtp_hdr->sequence = htons(++seq_num);
                 rtp_hdr->timestamp = htonl(ts_current);
                 rtp_hdr->sources = htonl(MY_SSRC_NUM);
                 /*
@@ -405,14 +482,9 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
                 fu_hdr->r = 0;
                 fu_hdr->type = nalu_buf_without_prefix[0] & 0x1f;
                 /*
-                 * 3. 填充rtp荷载
-                 */
-                memcpy(mRTP_BUFF_SEND + 14, nalu_buf_without_prefix + RTP_PAYLOAD_MAX_SIZE * fu_seq, last_fu_pack_size);    /* 不拷贝nalu头 */
-                /*
-                 * 4. 发送打包好的rtp包到客户端
+                 * 3. 发送打包好的rtp包到客户端
                  */
-                const size_t len_sendbuf = 12 + 2 + last_fu_pack_size;
-                forwardRTPPacket(mRTP_BUFF_SEND, len_sendbuf);
+                forwardRTPPacket(mRTP_BUFF_SEND, 12 + 2, nalu_buf_without_prefix + RTP_PAYLOAD_MAX_SIZE * fu_seq, last_fu_pack_size);
 
             } /* else-if (fu_seq == 0) */
         } /* end of for (fu_seq = 0; fu_seq < fu_pack_num; fu_seq++) */
@@ -422,12 +494,127 @@ int RTPEncoder::parseNALtoRTP(int framerate, const uint8_t *nalu_data, const siz
 }
 
 
-void RTPEncoder::forwardRTPPacket(uint8_t *rtp_packet, size_t rtp_packet_len) {
-    assert(rtp_packet_len!=0);
+void RTPEncoder::writeRTPHeader(const bool marker) {
+    memset(mRTP_BUFF_SEND, 0, sizeof(rtp_header_t));
+    auto* rtp_hdr= (rtp_header_t *)mRTP_BUFF_SEND;
+    rtp_hdr->cc = 0;
+    rtp_hdr->extension = 0;
+    rtp_hdr->padding = 0;
+    rtp_hdr->version = 2;
+    rtp_hdr->payload = RTP_PAYLOAD_TYPE_H264_H265;
+    rtp_hdr->marker = marker ? 1 : 0;
+    rtp_hdr->sequence = htons(++seq_num);
+    rtp_hdr->timestamp = htonl(ts_current);
+    rtp_hdr->sources = htonl(MY_SSRC_NUM);
+}
+
+int RTPEncoder::parseNALtoRTPH265(int framerate, const uint8_t *nalu_data, const size_t nalu_data_len,const bool lastNALUOfAccessUnit) {
+    // 4 bytes prefix and 2 bytes nal unit header
+    if(nalu_data_len <= 6){
+        return -1;
+    }
+    // Prefix is the 0,0,0,1. RTP does not use it
+    const uint8_t *nal = &nalu_data[4];
+    const size_t nal_len= nalu_data_len - 4;
+    const uint8_t nal_type=(nal[0]>>1) & 0x3F;
+    const bool isParameterSet=nal_type==32 || nal_type==33 || nal_type==34;
+
+    updateTimestamp(framerate,nal,nal_len,true);
+
+    // An aggregation packet holds the payload header and for each NALU 2 bytes size + the NALU
+    if(mAggregateParameterSets){
+        const std::size_t maxAggregationSize=RTP_PACKET_MAX_SIZE-sizeof(rtp_header_t);
+        if(isParameterSet && 2+2+nal_len<=maxAggregationSize){
+            if(mAggregationBufferSize+2+nal_len>maxAggregationSize){
+                flushAggregationH265();
+            }
+            if(mAggregationBufferSize==0){
+                mAggregationBufferSize=2;
+            }
+            mAggregationBuffer[mAggregationBufferSize]=(uint8_t)(nal_len>>8);
+            mAggregationBuffer[mAggregationBufferSize+1]=(uint8_t)(nal_len & 0xFF);
+            memcpy(&mAggregationBuffer[mAggregationBufferSize+2],nal,nal_len);
+            mAggregationBufferSize+=2+nal_len;
+            mNAggregatedNALUs++;
+            // The PPS is the last parameter set before the slice(s)
+            if(nal_type==34 || lastNALUOfAccessUnit){
+                flushAggregationH265(lastNALUOfAccessUnit);
+            }
+            return 0;
+        }
+        flushAggregationH265();
+    }
+    if(nal_len <= RTP_PACKET_MAX_SIZE-sizeof(rtp_header_t)){
+        // single NAL unit packet. Other than h264, the nal unit header is the payload header
+        writeRTPHeader(lastNALUOfAccessUnit);
+        forwardRTPPacket(mRTP_BUFF_SEND, sizeof(rtp_header_t), nal, nal_len);
+        return 0;
+    }
+    // FU packets. The payload header is the nal unit header with type 49, the FU header holds the original type
+    const size_t fu_payload_max_size=RTP_PACKET_MAX_SIZE-RTP_PACKET_MAX_OVERHEAD_H265;
+    const uint8_t* fu_data=nal+2;
+    const size_t fu_data_len=nal_len-2;
+    for(size_t offset=0;offset<fu_data_len;offset+=fu_payload_max_size){
+        const size_t fu_payload_size=std::min(fu_payload_max_size,fu_data_len-offset);
+        const bool start=offset==0;
+        const bool end=offset+fu_payload_size==fu_data_len;
+        writeRTPHeader(end && lastNALUOfAccessUnit);
+        mRTP_BUFF_SEND[12]=(uint8_t)((nal[0] & 0x81) | (49<<1));
+        mRTP_BUFF_SEND[13]=nal[1];
+        auto* fu_hdr=(fu_header_h265_t*)&mRTP_BUFF_SEND[14];
+        fu_hdr->s=start ? 1 : 0;
+        fu_hdr->e=end ? 1 : 0;
+        fu_hdr->fuType=nal_type;
+        forwardRTPPacket(mRTP_BUFF_SEND, RTP_PACKET_MAX_OVERHEAD_H265, fu_data+offset, fu_payload_size);
+    }
+    return 0;
+}
+
+void RTPEncoder::flushAggregationH265(const bool marker) {
+    if(mNAggregatedNALUs==0){
+        return;
+    }
+    uint8_t* packetPayload=&mRTP_BUFF_SEND[sizeof(rtp_header_t)];
+    size_t packetPayloadSize;
+    if(mNAggregatedNALUs==1){
+        // An aggregation packet has to contain at least 2 NALUs, send it as single NAL unit packet instead
+        packetPayloadSize=mAggregationBufferSize-4;
+        memcpy(packetPayload,&mAggregationBuffer[4],packetPayloadSize);
+    }else{
+        // The payload header: F bit set if any F bit is set, type 48, lowest LayerId and lowest TID of all aggregated NALUs
+        uint8_t f=0;
+        int layerId=63,tid=7;
+        for(std::size_t off=2;off<mAggregationBufferSize;){
+            const size_t nal_len=(mAggregationBuffer[off]<<8) | mAggregationBuffer[off+1];
+            const uint8_t* nal=&mAggregationBuffer[off+2];
+            f|=nal[0] & 0x80;
+            layerId=std::min(layerId,((nal[0] & 0x01)<<5) | (nal[1]>>3));
+            tid=std::min(tid,nal[1] & 0x07);
+            off+=2+nal_len;
+        }
+        mAggregationBuffer[0]=(uint8_t)(f | (48<<1) | (layerId>>5));
+        mAggregationBuffer[1]=(uint8_t)(((layerId & 0x1F)<<3) | tid);
+        packetPayloadSize=mAggregationBufferSize;
+        memcpy(packetPayload,mAggregationBuffer.data(),packetPayloadSize);
+    }
+    nCopiedBytes+=packetPayloadSize;
+    // The whole packet is 'header' now, the receiver of the scatter-gather callback copies it
+    writeRTPHeader(marker);
+    forwardRTPPacket(mRTP_BUFF_SEND, sizeof(rtp_header_t)+packetPayloadSize, packetPayload+packetPayloadSize, 0);
+    mAggregationBufferSize=0;
+    mNAggregatedNALUs=0;
+}
+
+void RTPEncoder::forwardRTPPacket(uint8_t *rtp_header, size_t rtp_header_len,const uint8_t* payload,size_t payload_len) {
+    const size_t rtp_packet_len=rtp_header_len+payload_len;
     assert(rtp_packet_len<=RTP_PACKET_MAX_SIZE);
     //MLOGD<<"forwardRTPPacket of size "<<rtp_packet_len;
-    if(mCB!= nullptr){
-        mCB({rtp_packet,rtp_packet_len});
+    if(mSGCB!= nullptr){
+        mSGCB({rtp_header,rtp_header_len,payload,payload_len});
+    }else if(mCB!= nullptr){
+        memcpy(rtp_header + rtp_header_len, payload, payload_len);
+        nCopiedBytes+=payload_len;
+        mCB({rtp_header,rtp_packet_len});
     }else{
         MLOGE<<"No RTP Encoder callback set";
     }
@@ -18,7 +18,7 @@ public:
 public:
     // check if a packet is missing by using the rtp sequence number and
     // if the payload is dynamic (h264 or h265)
-    // Returns false if payload is wrong
+    // Returns false if the packet is a duplicate of one of the last SEQUENCE_WINDOW_SIZE packets
     // sets the 'missing packet' flag to true if packet got lost
     bool validateRTPPacket(const rtp_header_t& rtpHeader);
     // parse rtp h264 packet to NALU
@@ -30,24 +30,54 @@ public:
     void appendNALUData(const uint8_t* data, size_t data_len);
     // reset mNALU_DATA_LENGTH to 0
     void reset();
+    // N of packets that are missing according to gaps in the rtp sequence numbers
+    long getNMissingPackets()const{return nMissingPackets;}
+    // N of aggregation packets (h264 STAP-A, h265 AP) and the N of NALUs they contained
+    long getNAggregationPackets()const{return nAggregationPackets;}
+    long getNAggregatedNALUs()const{return nAggregatedNALUs;}
 private:
     // Properly calls the cb function
     // Resets the mNALU_DATA_LENGTH to 0
     void forwardNALU(const std::chrono::steady_clock::time_point creationTime,const bool isH265=false);
+    // Split an aggregation packet payload (starting after the STAP-A / AP payload header) into
+    // its NALUs (each one prefixed by its 16 bit size) and forward them one by one
+    void parseAggregationPacket(const uint8_t* payload,size_t payload_size,bool isH265);
     const NALU_DATA_CALLBACK cb;
     std::array<uint8_t,NALU::NALU_MAXLEN> mNALU_DATA;
     size_t mNALU_DATA_LENGTH=0;
 private:
     //TDOD: What shall we do if a start, middle or end of fu-a is missing ?
+    // Highest sequence number so far
     int lastSequenceNumber=-1;
+    // Bit i is set if the packet with sequence number lastSequenceNumber-i was received
+    static constexpr int SEQUENCE_WINDOW_SIZE=64;
+    uint64_t mReceivedSequenceNumbers=0;
     bool flagPacketHasGoneMissing=false;
+    long nMissingPackets=0;
+    long nAggregationPackets=0;
+    long nAggregatedNALUs=0;
     // This time point is as 'early as possible' to debug the parsing time as accurately as possible.
     // E.g for a fu-a NALU the time point when the start fu-a was received, not when its end is received
     std::chrono::steady_clock::time_point timePointStartOfReceivingNALU;
 };
 
 /*********************************************
- ** Parses a stream of h264 NALUs into RTP packets
+ ** Detects the first NALU of each access unit (frame) in a stream of h264 or h265 NALUs.
+ ** A frame can consist of more than one slice, but all slices of a frame have to get the same rtp timestamp
+**********************************************/
+class AccessUnitDetector{
+public:
+    // nal: the NAL unit without the 0,0,0,1 prefix
+    // Returns true if this NAL unit is the first one of a new access unit
+    bool isFirstNALUOfAccessUnit(const uint8_t* nal,size_t nal_len,bool isH265);
+private:
+    // The first NALU always starts an access unit
+    bool lastNALUWasVCL=true;
+};
+
+/*********************************************
+ ** Parses a stream of h264 or h265 NALUs into RTP packets
+ ** h264: https://tools.ietf.org/html/rfc6184 h265: https://tools.ietf.org/html/rfc7798
 **********************************************/
 class RTPEncoder{
 public:
@@ -56,6 +86,15 @@ public:
         const size_t data_len;
     };
     typedef std::function<void(const RTPPacket& rtpPacket)> RTP_DATA_CALLBACK;
+    // The same packet, but as two parts: The rtp header (+ FU header(s)) and a pointer into the original NALU.
+    // The payload is only valid as long as the NALU data passed to parseNALtoRTP() is valid
+    struct RTPPacketSG{
+        const uint8_t* header;
+        const size_t header_len;
+        const uint8_t* payload;
+        const size_t payload_len;
+    };
+    typedef std::function<void(const RTPPacketSG& rtpPacket)> RTP_SG_DATA_CALLBACK;
 public:
     /**
      * @param cb The callback that receives the RTP packets
@@ -65,19 +104,68 @@ public:
     mCB(cb),
     RTP_PACKET_MAX_SIZE(RTP_PACKET_MAX_SIZE){
         assert(RTP_PACKET_MAX_SIZE<=RTPEncoder::SEND_BUF_SIZE);
+        mAggregationBuffer.resize(RTP_PACKET_MAX_SIZE);
     };
     // Set / change the callback
     void setCallback(RTP_DATA_CALLBACK cb){mCB=cb;};
-    // Parse one NALU into one or more RTP packets
+    // If set, the packets are forwarded as header + payload pointer to this callback instead of the contiguous one,
+    // e.g. the NALU payload is never copied (use with sendmsg()/sendmmsg() and an iovec for each part)
+    void setScatterGatherCallback(RTP_SG_DATA_CALLBACK cb){mSGCB=cb;};
+    // Parse one h264 NALU into one or more RTP packets
     int parseNALtoRTP(int framerate, const uint8_t *nalu_data,const size_t nalu_data_len);
+    // Parse one h265 NALU into one or more RTP packets (single NAL unit or FU packets).
+    // The marker bit is set on the last packet of the access unit, e.g. pass lastNALUOfAccessUnit for the last NALU of a frame
+    int parseNALtoRTPH265(int framerate, const uint8_t *nalu_data,const size_t nalu_data_len,bool lastNALUOfAccessUnit=false);
+    // h265 only: Send VPS,SPS and PPS together in one aggregation packet (AP) instead of one packet each.
+    // The aggregated NALUs are sent once the PPS or any other NALU arrives.
+    // Only enable if the receiver can depacketize aggregation packets
+    void setAggregateParameterSetsH265(const bool enable){mAggregateParameterSets=enable;}
+    /**
+     * Set the capture time of the access unit (frame) the next NALUs belong to. All NALUs passed until the next call
+     * get the same rtp timestamp, e.g. call this once per frame before the first NALU (SPS/PPS included).
+     * If never called, the timestamp advances by 90000/framerate on each new access unit instead.
+     * @param captureTime in the steady (CLOCK_MONOTONIC) time base, e.g. MediaCodec.BufferInfo.presentationTimeUs
+     */
+    void setAccessUnitCaptureTime(std::chrono::steady_clock::time_point captureTime){
+        ts_current=toRTPTimestamp(captureTime);
+        mUseCaptureTime=true;
+    }
+    // Maps a capture time to the 90kHz rtp clock. The epoch is the one of the steady clock,
+    // so all encoders (and streams) on one device agree on the timestamp of the same capture time
+    static uint32_t toRTPTimestamp(const std::chrono::steady_clock::time_point captureTime){
+        const auto ns=std::chrono::duration_cast<std::chrono::nanoseconds>(captureTime.time_since_epoch()).count();
+        // Truncated to 32 bit (the rtp timestamp wraps around)
+        return (uint32_t)(ns*9/(100*1000));
+    }
     // If the NAL unit fits into one rtp packet the overhead is 12 bytes
-    // Else, the overhead can be up to 12+2 bytes
+    // Else, the overhead can be up to 12+2 bytes (h264) or 12+3 bytes (h265)
     static constexpr std::size_t RTP_PACKET_MAX_OVERHEAD=12+2;
+    static constexpr std::size_t RTP_PACKET_MAX_OVERHEAD_H265=12+3;
     const std::size_t RTP_PACKET_MAX_SIZE;
     const std::size_t RTP_PAYLOAD_MAX_SIZE=RTP_PACKET_MAX_SIZE-RTP_PACKET_MAX_OVERHEAD;
+    // NALU bytes memcpy'd to create contiguous rtp packets (only the aggregation packets when using the scatter-gather callback)
+    std::size_t nCopiedBytes=0;
 private:
     RTP_DATA_CALLBACK mCB;
-    void forwardRTPPacket(uint8_t *rtp_packet, size_t rtp_packet_len);
+    RTP_SG_DATA_CALLBACK mSGCB= nullptr;
+    // The header has to be written to the start of mRTP_BUFF_SEND
+    // Only copies the payload behind the header if the contiguous callback is used
+    void forwardRTPPacket(uint8_t *rtp_header, size_t rtp_header_len,const uint8_t* payload,size_t payload_len);
+    // Write the rtp header for the next packet (increases the sequence number) to the start of mRTP_BUFF_SEND
+    void writeRTPHeader(bool marker);
+    // Send the VPS/SPS/PPS collected for an aggregation packet (if any).
+    // The packet is copied behind the rtp header, such that the next aggregation can reuse mAggregationBuffer
+    // while the scatter-gather callback still refers to the last packet
+    void flushAggregationH265(bool marker=false);
+    // Advance the rtp timestamp if nal starts a new access unit and no capture time is used
+    void updateTimestamp(int framerate,const uint8_t* nal,size_t nal_len,bool isH265);
+    AccessUnitDetector mAccessUnitDetector;
+    bool mUseCaptureTime=false;
+    bool mAggregateParameterSets=false;
+    // h265 aggregation packet payload: payload header, then 2 byte size + NALU for each aggregated NALU
+    std::vector<uint8_t> mAggregationBuffer;
+    std::size_t mAggregationBufferSize=0;
+    int mNAggregatedNALUs=0;
     // This buffer size does not affect the RTP packet size
     // I allocate a big buffer here to account for all RTP packet sizes of up to 1024*1024 bytes
     static constexpr const std::size_t SEND_BUF_SIZE=1024*1024;
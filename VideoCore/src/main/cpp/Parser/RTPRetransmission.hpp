@@ -0,0 +1,309 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_RTPRETRANSMISSION_HPP
+#define LIVEVIDEO10MS_RTPRETRANSMISSION_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <sstream>
+#include <arpa/inet.h>
+#include <TimeHelper.hpp>
+#include <AndroidLogger.hpp>
+#include "RTP.hpp"
+
+/*********************************************
+ ** Selective retransmission of lost rtp packets, requested with RTCP generic NACKs (https://tools.ietf.org/html/rfc4585#section-6.2.1)
+ ** Sender: RTPRetransmissionHistory keeps the last N sent rtp packets, keyed by the rtp sequence number.
+ ** Receiver: RTPNackReceiver sits in front of the RTPDecoder. It requests the packets missing in the sequence number
+ ** space and holds back the packets behind a gap until the missing ones arrive or their deadline passed.
+ ** Only useful if the round trip time is well below the deadline (e.g. LAN or close range wifi), FEC covers the rest.
+**********************************************/
+namespace RTCPGenericNack{
+    // Transport layer feedback message, FMT 1 = generic NACK
+    static constexpr uint8_t RTCP_PT_RTPFB=205;
+    static constexpr uint8_t FMT_GENERIC_NACK=1;
+    static void writeU16(std::vector<uint8_t>& buff,const std::size_t offset,const uint16_t value){
+        buff[offset]=(uint8_t)(value>>8);
+        buff[offset+1]=(uint8_t)(value & 0xFF);
+    }
+    static void writeU32(std::vector<uint8_t>& buff,const std::size_t offset,const uint32_t value){
+        writeU16(buff,offset,(uint16_t)(value>>16));
+        writeU16(buff,offset+2,(uint16_t)(value & 0xFFFF));
+    }
+    /**
+     * Create one generic NACK message requesting the given sequence numbers
+     * @param sequenceNumbers sorted in sequence number order (wrap around is allowed)
+     */
+    static std::vector<uint8_t> create(const uint32_t senderSSRC,const uint32_t mediaSSRC,const std::vector<uint16_t>& sequenceNumbers){
+        std::vector<uint8_t> ret(12);
+        std::size_t i=0;
+        while(i<sequenceNumbers.size()){
+            // Each FCI entry holds one lost packet (PID) and a bitmask of the following 16 packets (BLP)
+            const uint16_t pid=sequenceNumbers[i];
+            uint16_t blp=0;
+            i++;
+            while(i<sequenceNumbers.size()){
+                const uint16_t diff=sequenceNumbers[i]-pid;
+                if(diff<1 || diff>16)break;
+                blp|=(uint16_t)(1<<(diff-1));
+                i++;
+            }
+            const std::size_t offset=ret.size();
+            ret.resize(offset+4);
+            writeU16(ret,offset,pid);
+            writeU16(ret,offset+2,blp);
+        }
+        ret[0]=(uint8_t)(0x80 | FMT_GENERIC_NACK);
+        ret[1]=RTCP_PT_RTPFB;
+        // length in 32 bit words minus one
+        writeU16(ret,2,(uint16_t)(ret.size()/4-1));
+        writeU32(ret,4,senderSSRC);
+        writeU32(ret,8,mediaSSRC);
+        return ret;
+    }
+    /**
+     * Calls cb for each sequence number requested by the generic NACK(s) in a (compound) RTCP packet.
+     * Other RTCP messages are skipped. Returns false if the data is not a valid RTCP packet
+     */
+    static bool parse(const uint8_t* data,const std::size_t data_length,const std::function<void(uint16_t)>& cb){
+        std::size_t offset=0;
+        while(offset+4<=data_length){
+            const uint8_t* msg=&data[offset];
+            if((msg[0]>>6)!=2)return false;
+            const std::size_t msgLength=(((msg[2]<<8) | msg[3])+1)*4;
+            if(offset+msgLength>data_length)return false;
+            if((msg[0] & 0x1F)==FMT_GENERIC_NACK && msg[1]==RTCP_PT_RTPFB){
+                for(std::size_t fci=12;fci+4<=msgLength;fci+=4){
+                    const uint16_t pid=(msg[fci]<<8) | msg[fci+1];
+                    const uint16_t blp=(msg[fci+2]<<8) | msg[fci+3];
+                    cb(pid);
+                    for(int bit=0;bit<16;bit++){
+                        if(blp & (1<<bit)){
+                            cb((uint16_t)(pid+bit+1));
+                        }
+                    }
+                }
+            }
+            offset+=msgLength;
+        }
+        return offset==data_length;
+    }
+}
+
+/**
+ * Ring buffer of the last N sent rtp packets. Not thread safe.
+ */
+class RTPRetransmissionHistory{
+public:
+    struct Packet{
+        const uint8_t* data;
+        std::size_t data_len;
+    };
+    /**
+     * @param maxNPackets has to be a power of 2, the history should cover at least one RTT + deadline of packets
+     */
+    explicit RTPRetransmissionHistory(const std::size_t maxNPackets=1024,const std::size_t maxPacketSize=1500):
+    MAX_PACKET_SIZE(maxPacketSize),
+    mSlots(maxNPackets){
+        assert((maxNPackets & (maxNPackets-1))==0);
+        for(auto& slot:mSlots){
+            slot.data.resize(MAX_PACKET_SIZE);
+        }
+    }
+    // Store a copy of a sent rtp packet, the sequence number is read from the header
+    void store(const uint8_t* header,const std::size_t header_len,const uint8_t* payload,const std::size_t payload_len){
+        if(header_len<sizeof(rtp_header_t) || header_len+payload_len>MAX_PACKET_SIZE)return;
+        const uint16_t seq=((const rtp_header_t*)header)->getSequence();
+        Slot& slot=mSlots[seq & (mSlots.size()-1)];
+        std::memcpy(slot.data.data(),header,header_len);
+        std::memcpy(&slot.data[header_len],payload,payload_len);
+        slot.data_len=header_len+payload_len;
+        slot.sequenceNumber=seq;
+        slot.valid=true;
+    }
+    // Returns false if the packet is not (or not anymore) in the history
+    bool get(const uint16_t sequenceNumber,Packet& packet)const{
+        const Slot& slot=mSlots[sequenceNumber & (mSlots.size()-1)];
+        if(!slot.valid || slot.sequenceNumber!=sequenceNumber)return false;
+        packet={slot.data.data(),slot.data_len};
+        return true;
+    }
+private:
+    struct Slot{
+        bool valid=false;
+        uint16_t sequenceNumber=0;
+        std::size_t data_len=0;
+        std::vector<uint8_t> data;
+    };
+    const std::size_t MAX_PACKET_SIZE;
+    std::vector<Slot> mSlots;
+};
+
+/**
+ * Receiver side: Detects gaps in the rtp sequence numbers, sends RTCP generic NACKs for the missing packets
+ * and forwards the rtp packets in sequence number order (e.g. to the RTPDecoder).
+ * A missing packet is requested up to maxNacksPerPacket times. Once its deadline passed it is given up,
+ * and the packets held back behind it are forwarded (the RTPDecoder then sees the gap as usual).
+ * Deadlines are only checked on input() and update(), call update() regularly if the stream can stop. Not thread safe.
+ */
+class RTPNackReceiver{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    struct Options{
+        // Give up on a missing packet this long after its gap was detected.
+        // This is also the max latency added to the packets behind the gap
+        std::chrono::microseconds maxDelay=std::chrono::milliseconds(20);
+        // Request a missing packet again if it did not arrive after this time
+        std::chrono::microseconds retryInterval=std::chrono::milliseconds(5);
+        int maxNacksPerPacket=3;
+        // A bigger gap is handled as a restart of the stream
+        int maxGap=1024;
+    };
+    struct Stats{
+        long nReceivedPackets=0;
+        // Detected by gaps in the sequence numbers
+        long nMissingPackets=0;
+        long nRecoveredPackets=0;
+        // Missing packets whose deadline passed
+        long nLostPackets=0;
+        // Retransmitted (or reordered) packets that arrived after their deadline and duplicates
+        long nTooLatePackets=0;
+        long nNackMessages=0;
+        long nRequestedPackets=0;
+        // Gap detected -> missing packet received
+        AvgCalculator recoveryLatency;
+        // Latency added to the packets held back behind a gap
+        AvgCalculator holdBackLatency;
+    };
+    typedef std::function<void(const uint8_t* data,std::size_t data_length)> RTP_CALLBACK;
+    typedef std::function<void(const uint8_t* data,std::size_t data_length)> RTCP_CALLBACK;
+public:
+    /**
+     * @param onRTPPacket receives the rtp packets in order
+     * @param sendRTCP has to send the RTCP feedback to the rtp sender
+     */
+    RTPNackReceiver(const Options& options,RTP_CALLBACK onRTPPacket,RTCP_CALLBACK sendRTCP):
+    mOptions(options),mOnRTPPacket(std::move(onRTPPacket)),mSendRTCP(std::move(sendRTCP)){}
+    void input(const uint8_t* data,const std::size_t data_length,const TimePoint now){
+        if(data_length<sizeof(rtp_header_t))return;
+        const auto& header=*(const rtp_header_t*)data;
+        mMediaSSRC=ntohl(header.sources);
+        stats.nReceivedPackets++;
+        if(mNextExpected<0){
+            mNextExpected=mHighestReceived=header.getSequence();
+        }
+        // Extend the 16 bit sequence number relative to the highest one received so far
+        int64_t seq=mHighestReceived+(int16_t)(header.getSequence()-(uint16_t)mHighestReceived);
+        if(seq-mHighestReceived>mOptions.maxGap || mHighestReceived-seq>mOptions.maxGap){
+            restart(seq);
+        }
+        if(seq<mNextExpected || mHeldBack.count(seq)>0){
+            stats.nTooLatePackets++;
+            return;
+        }
+        const auto missing=mMissing.find(seq);
+        if(missing!=mMissing.end()){
+            stats.nRecoveredPackets++;
+            stats.recoveryLatency.add(now-missing->second.detected);
+            mMissing.erase(missing);
+        }
+        for(int64_t i=mHighestReceived+1;i<seq;i++){
+            mMissing.emplace(i,MissingPacket{now,now,0});
+            stats.nMissingPackets++;
+        }
+        mHighestReceived=std::max(mHighestReceived,seq);
+        if(seq==mNextExpected){
+            // No need to copy the packet
+            mOnRTPPacket(data,data_length);
+            mNextExpected++;
+        }else{
+            mHeldBack.emplace(seq,HeldBackPacket{now,std::vector<uint8_t>(data,data+data_length)});
+        }
+        update(now);
+    }
+    // Give up on missing packets whose deadline passed, forward what can be forwarded and send NACKs
+    void update(const TimePoint now){
+        for(auto it=mMissing.begin();it!=mMissing.end();){
+            if(now-it->second.detected>=mOptions.maxDelay){
+                stats.nLostPackets++;
+                it=mMissing.erase(it);
+            }else{
+                ++it;
+            }
+        }
+        releaseInOrder(now);
+        std::vector<uint16_t> nack;
+        for(auto& missing:mMissing){
+            auto& packet=missing.second;
+            if(packet.nNacks>=mOptions.maxNacksPerPacket)continue;
+            if(packet.nNacks>0 && now-packet.lastNack<mOptions.retryInterval)continue;
+            packet.nNacks++;
+            packet.lastNack=now;
+            nack.push_back((uint16_t)missing.first);
+        }
+        if(!nack.empty()){
+            const auto rtcp=RTCPGenericNack::create(RECEIVER_SSRC,mMediaSSRC,nack);
+            mSendRTCP(rtcp.data(),rtcp.size());
+            stats.nNackMessages++;
+            stats.nRequestedPackets+=nack.size();
+        }
+    }
+    std::string getStatsAsString()const{
+        std::stringstream ss;
+        ss<<"missing:"<<stats.nMissingPackets<<" recovered:"<<stats.nRecoveredPackets<<" lost:"<<stats.nLostPackets
+          <<" too late:"<<stats.nTooLatePackets<<" NACKs:"<<stats.nNackMessages<<" ("<<stats.nRequestedPackets<<" packets)";
+        return ss.str();
+    }
+    Stats stats;
+    static constexpr uint32_t RECEIVER_SSRC=1;
+private:
+    struct MissingPacket{
+        TimePoint detected;
+        TimePoint lastNack;
+        int nNacks;
+    };
+    struct HeldBackPacket{
+        TimePoint received;
+        std::vector<uint8_t> data;
+    };
+    // Forward all held back packets up to the first packet that is still missing
+    void releaseInOrder(const TimePoint now){
+        while(mNextExpected<=mHighestReceived && mMissing.count(mNextExpected)==0){
+            const auto held=mHeldBack.find(mNextExpected);
+            if(held!=mHeldBack.end()){
+                stats.holdBackLatency.add(now-held->second.received);
+                mOnRTPPacket(held->second.data.data(),held->second.data.size());
+                mHeldBack.erase(held);
+            }
+            mNextExpected++;
+        }
+    }
+    void restart(const int64_t seq){
+        MLOGD<<"RTPNackReceiver: sequence number jump, restart";
+        for(auto& held:mHeldBack){
+            mOnRTPPacket(held.second.data.data(),held.second.data.size());
+        }
+        mHeldBack.clear();
+        mMissing.clear();
+        mNextExpected=seq;
+        mHighestReceived=seq-1;
+    }
+    const Options mOptions;
+    const RTP_CALLBACK mOnRTPPacket;
+    const RTCP_CALLBACK mSendRTCP;
+    uint32_t mMediaSSRC=0;
+    // Extended (not wrapping) sequence numbers
+    int64_t mNextExpected=-1;
+    int64_t mHighestReceived=-1;
+    std::map<int64_t,MissingPacket> mMissing;
+    std::map<int64_t,HeldBackPacket> mHeldBack;
+};
+
+#endif //LIVEVIDEO10MS_RTPRETRANSMISSION_HPP
@@ -0,0 +1,234 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#include "ParseRTP.h"
+#include "ParseRAW.h"
+#include "NetworkImpairment.hpp"
+#include <AndroidLogger.hpp>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*********************************************
+ ** Replays a raw h264 or h265 stream: NALUs -> RTPEncoder -> NetworkImpairment -> RTPDecoder
+ ** And reports how many frames survived the impaired link and how much latency the link added.
+ ** Each access unit gets its own (virtual) capture time, the report also checks that all rtp packets of one
+ ** access unit (e.g. all slices of a frame) carry the rtp timestamp of this capture time.
+ ** The whole replay runs on a virtual clock, e.g. the report only depends on the input and the options
+**********************************************/
+class TestImpairedRTP{
+public:
+    // aggregateParameterSets: h265 only, send VPS/SPS/PPS in one aggregation packet
+    TestImpairedRTP(const NetworkImpairment::Options& options,const int framerate,const bool isH265=false,const bool aggregateParameterSets=false):
+    FRAMERATE(framerate),
+    FRAME_INTERVAL_US(1000*1000/framerate),
+    IS_H265(isH265),
+    mImpairment(options,[this](const uint8_t* data,std::size_t data_length,int64_t deliveryTimeUs){
+        currentDeliveryTimeUs=deliveryTimeUs;
+        if(IS_H265){
+            decoder->parseRTPH265toNALU(data,data_length);
+        }else{
+            decoder->parseRTPH264toNALU(data,data_length);
+        }
+    }){
+        encoder=std::make_unique<RTPEncoder>([this](const RTPEncoder::RTPPacket& packet){
+            checkRTPTimestamp(packet);
+            mImpairment.input(packet.data,packet.data_len,currentTimeUs);
+        });
+        encoder->setAggregateParameterSetsH265(aggregateParameterSets);
+        decoder=std::make_unique<RTPDecoder>([this](const NALU& nalu){
+            onNALU(nalu);
+        });
+    }
+    // Feed the NALUs in the same order as they were produced by the encoder
+    void feed(const NALU& nalu){
+        if(nalu.getSize()<=6)return;
+        nNALUs++;
+        const bool isFrame=isFrameNALU(nalu);
+        if(mAccessUnitDetector.isFirstNALUOfAccessUnit(nalu.getData()+4,nalu.getSize()-4,IS_H265)){
+            // Each access unit is captured (and sent) FRAME_INTERVAL_US after the previous one
+            currentTimeUs+=FRAME_INTERVAL_US;
+            nAccessUnits++;
+            encoder->setAccessUnitCaptureTime(std::chrono::steady_clock::time_point(std::chrono::microseconds(currentTimeUs)));
+        }
+        mSentNALUs.push_back({currentTimeUs,nAccessUnits,isFrame,nalu.isIDR(),false,0});
+        mSentNALUsByContent.emplace(hash(nalu.getData(),nalu.getSize()),mSentNALUs.size()-1);
+        if(IS_H265){
+            encoder->parseNALtoRTPH265(FRAMERATE,nalu.getData(),nalu.getSize());
+        }else{
+            encoder->parseNALtoRTP(FRAMERATE,nalu.getData(),nalu.getSize());
+        }
+    }
+    // Deliver all packets still in flight and create the report
+    std::string finishAndGetReport(){
+        mImpairment.flush();
+        long nFrames=0,nIntactFrames=0,nDecodableFrames=0,nReceivedNALUs=0;
+        int64_t sumLatencyUs=0,maxLatencyUs=0;
+        for(const auto& sent:mSentNALUs){
+            if(sent.received)nReceivedNALUs++;
+        }
+        // One frame is one access unit. It is only intact if all its slices were received
+        struct Frame{
+            int64_t sendTimeUs;
+            bool isIDR;
+            bool intact;
+            int64_t receiveTimeUs;
+        };
+        std::vector<Frame> frames;
+        long lastAccessUnit=-1;
+        for(const auto& sent:mSentNALUs){
+            if(!sent.isFrame)continue;
+            if(sent.accessUnit!=lastAccessUnit){
+                frames.push_back({sent.sendTimeUs,false,true,0});
+                lastAccessUnit=sent.accessUnit;
+            }
+            Frame& frame=frames.back();
+            frame.isIDR=frame.isIDR || sent.isIDR;
+            frame.intact=frame.intact && sent.received;
+            frame.receiveTimeUs=std::max(frame.receiveTimeUs,sent.receiveTimeUs);
+        }
+        // A frame can only be decoded if it and all its reference frames (since the last IDR) were received
+        bool referenceChainBroken=true;
+        for(const auto& frame:frames){
+            nFrames++;
+            if(frame.isIDR){
+                referenceChainBroken=false;
+            }
+            if(!frame.intact){
+                referenceChainBroken=true;
+                continue;
+            }
+            nIntactFrames++;
+            if(!referenceChainBroken){
+                nDecodableFrames++;
+            }
+            const int64_t latencyUs=frame.receiveTimeUs-frame.sendTimeUs;
+            sumLatencyUs+=latencyUs;
+            maxLatencyUs=std::max(maxLatencyUs,latencyUs);
+        }
+        std::stringstream ss;
+        ss<<"Frames:"<<nFrames<<" intact:"<<nIntactFrames<<" decodable:"<<nDecodableFrames
+          <<" dropped:"<<(nFrames-nIntactFrames)<<" corrupted NALUs:"<<nCorruptedNALUs
+          <<"\nNALUs:"<<nNALUs<<" not received:"<<(nNALUs-nReceivedNALUs);
+        ss<<"\nAdded latency avg:"<<(nIntactFrames>0 ? sumLatencyUs/nIntactFrames : 0)<<"us max:"<<maxLatencyUs<<"us";
+        ss<<"\nLink "<<mImpairment.getStatsAsString()<<" missing (rtp seq):"<<decoder->getNMissingPackets();
+        ss<<"\nAggregation packets:"<<decoder->getNAggregationPackets()<<" NALUs:"<<decoder->getNAggregatedNALUs();
+        ss<<"\nAccess units:"<<nAccessUnits<<" RTP timestamps:"<<nRTPTimestamps<<" wrong RTP timestamps:"<<nWrongRTPTimestamps;
+        return ss.str();
+    }
+private:
+    struct SentNALU{
+        int64_t sendTimeUs;
+        // The access unit (frame) this NALU belongs to
+        long accessUnit;
+        bool isFrame;
+        bool isIDR;
+        bool received;
+        int64_t receiveTimeUs;
+    };
+    static bool isFrameNALU(const NALU& nalu){
+        if(nalu.IS_H265_PACKET){
+            // All VCL NAL unit types
+            return nalu.get_nal_unit_type()<32;
+        }
+        return nalu.get_nal_unit_type()==NAL_UNIT_TYPE_CODED_SLICE_NON_IDR || nalu.get_nal_unit_type()==NAL_UNIT_TYPE_CODED_SLICE_IDR;
+    }
+    static std::size_t hash(const uint8_t* data,const std::size_t data_length){
+        return std::hash<std::string_view>{}(std::string_view((const char*)data,data_length));
+    }
+    // The rtp timestamp has to match the capture time of the current access unit (90kHz)
+    void checkRTPTimestamp(const RTPEncoder::RTPPacket& packet){
+        const uint32_t timestamp=ntohl(((const rtp_header_t*)packet.data)->timestamp);
+        if(timestamp!=(uint32_t)(currentTimeUs*90/1000)){
+            nWrongRTPTimestamps++;
+        }
+        if(nRTPTimestamps==0 || timestamp!=lastRTPTimestamp){
+            nRTPTimestamps++;
+            lastRTPTimestamp=timestamp;
+        }
+    }
+    void onNALU(const NALU& nalu){
+        // Find the first NALU with the same content that was not received yet.
+        // Everything that does not match any sent NALU was corrupted on the link
+        const auto range=mSentNALUsByContent.equal_range(hash(nalu.getData(),nalu.getSize()));
+        for(auto it=range.first;it!=range.second;++it){
+            auto& sent=mSentNALUs[it->second];
+            if(!sent.received){
+                sent.received=true;
+                sent.receiveTimeUs=currentDeliveryTimeUs;
+                return;
+            }
+        }
+        nCorruptedNALUs++;
+    }
+    const int FRAMERATE;
+    const int64_t FRAME_INTERVAL_US;
+    const bool IS_H265;
+    NetworkImpairment mImpairment;
+    std::unique_ptr<RTPEncoder> encoder;
+    std::unique_ptr<RTPDecoder> decoder;
+    std::vector<SentNALU> mSentNALUs;
+    std::unordered_multimap<std::size_t,std::size_t> mSentNALUsByContent;
+    int64_t currentTimeUs=0;
+    int64_t currentDeliveryTimeUs=0;
+    long nCorruptedNALUs=0;
+    long nNALUs=0;
+    AccessUnitDetector mAccessUnitDetector;
+    long nAccessUnits=0;
+    // N of times the rtp timestamp changed, has to be equal to the n of access units
+    long nRTPTimestamps=0;
+    uint32_t lastRTPTimestamp=0;
+    long nWrongRTPTimestamps=0;
+};
+
+#ifdef __ANDROID__
+
+#include <jni.h>
+#include <android/asset_manager.h>
+#include <NDKHelper.hpp>
+//----------------------------------------------------JAVA bindings---------------------------------------------------------------
+#define JNI_METHOD(return_type, method_name) \
+  JNIEXPORT return_type JNICALL              \
+      Java_constantin_video_core_TestImpairedRTP_##method_name
+
+
+extern "C" {
+
+JNI_METHOD(jstring , nativeRunReplay)
+(JNIEnv *env, jclass jclass1,jobject context,jstring assetFilename,jboolean isH265,jboolean aggregateParameterSets,jint seed,jfloat lossProbability,jfloat geGoodToBad,jfloat geBadToGood,
+ jfloat reorderProbability,jint reorderDepth,jfloat duplicateProbability,jint jitterUs) {
+    NetworkImpairment::Options options{};
+    options.seed=(uint32_t)seed;
+    options.lossProbability=lossProbability;
+    options.geGoodToBad=geGoodToBad;
+    options.geBadToGood=geBadToGood;
+    options.reorderProbability=reorderProbability;
+    options.reorderDepth=reorderDepth;
+    options.duplicateProbability=duplicateProbability;
+    options.jitterUs=jitterUs;
+    TestImpairedRTP test(options,30,isH265,aggregateParameterSets);
+    ParseRAW parseRAW([&test](const NALU& nalu){
+        test.feed(nalu);
+    });
+    const char *str = env->GetStringUTFChars(assetFilename, nullptr);
+    AAssetManager *assetManager=NDKHelper::getAssetManagerFromContext2(env,context);
+    AAsset *asset = AAssetManager_open(assetManager,str,AASSET_MODE_BUFFER);
+    env->ReleaseStringUTFChars(assetFilename,str);
+    if(!asset){
+        return env->NewStringUTF("Cannot open asset");
+    }
+    std::vector<uint8_t> buffer(1024*1024);
+    while(true){
+        const auto len=AAsset_read(asset,buffer.data(),buffer.size());
+        if(len<=0)break;
+        parseRAW.parseData(buffer.data(),(size_t)len,isH265);
+    }
+    AAsset_close(asset);
+    const std::string report=test.finishAndGetReport();
+    MLOGD<<"TestImpairedRTP "<<report;
+    return env->NewStringUTF(report.c_str());
+}
+
+}
+#endif
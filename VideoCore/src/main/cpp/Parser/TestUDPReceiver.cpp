@@ -0,0 +1,217 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#include <UDPReceiver.h>
+#include "DiversityReceiver.hpp"
+#include <AndroidLogger.hpp>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+/*********************************************
+ ** Tests of the receive side that need real sockets (loopback interface).
+ ** Each test uses its own port(s), such that they can run one after another without waiting for the OS to release them
+**********************************************/
+namespace TestUDPReceiver{
+    // Sends to 127.0.0.1:port
+    class LoopbackSender{
+    public:
+        explicit LoopbackSender(const int port){
+            mSocket=socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+            mAddress.sin_family=AF_INET;
+            mAddress.sin_port=htons(port);
+            inet_pton(AF_INET,"127.0.0.1",&mAddress.sin_addr);
+        }
+        ~LoopbackSender(){
+            close(mSocket);
+        }
+        void send(const uint8_t* data,const size_t data_length){
+            sendto(mSocket,data,data_length,0,(sockaddr*)&mAddress,sizeof(mAddress));
+        }
+    private:
+        int mSocket;
+        sockaddr_in mAddress{};
+    };
+
+    // The biggest receive buffer the OS grants this process (as reported by getsockopt)
+    static size_t getMaxRcvBufSize(){
+        const int fd=socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+        const int wanted=1024*1024*1024;
+        setsockopt(fd,SOL_SOCKET,SO_RCVBUF,&wanted,sizeof(int));
+        int size=0;
+        socklen_t len=sizeof(size);
+        getsockopt(fd,SOL_SOCKET,SO_RCVBUF,&size,&len);
+        close(fd);
+        return (size_t)size;
+    }
+
+    /**
+     * While the receiver thread is blocked, a burst of packets overflows the socket receive buffer.
+     * Checks that the drops reported by the OS (SO_RXQ_OVFL) are exactly the packets that did not arrive,
+     * and that the receive buffer grew (unless it already was at the OS limit) without exceeding maxRcvBufSize
+     * (linux applies twice the requested size).
+     */
+    static std::string testKernelDrops(const int port,const int nBurstPackets,const size_t maxRcvBufSize){
+        enum PACKET_TYPE:uint8_t{PING,BURST,FLUSH};
+        std::atomic<long> nReceived[3]{{0},{0},{0}};
+        UDPReceiver receiver(nullptr,port,"T_UDP_R",0,[&nReceived](const uint8_t* data,size_t data_length){
+            if(data_length==0 || data[0]>FLUSH)return;
+            // Block the receiver thread on the first packet of the burst
+            if(data[0]==BURST && nReceived[BURST]==0){
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            }
+            nReceived[data[0]]++;
+        },0,maxRcvBufSize);
+        receiver.startReceiving();
+        LoopbackSender sender(port);
+        std::vector<uint8_t> packet(1024);
+        // Packets sent before the socket is bound are lost without being counted as drops
+        for(int i=0;i<1000 && nReceived[PING]==0;i++){
+            packet[0]=PING;
+            sender.send(packet.data(),packet.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const size_t rcvBufSizeBefore=receiver.getCurrentRcvBufSize();
+        for(int i=0;i<nBurstPackets;i++){
+            packet[0]=BURST;
+            sender.send(packet.data(),packet.size());
+        }
+        // The OS reports the drop counter with the next packet that is queued, the flush packets carry the final value
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        constexpr int N_FLUSH_PACKETS=10;
+        for(int i=0;i<N_FLUSH_PACKETS;i++){
+            packet[0]=FLUSH;
+            sender.send(packet.data(),packet.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        receiver.stopReceiving();
+        const size_t rcvBufSizeAfter=receiver.getCurrentRcvBufSize();
+        const long nLost=(nBurstPackets+N_FLUSH_PACKETS)-(nReceived[BURST]+nReceived[FLUSH]);
+        const long nKernelDrops=receiver.getNKernelDroppedPackets();
+        const size_t osMax=getMaxRcvBufSize();
+        const bool canGrow=rcvBufSizeBefore<std::min(maxRcvBufSize,osMax);
+        const bool growthOk=(canGrow ? rcvBufSizeAfter>rcvBufSizeBefore : rcvBufSizeAfter==rcvBufSizeBefore) &&
+                rcvBufSizeAfter<=std::max(rcvBufSizeBefore,2*maxRcvBufSize);
+        std::stringstream ss;
+        ss<<"burst:"<<nBurstPackets<<" received:"<<nReceived[BURST]<<" flush received:"<<nReceived[FLUSH]<<"\n";
+        ss<<"lost:"<<nLost<<" kernel drops:"<<nKernelDrops<<" match:"<<(nLost>0 && nLost==nKernelDrops ? "yes" : "no")<<"\n";
+        ss<<"rcvbuf before:"<<rcvBufSizeBefore<<" after:"<<rcvBufSizeAfter<<" max:"<<maxRcvBufSize<<" os max:"<<osMax;
+        ss<<" growth:"<<(growthOk ? "yes" : "no");
+        return ss.str();
+    }
+
+    /**
+     * Two paths deliver the same rtp stream to a DiversityReceiver. Each path loses some packets, the second path
+     * is two packets behind the first one and the first path also duplicates some packets. The sequence numbers wrap around.
+     * The packets are sent one at a time (the next one only after the receiver processed the last one), such that the
+     * expected output is exact: the first copy of each packet in the order it arrived, packets lost on both paths missing.
+     */
+    static std::string testDiversityReceiver(const int port0,const int port1,const int nPackets){
+        constexpr uint16_t FIRST_SEQ_NR=65500;
+        std::vector<uint16_t> forwarded;
+        DiversityReceiver receiver(nullptr,{port0,port1},0,[&forwarded](const uint8_t* data,size_t data_length){
+            // Called under the lock of the DiversityReceiver
+            forwarded.push_back(((const rtp_header_t*)data)->getSequence());
+        });
+        receiver.startReceiving();
+        LoopbackSender sender0(port0),sender1(port1);
+        std::vector<uint8_t> packet(sizeof(rtp_header_t)+100);
+        long nSentBytes=0;
+        // Returns false if the receiver did not process the packet in time
+        const auto send=[&](const int path,const uint16_t seqNr){
+            auto* header=(rtp_header_t*)packet.data();
+            header->version=2;
+            header->payload=96;
+            header->sequence=htons(seqNr);
+            (path==0 ? sender0 : sender1).send(packet.data(),packet.size());
+            nSentBytes+=packet.size();
+            for(int i=0;i<1000;i++){
+                if(receiver.getNReceivedBytes()==nSentBytes)return true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return false;
+        };
+        // Packets sent before the sockets are bound are lost, the warm up packet is the first of the stream on both paths
+        const uint16_t warmUpSeqNr=FIRST_SEQ_NR-1;
+        for(int path=0;path<2;path++){
+            bool received=false;
+            for(int i=0;i<100 && !received;i++){
+                nSentBytes=receiver.getNReceivedBytes();
+                received=send(path,warmUpSeqNr);
+            }
+        }
+        forwarded.clear();
+        std::vector<uint16_t> expected;
+        std::vector<bool> seen(nPackets,false);
+        bool inTime=true;
+        const auto sendAndExpect=[&](const int path,const int idx){
+            inTime=send(path,(uint16_t)(FIRST_SEQ_NR+idx)) && inTime;
+            if(!seen[idx]){
+                seen[idx]=true;
+                expected.push_back((uint16_t)(FIRST_SEQ_NR+idx));
+            }
+        };
+        constexpr int PATH1_DELAY=2;
+        for(int i=0;i<nPackets+PATH1_DELAY;i++){
+            if(i<nPackets && i%5!=1){
+                sendAndExpect(0,i);
+                if(i%11==0){
+                    sendAndExpect(0,i);
+                }
+            }
+            const int delayed=i-PATH1_DELAY;
+            if(delayed>=0 && delayed%7!=3){
+                sendAndExpect(1,delayed);
+            }
+        }
+        receiver.stopReceiving();
+        const long nLostOnBothPaths=std::count(seen.begin(),seen.end(),false);
+        std::vector<uint16_t> sorted=forwarded;
+        std::sort(sorted.begin(),sorted.end());
+        const long nDuplicates=sorted.size()-(std::unique(sorted.begin(),sorted.end())-sorted.begin());
+        std::stringstream ss;
+        ss<<"packets:"<<nPackets<<" forwarded:"<<forwarded.size()<<" expected:"<<expected.size()<<" lost on both paths:"<<nLostOnBothPaths;
+        ss<<" duplicates:"<<nDuplicates<<" in time:"<<(inTime ? "yes" : "no");
+        ss<<" order:"<<(inTime && forwarded==expected ? "yes" : "no");
+        ss<<receiver.getPathStatsAsString();
+        return ss.str();
+    }
+}
+
+#ifdef __ANDROID__
+
+#include <jni.h>
+//----------------------------------------------------JAVA bindings---------------------------------------------------------------
+#define JNI_METHOD(return_type, method_name) \
+  JNIEXPORT return_type JNICALL              \
+      Java_constantin_video_core_TestUDPReceiver_##method_name
+
+
+extern "C" {
+
+JNI_METHOD(jstring , nativeTestKernelDrops)
+(JNIEnv *env, jclass jclass1,jint nBurstPackets,jint maxRcvBufSizeKB) {
+    const std::string report=TestUDPReceiver::testKernelDrops(5710,nBurstPackets,(size_t)maxRcvBufSizeKB*1024);
+    MLOGD<<"TestKernelDrops\n"<<report;
+    return env->NewStringUTF(report.c_str());
+}
+
+JNI_METHOD(jstring , nativeTestDiversityReceiver)
+(JNIEnv *env, jclass jclass1,jint nPackets) {
+    const std::string report=TestUDPReceiver::testDiversityReceiver(5711,5712,nPackets);
+    MLOGD<<"TestDiversityReceiver\n"<<report;
+    return env->NewStringUTF(report.c_str());
+}
+
+}
+
+#endif
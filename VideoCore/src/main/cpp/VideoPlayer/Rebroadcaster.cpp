@@ -0,0 +1,185 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#include "Rebroadcaster.h"
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <AndroidLogger.hpp>
+#include <StringHelper.hpp>
+
+std::vector<Rebroadcaster::Destination> Rebroadcaster::parseDestinations(const std::string &destinations) {
+    std::vector<Destination> ret;
+    std::stringstream ss(destinations);
+    std::string entry;
+    while(std::getline(ss,entry,',')){
+        const auto separator=entry.find(':');
+        if(separator==std::string::npos){
+            MLOGE<<"Invalid rebroadcast destination "<<entry;
+            continue;
+        }
+        const std::string ip=entry.substr(0,separator);
+        const int port=std::atoi(entry.substr(separator+1).c_str());
+        in_addr tmp{};
+        if(port<=0 || port>UINT16_MAX || inet_pton(AF_INET,ip.c_str(),&tmp)!=1){
+            MLOGE<<"Invalid rebroadcast destination "<<entry;
+            continue;
+        }
+        ret.push_back({ip,port});
+    }
+    return ret;
+}
+
+Rebroadcaster::Rebroadcaster(const std::vector<Destination>& destinations,const VIDEO_DATA_TYPE videoDataType,const int WANTED_SNDBUFF_SIZE):
+    IS_RTP(videoDataType==VIDEO_DATA_TYPE::RTP_H264 || videoDataType==VIDEO_DATA_TYPE::RTP_H265),
+    IS_H265(videoDataType==VIDEO_DATA_TYPE::RTP_H265),
+    mDestinations(destinations){
+    mSocket=socket(AF_INET,SOCK_DGRAM,0);
+    if (mSocket < 0) {
+        MLOGE<<"Cannot create socket";
+    }
+    if(WANTED_SNDBUFF_SIZE!=0){
+        if(setsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, &WANTED_SNDBUFF_SIZE,sizeof(WANTED_SNDBUFF_SIZE))) {
+            MLOGD<<"Cannot increase buffer size to "<<StringHelper::memorySizeReadable(WANTED_SNDBUFF_SIZE);
+        }
+    }
+    for(const auto& destination:mDestinations){
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(destination.port);
+        inet_pton(AF_INET,destination.ip.c_str(), &address.sin_addr);
+        mAddresses.push_back(address);
+        mPrimed.push_back(false);
+        mStats.push_back(std::make_unique<DestinationStats>());
+        MLOGD<<"Rebroadcasting to "<<destination.ip<<":"<<destination.port;
+    }
+    mMessages.resize(mDestinations.size());
+    mMessageDestination.resize(mDestinations.size());
+    mPrimingEncoder=std::make_unique<RTPEncoder>([this](const RTPEncoder::RTPPacket& packet){
+        mPrimingPackets.emplace_back(packet.data,packet.data+packet.data_len);
+    });
+}
+
+Rebroadcaster::~Rebroadcaster() {
+    close(mSocket);
+}
+
+void Rebroadcaster::forward(const uint8_t *data,const size_t data_length) {
+    // Prime all destinations that are not primed yet as soon as all key frame data is available.
+    // Only rtp streams are primed, the other ones are forwarded right away
+    const bool isRTPPacket=data_length>=sizeof(rtp_header_t) && ((const rtp_header_t*)data)->version==2;
+    const bool primingPossible=isRTPPacket && mKeyFrameFinder.allKeyFramesAvailable(IS_H265) && !mKeyFrameFinder.getIDRFrame().empty();
+    // All messages point to the same data (the receive buffer)
+    iovec iov{const_cast<uint8_t*>(data),data_length};
+    std::size_t nMessages=0;
+    for(std::size_t i=0;i<mDestinations.size();i++){
+        if(IS_RTP && !mPrimed[i]){
+            if(!primingPossible){
+                // Without SPS/PPS/IDR the destination cannot decode anything anyways
+                continue;
+            }
+            primeDestination(i,*(const rtp_header_t*)data);
+        }
+        mmsghdr& msg=mMessages[nMessages];
+        msg={};
+        msg.msg_hdr.msg_name=&mAddresses[i];
+        msg.msg_hdr.msg_namelen=sizeof(sockaddr_in);
+        msg.msg_hdr.msg_iov=&iov;
+        msg.msg_hdr.msg_iovlen=1;
+        mMessageDestination[nMessages]=i;
+        nMessages++;
+    }
+    std::size_t idx=0;
+    while(idx<nMessages){
+        // sendmmsg() stops at the first message it cannot send. Count it as dropped and continue with the next one
+        const int result=sendmmsg(mSocket,&mMessages[idx],nMessages-idx,MSG_DONTWAIT);
+        const int nSent=result<0 ? 0 : result;
+        for(int i=0;i<nSent;i++){
+            auto& stats=*mStats[mMessageDestination[idx+i]];
+            stats.nSentPackets++;
+            stats.nSentBytes+=data_length;
+        }
+        idx+=nSent;
+        if(idx<nMessages){
+            mStats[mMessageDestination[idx]]->nDroppedPackets++;
+            idx++;
+        }
+    }
+}
+
+void Rebroadcaster::onNewNALU(const NALU &nalu) {
+    mKeyFrameFinder.saveIfKeyFrame(nalu);
+}
+
+void Rebroadcaster::createPrimingPackets() {
+    mPrimingPackets.clear();
+    // The timestamps are replaced by the one of the live stream, the framerate does not matter
+    constexpr int FRAMERATE=60;
+    const auto& idrFrame=mKeyFrameFinder.getIDRFrame();
+    if(IS_H265){
+        const NALU& vps=mKeyFrameFinder.getVPS();
+        const NALU& sps=mKeyFrameFinder.getCSD0();
+        const NALU& pps=mKeyFrameFinder.getCSD1();
+        mPrimingEncoder->parseNALtoRTPH265(FRAMERATE,vps.getData(),vps.getSize());
+        mPrimingEncoder->parseNALtoRTPH265(FRAMERATE,sps.getData(),sps.getSize());
+        mPrimingEncoder->parseNALtoRTPH265(FRAMERATE,pps.getData(),pps.getSize());
+        for(std::size_t i=0;i<idrFrame.size();i++){
+            mPrimingEncoder->parseNALtoRTPH265(FRAMERATE,idrFrame[i]->getData(),idrFrame[i]->getSize(),i+1==idrFrame.size());
+        }
+        return;
+    }
+    const NALU& sps=mKeyFrameFinder.getCSD0();
+    const NALU& pps=mKeyFrameFinder.getCSD1();
+    mPrimingEncoder->parseNALtoRTP(FRAMERATE,sps.getData(),sps.getSize());
+    mPrimingEncoder->parseNALtoRTP(FRAMERATE,pps.getData(),pps.getSize());
+    for(const auto& slice:idrFrame){
+        mPrimingEncoder->parseNALtoRTP(FRAMERATE,slice->getData(),slice->getSize());
+    }
+}
+
+void Rebroadcaster::primeDestination(const std::size_t idx,const rtp_header_t& liveHeader) {
+    createPrimingPackets();
+    // The priming packets take the sequence numbers right before the live packet, such that the receiver sees
+    // one continuous stream (no jump, no sequence number it already has in its duplicate window).
+    // The key frame is older than the live packet, its timestamp is one tick before the live one
+    const uint16_t firstSeqNr=liveHeader.getSequence()-(uint16_t)mPrimingPackets.size();
+    const uint32_t timestamp=liveHeader.getTimestamp()-1;
+    auto& stats=*mStats[idx];
+    for(std::size_t i=0;i<mPrimingPackets.size();i++){
+        auto& packet=mPrimingPackets[i];
+        auto* header=(rtp_header_t*)packet.data();
+        header->sequence=htons((uint16_t)(firstSeqNr+i));
+        header->timestamp=htonl(timestamp);
+        header->sources=liveHeader.sources;
+        const auto result=sendto(mSocket,packet.data(),packet.size(),MSG_DONTWAIT,(sockaddr*)&mAddresses[idx],sizeof(sockaddr_in));
+        if(result<0){
+            stats.nDroppedPackets++;
+        }else{
+            stats.nSentPackets++;
+            stats.nSentBytes+=packet.size();
+        }
+    }
+    mPrimed[idx]=true;
+    MLOGD<<"Primed "<<mDestinations[idx].ip<<":"<<mDestinations[idx].port<<" with "<<mPrimingPackets.size()<<" packets";
+}
+
+std::string Rebroadcaster::getStatsAsString() {
+    const auto now=std::chrono::steady_clock::now();
+    const float deltaS=std::chrono::duration_cast<std::chrono::milliseconds>(now-mLastReport).count()/1000.0f;
+    mLastReport=now;
+    std::stringstream ss;
+    for(std::size_t i=0;i<mDestinations.size();i++){
+        auto& stats=*mStats[i];
+        const long nSentBytes=stats.nSentBytes;
+        const float rateMBits= deltaS>0 ? (nSentBytes-stats.nSentBytesLastReport)*8/1024.0f/1024.0f/deltaS : 0;
+        stats.nSentBytesLastReport=nSentBytes;
+        ss<<"\nRebroadcast "<<mDestinations[i].ip<<":"<<mDestinations[i].port
+          <<" sent: "<<stats.nSentPackets<<" ("<<StringHelper::memorySizeReadable(nSentBytes)<<")"
+          <<" rate: "<<rateMBits<<" MBit/s"
+          <<" dropped: "<<stats.nDroppedPackets;
+    }
+    return ss.str();
+}
@@ -0,0 +1,74 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_REBROADCASTER_H
+#define LIVEVIDEO10MS_REBROADCASTER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "../NALU/KeyFrameFinder.hpp"
+#include "../Parser/ParseRTP.h"
+#include "VideoDataType.hpp"
+
+/**
+ * Forwards the received datagrams to N other devices in the LAN (e.g. a second display or a recorder box).
+ * The datagrams are sent with one sendmmsg() call directly from the receive buffer, e.g. without copying.
+ * For rtp h264 / h265 streams a destination only receives the live stream after it was 'primed' with the latest
+ * (VPS)/SPS/PPS/IDR, such that it can start decoding immediately instead of waiting for the next key frame.
+ * The priming packets continue the live stream (same SSRC, sequence numbers right before the next live packet).
+ * Other streams (raw, rtp inside FEC) are forwarded as they are, without priming.
+ * Not thread safe except getStatsAsString(), e.g. call forward() and onNewNALU() from the receiver thread only.
+ */
+class Rebroadcaster{
+public:
+    struct Destination{
+        std::string ip;
+        int port;
+    };
+    // Parse a list of destinations in the form "192.168.0.2:5600,192.168.0.3:5600". Invalid entries are skipped
+    static std::vector<Destination> parseDestinations(const std::string& destinations);
+    Rebroadcaster(const std::vector<Destination>& destinations,VIDEO_DATA_TYPE videoDataType,const int WANTED_SNDBUFF_SIZE=1024*1024);
+    ~Rebroadcaster();
+    // Send one datagram to all destinations that are already primed. Never blocks, if the OS cannot
+    // take the datagram for a destination it is counted as dropped for this destination
+    void forward(const uint8_t* data,size_t data_length);
+    // Feed the parsed NALUs such that the latest SPS/PPS/IDR are available for priming
+    void onNewNALU(const NALU& nalu);
+    // Send rate and drops for each destination. Call this regularly (e.g. from the UI) since the rate is
+    // calculated over the time since the last call
+    std::string getStatsAsString();
+private:
+    struct DestinationStats{
+        std::atomic<long> nSentPackets=0;
+        std::atomic<long> nSentBytes=0;
+        std::atomic<long> nDroppedPackets=0;
+        // only accessed in getStatsAsString()
+        long nSentBytesLastReport=0;
+    };
+    // Send the cached (VPS)/SPS/PPS/IDR to one destination. liveHeader is the header of the live rtp packet that is forwarded next
+    void primeDestination(std::size_t idx,const rtp_header_t& liveHeader);
+    // Packetize the cached key frame data into mPrimingPackets
+    void createPrimingPackets();
+    const bool IS_RTP;
+    const bool IS_H265;
+    int mSocket;
+    std::vector<Destination> mDestinations;
+    std::vector<sockaddr_in> mAddresses;
+    std::vector<bool> mPrimed;
+    std::vector<std::unique_ptr<DestinationStats>> mStats;
+    // Re-used for each sendmmsg() call
+    std::vector<mmsghdr> mMessages;
+    std::vector<std::size_t> mMessageDestination;
+    KeyFrameFinder mKeyFrameFinder{true};
+    std::unique_ptr<RTPEncoder> mPrimingEncoder;
+    std::vector<std::vector<uint8_t>> mPrimingPackets;
+    std::chrono::steady_clock::time_point mLastReport=std::chrono::steady_clock::now();
+};
+
+#endif //LIVEVIDEO10MS_REBROADCASTER_H
@@ -0,0 +1,11 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_VIDEODATATYPE_HPP
+#define LIVEVIDEO10MS_VIDEODATATYPE_HPP
+
+// What the received video data contains. Same values as VS_PROTOCOL (see entriesVideoStream)
+enum VIDEO_DATA_TYPE{RTP_H264,RAW_h264,RTP_H265,RAW_H265,CUSTOM,CUSTOM2,DJI};
+
+#endif //LIVEVIDEO10MS_VIDEODATATYPE_HPP
@@ -70,6 +70,9 @@ void VideoPlayer::onNewNALU(const NALU& nalu){
     //if(!nalu.IS_H265_PACKET){
     //     mTestEncodeDecodeRTP.testEncodeDecodeRTP(nalu);
     //}
+    if(mRebroadcaster){
+        mRebroadcaster->onNewNALU(nalu);
+    }
     if(VS_ENABLE_H264_SPS_VUI_FIX && nalu.isSPS()){
         if(nalu.IS_H265_PACKET){
             // no fixups for H265 yet (TODO)
@@ -139,11 +142,70 @@ void VideoPlayer::start(JNIEnv *env,jobject androidContext) {
     switch (VS_SOURCE){
         case UDP:{
             const int VS_PORT=5600;
-            // const int VS_PROTOCOL= mVideoSettings.getInt(IDV::VS_PROTOCOL);
-            const auto videoDataType=VIDEO_DATA_TYPE::RTP_H264;
+            // Same values as VIDEO_DATA_TYPE (see entriesVideoStream)
+            const auto videoDataType=static_cast<VIDEO_DATA_TYPE>(mVideoSettings.getInt(IDV::VS_PROTOCOL,VIDEO_DATA_TYPE::RTP_H264));
+            // Forward the received datagrams to other devices in the LAN if enabled
+            const auto rebroadcastDestinations=Rebroadcaster::parseDestinations(mVideoSettings.getString(IDV::VS_REBROADCAST_DESTINATIONS));
+            if(!rebroadcastDestinations.empty()){
+                mRebroadcaster=std::make_unique<Rebroadcaster>(rebroadcastDestinations,videoDataType);
+            }
+            // If set, the same rtp stream is also expected on a 2nd port (e.g. from a 2nd radio) and merged with the 1st one
+            const int VS_DIVERSITY_PORT=mVideoSettings.getInt(IDV::VS_DIVERSITY_PORT,0);
+            if(VS_DIVERSITY_PORT!=0 && VS_DIVERSITY_PORT!=VS_PORT){
+                mDiversityReceiver=std::make_unique<DiversityReceiver>(javaVm,std::vector<int>{VS_PORT,VS_DIVERSITY_PORT}, FPV_VR_PRIORITY::CPU_PRIORITY_UDPRECEIVER_VIDEO, [this,videoDataType](const uint8_t* data, size_t data_length) {
+                    if(mRebroadcaster){
+                        mRebroadcaster->forward(data,data_length);
+                    }
+                    onNewVideoData(data,data_length,videoDataType);
+                }, WANTED_UDP_RCVBUF_SIZE,MAX_UDP_RCVBUF_SIZE);
+                mDiversityReceiver->startReceiving();
+                break;
+            }
+            // Request lost packets from the sender if enabled
+            const int VS_RTP_NACK_MAX_DELAY_MS=mVideoSettings.getInt(IDV::VS_RTP_NACK_MAX_DELAY_MS,0);
+            if(VS_RTP_NACK_MAX_DELAY_MS>0){
+                RTPNackReceiver::Options options{};
+                options.maxDelay=std::chrono::milliseconds(VS_RTP_NACK_MAX_DELAY_MS);
+                mNackReceiver=std::make_unique<RTPNackReceiver>(options,[this,videoDataType](const uint8_t* data, size_t data_length){
+                    onNewVideoData(data,data_length,videoDataType);
+                },[this](const uint8_t* data, size_t data_length){
+                    mUDPReceiver->sendToSource(data,data_length);
+                });
+            }
+            // Report the loss of the 'rtp inside FEC' stream to the sender if enabled
+            const int VS_FEC_LOSS_REPORT_INTERVAL_MS=mVideoSettings.getInt(IDV::VS_FEC_LOSS_REPORT_INTERVAL_MS,0);
+            if(VS_FEC_LOSS_REPORT_INTERVAL_MS>0 && videoDataType==VIDEO_DATA_TYPE::CUSTOM2){
+                FECLossMonitor::Options options{};
+                options.reportInterval=std::chrono::milliseconds(VS_FEC_LOSS_REPORT_INTERVAL_MS);
+                mFECLossMonitor=std::make_unique<FECLossMonitor>(options);
+            }
             mUDPReceiver=std::make_unique<UDPReceiver>(javaVm,VS_PORT, "V_UDP_R", FPV_VR_PRIORITY::CPU_PRIORITY_UDPRECEIVER_VIDEO, [this,videoDataType](const uint8_t* data, size_t data_length) {
-                onNewVideoData(data,data_length,videoDataType);
-            }, WANTED_UDP_RCVBUF_SIZE);
+                if(mRebroadcaster){
+                    mRebroadcaster->forward(data,data_length);
+                }
+                if(mFECLossMonitor){
+                    mFECLossMonitor->input(data,data_length);
+                    RTCPFECLossReport::Report report;
+                    if(mFECLossMonitor->getReport(std::chrono::steady_clock::now(),report)){
+                        const auto rtcp=RTCPFECLossReport::create(FECLossMonitor::RECEIVER_SSRC,report);
+                        mUDPReceiver->sendToSource(rtcp.data(),rtcp.size());
+                    }
+                }
+                if(mNackReceiver){
+                    mNackReceiver->input(data,data_length,std::chrono::steady_clock::now());
+                }else{
+                    onNewVideoData(data,data_length,videoDataType);
+                }
+            }, WANTED_UDP_RCVBUF_SIZE,MAX_UDP_RCVBUF_SIZE);
+            // Data held back for missing packets has to be released even if no more packets arrive
+            mUDPReceiver->registerOnTimerTick([this,videoDataType](){
+                if(videoDataType==VIDEO_DATA_TYPE::CUSTOM2){
+                    mParser.releaseExpiredFECBlocks();
+                }
+                if(mNackReceiver){
+                    mNackReceiver->update(std::chrono::steady_clock::now());
+                }
+            },RECEIVER_TIMER_INTERVAL);
             mUDPReceiver->startReceiving();
         }break;
         case FILE:
@@ -151,14 +213,21 @@ void VideoPlayer::start(JNIEnv *env,jobject androidContext) {
             const bool useAsset=VS_SOURCE==ASSETS;
             const std::string filename = useAsset ? mVideoSettings.getString(IDV::VS_ASSETS_FILENAME_TEST_ONLY, "testVideo.h264") :
                                          mVideoSettings.getString(IDV::VS_PLAYBACK_FILENAME);
-            if(!FileHelper::endsWith(filename, ".fpv")){
+            const bool isPcap=FileHelper::endsWith(filename, ".pcap") || FileHelper::endsWith(filename, ".pcapng");
+            // .fpv and network captures have their own timing
+            if(!FileHelper::endsWith(filename, ".fpv") && !isPcap){
                 mParser.setLimitFPS(VS_FILE_ONLY_LIMIT_FPS);
             }
-            const auto cb=[this](const uint8_t *data, size_t data_length,GroundRecorderFPV::PACKET_TYPE packetType) {
+            // How to interpret the UDP payloads of a network capture (same as for the UDP source)
+            const auto pcapVideoDataType=static_cast<VIDEO_DATA_TYPE>(mVideoSettings.getInt(IDV::VS_PCAP_PAYLOAD_TYPE,VIDEO_DATA_TYPE::RTP_H264));
+            mFileReceiver.setPcapOptions(mVideoSettings.getInt(IDV::VS_PCAP_UDP_PORT,5600),mVideoSettings.getFloat(IDV::VS_PCAP_SPEED,1.0f));
+            const auto cb=[this,pcapVideoDataType](const uint8_t *data, size_t data_length,GroundRecorderFPV::PACKET_TYPE packetType) {
                 if (packetType == GroundRecorderFPV::PACKET_TYPE_VIDEO_H264) {
                     onNewVideoData(data, data_length,VIDEO_DATA_TYPE::RAW_h264);
                 }else if(packetType == GroundRecorderFPV::PACKET_TYPE_VIDEO_H265){
                     onNewVideoData(data, data_length,VIDEO_DATA_TYPE::RAW_H265);
+                }else if(packetType == GroundRecorderFPV::PACKET_TYPE_UDP_PAYLOAD){
+                    onNewVideoData(data, data_length,pcapVideoDataType);
                 }
             };
             mFileReceiver.setCallBack(0,cb);
@@ -196,6 +265,14 @@ void VideoPlayer::stop(JNIEnv *env,jobject androidContext) {
         mUDPReceiver->stopReceiving();
         mUDPReceiver.reset();
     }
+    if(mDiversityReceiver){
+        mDiversityReceiver->stopReceiving();
+        mDiversityReceiver.reset();
+    }
+    // Only safe to delete after the receiver(s) have been stopped
+    mRebroadcaster.reset();
+    mNackReceiver.reset();
+    mFECLossMonitor.reset();
     mFileReceiver.stopReadingIfStarted();
     if(mFFMpegVideoReceiver){
         mFFMpegVideoReceiver->shutdown_callback();
@@ -212,6 +289,23 @@ std::string VideoPlayer::getInfoString()const{
         ss << "\nReceived: " << mUDPReceiver->getNReceivedBytes() << "B"
            << " | parsed frames: "
            << mParser.nParsedNALUs << " | key frames: " << mParser.nParsedKonfigurationFrames;
+        // Distinguish between packets lost on the link and packets dropped on this device
+        ss << "\nLost (link): " << mParser.getNMissingRTPPackets()
+           << " | dropped (rcvbuf full): " << mUDPReceiver->getNKernelDroppedPackets()
+           << " | rcvbuf: " << StringHelper::memorySizeReadable(mUDPReceiver->getCurrentRcvBufSize());
+        ss << "\nAggregation packets: " << mParser.getNRTPAggregationPackets() << " (" << mParser.getNRTPAggregatedNALUs() << " NALUs)";
+        if(mNackReceiver){
+            ss << "\nNACK " << mNackReceiver->getStatsAsString();
+        }
+    }else if(mDiversityReceiver){
+        ss << "Listening for video on multiple ports (diversity)";
+        ss << "\nReceived: " << mDiversityReceiver->getNReceivedBytes() << "B"
+           << " | parsed frames: "
+           << mParser.nParsedNALUs << " | key frames: " << mParser.nParsedKonfigurationFrames;
+        ss << "\nLost (all paths): " << mParser.getNMissingRTPPackets()
+           << " | dropped (rcvbuf full): " << mDiversityReceiver->getNKernelDroppedPackets();
+        ss << "\nAggregation packets: " << mParser.getNRTPAggregationPackets() << " (" << mParser.getNRTPAggregatedNALUs() << " NALUs)";
+        ss << mDiversityReceiver->getPathStatsAsString();
     }else if(mFFMpegVideoReceiver){
         ss << "Connecting to "<<mFFMpegVideoReceiver->m_url;
         ss << "\n"<<mFFMpegVideoReceiver->currentErrorMessage;
@@ -221,6 +315,9 @@ std::string VideoPlayer::getInfoString()const{
     }else{
         ss << "Not receiving udp raw / rtp / rtsp";
     }
+    if(mRebroadcaster){
+        ss << mRebroadcaster->getStatsAsString();
+    }
     return ss.str();
 }
 
@@ -289,6 +386,9 @@ JNI_METHOD(jstring , getVideoInfoString)
 JNI_METHOD(jboolean , anyVideoDataReceived)
 (JNIEnv *env,jclass jclass1,jlong testReceiverN) {
     VideoPlayer* p=native(testReceiverN);
+    if(p->mDiversityReceiver){
+        return (jboolean) (p->mDiversityReceiver->getNReceivedBytes() > 0);
+    }
     if(p->mUDPReceiver== nullptr){
         return (jboolean) false;
     }
@@ -302,6 +402,9 @@ JNI_METHOD(jboolean , receivingVideoButCannotParse)
     if(p->mUDPReceiver){
         return (jboolean) (p->mUDPReceiver->getNReceivedBytes() > 1024 * 1024 && p->mParser.nParsedNALUs == 0);
     }
+    if(p->mDiversityReceiver){
+        return (jboolean) (p->mDiversityReceiver->getNReceivedBytes() > 1024 * 1024 && p->mParser.nParsedNALUs == 0);
+    }
     return (jboolean) false;
 }
 
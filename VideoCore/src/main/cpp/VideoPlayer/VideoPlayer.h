@@ -15,11 +15,16 @@
 #include "../Experiment360/FFMPEGFileWriter.h"
 #include "../Decoder/LowLagDecoder.h"
 #include "../Parser/H26XParser.h"
+#include "../Parser/DiversityReceiver.hpp"
+#include "../Parser/RTPRetransmission.hpp"
+#include "../Parser/FECLossReport.hpp"
+#include "Rebroadcaster.h"
+#include "VideoDataType.hpp"
 
 class VideoPlayer{
 public:
     VideoPlayer(JNIEnv * env, jobject context, const char* DIR);
-    enum VIDEO_DATA_TYPE{RTP_H264,RAW_h264,RTP_H265,RAW_H265,CUSTOM,CUSTOM2,DJI};
+    using VIDEO_DATA_TYPE=::VIDEO_DATA_TYPE;
     void onNewVideoData(const uint8_t* data,const std::size_t data_length,const VIDEO_DATA_TYPE videoDataType);
     /*
      * Set the surface the decoder can be configured with. When @param surface==nullptr
@@ -43,6 +48,10 @@ private:
     //Assumptions: Max bitrate: 40 MBit/s, Max time to buffer: 100ms
     //5 MB should be plenty !
     static constexpr const size_t WANTED_UDP_RCVBUF_SIZE=1024*1024*5;
+    // If the OS still drops packets because the receive buffer is full, grow it up to this size
+    static constexpr const size_t MAX_UDP_RCVBUF_SIZE=1024*1024*20;
+    // How often the UDP receiver thread checks for held back data when no packets arrive
+    static constexpr const std::chrono::milliseconds RECEIVER_TIMER_INTERVAL{5};
     //Retreive settings from shared preferences
     SharedPreferences mVideoSettings;
     enum SOURCE_TYPE_OPTIONS{UDP,FILE,ASSETS,VIA_FFMPEG_URL,EXTERNAL};
@@ -54,6 +63,14 @@ public:
     LowLagDecoder mLowLagDecoder;
     std::unique_ptr<FFMpegVideoReceiver> mFFMpegVideoReceiver;
     std::unique_ptr<UDPReceiver> mUDPReceiver;
+    // Optional, between mUDPReceiver and the parser
+    std::unique_ptr<RTPNackReceiver> mNackReceiver;
+    // Optional, reports the loss of the 'rtp inside FEC' stream back to the sender (adaptive FEC)
+    std::unique_ptr<FECLossMonitor> mFECLossMonitor;
+    // Only used instead of mUDPReceiver when VS_DIVERSITY_PORT is set
+    std::unique_ptr<DiversityReceiver> mDiversityReceiver;
+    // Only created when VS_REBROADCAST_DESTINATIONS is set
+    std::unique_ptr<Rebroadcaster> mRebroadcaster;
     long nNALUsAtLastCall=0;
 public:
     DecodingInfo latestDecodingInfo{};
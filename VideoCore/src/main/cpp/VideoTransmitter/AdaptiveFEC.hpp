@@ -0,0 +1,108 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_ADAPTIVEFEC_HPP
+#define LIVEVIDEO10MS_ADAPTIVEFEC_HPP
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <optional>
+#include "../Parser/FECLossReport.hpp"
+
+/*********************************************
+ ** Adapts the FEC overhead of the VideoTransmitter to the loss the receiver reports (see FECLossReport.hpp).
+ ** The loss rate and the mean burst length are smoothed over the last reports. The needed overhead covers the mean loss
+ ** of a FEC group plus a margin of a few standard deviations. Burst loss increases the variance of the n of lost
+ ** packets per group, e.g. it needs a bigger margin than random loss of the same rate.
+ ** Increases are applied at once. Decreases only once the needed overhead stayed below the current one by more than
+ ** the hysteresis for decreaseHoldTime. The overhead always stays within [minOverhead,maxOverhead]. Not thread safe.
+**********************************************/
+class AdaptiveFEC{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    struct Options{
+        // 0.5 means 50% more data is sent
+        float minOverhead=0.1f;
+        float maxOverhead=1.5f;
+        // Data blocks of a typical FEC group, the smaller the group the bigger the margin
+        int typicalGroupBlocks=16;
+        // Standard deviations of the n of lost packets per group that are covered
+        float margin=2.0f;
+        float hysteresis=0.25f;
+        std::chrono::milliseconds decreaseHoldTime=std::chrono::milliseconds(2000);
+        // Weight of the newest report
+        float smoothing=0.3f;
+    };
+    AdaptiveFEC(const Options& options,const float initialOverhead):
+    mOptions(options),
+    mOverhead(std::clamp(initialOverhead,options.minOverhead,options.maxOverhead)){}
+    // Returns true if the overhead changed
+    bool onReport(const RTCPFECLossReport::Report& report,const TimePoint now){
+        if(report.nExpected==0)return false;
+        nReports++;
+        const float lossRate=std::min((float)report.nLost/report.nExpected,1.0f);
+        const float burstLength=report.nBursts>0 ? (float)report.nLost/report.nBursts : 1.0f;
+        if(nReports==1){
+            mLossRate=lossRate;
+            mBurstLength=burstLength;
+        }else{
+            mLossRate+=(lossRate-mLossRate)*mOptions.smoothing;
+            // Without losses nothing is known about the bursts
+            if(report.nLost>0){
+                mBurstLength+=(burstLength-mBurstLength)*mOptions.smoothing;
+            }
+        }
+        const float needed=std::clamp(neededOverhead(mLossRate,mBurstLength,mOptions.typicalGroupBlocks,mOptions.margin),
+                                      mOptions.minOverhead,mOptions.maxOverhead);
+        if(needed>mOverhead){
+            mOverhead=needed;
+            mBelowSince.reset();
+            return true;
+        }
+        if(needed>=mOverhead*(1-mOptions.hysteresis)){
+            mBelowSince.reset();
+            return false;
+        }
+        if(!mBelowSince){
+            mBelowSince=now;
+        }
+        if(now-*mBelowSince<mOptions.decreaseHoldTime){
+            return false;
+        }
+        // Stay a bit above the needed overhead, the next small increase of the loss does not change the overhead again
+        mOverhead=std::max(needed*(1+mOptions.hysteresis/2),mOptions.minOverhead);
+        mOverhead=std::min(mOverhead,mOptions.maxOverhead);
+        mBelowSince.reset();
+        return true;
+    }
+    float getOverhead()const{
+        return mOverhead;
+    }
+    /**
+     * Overhead that recovers a group of groupBlocks data blocks unless more than margin standard deviations of packets
+     * are lost. With Gilbert-Elliott loss of mean burst length b the variance of the n of lost packets is about (2b-1)
+     * times the one of random loss.
+     */
+    static float neededOverhead(const float lossRate,const float burstLength,const int groupBlocks,const float margin){
+        const float p=std::clamp(lossRate,0.0f,0.9f);
+        const float variance=p*(1-p)*std::max(2*burstLength-1,1.0f)/std::max(groupBlocks,1);
+        return (p+margin*std::sqrt(variance))/(1-p);
+    }
+    std::string getStatsAsString()const{
+        std::stringstream ss;
+        ss<<"Adaptive FEC overhead:"<<mOverhead<<" loss:"<<mLossRate<<" burst length:"<<mBurstLength<<" reports:"<<nReports;
+        return ss.str();
+    }
+private:
+    const Options mOptions;
+    float mOverhead;
+    float mLossRate=0;
+    float mBurstLength=1;
+    long nReports=0;
+    std::optional<TimePoint> mBelowSince;
+};
+
+#endif //LIVEVIDEO10MS_ADAPTIVEFEC_HPP
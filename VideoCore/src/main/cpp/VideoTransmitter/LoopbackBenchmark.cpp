@@ -0,0 +1,262 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#include "VideoTransmitter.h"
+#include "../Parser/H26XParser.h"
+#include "../Parser/ParseRAW.h"
+#include <AndroidLogger.hpp>
+#include <UDPReceiver.h>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <ctime>
+#include <algorithm>
+#include <cstring>
+
+/*********************************************
+ ** End to end benchmark of the whole live video path on one device:
+ ** NALUs of a test video -> VideoTransmitter (raw, rtp or rtp inside FEC) -> loopback -> UDPReceiver -> H26XParser -> null sink.
+ ** Reports the throughput, the one-way latency of each NALU (from handing it to the VideoTransmitter until the parser
+ ** outputs it), the CPU time (sender and receiver together) per MB of video data and checks that each received NALU is
+ ** bit-exact the same as the sent one.
+ ** Note: The raw parser can only output a NALU once the start code of the next one arrives, its latency includes the
+ ** time until the next NALU is sent.
+**********************************************/
+class LoopbackBenchmark{
+public:
+    // Same as the stream modes of the VideoPlayer (only the ones the VideoTransmitter can send)
+    enum class Mode{RAW=0,RTP=1,RTP_FEC=2};
+    struct Options{
+        Mode mode=Mode::RTP;
+        bool isH265=false;
+        // 0: Send the NALUs as fast as possible, else pace them per access unit (frame)
+        int fps=0;
+    };
+    static std::string run(const std::vector<uint8_t>& video,const Options& options){
+        if(options.mode==Mode::RTP_FEC && options.isH265){
+            return "RTP inside FEC is only supported for h264";
+        }
+        // Split the video into NALUs before the benchmark starts
+        std::vector<std::vector<uint8_t>> nalus;
+        ParseRAW parseRAW([&nalus](const NALU& nalu){
+            if(nalu.getSize()<=6)return;
+            nalus.emplace_back(nalu.getData(),nalu.getData()+nalu.getSize());
+        });
+        parseRAW.parseData(video.data(),video.size(),options.isH265);
+        if(nalus.empty()){
+            return "No NALUs found";
+        }
+        struct SentNALU{
+            int64_t sendTimeUs=0;
+            bool received=false;
+            int64_t receiveTimeUs=0;
+        };
+        std::vector<SentNALU> sent(nalus.size());
+        std::unordered_multimap<std::size_t,std::size_t> sentByContent;
+        std::size_t nBytes=0;
+        for(std::size_t i=0;i<nalus.size();i++){
+            sentByContent.emplace(hash(nalus[i].data(),nalus[i].size()),i);
+            nBytes+=nalus[i].size();
+        }
+        // Only the receiver thread writes the received NALUs, the sender thread only polls the count
+        std::atomic<long> nReceived{0};
+        long nCorruptedNALUs=0;
+        H26XParser parser([&](const NALU& nalu){
+            const int64_t nowUs=getTimeUs();
+            // Find the first NALU with the same content that was not received yet
+            const auto range=sentByContent.equal_range(hash(nalu.getData(),nalu.getSize()));
+            for(auto it=range.first;it!=range.second;++it){
+                if(sent[it->second].received)continue;
+                const auto& data=nalus[it->second];
+                if(data.size()!=nalu.getSize() || std::memcmp(data.data(),nalu.getData(),data.size())!=0)continue;
+                sent[it->second].received=true;
+                sent[it->second].receiveTimeUs=nowUs;
+                nReceived++;
+                return;
+            }
+            nCorruptedNALUs++;
+        });
+        parser.setLimitFPS(-1);
+        UDPReceiver receiver(nullptr,PORT,"LoopbackBenchmark",0,[&parser,&options](const uint8_t* data,size_t data_length){
+            switch(options.mode){
+                case Mode::RAW:
+                    if(options.isH265){
+                        parser.parse_raw_h265_stream(data,data_length);
+                    }else{
+                        parser.parse_raw_h264_stream(data,data_length);
+                    }
+                    break;
+                case Mode::RTP:
+                    if(options.isH265){
+                        parser.parse_rtp_h265_stream(data,data_length);
+                    }else{
+                        parser.parse_rtp_h264_stream(data,data_length);
+                    }
+                    break;
+                case Mode::RTP_FEC:
+                    parser.parseCustomRTPinsideFEC(data,data_length);
+                    break;
+            }
+        },WANTED_RCVBUF_SIZE,MAX_RCVBUF_SIZE);
+        receiver.startReceiving();
+        // Make sure the receiver thread has opened the port before sending
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        VideoTransmitter transmitter("127.0.0.1",PORT);
+        transmitter.DO_FEC_WRAPPING=options.mode==Mode::RTP_FEC;
+        AccessUnitDetector accessUnitDetector;
+        const int64_t frameIntervalUs=options.fps>0 ? 1000*1000/options.fps : 0;
+        const int64_t startUs=getTimeUs();
+        const int64_t startCPUTimeUs=getProcessCPUTimeUs();
+        int64_t captureTimeUs=startUs;
+        long nAccessUnits=0;
+        for(std::size_t i=0;i<nalus.size();i++){
+            const auto& nalu=nalus[i];
+            if(accessUnitDetector.isFirstNALUOfAccessUnit(nalu.data()+4,nalu.size()-4,options.isH265)){
+                if(frameIntervalUs>0){
+                    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(startUs+nAccessUnits*frameIntervalUs)));
+                }
+                captureTimeUs=getTimeUs();
+                nAccessUnits++;
+            }
+            sent[i].sendTimeUs=getTimeUs();
+            switch(options.mode){
+                case Mode::RAW:
+                    transmitter.splitAndSend(nalu.data(),nalu.size());
+                    break;
+                case Mode::RTP:
+                case Mode::RTP_FEC:
+                    if(options.isH265){
+                        transmitter.RTPSendH265(nalu.data(),nalu.size(),captureTimeUs);
+                    }else{
+                        transmitter.RTPSend(nalu.data(),nalu.size(),captureTimeUs);
+                    }
+                    break;
+            }
+        }
+        if(options.mode==Mode::RAW){
+            // The raw parser outputs the last NALU once it sees the next start code
+            const uint8_t START_CODE[4]={0,0,0,1};
+            transmitter.splitAndSend(START_CODE,sizeof(START_CODE));
+        }
+        // Wait until all NALUs were received or nothing arrived for a while (lost packets)
+        long lastNReceived=-1;
+        auto lastProgress=std::chrono::steady_clock::now();
+        while(nReceived<(long)nalus.size() && std::chrono::steady_clock::now()-lastProgress<NO_PROGRESS_TIMEOUT){
+            if(nReceived!=lastNReceived){
+                lastNReceived=nReceived;
+                lastProgress=std::chrono::steady_clock::now();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        receiver.stopReceiving();
+        const int64_t cpuTimeUs=getProcessCPUTimeUs()-startCPUTimeUs;
+        std::vector<int64_t> latenciesUs;
+        int64_t lastReceiveTimeUs=startUs;
+        for(const auto& s:sent){
+            if(!s.received)continue;
+            latenciesUs.push_back(s.receiveTimeUs-s.sendTimeUs);
+            lastReceiveTimeUs=std::max(lastReceiveTimeUs,s.receiveTimeUs);
+        }
+        std::sort(latenciesUs.begin(),latenciesUs.end());
+        const double durationS=std::max(lastReceiveTimeUs-startUs,(int64_t)1)/(1000.0*1000.0);
+        const double nMB=nBytes/(1024.0*1024.0);
+        std::stringstream ss;
+        ss<<MODE_NAMES[(int)options.mode]<<(options.isH265 ? " h265" : " h264")<<" NALUs:"<<nalus.size()<<" received:"<<nReceived
+          <<" bit-exact:"<<(nReceived==(long)nalus.size() && nCorruptedNALUs==0 ? "yes" : "no")
+          <<" corrupted NALUs:"<<nCorruptedNALUs<<" kernel drops:"<<receiver.getNKernelDroppedPackets();
+        ss<<"\nThroughput:"<<(nMB*8/durationS)<<"MBit/s "<<(nReceived/durationS)<<"NALUs/s";
+        ss<<"\nLatency p50:"<<percentile(latenciesUs,50)<<"us p90:"<<percentile(latenciesUs,90)
+          <<"us p99:"<<percentile(latenciesUs,99)<<"us max:"<<(latenciesUs.empty() ? 0 : latenciesUs.back())<<"us";
+        ss<<"\nCPU:"<<(cpuTimeUs/1000.0/nMB)<<"ms/MB";
+        return ss.str();
+    }
+private:
+    static constexpr int PORT=5695;
+    static constexpr size_t WANTED_RCVBUF_SIZE=8*1024*1024;
+    static constexpr size_t MAX_RCVBUF_SIZE=32*1024*1024;
+    static constexpr auto NO_PROGRESS_TIMEOUT=std::chrono::milliseconds(500);
+    static constexpr const char* MODE_NAMES[]={"raw","rtp","rtp+fec"};
+    static int64_t getTimeUs(){
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // CPU time of all threads of this process (e.g. sender and receiver)
+    static int64_t getProcessCPUTimeUs(){
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+        return (int64_t)ts.tv_sec*1000*1000+ts.tv_nsec/1000;
+    }
+    static std::size_t hash(const uint8_t* data,const std::size_t data_length){
+        return std::hash<std::string_view>{}(std::string_view((const char*)data,data_length));
+    }
+    // sorted has to be sorted ascending
+    static int64_t percentile(const std::vector<int64_t>& sorted,const int p){
+        if(sorted.empty())return 0;
+        return sorted[std::min(sorted.size()-1,sorted.size()*p/100)];
+    }
+};
+
+#ifdef __ANDROID__
+
+#include <jni.h>
+#include <android/asset_manager.h>
+#include <NDKHelper.hpp>
+//----------------------------------------------------JAVA bindings---------------------------------------------------------------
+#define JNI_METHOD(return_type, method_name) \
+  JNIEXPORT return_type JNICALL              \
+      Java_constantin_video_transmitter_VideoTransmitter_##method_name
+
+extern "C" {
+
+JNI_METHOD(jstring, nativeBenchmarkLoopback)
+(JNIEnv *env, jclass jclass1,jobject context,jstring assetFilename,jint mode,jboolean isH265,jint fps) {
+    const char *str = env->GetStringUTFChars(assetFilename, nullptr);
+    AAssetManager *assetManager=NDKHelper::getAssetManagerFromContext2(env,context);
+    AAsset *asset = AAssetManager_open(assetManager,str,AASSET_MODE_BUFFER);
+    env->ReleaseStringUTFChars(assetFilename,str);
+    if(!asset){
+        return env->NewStringUTF("Cannot open asset");
+    }
+    const auto* data=(const uint8_t*)AAsset_getBuffer(asset);
+    const std::vector<uint8_t> video(data,data+AAsset_getLength(asset));
+    AAsset_close(asset);
+    LoopbackBenchmark::Options options{};
+    options.mode=(LoopbackBenchmark::Mode)mode;
+    options.isH265=isH265;
+    options.fps=fps;
+    const std::string report=LoopbackBenchmark::run(video,options);
+    MLOGD<<"LoopbackBenchmark "<<report;
+    return env->NewStringUTF(report.c_str());
+}
+
+}
+#else
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// Host build: LoopbackBenchmark <file.h264|file.h265> <raw|rtp|rtp+fec> [h265] [fps]
+int main(int argc,char** argv){
+    if(argc<3){
+        std::cerr<<"Usage: "<<argv[0]<<" <file> <raw|rtp|rtp+fec> [h265] [fps]\n";
+        return 1;
+    }
+    std::ifstream file(argv[1],std::ios::binary);
+    if(!file){
+        std::cerr<<"Cannot open "<<argv[1]<<"\n";
+        return 1;
+    }
+    const std::vector<uint8_t> video((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+    LoopbackBenchmark::Options options{};
+    const std::string mode=argv[2];
+    options.mode= mode=="raw" ? LoopbackBenchmark::Mode::RAW : (mode=="rtp" ? LoopbackBenchmark::Mode::RTP : LoopbackBenchmark::Mode::RTP_FEC);
+    options.isH265=argc>3 && std::string(argv[3])=="h265";
+    options.fps=argc>4 ? std::atoi(argv[4]) : 0;
+    std::cout<<LoopbackBenchmark::run(video,options)<<"\n";
+    return 0;
+}
+#endif
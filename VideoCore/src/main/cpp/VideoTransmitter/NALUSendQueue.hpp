@@ -0,0 +1,161 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_NALUSENDQUEUE_HPP
+#define LIVEVIDEO10MS_NALUSENDQUEUE_HPP
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "UnequalErrorProtection.hpp"
+
+/*********************************************
+ ** Bounded single producer (encoder thread) single consumer (send thread) queue of NALUs.
+ ** The producer never blocks on the consumer: If the backlog exceeds maxBacklogBytes, the oldest queued NALU of the
+ ** least important class is dropped (e.g. non-reference slices first). If all queued NALUs are more important than the
+ ** new one, the new one is dropped instead. A NALU that is bigger than the whole backlog is accepted if nothing else is queued.
+ ** Dropping only marks the slot, the consumer skips marked slots. Each slot goes QUEUED->TAKEN (consumer) or
+ ** QUEUED->DROPPED (producer) exactly once, which keeps the byte accounting exact without a lock.
+ ** The mutex is only used to wake up the consumer.
+**********************************************/
+class NALUSendQueue{
+public:
+    struct Item{
+        // Owned by the slot, the capacity is reused for the next NALU
+        std::vector<uint8_t> data;
+        int streamMode;
+        int64_t captureTimeUs;
+        NALUImportance importance;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+    NALUSendQueue(const std::size_t capacity,const std::size_t maxBacklogBytes):
+    mSlots(capacity),
+    MAX_BACKLOG_BYTES(maxBacklogBytes){}
+    // Producer only. Returns false if the new NALU was dropped
+    bool push(const uint8_t* data,const std::size_t data_length,const int streamMode,const int64_t captureTimeUs,const NALUImportance importance){
+        const std::size_t head=mHead.load(std::memory_order_relaxed);
+        if(head-mTail.load(std::memory_order_acquire)>=mSlots.size()){
+            // Not even dropped slots were skipped by the consumer yet
+            countDropped(importance);
+            return false;
+        }
+        while(mQueuedBytes>0 && mQueuedBytes+data_length>MAX_BACKLOG_BYTES){
+            if(!dropLeastImportant(importance)){
+                countDropped(importance);
+                return false;
+            }
+        }
+        Slot& slot=mSlots[head % mSlots.size()];
+        slot.item.data.assign(data,data+data_length);
+        slot.item.streamMode=streamMode;
+        slot.item.captureTimeUs=captureTimeUs;
+        slot.item.importance=importance;
+        slot.item.enqueueTime=std::chrono::steady_clock::now();
+        slot.state.store(QUEUED,std::memory_order_relaxed);
+        mQueuedBytes+=data_length;
+        mQueuedNALUs++;
+        mHead.store(head+1,std::memory_order_release);
+        {
+            // Taking the lock makes sure the consumer is either waiting (and gets notified) or has not checked for data yet
+            std::lock_guard<std::mutex> lock(mWakeUpMutex);
+        }
+        mWakeUp.notify_one();
+        return true;
+    }
+    // Consumer only. Returns the oldest NALU that was not dropped or nullptr if there is none. Call pop() once done with it
+    Item* front(){
+        while(true){
+            const std::size_t tail=mTail.load(std::memory_order_relaxed);
+            if(tail==mHead.load(std::memory_order_acquire))return nullptr;
+            Slot& slot=mSlots[tail % mSlots.size()];
+            int expected=QUEUED;
+            if(slot.state.compare_exchange_strong(expected,TAKEN,std::memory_order_acq_rel)){
+                mQueuedBytes-=slot.item.data.size();
+                mQueuedNALUs--;
+                return &slot.item;
+            }
+            // Dropped by the producer
+            mTail.store(tail+1,std::memory_order_release);
+        }
+    }
+    // Consumer only. Releases the slot of the last front()
+    void pop(){
+        mTail.store(mTail.load(std::memory_order_relaxed)+1,std::memory_order_release);
+    }
+    // Consumer only. Returns once data is available, stop() was called or the timeout expired
+    void waitForData(const std::chrono::milliseconds timeout){
+        std::unique_lock<std::mutex> lock(mWakeUpMutex);
+        mWakeUp.wait_for(lock,timeout,[this]{
+            return mStopped || mTail.load(std::memory_order_relaxed)!=mHead.load(std::memory_order_acquire);
+        });
+    }
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lock(mWakeUpMutex);
+            mStopped=true;
+        }
+        mWakeUp.notify_one();
+    }
+    std::size_t getQueuedBytes()const{return mQueuedBytes;}
+    long getQueuedNALUs()const{return mQueuedNALUs;}
+    long getNDroppedNALUs()const{return nDroppedNALUs;}
+    // N of dropped NALUs per NALUImportance
+    long getNDroppedNALUs(const NALUImportance importance)const{return nDroppedNALUsPerClass[(int)importance];}
+private:
+    static constexpr int QUEUED=0;
+    static constexpr int TAKEN=1;
+    static constexpr int DROPPED=2;
+    struct Slot{
+        Item item;
+        std::atomic<int> state{TAKEN};
+    };
+    std::vector<Slot> mSlots;
+    const std::size_t MAX_BACKLOG_BYTES;
+    // Only increase. Written by the producer / consumer
+    std::atomic<std::size_t> mHead{0};
+    std::atomic<std::size_t> mTail{0};
+    std::atomic<std::size_t> mQueuedBytes{0};
+    std::atomic<long> mQueuedNALUs{0};
+    std::atomic<long> nDroppedNALUs{0};
+    std::array<std::atomic<long>,UnequalErrorProtection::N_CLASSES> nDroppedNALUsPerClass{};
+    std::mutex mWakeUpMutex;
+    std::condition_variable mWakeUp;
+    bool mStopped=false;
+    void countDropped(const NALUImportance importance){
+        nDroppedNALUs++;
+        nDroppedNALUsPerClass[(int)importance]++;
+    }
+    // Producer only. The item fields of a queued slot are only written by the producer, reading them is safe
+    bool dropLeastImportant(const NALUImportance newImportance){
+        const std::size_t head=mHead.load(std::memory_order_relaxed);
+        Slot* victim=nullptr;
+        for(std::size_t i=mTail.load(std::memory_order_acquire);i!=head;i++){
+            Slot& slot=mSlots[i % mSlots.size()];
+            if(slot.state.load(std::memory_order_acquire)!=QUEUED)continue;
+            // Oldest first, e.g. only replace the victim if strictly less important
+            if(victim==nullptr || slot.item.importance>victim->item.importance){
+                victim=&slot;
+            }
+        }
+        // The consumer took all queued NALUs but did not update the byte count yet
+        if(victim==nullptr)return true;
+        if(victim->item.importance<newImportance){
+            return false;
+        }
+        int expected=QUEUED;
+        // Fails if the consumer took it in the meantime - the caller checks the backlog again in this case
+        if(victim->state.compare_exchange_strong(expected,DROPPED,std::memory_order_acq_rel)){
+            mQueuedBytes-=victim->item.data.size();
+            mQueuedNALUs--;
+            countDropped(victim->item.importance);
+        }
+        return true;
+    }
+};
+
+#endif //LIVEVIDEO10MS_NALUSENDQUEUE_HPP
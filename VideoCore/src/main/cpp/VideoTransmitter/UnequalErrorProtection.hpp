@@ -0,0 +1,193 @@
+//
+// Created by geier on 18/10/2026.
+//
+
+#ifndef LIVEVIDEO10MS_UNEQUALERRORPROTECTION_HPP
+#define LIVEVIDEO10MS_UNEQUALERRORPROTECTION_HPP
+
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+// Ordered from most to least important
+enum class NALUImportance:int{
+    // SPS,PPS (h264) VPS,SPS,PPS (h265) - without them nothing can be decoded
+    PARAMETER_SET=0,
+    // IDR (h264) IRAP (h265) - losing one costs all frames until the next key frame
+    KEY_FRAME=1,
+    // All other NALUs that can be referenced by later frames
+    REFERENCE=2,
+    // Non-reference slices, SEI, AUD - losing one costs at most one frame
+    NON_REFERENCE=3
+};
+
+/*********************************************
+ ** Unequal error protection for the FEC wrapping of the VideoTransmitter.
+ ** Each NALU is classified by its type (and nal_ref_idc for h264), each class gets its own FEC ratio and
+ ** an optional number of duplicates (the whole FEC group is sent again). The FEC ratios are weighted by class and
+ ** scaled such that the total overhead (parity and duplicates relative to the data) matches the overhead budget.
+ ** The share of each class is estimated from the last few MB of video data.
+ ** Not thread safe.
+**********************************************/
+class UnequalErrorProtection{
+public:
+    static constexpr int N_CLASSES=4;
+    struct ClassOptions{
+        // The FEC ratio of this class is proportional to its weight
+        float weight;
+        // Send the FEC group of a NALU of this class this many times more
+        int nDuplicates;
+    };
+    struct Options{
+        // 0.5 means 50% more data is sent
+        float overheadBudget=0.5f;
+        // Indexed by NALUImportance. Key frames are big, e.g. their FEC group is long and already robust against
+        // burst loss - they get the same weight as the (much smaller) reference frames
+        std::array<ClassOptions,N_CLASSES> classes{{{4,1},{1.5f,0},{1.5f,0},{0.25f,0}}};
+        float maxFECRatio=2.0f;
+    };
+    // Same FEC ratio for all classes and no duplicates, e.g. what UEP is compared against
+    static Options flat(const float overheadBudget){
+        Options options{};
+        options.overheadBudget=overheadBudget;
+        options.classes={{{1,0},{1,0},{1,0},{1,0}}};
+        return options;
+    }
+    static Options unequal(const float overheadBudget){
+        Options options{};
+        options.overheadBudget=overheadBudget;
+        return options;
+    }
+    explicit UnequalErrorProtection(const Options& options){
+        setOptions(options);
+    }
+    void setOptions(const Options& options){
+        mOptions=options;
+        updateFECRatios();
+    }
+    // Keeps the weights and duplicates of each class
+    void setOverheadBudget(const float overheadBudget){
+        mOptions.overheadBudget=overheadBudget;
+        updateFECRatios();
+    }
+    float getOverheadBudget()const{
+        return mOptions.overheadBudget;
+    }
+    /**
+     * @param nal the NAL unit without the 0,0,0,1 prefix
+     */
+    static NALUImportance classify(const uint8_t* nal,const std::size_t nal_len,const bool isH265){
+        if(nal_len<1)return NALUImportance::NON_REFERENCE;
+        if(isH265){
+            const int type=(nal[0]>>1) & 0x3F;
+            // VPS,SPS,PPS
+            if(type>=32 && type<=34)return NALUImportance::PARAMETER_SET;
+            // BLA,IDR,CRA and the reserved IRAP types
+            if(type>=16 && type<=23)return NALUImportance::KEY_FRAME;
+            // TRAIL_N,TSA_N,STSA_N,RADL_N,RASL_N and the reserved sub-layer non-reference types
+            if(type<=14 && type%2==0)return NALUImportance::NON_REFERENCE;
+            if(type<32)return NALUImportance::REFERENCE;
+            return NALUImportance::NON_REFERENCE;
+        }
+        const int type=nal[0] & 0x1F;
+        const int nalRefIdc=(nal[0]>>5) & 0x03;
+        if(type==7 || type==8)return NALUImportance::PARAMETER_SET;
+        if(type==5)return NALUImportance::KEY_FRAME;
+        // Coded slices (and data partitions) with nal_ref_idc!=0 can be referenced
+        if(type>=1 && type<=4 && nalRefIdc!=0)return NALUImportance::REFERENCE;
+        return NALUImportance::NON_REFERENCE;
+    }
+    /**
+     * Returns the n of FEC blocks for a group of nDataBlocks blocks (dataBytes bytes) of this class and updates the class statistics.
+     * @param fecBlockSize size of one FEC block of this group (the size of its biggest data block)
+     * FEC bytes that do not fill a whole block are carried over to the next group of the same class, such that the
+     * overhead matches the ratio on average (even when most groups consist of only one or two small blocks)
+     */
+    int getNFECBlocks(const NALUImportance importance,const int nDataBlocks,const std::size_t dataBytes,const std::size_t fecBlockSize){
+        const int c=(int)importance;
+        nBytesPerClass[c]+=dataBytes;
+        nTotalBytes+=dataBytes;
+        if(nTotalBytes>STATISTICS_WINDOW_BYTES){
+            for(auto& n:nBytesPerClass){
+                n/=2;
+            }
+            nTotalBytes/=2;
+        }
+        updateFECRatios();
+        mFECBytesCarry[c]+=dataBytes*mFECRatios[c];
+        const int maxNFECBlocks=(int)std::ceil(nDataBlocks*mOptions.maxFECRatio);
+        const int nFECBlocks=std::min((int)std::floor(mFECBytesCarry[c]/std::max(fecBlockSize,(std::size_t)1)),maxNFECBlocks);
+        mFECBytesCarry[c]-=(float)nFECBlocks*fecBlockSize;
+        // Do not save up more than one block, else a small group after a big one gets too many FEC blocks
+        mFECBytesCarry[c]=std::min(mFECBytesCarry[c],(float)fecBlockSize);
+        return nFECBlocks;
+    }
+    int getNDuplicates(const NALUImportance importance)const{
+        return mOptions.classes[(int)importance].nDuplicates;
+    }
+    float getFECRatio(const NALUImportance importance)const{
+        return mFECRatios[(int)importance];
+    }
+    std::string getStatsAsString()const{
+        std::stringstream ss;
+        ss<<"FEC ratio/duplicates/share parameter sets:";
+        for(int c=0;c<N_CLASSES;c++){
+            if(c==1)ss<<" key frames:";
+            if(c==2)ss<<" reference:";
+            if(c==3)ss<<" non-reference:";
+            ss<<mFECRatios[c]<<"/"<<mOptions.classes[c].nDuplicates<<"/"<<(nTotalBytes>0 ? (float)nBytesPerClass[c]/nTotalBytes : 0.0f);
+        }
+        return ss.str();
+    }
+private:
+    static constexpr std::size_t STATISTICS_WINDOW_BYTES=4*1024*1024;
+    Options mOptions;
+    std::array<std::size_t,N_CLASSES> nBytesPerClass{};
+    std::size_t nTotalBytes=0;
+    std::array<float,N_CLASSES> mFECRatios{};
+    std::array<float,N_CLASSES> mFECBytesCarry{};
+    float fecRatio(const int c,const float scale)const{
+        return std::min(mOptions.maxFECRatio,scale*mOptions.classes[c].weight);
+    }
+    // Overhead of all classes (weighted by their share) when the FEC ratio of each class is scale*weight
+    float overhead(const float scale)const{
+        float ret=0;
+        for(int c=0;c<N_CLASSES;c++){
+            const float share=(float)nBytesPerClass[c]/nTotalBytes;
+            ret+=share*((1+fecRatio(c,scale))*(1+mOptions.classes[c].nDuplicates)-1);
+        }
+        return ret;
+    }
+    // Find the scale that uses exactly the overhead budget (the overhead is monotonic in the scale).
+    // If the duplicates alone exceed the budget no FEC is added, the budget is exceeded in this case
+    void updateFECRatios(){
+        if(nTotalBytes==0){
+            mFECRatios.fill(std::min(mOptions.overheadBudget,mOptions.maxFECRatio));
+            return;
+        }
+        float minWeight=mOptions.classes[0].weight;
+        for(const auto& c:mOptions.classes){
+            minWeight=std::min(minWeight,c.weight);
+        }
+        float low=0,high=mOptions.maxFECRatio/std::max(minWeight,0.001f);
+        if(overhead(high)<=mOptions.overheadBudget){
+            low=high;
+        }else{
+            for(int i=0;i<24;i++){
+                const float mid=(low+high)/2;
+                if(overhead(mid)<=mOptions.overheadBudget){
+                    low=mid;
+                }else{
+                    high=mid;
+                }
+            }
+        }
+        for(int c=0;c<N_CLASSES;c++){
+            mFECRatios[c]=fecRatio(c,low);
+        }
+    }
+};
+
+#endif //LIVEVIDEO10MS_UNEQUALERRORPROTECTION_HPP
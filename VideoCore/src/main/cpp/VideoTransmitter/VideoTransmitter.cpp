@@ -5,6 +5,8 @@
 #include <string>
 #include <arpa/inet.h>
 #include <array>
+#include <sstream>
+#include <cstring>
 
 #include <TimeHelper.hpp>
 
@@ -20,49 +22,19 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <StringHelper.hpp>
-#include <UDPSender.h>
-#include <wifibroadcast/fec.hh>
-#include "../Parser/ParseRTP.h"
+#include "VideoTransmitter.h"
+#include "../Parser/NetworkImpairment.hpp"
 #include <ATraceCompbat.hpp>
-
-
-class VideoTransmitter{
-public:
-    VideoTransmitter(const std::string& IP,const int Port):
-    mUDPSender(IP,Port,UDPSender::EXAMPLE_MEDIUM_SNDBUFF_SIZE),
-    mEncodeRTP(std::bind(&VideoTransmitter::newRTPPacket, this, std::placeholders::_1),MY_RTP_PACKET_MAX_SIZE){}
-    /**
-     * send data to the ip and port set previously. Logs error on failure.
-     * If data length exceeds the max UDP packet size, the method splits data into smaller packets
-     */
-    void splitAndSend(const uint8_t* data, ssize_t data_length);
-    //
-    void sendPacket(const uint8_t* data, ssize_t data_length);
-    //
-    //
-    void RTPSend(const uint8_t* data, ssize_t data_length);
-    AvgCalculatorSize avgNALUSize;
-    // Do FEC over the RTP packets
-    bool DO_FEC_WRAPPING=false;
-    // Prepend each udp packets with 4 bytes of sequence numbers (for raw)
-    bool ADD_SEQUENCE_NR=false;
-    int SEND_EACH_RTP_PACKET_MULTIPLE_TIMES=0;
-private:
-    // RTP parser splits into packets of this maximum size
-    static constexpr const size_t MY_RTP_PACKET_MAX_SIZE=65507;//TODO remove
-    UDPSender mUDPSender;
-    static constexpr const size_t MAX_VIDEO_DATA_PACKET_SIZE=1024-sizeof(uint32_t);
-    int32_t sequenceNumber=0;
-    std::array<uint8_t,UDPSender::UDP_PACKET_MAX_SIZE> workingBuffer;
-    AvgCalculator avgTimeBetweenVideoNALUS;
-    std::chrono::steady_clock::time_point lastForwardedPacket{};
-    //
-    FECBufferEncoder enc{1500,0.5f};
-    //
-    RTPEncoder mEncodeRTP;
-    void newRTPPacket(const RTPEncoder::RTPPacket& packet);
-    FECDecoder mFECDecoder;
-};
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <poll.h>
+#include <mutex>
+#include <random>
+#include <unordered_set>
+#include <unordered_map>
+#include <string_view>
+#include <algorithm>
 
 //Split data into smaller packets when exceeding UDP max packet size
 void VideoTransmitter::splitAndSend(const uint8_t *data, ssize_t data_length) {
@@ -98,6 +70,7 @@ void VideoTransmitter::splitAndSend(const uint8_t *data, ssize_t data_length) {
         sendPacket(&data[offset],MAX_VIDEO_DATA_PACKET_SIZE);
         offset+=MAX_VIDEO_DATA_PACKET_SIZE;
     }
+    mUDPSender.flush();
     //if(data_length>MAX_VIDEO_DATA_PACKET_SIZE){
     //    mySendTo(data,MAX_VIDEO_DATA_PACKET_SIZE);
     //    splitAndSend(&data[MAX_VIDEO_DATA_PACKET_SIZE], data_length - MAX_VIDEO_DATA_PACKET_SIZE);
@@ -112,52 +85,1043 @@ void VideoTransmitter::sendPacket(const uint8_t *data, ssize_t data_length) {
         std::memcpy(&workingBuffer.data()[sizeof(uint32_t)],data,data_length);
         sequenceNumber++;
         for(int i=0;i<1;i++){
-            mUDPSender.mySendTo(workingBuffer.data(), data_length + sizeof(uint32_t));
+            mUDPSender.queue(workingBuffer.data(), data_length + sizeof(uint32_t));
         }
     } else{
-        mUDPSender.mySendTo(data, data_length);
+        mUDPSender.queue(data, data_length);
     }
 }
 
-void VideoTransmitter::RTPSend(const uint8_t *data, ssize_t data_length) {
+void VideoTransmitter::setCaptureTime(const int64_t captureTimeUs) {
+    if(captureTimeUs>=0){
+        mEncodeRTP.setAccessUnitCaptureTime(std::chrono::steady_clock::time_point(std::chrono::microseconds(captureTimeUs)));
+    }
+}
+
+void VideoTransmitter::RTPSend(const uint8_t *data, ssize_t data_length,const int64_t captureTimeUs) {
     ATrace_beginSection("VideoTransmitter::RTPSend");
+    setCaptureTime(captureTimeUs);
+    const bool fecWrapping=DO_FEC_WRAPPING && data_length>4;
+    if(fecWrapping){
+        beginFECNALU(UnequalErrorProtection::classify(&data[4],data_length-4,false),captureTimeUs);
+    }
     mEncodeRTP.parseNALtoRTP(30,data,data_length);
+    if(fecWrapping){
+        endFECNALU();
+    }
+    // All RTP packets (and FEC blocks) of this NALU go out with (usually) one syscall
+    ATrace_beginSection("UDP::flush");
+    mUDPSender.flush();
+    ATrace_endSection();
     ATrace_endSection();
 }
 
-void VideoTransmitter::newRTPPacket(const RTPEncoder::RTPPacket& packet) {
+void VideoTransmitter::RTPSendH265(const uint8_t *data, ssize_t data_length,const int64_t captureTimeUs) {
+    ATrace_beginSection("VideoTransmitter::RTPSendH265");
+    setCaptureTime(captureTimeUs);
+    // Split at the 0,0,0,1 prefix of each NALU
+    const auto isPrefix=[data](const ssize_t i){
+        return data[i]==0 && data[i+1]==0 && data[i+2]==0 && data[i+3]==1;
+    };
+    // One buffer holds one access unit, the rtp marker bit is set on the last packet of its last NALU
+    const auto send=[this,data,captureTimeUs](const ssize_t naluStart,const ssize_t naluLength,const bool lastNALU){
+        const bool fecWrapping=DO_FEC_WRAPPING && naluLength>4;
+        if(fecWrapping){
+            beginFECNALU(UnequalErrorProtection::classify(&data[naluStart+4],naluLength-4,true),captureTimeUs);
+        }
+        mEncodeRTP.parseNALtoRTPH265(30,&data[naluStart],naluLength,lastNALU);
+        if(fecWrapping){
+            endFECNALU();
+        }
+    };
+    ssize_t naluStart=0;
+    for(ssize_t i=4;i+4<=data_length;i++){
+        if(isPrefix(i)){
+            send(naluStart,i-naluStart,false);
+            naluStart=i;
+        }
+    }
+    send(naluStart,data_length-naluStart,true);
+    ATrace_beginSection("UDP::flush");
+    mUDPSender.flush();
+    ATrace_endSection();
+    ATrace_endSection();
+}
+
+void VideoTransmitter::newRTPPacket(const RTPEncoder::RTPPacketSG& packet) {
     /*std::vector<uint8_t> tmp;
     tmp.reserve(1024);
     for(int i=0;i<1024;i++){
         tmp.push_back((uint8_t)i);
     }*/
     if(DO_FEC_WRAPPING){
-        ATrace_beginSection("VideoTransmitter::FECWrapping");
-        MLOGD<<"Wrapping rtp packet into FEC";
-        assert(packet.data_len<=1024);
-        std::vector<std::shared_ptr<FECBlock> > blks = enc.encode_buffer(packet.data,packet.data_len);
-        // With a ratio of 0.5 we should get exactly 2 blocks
-        assert(blks.size()==2);
-        ATrace_endSection();
-        for (auto blk : blks) {
-            ATrace_beginSection("UDP::sendto");
-            mUDPSender.mySendTo(blk->pkt_data(), blk->pkt_length());
-            ATrace_endSection();
-        }
-        //
+        const size_t data_len=packet.header_len+packet.payload_len;
+        assert(data_len<=MY_RTP_PACKET_MAX_SIZE);
+        // The FEC group is encoded once the whole NALU was packetized (see sendFECGroup).
+        // The rtp packet is built directly in a (pooled) block of the FEC encoder
+        FECBlockPtr block=mFECEncoder.new_block();
+        std::memcpy(block->data(),packet.header,packet.header_len);
+        std::memcpy(block->data()+packet.header_len,packet.payload,packet.payload_len);
+        block->data_length((uint16_t)data_len);
+        mFECGroupBlocks.push_back(std::move(block));
     }else{
         // To emulate a higher bitstream rate (the receiver has to drop duplicates though)
         // Only enabled in 'CUSTOM' mode
         if(SEND_EACH_RTP_PACKET_MULTIPLE_TIMES>0){
             for(int i=0;i<SEND_EACH_RTP_PACKET_MULTIPLE_TIMES;i++){
-                mUDPSender.mySendTo(packet.data, packet.data_len);
+                mUDPSender.queueZeroCopy(packet.header, packet.header_len, packet.payload, packet.payload_len);
             }
         }else{
-            mUDPSender.mySendTo(packet.data, packet.data_len);
+            // The payload points into the NALU, which stays valid until RTPSend() flushes
+            mUDPSender.queueZeroCopy(packet.header, packet.header_len, packet.payload, packet.payload_len);
         }
+        if(mRetransmissionHistory){
+            std::lock_guard<std::mutex> lock(mRetransmissionHistoryMutex);
+            mRetransmissionHistory->store(packet.header,packet.header_len,packet.payload,packet.payload_len);
+        }
+    }
+}
+
+void VideoTransmitter::setFECFrameGrouping(const int maxFrameGroupBlocks) {
+    // The pending group was collected with the old setting
+    flushFECGroup();
+    mMaxFrameGroupBlocks=std::min((std::size_t)std::max(maxFrameGroupBlocks,0),MAX_FEC_GROUP_SIZE);
+}
+
+void VideoTransmitter::flushFECGroup() {
+    if(mFECGroupBlocks.empty())return;
+    sendFECGroup(mFECGroupImportance);
+    mUDPSender.flush();
+}
+
+void VideoTransmitter::beginFECNALU(const NALUImportance importance,const int64_t captureTimeUs) {
+    // A NALU of another importance or of the next frame starts a new group. Without a capture time only the importance
+    // (and send() / flushFECGroup()) can end a frame
+    const bool nextFrame=captureTimeUs>=0 && captureTimeUs!=mFECGroupCaptureTimeUs;
+    if(!mFECGroupBlocks.empty() && (importance!=mFECGroupImportance || nextFrame)){
+        sendFECGroup(mFECGroupImportance);
+    }
+    mFECGroupImportance=importance;
+    mFECGroupCaptureTimeUs=captureTimeUs;
+}
+
+void VideoTransmitter::endFECNALU() {
+    if(mMaxFrameGroupBlocks==0){
+        sendFECGroup(mFECGroupImportance);
     }
 }
 
+void VideoTransmitter::sendFECGroup(const NALUImportance importance) {
+    ATrace_beginSection("VideoTransmitter::FECWrapping");
+    if(mAdaptiveFEC && mAdaptiveFECOverhead!=mUEP.getOverheadBudget()){
+        mUEP.setOverheadBudget(mAdaptiveFECOverhead);
+    }
+    const std::size_t maxGroupSize=mMaxFrameGroupBlocks>0 ? mMaxFrameGroupBlocks : MAX_NALU_FEC_GROUP_SIZE;
+    // Split into groups of (almost) the same size, a short group at the end would be less robust against burst loss
+    const std::size_t nGroups=(mFECGroupBlocks.size()+maxGroupSize-1)/maxGroupSize;
+    for(std::size_t group=0;group<nGroups;group++){
+        const std::size_t first=mFECGroupBlocks.size()*group/nGroups;
+        const std::size_t nDataBlocks=mFECGroupBlocks.size()*(group+1)/nGroups-first;
+        std::size_t dataBytes=0,maxBlockSize=0;
+        for(std::size_t i=first;i<first+nDataBlocks;i++){
+            dataBytes+=mFECGroupBlocks[i]->data_length();
+            maxBlockSize=std::max(maxBlockSize,(std::size_t)mFECGroupBlocks[i]->data_length());
+        }
+        const int nFECBlocks=std::min({mUEP.getNFECBlocks(importance,(int)nDataBlocks,dataBytes,maxBlockSize),
+                                       (int)MAX_FEC_GROUP_SIZE,255-(int)nDataBlocks});
+        // Each duplicate is a FEC group of its own (with a new sequence number), e.g. the FEC decoder on the receiver
+        // uses whichever copy is complete and the rtp decoder drops the duplicated rtp packets.
+        // The data blocks are re-used for each copy, UDPSender::queue() copies them before the headers are overwritten
+        for(int copy=0;copy<=mUEP.getNDuplicates(importance);copy++){
+            mFECEncoder.reset((uint8_t)nDataBlocks,(uint8_t)nFECBlocks,mFECSequenceNumber);
+            // Without FEC blocks, each block gets its own sequence number
+            for(std::size_t i=0;i< (nFECBlocks>0 ? 1 : nDataBlocks);i++){
+                mFECSequenceNumber++;
+                if(mFECSequenceNumber==0)mFECSequenceNumber++;
+            }
+            for(std::size_t i=first;i<first+nDataBlocks;i++){
+                if(copy==0)nFECDataBytes+=mFECGroupBlocks[i]->data_length();
+                mFECEncoder.add_block(mFECGroupBlocks[i]);
+            }
+            for(FECBlockPtr block=mFECEncoder.get_block();block;block=mFECEncoder.get_block()){
+                mUDPSender.queue(block->pkt_data(),block->pkt_length());
+                nFECSentBytes+=block->pkt_length();
+            }
+        }
+    }
+    mFECGroupBlocks.clear();
+    ATrace_endSection();
+}
+
+void VideoTransmitter::enableRetransmission() {
+    if(mRetransmissionHistory)return;
+    mRetransmissionHistory=std::make_unique<RTPRetransmissionHistory>(1024,MY_RTP_PACKET_MAX_SIZE);
+    startFeedbackThread();
+}
+
+void VideoTransmitter::enableAdaptiveFEC(const int minOverheadPercent,const int maxOverheadPercent) {
+    if(mAdaptiveFEC)return;
+    AdaptiveFEC::Options options{};
+    options.minOverhead=std::max(minOverheadPercent,0)/100.0f;
+    options.maxOverhead=std::max(maxOverheadPercent,minOverheadPercent)/100.0f;
+    mAdaptiveFEC=std::make_unique<AdaptiveFEC>(options,mUEP.getOverheadBudget());
+    mAdaptiveFECOverhead=mAdaptiveFEC->getOverhead();
+    startFeedbackThread();
+}
+
+void VideoTransmitter::startFeedbackThread() {
+    if(mFeedbackThread)return;
+    mReceivingFeedback=true;
+    mFeedbackThread=std::make_unique<std::thread>([this]{receiveFeedbackLoop();});
+}
+
+void VideoTransmitter::receiveFeedbackLoop() {
+    std::array<uint8_t,1500> buff{};
+    while(mReceivingFeedback){
+        const auto len=mUDPSender.receiveFeedback(buff.data(),buff.size(),std::chrono::milliseconds(100));
+        if(len<=0)continue;
+        onFeedback(buff.data(),(std::size_t)len,std::chrono::steady_clock::now());
+    }
+    MLOGD<<"Retransmitted "<<nRetransmittedPackets<<" packets, not in history "<<nNotInHistoryPackets;
+}
+
+void VideoTransmitter::onFeedback(const uint8_t* data,const std::size_t data_length,const std::chrono::steady_clock::time_point now) {
+    if(mRetransmissionHistory){
+        std::lock_guard<std::mutex> lock(mRetransmissionHistoryMutex);
+        const bool valid=RTCPGenericNack::parse(data,data_length,[this](const uint16_t sequenceNumber){
+            RTPRetransmissionHistory::Packet packet{};
+            if(mRetransmissionHistory->get(sequenceNumber,packet)){
+                mUDPSender.sendImmediately(packet.data,packet.data_len);
+                nRetransmittedPackets++;
+            }else{
+                nNotInHistoryPackets++;
+            }
+        });
+        if(!valid){
+            MLOGE<<"Got invalid RTCP packet";
+            return;
+        }
+    }
+    if(mAdaptiveFEC){
+        std::lock_guard<std::mutex> lock(mAdaptiveFECMutex);
+        const bool valid=RTCPFECLossReport::parse(data,data_length,[this,now](const RTCPFECLossReport::Report& report){
+            if(mAdaptiveFEC->onReport(report,now)){
+                mAdaptiveFECOverhead=mAdaptiveFEC->getOverhead();
+                MLOGD<<mAdaptiveFEC->getStatsAsString();
+            }
+        });
+        if(!valid){
+            MLOGE<<"Got invalid RTCP packet";
+        }
+    }
+}
+
+std::string VideoTransmitter::benchmarkRTPPacketization(const std::size_t naluSize,const int nNALUs) {
+    // One big (IDR) NALU with random content
+    std::vector<uint8_t> nalu(std::max(naluSize,(std::size_t)6));
+    for(std::size_t i=0;i<nalu.size();i++){
+        nalu[i]=(uint8_t)(rand()%256);
+    }
+    nalu[0]=0;nalu[1]=0;nalu[2]=0;nalu[3]=1;nalu[4]=0x65;
+    std::stringstream ss;
+    for(const bool scatterGather:{false,true}){
+        // Nobody listens on this port, the data is dropped after the loopback interface
+        UDPSender sender("127.0.0.1",5699,UDPSender::EXAMPLE_MEDIUM_SNDBUFF_SIZE);
+        // RTPEncoder has a big buffer, do not put it on the stack
+        auto encoder=std::make_unique<RTPEncoder>(nullptr,MY_RTP_PACKET_MAX_SIZE);
+        long nPackets=0;
+        if(scatterGather){
+            encoder->setScatterGatherCallback([&sender,&nPackets](const RTPEncoder::RTPPacketSG& packet){
+                sender.queueZeroCopy(packet.header,packet.header_len,packet.payload,packet.payload_len);
+                nPackets++;
+            });
+        }else{
+            encoder->setCallback([&sender,&nPackets](const RTPEncoder::RTPPacket& packet){
+                sender.queue(packet.data,packet.data_len);
+                nPackets++;
+            });
+        }
+        const auto before=std::chrono::steady_clock::now();
+        for(int i=0;i<nNALUs;i++){
+            encoder->parseNALtoRTP(30,nalu.data(),nalu.size());
+            sender.flush();
+        }
+        const auto delta=std::chrono::steady_clock::now()-before;
+        const float deltaS=std::chrono::duration_cast<std::chrono::microseconds>(delta).count()/1000.0f/1000.0f;
+        const std::size_t nCopiedBytes=encoder->nCopiedBytes+sender.nCopiedBytes;
+        ss<<(scatterGather ? "Scatter-gather" : "Contiguous")<<" packets:"<<nPackets
+          <<" packets/s:"<<(deltaS>0 ? (long)(nPackets/deltaS) : 0)
+          <<" MBit/s:"<<(deltaS>0 ? sender.nSentBytes*8/1024.0f/1024.0f/deltaS : 0)
+          <<" copied bytes:"<<StringHelper::memorySizeReadable(nCopiedBytes)
+          <<" ("<<(nCopiedBytes/nNALUs)<<" per NALU of "<<nalu.size()<<")\n";
+    }
+    return ss.str();
+}
+
+// Scaffolding shared by the loopback tests below
+namespace{
+    // UDP socket bound to 127.0.0.1 on a port chosen by the OS, such that the tests never collide on a port.
+    // rcvBufSize==0 keeps the OS default
+    class LoopbackSocket{
+    public:
+        explicit LoopbackSocket(const int rcvBufSize=8*1024*1024){
+            fd=socket(AF_INET,SOCK_DGRAM,0);
+            if(rcvBufSize>0){
+                setsockopt(fd,SOL_SOCKET,SO_RCVBUF,&rcvBufSize,sizeof(rcvBufSize));
+            }
+            sockaddr_in address{};
+            address.sin_family=AF_INET;
+            address.sin_port=0;
+            inet_pton(AF_INET,"127.0.0.1",&address.sin_addr);
+            socklen_t addressLen=sizeof(address);
+            if(bind(fd,(sockaddr*)&address,sizeof(address))<0 || getsockname(fd,(sockaddr*)&address,&addressLen)<0){
+                error="Cannot bind receive socket "+std::string(strerror(errno));
+                close(fd);
+                fd=-1;
+                return;
+            }
+            port=ntohs(address.sin_port);
+        }
+        LoopbackSocket(const LoopbackSocket&)=delete;
+        LoopbackSocket& operator=(const LoopbackSocket&)=delete;
+        ~LoopbackSocket(){
+            if(fd>=0)close(fd);
+        }
+        // Loopback delivers synchronously, this reads everything that was sent so far
+        template<class F>
+        void receiveQueued(F onPacket){
+            while(true){
+                const auto len=recv(fd,buff.data(),buff.size(),MSG_DONTWAIT);
+                if(len<=0)break;
+                onPacket(buff.data(),(std::size_t)len);
+            }
+        }
+        int fd;
+        int port=0;
+        // Set if the socket cannot be used
+        std::string error;
+    private:
+        std::array<uint8_t,UDPSender::UDP_PACKET_MAX_SIZE> buff{};
+    };
+
+    std::size_t hashData(const uint8_t* data,const std::size_t data_length){
+        return std::hash<std::string_view>{}(std::string_view((const char*)data,data_length));
+    }
+
+    // NALU with start code and header byte, the rest is random content (e.g. the receiver can match it by its hash)
+    std::vector<uint8_t> createRandomNALU(std::mt19937& random,const std::size_t size,const uint8_t naluHeader){
+        std::vector<uint8_t> nalu(std::max(size,(std::size_t)5));
+        for(auto& value:nalu){
+            value=(uint8_t)random();
+        }
+        nalu[0]=0;nalu[1]=0;nalu[2]=0;nalu[3]=1;nalu[4]=naluHeader;
+        return nalu;
+    }
+
+    void parseDecodedFECBlocks(FECDecoder& fecDecoder,RTPDecoder& decoder){
+        for(FECBlockPtr block=fecDecoder.get_block();block;block=fecDecoder.get_block()){
+            decoder.parseRTPH264toNALU(block->data(),block->data_length());
+        }
+    }
+}
+
+std::string VideoTransmitter::testPacing(const int bitrateMBits,const int burstKB,const int nFrames) {
+    constexpr int FPS=30;
+    constexpr int KEY_FRAME_INTERVAL=FPS;
+    // A key frame is this many times bigger than a delta frame
+    constexpr int KEY_FRAME_SIZE_FACTOR=10;
+    // The pacer (and the simulated bottleneck link) run at this multiple of the video bitrate
+    constexpr float LINK_RATE_FACTOR=1.5f;
+    const uint64_t bitrateBytesPerSecond=(uint64_t)bitrateMBits*1024*1024/8;
+    const uint64_t linkRateBytesPerSecond=(uint64_t)(bitrateBytesPerSecond*LINK_RATE_FACTOR);
+    const std::size_t bytesPerGOP=bitrateBytesPerSecond*KEY_FRAME_INTERVAL/FPS;
+    const std::size_t deltaFrameSize=bytesPerGOP/(KEY_FRAME_INTERVAL-1+KEY_FRAME_SIZE_FACTOR);
+    const std::size_t keyFrameSize=deltaFrameSize*KEY_FRAME_SIZE_FACTOR;
+    std::vector<uint8_t> frameData(keyFrameSize);
+    std::stringstream ss;
+    for(const bool paced:{false,true}){
+        struct Arrival{
+            std::chrono::steady_clock::time_point time;
+            uint32_t frameIdx;
+            std::size_t size;
+        };
+        LoopbackSocket receiveSocket;
+        if(receiveSocket.fd<0){
+            return receiveSocket.error;
+        }
+        const timeval timeout{0,100*1000};
+        setsockopt(receiveSocket.fd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+        std::vector<Arrival> arrivals;
+        std::atomic<bool> receiving{true};
+        std::thread receiver([&arrivals,&receiving,fd=receiveSocket.fd]{
+            std::array<uint8_t,UDPSender::UDP_PACKET_MAX_SIZE> buff{};
+            while(receiving){
+                const auto len=recv(fd,buff.data(),buff.size(),0);
+                if(len<(ssize_t)sizeof(uint32_t))continue;
+                uint32_t frameIdx;
+                std::memcpy(&frameIdx,buff.data(),sizeof(uint32_t));
+                arrivals.push_back({std::chrono::steady_clock::now(),frameIdx,(std::size_t)len});
+            }
+        });
+        UDPSender sender("127.0.0.1",receiveSocket.port,UDPSender::EXAMPLE_MEDIUM_SNDBUFF_SIZE);
+        if(paced){
+            sender.setPacing(linkRateBytesPerSecond,(uint64_t)burstKB*1024);
+        }
+        std::vector<std::chrono::steady_clock::time_point> submitTimes(nFrames);
+        long nSentPackets=0;
+        const auto start=std::chrono::steady_clock::now();
+        for(int frameIdx=0;frameIdx<nFrames;frameIdx++){
+            // Frames come from the encoder at absolute times, pacing must not shift them
+            submitTimes[frameIdx]=start+std::chrono::microseconds(frameIdx*1000*1000/FPS);
+            std::this_thread::sleep_until(submitTimes[frameIdx]);
+            const std::size_t frameSize= frameIdx % KEY_FRAME_INTERVAL==0 ? keyFrameSize : deltaFrameSize;
+            for(std::size_t offset=0;offset<frameSize;offset+=MY_RTP_PACKET_MAX_SIZE){
+                const std::size_t packetSize=std::min(frameSize-offset,MY_RTP_PACKET_MAX_SIZE);
+                std::memcpy(&frameData[offset],&frameIdx,sizeof(uint32_t));
+                sender.queue(&frameData[offset],std::max(packetSize,sizeof(uint32_t)));
+                nSentPackets++;
+            }
+            sender.flush();
+        }
+        // Wait until everything was received
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        receiving=false;
+        receiver.join();
+        // Bottleneck queue that drains at the link rate
+        double queueBytes=0;
+        std::size_t peakQueueBytes=0;
+        AvgCalculator addedLatency;
+        AvgCalculator addedLatencyWithQueue;
+        std::chrono::steady_clock::time_point lastArrival=arrivals.empty() ? start : arrivals.front().time;
+        for(const auto& arrival:arrivals){
+            const double deltaS=std::chrono::duration_cast<std::chrono::nanoseconds>(arrival.time-lastArrival).count()/1000.0/1000.0/1000.0;
+            lastArrival=arrival.time;
+            queueBytes=std::max(0.0,queueBytes-deltaS*linkRateBytesPerSecond)+arrival.size;
+            peakQueueBytes=std::max(peakQueueBytes,(std::size_t)queueBytes);
+            if(arrival.frameIdx>=(uint32_t)nFrames)continue;
+            const auto latency=arrival.time-submitTimes[arrival.frameIdx];
+            const auto queueDelay=std::chrono::nanoseconds((int64_t)(queueBytes*1000*1000*1000/linkRateBytesPerSecond));
+            addedLatency.add(latency);
+            addedLatencyWithQueue.add(latency+queueDelay);
+        }
+        ss<<(paced ? "paced" : "unpaced")<<" peak queue:"<<peakQueueBytes<<" bytes"
+          <<" packets sent:"<<nSentPackets<<" received:"<<arrivals.size()
+          <<"\n sender latency "<<addedLatency.getAvgReadable()
+          <<"\n latency incl. queue "<<addedLatencyWithQueue.getAvgReadable()<<"\n";
+    }
+    return ss.str();
+}
+
+std::string VideoTransmitter::testBatchSend(const int nFrames) {
+    // One packet, a run of full packets with a smaller last one and a run that is longer than one GSO buffer
+    const std::array<std::size_t,3> FRAME_SIZES{{300,10*MY_RTP_PACKET_MAX_SIZE+100,80*MY_RTP_PACKET_MAX_SIZE}};
+    constexpr std::size_t HEADER_SIZE=sizeof(rtp_header_t);
+    std::mt19937 random(1234);
+    std::vector<std::vector<uint8_t>> frames;
+    for(int i=0;i<nFrames;i++){
+        frames.push_back(createRandomNALU(random,FRAME_SIZES[i%FRAME_SIZES.size()],0x41));
+    }
+    struct Packet{
+        const uint8_t* data;
+        std::size_t size;
+    };
+    std::stringstream ss;
+    std::size_t nSendCallsPerPacket=0,nSendCallsBatch=0,nSendCallsGSO=0;
+    bool allIntact=true;
+    for(const int mode:{0,1,2}){
+        const bool batch=mode>0;
+        const bool gso=mode==2;
+        LoopbackSocket receiveSocket;
+        if(receiveSocket.fd<0){
+            return receiveSocket.error;
+        }
+        UDPSender sender("127.0.0.1",receiveSocket.port,UDPSender::EXAMPLE_MEDIUM_SNDBUFF_SIZE);
+        sender.setUseGSO(gso);
+        long nSentPackets=0,nReceivedPackets=0,nCorruptedPackets=0;
+        const auto start=std::chrono::steady_clock::now();
+        for(int frameIdx=0;frameIdx<nFrames;frameIdx++){
+            const auto& frame=frames[frameIdx];
+            // Every second frame is queued as header + payload (scatter-gather), like the rtp packetization does
+            const bool zeroCopy=frameIdx%2==1;
+            std::vector<Packet> packets;
+            for(std::size_t offset=0;offset<frame.size();offset+=MY_RTP_PACKET_MAX_SIZE){
+                const Packet packet{&frame[offset],std::min(frame.size()-offset,MY_RTP_PACKET_MAX_SIZE)};
+                if(!batch){
+                    sender.mySendTo(packet.data,packet.size);
+                }else if(zeroCopy && packet.size>HEADER_SIZE){
+                    sender.queueZeroCopy(packet.data,HEADER_SIZE,packet.data+HEADER_SIZE,packet.size-HEADER_SIZE);
+                }else{
+                    sender.queue(packet.data,packet.size);
+                }
+                packets.push_back(packet);
+            }
+            sender.flush();
+            nSentPackets+=packets.size();
+            // Each datagram has to arrive unchanged and in order, with the packet boundaries of the sender
+            std::size_t idx=0;
+            receiveSocket.receiveQueued([&](const uint8_t* data,std::size_t data_length){
+                nReceivedPackets++;
+                if(idx>=packets.size() || packets[idx].size!=data_length || std::memcmp(packets[idx].data,data,data_length)!=0){
+                    nCorruptedPackets++;
+                }
+                idx++;
+            });
+        }
+        const auto delta=std::chrono::steady_clock::now()-start;
+        const bool intact=nReceivedPackets==nSentPackets && nCorruptedPackets==0;
+        allIntact=allIntact && intact;
+        ss<<(mode==0 ? "per packet" : (gso ? "batch GSO" : "batch"))<<" packets:"<<nSentPackets<<" received:"<<nReceivedPackets
+          <<" corrupted:"<<nCorruptedPackets<<" send calls:"<<sender.nSendCalls<<" GSO buffers:"<<sender.nGSOBuffers
+          <<" took:"<<std::chrono::duration_cast<std::chrono::microseconds>(delta).count()<<"us\n";
+        (mode==0 ? nSendCallsPerPacket : (gso ? nSendCallsGSO : nSendCallsBatch))=sender.nSendCalls;
+    }
+    ss<<"intact:"<<(allIntact ? "yes" : "no")<<"\n";
+    ss<<"fewer send calls:"<<(nSendCallsBatch<nSendCallsPerPacket && nSendCallsGSO<nSendCallsPerPacket ? "yes" : "no")<<"\n";
+    return ss.str();
+}
+
+std::string VideoTransmitter::testRetransmission(const float lossProbability,const int nFrames,const int maxDelayMs) {
+    constexpr int FPS=30;
+    constexpr std::size_t FRAME_SIZE=20*1024;
+    // The NALUs are created up front, the receiver checks that each NALU it gets matches a sent one
+    std::vector<std::vector<uint8_t>> nalus;
+    std::mt19937 random(1234);
+    std::unordered_multiset<std::size_t> sentNALUHashes;
+    for(int i=0;i<nFrames;i++){
+        nalus.push_back(createRandomNALU(random,FRAME_SIZE,i==0 ? 0x65 : 0x41));
+        sentNALUHashes.insert(hashData(nalus[i].data(),nalus[i].size()));
+    }
+    std::stringstream ss;
+    for(const bool useRetransmission:{false,true}){
+        LoopbackSocket receiveSocket;
+        if(receiveSocket.fd<0){
+            return receiveSocket.error;
+        }
+        auto transmitter=std::make_unique<VideoTransmitter>("127.0.0.1",receiveSocket.port);
+        if(useRetransmission){
+            transmitter->enableRetransmission();
+        }
+        std::atomic<bool> sending{true};
+        std::thread sender([&transmitter,&nalus,&sending]{
+            const auto start=std::chrono::steady_clock::now();
+            for(std::size_t i=0;i<nalus.size();i++){
+                std::this_thread::sleep_until(start+std::chrono::microseconds(i*1000*1000/FPS));
+                transmitter->RTPSend(nalus[i].data(),nalus[i].size());
+            }
+            // Time for the last retransmissions
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            sending=false;
+        });
+        long nIntactNALUs=0,nCorruptedNALUs=0,nReceivedPackets=0,nDroppedPackets=0;
+        RTPDecoder decoder([&](const NALU& nalu){
+            if(sentNALUHashes.count(hashData(nalu.getData(),nalu.getSize()))>0){
+                nIntactNALUs++;
+            }else{
+                nCorruptedNALUs++;
+            }
+        });
+        sockaddr_in source{};
+        RTPNackReceiver::Options options{};
+        options.maxDelay=std::chrono::milliseconds(maxDelayMs);
+        RTPNackReceiver nackReceiver(options,[&decoder](const uint8_t* data,std::size_t data_length){
+            decoder.parseRTPH264toNALU(data,data_length);
+        },[fd=receiveSocket.fd,&source](const uint8_t* data,std::size_t data_length){
+            sendto(fd,data,data_length,0,(sockaddr*)&source,sizeof(source));
+        });
+        // The same loss pattern for both runs
+        std::mt19937 lossRandom(42);
+        std::uniform_real_distribution<float> lossDistribution(0,1);
+        std::array<uint8_t,UDPSender::UDP_PACKET_MAX_SIZE> buff{};
+        while(sending){
+            pollfd fds{receiveSocket.fd,POLLIN,0};
+            if(poll(&fds,1,1)>0){
+                socklen_t sourceLen=sizeof(source);
+                const auto len=recvfrom(receiveSocket.fd,buff.data(),buff.size(),0,(sockaddr*)&source,&sourceLen);
+                if(len<=0)continue;
+                nReceivedPackets++;
+                // Injected loss (retransmissions can be lost, too)
+                if(lossDistribution(lossRandom)<lossProbability){
+                    nDroppedPackets++;
+                    continue;
+                }
+                if(useRetransmission){
+                    nackReceiver.input(buff.data(),(std::size_t)len,std::chrono::steady_clock::now());
+                }else{
+                    decoder.parseRTPH264toNALU(buff.data(),(std::size_t)len);
+                }
+            }else if(useRetransmission){
+                nackReceiver.update(std::chrono::steady_clock::now());
+            }
+        }
+        sender.join();
+        ss<<(useRetransmission ? "NACK" : "no retransmission")<<" NALUs:"<<nFrames<<" intact:"<<nIntactNALUs<<" corrupted:"<<nCorruptedNALUs
+          <<" packets:"<<nReceivedPackets<<" dropped:"<<nDroppedPackets<<"\n";
+        if(useRetransmission){
+            const auto& stats=nackReceiver.stats;
+            ss<<" "<<nackReceiver.getStatsAsString()
+              <<"\n recovered ratio:"<<(stats.nMissingPackets>0 ? (float)stats.nRecoveredPackets/stats.nMissingPackets : 1.0f)
+              <<" retransmitted:"<<transmitter->nRetransmittedPackets
+              <<"\n recovery latency "<<stats.recoveryLatency.getAvgReadable()
+              <<"\n hold back latency "<<stats.holdBackLatency.getAvgReadable()<<"\n";
+        }
+    }
+    return ss.str();
+}
+
+std::string VideoTransmitter::testUnequalErrorProtection(const float geGoodToBad,const float geBadToGood,const int overheadPercent,const int nGOPs) {
+    constexpr int GOP_SIZE=30;
+    constexpr std::size_t KEY_FRAME_SIZE=40*1024;
+    constexpr std::size_t REFERENCE_FRAME_SIZE=6*1024;
+    constexpr std::size_t NON_REFERENCE_FRAME_SIZE=3*1024;
+    struct SentNALU{
+        std::vector<uint8_t> data;
+        NALUImportance importance;
+        bool received;
+    };
+    // SPS,PPS,IDR and then P frames, every second one is not used as reference (nal_ref_idc==0).
+    // All NALUs have random content, the receiver matches them by their hash
+    std::vector<SentNALU> nalus;
+    std::mt19937 random(1234);
+    const auto addNALU=[&nalus,&random](const uint8_t naluHeader,const std::size_t size){
+        auto nalu=createRandomNALU(random,size,naluHeader);
+        const NALUImportance importance=UnequalErrorProtection::classify(&nalu[4],nalu.size()-4,false);
+        nalus.push_back({std::move(nalu),importance,false});
+    };
+    for(int gop=0;gop<nGOPs;gop++){
+        addNALU(0x67,24);
+        addNALU(0x68,8);
+        addNALU(0x65,KEY_FRAME_SIZE);
+        for(int i=1;i<GOP_SIZE;i++){
+            if(i%2==1){
+                addNALU(0x41,REFERENCE_FRAME_SIZE);
+            }else{
+                addNALU(0x01,NON_REFERENCE_FRAME_SIZE);
+            }
+        }
+    }
+    std::unordered_map<std::size_t,std::size_t> naluIndexByHash;
+    for(std::size_t i=0;i<nalus.size();i++){
+        naluIndexByHash[hashData(nalus[i].data.data(),nalus[i].data.size())]=i;
+    }
+    std::stringstream ss;
+    for(const bool unequal:{false,true}){
+        for(auto& nalu:nalus){
+            nalu.received=false;
+        }
+        LoopbackSocket receiveSocket;
+        if(receiveSocket.fd<0){
+            return receiveSocket.error;
+        }
+        auto transmitter=std::make_unique<VideoTransmitter>("127.0.0.1",receiveSocket.port);
+        transmitter->DO_FEC_WRAPPING=true;
+        transmitter->setFECProtection(overheadPercent,unequal);
+        long nCorruptedNALUs=0;
+        RTPDecoder decoder([&](const NALU& nalu){
+            const auto it=naluIndexByHash.find(hashData(nalu.getData(),nalu.getSize()));
+            if(it!=naluIndexByHash.end()){
+                nalus[it->second].received=true;
+            }else{
+                nCorruptedNALUs++;
+            }
+        });
+        FECDecoder fecDecoder;
+        // Same burst loss pattern for both runs. The loss is applied to the FEC blocks, e.g. what goes over the air
+        NetworkImpairment::Options options{};
+        options.seed=42;
+        options.geGoodToBad=geGoodToBad;
+        options.geBadToGood=geBadToGood;
+        NetworkImpairment impairment(options,[&fecDecoder,&decoder](const uint8_t* data,std::size_t data_length,int64_t){
+            fecDecoder.add_block(data,(uint16_t)data_length);
+            parseDecodedFECBlocks(fecDecoder,decoder);
+        });
+        for(const auto& nalu:nalus){
+            transmitter->RTPSend(nalu.data.data(),nalu.data.size());
+            receiveSocket.receiveQueued([&impairment](const uint8_t* data,std::size_t data_length){
+                impairment.input(data,data_length,0);
+                impairment.advanceTo(0);
+            });
+        }
+        impairment.flush();
+        // Release the sequences that are still waiting for blocks
+        fecDecoder.flush();
+        parseDecodedFECBlocks(fecDecoder,decoder);
+        // A frame can be decoded if it, the parameter sets and all reference frames since the last key frame were received
+        long nFrames=0,nDecodableFrames=0;
+        bool hasParameterSets=false,referenceChainBroken=true;
+        for(const auto& nalu:nalus){
+            switch(nalu.importance){
+                case NALUImportance::PARAMETER_SET:
+                    // The parameter sets do not change, the decoder can use the ones of an earlier GOP
+                    if(nalu.received)hasParameterSets=true;
+                    continue;
+                case NALUImportance::KEY_FRAME:
+                    referenceChainBroken=!(nalu.received && hasParameterSets);
+                    break;
+                case NALUImportance::REFERENCE:
+                    if(!nalu.received)referenceChainBroken=true;
+                    break;
+                case NALUImportance::NON_REFERENCE:break;
+            }
+            nFrames++;
+            if(nalu.received && !referenceChainBroken){
+                nDecodableFrames++;
+            }
+        }
+        const float frameLoss=nFrames>0 ? 100.0f*(nFrames-nDecodableFrames)/nFrames : 0;
+        const float overhead=transmitter->nFECDataBytes>0 ? 100.0f*(transmitter->nFECSentBytes-transmitter->nFECDataBytes)/transmitter->nFECDataBytes : 0;
+        ss<<(unequal ? "unequal" : "flat")<<" frames:"<<nFrames<<" decodable:"<<nDecodableFrames<<" frame loss:"<<frameLoss<<"%"
+          <<" overhead:"<<overhead<<"%"<<" corrupted NALUs:"<<nCorruptedNALUs
+          <<"\n Link "<<impairment.getStatsAsString()
+          <<"\n "<<transmitter->mUEP.getStatsAsString()<<"\n";
+    }
+    return ss.str();
+}
+
+std::string VideoTransmitter::testFECFrameGrouping(const float geGoodToBad,const float geBadToGood,const int overheadPercent,const int nFrames,const int nSlicesPerFrame) {
+    constexpr std::size_t FRAME_SIZE=12*1024;
+    constexpr int64_t FRAME_INTERVAL_US=16667;
+    // Reference P frames only (e.g. all NALUs have the same importance), each frame is split into nSlicesPerFrame slices.
+    // All slices have random content, the receiver matches them by their hash
+    struct SentSlice{
+        std::vector<uint8_t> data;
+        int frame;
+        bool received;
+    };
+    std::vector<SentSlice> slices;
+    std::mt19937 random(1234);
+    const int nSlices=std::max(nSlicesPerFrame,1);
+    for(int frame=0;frame<nFrames;frame++){
+        for(int i=0;i<nSlices;i++){
+            slices.push_back({createRandomNALU(random,FRAME_SIZE/nSlices,0x41),frame,false});
+        }
+    }
+    std::unordered_map<std::size_t,std::size_t> sliceIndexByHash;
+    for(std::size_t i=0;i<slices.size();i++){
+        sliceIndexByHash[hashData(slices[i].data.data(),slices[i].data.size())]=i;
+    }
+    std::stringstream ss;
+    long nCompleteFramesPerNALU=0;
+    for(const bool perFrame:{false,true}){
+        for(auto& slice:slices){
+            slice.received=false;
+        }
+        LoopbackSocket receiveSocket;
+        if(receiveSocket.fd<0){
+            return receiveSocket.error;
+        }
+        auto transmitter=std::make_unique<VideoTransmitter>("127.0.0.1",receiveSocket.port);
+        transmitter->DO_FEC_WRAPPING=true;
+        transmitter->setFECProtection(overheadPercent,false);
+        transmitter->setFECFrameGrouping(perFrame ? (int)MAX_FEC_GROUP_SIZE : 0);
+        long nCorruptedNALUs=0;
+        RTPDecoder decoder([&](const NALU& nalu){
+            const auto it=sliceIndexByHash.find(hashData(nalu.getData(),nalu.getSize()));
+            if(it!=sliceIndexByHash.end()){
+                slices[it->second].received=true;
+            }else{
+                nCorruptedNALUs++;
+            }
+        });
+        FECDecoder fecDecoder;
+        // Same burst loss pattern for both runs
+        NetworkImpairment::Options options{};
+        options.seed=42;
+        options.geGoodToBad=geGoodToBad;
+        options.geBadToGood=geBadToGood;
+        NetworkImpairment impairment(options,[&fecDecoder,&decoder](const uint8_t* data,std::size_t data_length,int64_t){
+            fecDecoder.add_block(data,(uint16_t)data_length);
+            parseDecodedFECBlocks(fecDecoder,decoder);
+        });
+        const auto receive=[&receiveSocket,&impairment](){
+            receiveSocket.receiveQueued([&impairment](const uint8_t* data,std::size_t data_length){
+                impairment.input(data,data_length,0);
+                impairment.advanceTo(0);
+            });
+        };
+        for(const auto& slice:slices){
+            // The capture time changes with each frame, which ends the FEC group of the last frame
+            transmitter->RTPSend(slice.data.data(),slice.data.size(),slice.frame*FRAME_INTERVAL_US);
+            receive();
+        }
+        transmitter->flushFECGroup();
+        receive();
+        impairment.flush();
+        fecDecoder.flush();
+        parseDecodedFECBlocks(fecDecoder,decoder);
+        long nCompleteFrames=0;
+        for(int frame=0;frame<nFrames;frame++){
+            bool complete=true;
+            for(int i=0;i<nSlices;i++){
+                complete=complete && slices[frame*nSlices+i].received;
+            }
+            if(complete)nCompleteFrames++;
+        }
+        const float frameLoss=nFrames>0 ? 100.0f*(nFrames-nCompleteFrames)/nFrames : 0;
+        const float overhead=transmitter->nFECDataBytes>0 ? 100.0f*(transmitter->nFECSentBytes-transmitter->nFECDataBytes)/transmitter->nFECDataBytes : 0;
+        ss<<(perFrame ? "per frame" : "per NALU")<<" frames:"<<nFrames<<" complete:"<<nCompleteFrames<<" frame loss:"<<frameLoss<<"%"
+          <<" overhead:"<<overhead<<"%"<<" corrupted NALUs:"<<nCorruptedNALUs
+          <<"\n Link "<<impairment.getStatsAsString()<<"\n";
+        if(perFrame){
+            ss<<"more complete frames per frame:"<<(nCompleteFrames>nCompleteFramesPerNALU ? "yes" : "no")<<"\n";
+        }else{
+            nCompleteFramesPerNALU=nCompleteFrames;
+        }
+    }
+    return ss.str();
+}
+
+std::string VideoTransmitter::testAdaptiveFEC(const int minOverheadPercent,const int maxOverheadPercent,const int nFrames) {
+    constexpr std::size_t FRAME_SIZE=12*1024;
+    constexpr int N_SLICES_PER_FRAME=8;
+    constexpr int64_t FRAME_INTERVAL_US=16667;
+    // The packets of a frame go over the link back to back, one per slot
+    constexpr int64_t SLOT_US=100;
+    // Loss trace: Gilbert-Elliott loss per slot, the link changes between clean and bursty phases.
+    // The trace is in the time domain, e.g. all runs see the same loss independent of how many packets they send
+    struct Phase{
+        float geGoodToBad;
+        float geBadToGood;
+    };
+    const std::array<Phase,4> phases{{{0.0005f,0.5f},{0.02f,0.25f},{0.0005f,0.5f},{0.01f,0.4f}}};
+    const int64_t durationUs=(nFrames+1)*FRAME_INTERVAL_US;
+    std::vector<bool> lossTrace((std::size_t)(durationUs/SLOT_US));
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> uniform(0,1);
+    bool bad=false;
+    for(std::size_t slot=0;slot<lossTrace.size();slot++){
+        const Phase& phase=phases[std::min(slot*phases.size()/lossTrace.size(),phases.size()-1)];
+        bad=bad ? uniform(random)>=phase.geBadToGood : uniform(random)<phase.geGoodToBad;
+        lossTrace[slot]=bad;
+    }
+    // Reference P frames, all slices have random content. The receiver matches them by their hash
+    std::vector<std::vector<uint8_t>> slices;
+    for(int i=0;i<nFrames*N_SLICES_PER_FRAME;i++){
+        slices.push_back(createRandomNALU(random,FRAME_SIZE/N_SLICES_PER_FRAME,0x41));
+    }
+    std::unordered_map<std::size_t,std::size_t> sliceIndexByHash;
+    for(std::size_t i=0;i<slices.size();i++){
+        sliceIndexByHash[hashData(slices[i].data(),slices[i].size())]=i;
+    }
+    std::stringstream ss;
+    long nCompleteFramesMin=0;
+    float overheadMax=0;
+    for(const int mode:{0,1,2}){
+        const bool adaptive=mode==2;
+        const int overheadPercent=mode==1 ? maxOverheadPercent : minOverheadPercent;
+        LoopbackSocket receiveSocket;
+        if(receiveSocket.fd<0){
+            return receiveSocket.error;
+        }
+        auto transmitter=std::make_unique<VideoTransmitter>("127.0.0.1",receiveSocket.port);
+        transmitter->DO_FEC_WRAPPING=true;
+        transmitter->setFECProtection(overheadPercent,false);
+        transmitter->setFECFrameGrouping(64);
+        if(adaptive){
+            // Only the controller, the reports are passed to the transmitter directly (on the virtual clock)
+            AdaptiveFEC::Options options{};
+            options.minOverhead=minOverheadPercent/100.0f;
+            options.maxOverhead=maxOverheadPercent/100.0f;
+            transmitter->mAdaptiveFEC=std::make_unique<AdaptiveFEC>(options,minOverheadPercent/100.0f);
+            transmitter->mAdaptiveFECOverhead=transmitter->mAdaptiveFEC->getOverhead();
+        }
+        std::vector<bool> received(slices.size(),false);
+        long nCorruptedNALUs=0;
+        RTPDecoder decoder([&](const NALU& nalu){
+            const auto it=sliceIndexByHash.find(hashData(nalu.getData(),nalu.getSize()));
+            if(it!=sliceIndexByHash.end()){
+                received[it->second]=true;
+            }else{
+                nCorruptedNALUs++;
+            }
+        });
+        FECDecoder fecDecoder;
+        FECLossMonitor lossMonitor(FECLossMonitor::Options{});
+        long nSentPackets=0,nLostPackets=0;
+        int64_t linkTimeUs=0;
+        for(int frame=0;frame<nFrames;frame++){
+            const int64_t frameStartUs=frame*FRAME_INTERVAL_US;
+            for(int i=0;i<N_SLICES_PER_FRAME;i++){
+                const auto& slice=slices[frame*N_SLICES_PER_FRAME+i];
+                transmitter->RTPSend(slice.data(),slice.size(),frameStartUs);
+            }
+            transmitter->flushFECGroup();
+            linkTimeUs=std::max(linkTimeUs,frameStartUs);
+            receiveSocket.receiveQueued([&](const uint8_t* data,std::size_t data_length){
+                nSentPackets++;
+                const std::size_t slot=std::min((std::size_t)(linkTimeUs/SLOT_US),lossTrace.size()-1);
+                linkTimeUs+=SLOT_US;
+                if(lossTrace[slot]){
+                    nLostPackets++;
+                    return;
+                }
+                lossMonitor.input(data,data_length);
+                fecDecoder.add_block(data,(uint16_t)data_length);
+                parseDecodedFECBlocks(fecDecoder,decoder);
+            });
+            const auto now=std::chrono::steady_clock::time_point(std::chrono::microseconds(frameStartUs+FRAME_INTERVAL_US));
+            RTCPFECLossReport::Report report;
+            if(lossMonitor.getReport(now,report) && adaptive){
+                const auto rtcp=RTCPFECLossReport::create(FECLossMonitor::RECEIVER_SSRC,report);
+                transmitter->onFeedback(rtcp.data(),rtcp.size(),now);
+            }
+        }
+        fecDecoder.flush();
+        parseDecodedFECBlocks(fecDecoder,decoder);
+        long nCompleteFrames=0;
+        for(int frame=0;frame<nFrames;frame++){
+            bool complete=true;
+            for(int i=0;i<N_SLICES_PER_FRAME;i++){
+                complete=complete && received[frame*N_SLICES_PER_FRAME+i];
+            }
+            if(complete)nCompleteFrames++;
+        }
+        const float frameLoss=nFrames>0 ? 100.0f*(nFrames-nCompleteFrames)/nFrames : 0;
+        const float overhead=transmitter->nFECDataBytes>0 ? 100.0f*(transmitter->nFECSentBytes-transmitter->nFECDataBytes)/transmitter->nFECDataBytes : 0;
+        ss<<(adaptive ? "adaptive" : "fixed "+std::to_string(overheadPercent)+"%")<<" frames:"<<nFrames<<" complete:"<<nCompleteFrames
+          <<" frame loss:"<<frameLoss<<"%"<<" overhead:"<<overhead<<"%"<<" corrupted NALUs:"<<nCorruptedNALUs
+          <<"\n Link packets:"<<nSentPackets<<" lost:"<<nLostPackets<<"\n";
+        if(mode==0){
+            nCompleteFramesMin=nCompleteFrames;
+        }else if(mode==1){
+            overheadMax=overhead;
+        }else{
+            ss<<" "<<transmitter->mAdaptiveFEC->getStatsAsString()<<"\n"
+              <<"less frame loss than fixed min:"<<(nCompleteFrames>nCompleteFramesMin ? "yes" : "no")<<"\n"
+              <<"less overhead than fixed max:"<<(overhead<overheadMax ? "yes" : "no")<<"\n";
+        }
+    }
+    return ss.str();
+}
+
+void VideoTransmitter::send(const uint8_t *data,const ssize_t data_length,const int streamMode,const int64_t captureTimeUs) {
+    if(!mSendQueue){
+        sendOnCurrentThread(data,data_length,streamMode,captureTimeUs);
+        return;
+    }
+    const auto start=std::chrono::steady_clock::now();
+    const NALUImportance importance= data_length>4 ? UnequalErrorProtection::classify(&data[4],data_length-4,streamMode==STREAM_MODE_RTP_H265) : NALUImportance::NON_REFERENCE;
+    mSendQueue->push(data,data_length,streamMode,captureTimeUs,importance);
+    std::size_t peak=mPeakQueuedBytes;
+    const std::size_t queuedBytes=mSendQueue->getQueuedBytes();
+    while(queuedBytes>peak && !mPeakQueuedBytes.compare_exchange_weak(peak,queuedBytes)){}
+    std::lock_guard<std::mutex> lock(mSendStatsMutex);
+    avgEnqueueTime.add(std::chrono::steady_clock::now()-start);
+}
+
+void VideoTransmitter::sendOnCurrentThread(const uint8_t *data,const ssize_t data_length,const int streamMode,const int64_t captureTimeUs) {
+    DO_FEC_WRAPPING=false;
+    ADD_SEQUENCE_NR=false;
+    SEND_EACH_RTP_PACKET_MULTIPLE_TIMES=0;
+    switch(streamMode){
+        case STREAM_MODE_RTP:
+            RTPSend(data,data_length,captureTimeUs);
+            break;
+        case STREAM_MODE_RAW:
+            splitAndSend(data,data_length);
+            break;
+        case STREAM_MODE_RTP_MULTIPLE_TIMES:
+            SEND_EACH_RTP_PACKET_MULTIPLE_TIMES=5;
+            RTPSend(data,data_length,captureTimeUs);
+            break;
+        case STREAM_MODE_RTP_H265:
+            RTPSendH265(data,data_length,captureTimeUs);
+            break;
+        default:
+            // RTP inside FEC over UDP. Each encoder output buffer is one frame
+            DO_FEC_WRAPPING=true;
+            RTPSend(data,data_length,captureTimeUs);
+            flushFECGroup();
+            break;
+    }
+}
+
+void VideoTransmitter::startSendThread(const int maxBacklogKB) {
+    if(maxBacklogKB<=0 || mSendThread)return;
+    // Enough slots for a few seconds of sliced video, the byte limit is usually reached first
+    constexpr std::size_t SEND_QUEUE_CAPACITY=256;
+    mSendQueue=std::make_unique<NALUSendQueue>(SEND_QUEUE_CAPACITY,(std::size_t)maxBacklogKB*1024);
+    mSending=true;
+    mSendThread=std::make_unique<std::thread>(&VideoTransmitter::sendLoop,this);
+}
+
+void VideoTransmitter::sendLoop() {
+    while(mSending){
+        mSendQueue->waitForData(std::chrono::milliseconds(100));
+        for(auto* item=mSendQueue->front();item!=nullptr && mSending;item=mSendQueue->front()){
+            const auto start=std::chrono::steady_clock::now();
+            sendOnCurrentThread(item->data.data(),(ssize_t)item->data.size(),item->streamMode,item->captureTimeUs);
+            const auto end=std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(mSendStatsMutex);
+                avgQueueWaitTime.add(start-item->enqueueTime);
+                avgSendTime.add(end-start);
+            }
+            mSendQueue->pop();
+        }
+    }
+}
+
+std::string VideoTransmitter::getSendThreadStatsAsString() const {
+    if(!mSendQueue){
+        return "Send thread disabled";
+    }
+    std::stringstream ss;
+    ss<<"Queue NALUs:"<<mSendQueue->getQueuedNALUs()<<" bytes:"<<mSendQueue->getQueuedBytes()<<" peak bytes:"<<mPeakQueuedBytes
+      <<" dropped NALUs:"<<mSendQueue->getNDroppedNALUs()
+      <<" (parameter sets:"<<mSendQueue->getNDroppedNALUs(NALUImportance::PARAMETER_SET)
+      <<" key frames:"<<mSendQueue->getNDroppedNALUs(NALUImportance::KEY_FRAME)
+      <<" reference:"<<mSendQueue->getNDroppedNALUs(NALUImportance::REFERENCE)
+      <<" non-reference:"<<mSendQueue->getNDroppedNALUs(NALUImportance::NON_REFERENCE)<<")";
+    std::lock_guard<std::mutex> lock(mSendStatsMutex);
+    ss<<"\nEnqueue "<<avgEnqueueTime.getAvgReadable()
+      <<"\nQueue wait "<<avgQueueWaitTime.getAvgReadable()
+      <<"\nPacketize+FEC+send "<<avgSendTime.getAvgReadable();
+    return ss.str();
+}
+
+std::string VideoTransmitter::testSendThread(const int linkRateMBits,const int maxBacklogKB,const int nFrames) {
+    constexpr int FPS=30;
+    constexpr int GOP_SIZE=30;
+    constexpr std::size_t KEY_FRAME_SIZE=40*1024;
+    constexpr std::size_t REFERENCE_FRAME_SIZE=6*1024;
+    constexpr std::size_t NON_REFERENCE_FRAME_SIZE=3*1024;
+    // Nobody reads from this socket, the kernel drops what does not fit into its (default) buffer
+    LoopbackSocket receiveSocket(0);
+    if(receiveSocket.fd<0){
+        return receiveSocket.error;
+    }
+    // Same GOP structure as in testUnequalErrorProtection, one NALU per frame
+    std::vector<std::vector<uint8_t>> frames;
+    std::mt19937 random(1234);
+    for(int i=0;i<nFrames;i++){
+        const int idxInGOP=i % GOP_SIZE;
+        const std::size_t size= idxInGOP==0 ? KEY_FRAME_SIZE : (idxInGOP%2==1 ? REFERENCE_FRAME_SIZE : NON_REFERENCE_FRAME_SIZE);
+        frames.push_back(createRandomNALU(random,size,idxInGOP==0 ? 0x65 : (idxInGOP%2==1 ? 0x41 : 0x01)));
+    }
+    std::stringstream ss;
+    for(const bool async:{false,true}){
+        auto transmitter=std::make_unique<VideoTransmitter>("127.0.0.1",receiveSocket.port);
+        transmitter->setPacing(linkRateMBits,16);
+        if(async){
+            transmitter->startSendThread(maxBacklogKB);
+        }
+        AvgCalculator avgCallTime;
+        const auto start=std::chrono::steady_clock::now();
+        for(int i=0;i<nFrames;i++){
+            // The encoder produces frames at absolute times, a blocking call delays all following frames
+            std::this_thread::sleep_until(start+std::chrono::microseconds((int64_t)i*1000*1000/FPS));
+            const auto before=std::chrono::steady_clock::now();
+            transmitter->send(frames[i].data(),(ssize_t)frames[i].size(),STREAM_MODE_RTP);
+            avgCallTime.add(std::chrono::steady_clock::now()-before);
+        }
+        const auto duration=std::chrono::steady_clock::now()-start;
+        ss<<(async ? "async" : "inline")<<" send() avg:"<<std::chrono::duration_cast<std::chrono::microseconds>(avgCallTime.getAvg()).count()
+          <<"us max:"<<std::chrono::duration_cast<std::chrono::microseconds>(avgCallTime.getMax()).count()
+          <<"us encoder ran "<<std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()<<"ms for "<<(nFrames*1000/FPS)<<"ms of video\n "
+          <<transmitter->getSendThreadStatsAsString()<<"\n";
+    }
+    return ss.str();
+}
 
 //----------------------------------------------------JAVA bindings---------------------------------------------------------------
 
@@ -183,32 +1147,105 @@ JNI_METHOD(void, nativeDelete)
     delete native(p);
 }
 
+JNI_METHOD(jstring, nativeBenchmarkRTPPacketization)
+(JNIEnv *env, jclass jclass1, jint naluSize,jint nNALUs) {
+    const std::string result=VideoTransmitter::benchmarkRTPPacketization((std::size_t)naluSize,(int)nNALUs);
+    MLOGD<<"BenchmarkRTPPacketization\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(void, nativeSetPacing)
+(JNIEnv *env, jobject obj, jlong p,jint rateMBits,jint burstKB) {
+    native(p)->setPacing((int)rateMBits,(int)burstKB);
+}
+
+JNI_METHOD(jstring, nativeTestPacing)
+(JNIEnv *env, jclass jclass1, jint bitrateMBits,jint burstKB,jint nFrames) {
+    const std::string result=VideoTransmitter::testPacing((int)bitrateMBits,(int)burstKB,(int)nFrames);
+    MLOGD<<"TestPacing\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring, nativeTestBatchSend)
+(JNIEnv *env, jclass jclass1, jint nFrames) {
+    const std::string result=VideoTransmitter::testBatchSend((int)nFrames);
+    MLOGD<<"TestBatchSend\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(void, nativeEnableRetransmission)
+(JNIEnv *env, jobject obj, jlong p) {
+    native(p)->enableRetransmission();
+}
+
+JNI_METHOD(jstring, nativeTestRetransmission)
+(JNIEnv *env, jclass jclass1, jfloat lossProbability,jint nFrames,jint maxDelayMs) {
+    const std::string result=VideoTransmitter::testRetransmission((float)lossProbability,(int)nFrames,(int)maxDelayMs);
+    MLOGD<<"TestRetransmission\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(void, nativeSetFECProtection)
+(JNIEnv *env, jobject obj, jlong p,jint overheadPercent,jboolean unequal) {
+    native(p)->setFECProtection((int)overheadPercent,(bool)unequal);
+}
+
+JNI_METHOD(jstring, nativeTestUnequalErrorProtection)
+(JNIEnv *env, jclass jclass1, jfloat geGoodToBad,jfloat geBadToGood,jint overheadPercent,jint nGOPs) {
+    const std::string result=VideoTransmitter::testUnequalErrorProtection((float)geGoodToBad,(float)geBadToGood,(int)overheadPercent,(int)nGOPs);
+    MLOGD<<"TestUnequalErrorProtection\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(void, nativeSetFECFrameGrouping)
+(JNIEnv *env, jobject obj, jlong p,jint maxFrameGroupBlocks) {
+    native(p)->setFECFrameGrouping((int)maxFrameGroupBlocks);
+}
+
+JNI_METHOD(jstring, nativeTestFECFrameGrouping)
+(JNIEnv *env, jclass jclass1, jfloat geGoodToBad,jfloat geBadToGood,jint overheadPercent,jint nFrames,jint nSlicesPerFrame) {
+    const std::string result=VideoTransmitter::testFECFrameGrouping((float)geGoodToBad,(float)geBadToGood,(int)overheadPercent,(int)nFrames,(int)nSlicesPerFrame);
+    MLOGD<<"TestFECFrameGrouping\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(void, nativeEnableAdaptiveFEC)
+(JNIEnv *env, jobject obj, jlong p,jint minOverheadPercent,jint maxOverheadPercent) {
+    native(p)->enableAdaptiveFEC((int)minOverheadPercent,(int)maxOverheadPercent);
+}
+
+JNI_METHOD(jstring, nativeTestAdaptiveFEC)
+(JNIEnv *env, jclass jclass1, jint minOverheadPercent,jint maxOverheadPercent,jint nFrames) {
+    const std::string result=VideoTransmitter::testAdaptiveFEC((int)minOverheadPercent,(int)maxOverheadPercent,(int)nFrames);
+    MLOGD<<"TestAdaptiveFEC\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
 JNI_METHOD(void, nativeSend)
-(JNIEnv *env, jobject obj, jlong p,jobject buf,jint size,jint streamMode) {
+(JNIEnv *env, jobject obj, jlong p,jobject buf,jint size,jint streamMode,jlong captureTimeUs) {
     //jlong size=env->GetDirectBufferCapacity(buf);
     auto *data = (jbyte*)env->GetDirectBufferAddress(buf);
     if(data== nullptr){
         MLOGE<<"Something wrong with the byte buffer (is it direct ?)";
     }
-    native(p)->DO_FEC_WRAPPING=false;
-    native(p)->ADD_SEQUENCE_NR=false;
-    native(p)->SEND_EACH_RTP_PACKET_MULTIPLE_TIMES=0;
-    //LOGD("size %d",size);
-    if(streamMode==0){
-        // RTP
-        native(p)->RTPSend((uint8_t*)data,(ssize_t)size);
-    }else if(streamMode==1){
-        // RAW
-        native(p)->splitAndSend((uint8_t *) data, (ssize_t) size);
-    }else if(streamMode==2){
-        // Send each rtp packet multiple times
-        native(p)->SEND_EACH_RTP_PACKET_MULTIPLE_TIMES=5;
-        native(p)->RTPSend((uint8_t*)data,(ssize_t)size);
-    }else{
-        // RTP inside FEC over UDP
-        native(p)->DO_FEC_WRAPPING=true;
-        native(p)->RTPSend((uint8_t *) data, (ssize_t) size);
-    }
+    native(p)->send((uint8_t*)data,(ssize_t)size,(int)streamMode,(int64_t)captureTimeUs);
+}
+
+JNI_METHOD(void, nativeStartSendThread)
+(JNIEnv *env, jobject obj, jlong p,jint maxBacklogKB) {
+    native(p)->startSendThread((int)maxBacklogKB);
+}
+
+JNI_METHOD(jstring, nativeGetSendThreadStats)
+(JNIEnv *env, jobject obj, jlong p) {
+    return env->NewStringUTF(native(p)->getSendThreadStatsAsString().c_str());
+}
+
+JNI_METHOD(jstring, nativeTestSendThread)
+(JNIEnv *env, jclass jclass1, jint linkRateMBits,jint maxBacklogKB,jint nFrames) {
+    const std::string result=VideoTransmitter::testSendThread((int)linkRateMBits,(int)maxBacklogKB,(int)nFrames);
+    MLOGD<<"TestSendThread\n"<<result;
+    return env->NewStringUTF(result.c_str());
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+//
+// Created by geier on 13/10/2020.
+//
+
+#ifndef LIVEVIDEO10MS_VIDEOTRANSMITTER_H
+#define LIVEVIDEO10MS_VIDEOTRANSMITTER_H
+
+#include <string>
+#include <array>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <TimeHelper.hpp>
+#include <UDPSender.h>
+#include <wifibroadcast/fec.hh>
+#include "../Parser/ParseRTP.h"
+#include "../Parser/RTPRetransmission.hpp"
+#include "UnequalErrorProtection.hpp"
+#include "AdaptiveFEC.hpp"
+#include "NALUSendQueue.hpp"
+
+/*********************************************
+ ** Sends the NALUs of the encoder to the receiver (VideoPlayer). Either as raw h264 (split into udp packets),
+ ** as rtp or as rtp inside FEC. Optional: pacing, NACK based retransmission, unequal error protection
+**********************************************/
+class VideoTransmitter{
+public:
+    VideoTransmitter(const std::string& IP,const int Port):
+    mUDPSender(IP,Port,UDPSender::EXAMPLE_MEDIUM_SNDBUFF_SIZE),
+    mEncodeRTP(nullptr,MY_RTP_PACKET_MAX_SIZE){
+        mEncodeRTP.setScatterGatherCallback(std::bind(&VideoTransmitter::newRTPPacket, this, std::placeholders::_1));
+    }
+    ~VideoTransmitter(){
+        if(mSendThread){
+            mSending=false;
+            mSendQueue->stop();
+            mSendThread->join();
+        }
+        if(mFeedbackThread){
+            mReceivingFeedback=false;
+            mFeedbackThread->join();
+        }
+    }
+    // Same values as the stream modes in VideoTransmitter.java
+    static constexpr int STREAM_MODE_RTP=0;
+    static constexpr int STREAM_MODE_RAW=1;
+    static constexpr int STREAM_MODE_RTP_MULTIPLE_TIMES=2;
+    static constexpr int STREAM_MODE_RTP_FEC=3;
+    static constexpr int STREAM_MODE_RTP_H265=4;
+    /**
+     * Send the data of the encoder (one or more NALUs with 0,0,0,1 prefix) with the given stream mode.
+     * If the send thread was started the data is only copied into the send queue, else it is sent on the calling thread.
+     * @param captureTimeUs see RTPSend
+     */
+    void send(const uint8_t* data,ssize_t data_length,int streamMode,int64_t captureTimeUs=-1);
+    // Packetize, FEC encode and send on an extra thread, such that a slow socket (or pacing) cannot stall the encoder.
+    // At most maxBacklogKB of data are queued, when more data arrives the oldest NALU of the least important class is dropped
+    // (see NALUSendQueue.hpp). Has to be called before the first send(). maxBacklogKB==0: send on the calling thread
+    void startSendThread(int maxBacklogKB);
+    // Queue depth, dropped NALUs and the time spent in send(), in the queue and in packetization + FEC + sendto
+    std::string getSendThreadStatsAsString()const;
+    // Send synthetic frames to a link (pacing) that is slower than the video bitrate, once inline and once with the send thread.
+    // Reports how long the encoder-facing send() call took and which NALUs were dropped
+    static std::string testSendThread(int linkRateMBits,int maxBacklogKB,int nFrames);
+    /**
+     * send data to the ip and port set previously. Logs error on failure.
+     * If data length exceeds the max UDP packet size, the method splits data into smaller packets
+     */
+    void splitAndSend(const uint8_t* data, ssize_t data_length);
+    //
+    void sendPacket(const uint8_t* data, ssize_t data_length);
+    // captureTimeUs: capture time of the frame the data belongs to (steady clock), or -1 if unknown.
+    // All data passed with the same capture time gets the same rtp timestamp
+    void RTPSend(const uint8_t* data, ssize_t data_length,int64_t captureTimeUs=-1);
+    // Same as RTPSend, but for h265. The data can contain more than one NALU (e.g. VPS,SPS and PPS in csd-0).
+    // It has to end with the last NALU of an access unit, the rtp marker bit is set on its last packet
+    void RTPSendH265(const uint8_t* data, ssize_t data_length,int64_t captureTimeUs=-1);
+    // Compare packets per second and bytes copied of the contiguous and the scatter-gather rtp packetization
+    static std::string benchmarkRTPPacketization(std::size_t naluSize,int nNALUs);
+    // Spread the packets of each NALU in time instead of sending them as one burst. rateMBits==0 disables pacing
+    void setPacing(const int rateMBits,const int burstKB){
+        mUDPSender.setPacing((uint64_t)rateMBits*1024*1024/8,(uint64_t)burstKB*1024);
+    }
+    // Send synthetic frames (with a big key frame every second) over the loopback interface, with and without pacing.
+    // Reports the peak occupancy of a simulated bottleneck queue that drains at the pacing rate and the added latency
+    static std::string testPacing(int bitrateMBits,int burstKB,int nFrames);
+    // Send synthetic frames over the loopback interface packet by packet (sendto), batched (sendmmsg) and batched with UDP GSO.
+    // Checks that every packet arrives unchanged and in order, and reports the n of send calls and GSO buffers
+    static std::string testBatchSend(int nFrames);
+    // Keep the last sent rtp packets and retransmit them when the receiver requests them with RTCP generic NACKs
+    // (see RTPRetransmission.hpp). The NACKs are received on the sending socket by an extra thread
+    void enableRetransmission();
+    // Send synthetic frames over the loopback interface to a receiver that drops packets with lossProbability,
+    // once without and once with NACK based retransmission. Reports the n of intact NALUs, the recovered packets and the added latency
+    static std::string testRetransmission(float lossProbability,int nFrames,int maxDelayMs);
+    // FEC wrapping only. overheadPercent: parity and duplicates relative to the video data.
+    // unequal: protect parameter sets and key frames more than the rest (see UnequalErrorProtection.hpp), else the same FEC ratio for all NALUs
+    void setFECProtection(const int overheadPercent,const bool unequal){
+        const float overheadBudget=overheadPercent/100.0f;
+        mUEP.setOptions(unequal ? UnequalErrorProtection::unequal(overheadBudget) : UnequalErrorProtection::flat(overheadBudget));
+    }
+    // FEC wrapping only. maxFrameGroupBlocks>0: The rtp packets of all NALUs of one frame (that have the same importance) form one
+    // FEC group of at most maxFrameGroupBlocks data blocks (at most 128, bigger frames are split into groups of equal size).
+    // A frame ends with each send(), when the capture time changes or with flushFECGroup(). 0: One FEC group per NALU
+    void setFECFrameGrouping(int maxFrameGroupBlocks);
+    // Send the FEC group of the NALUs that were passed to RTPSend() since the last frame boundary
+    void flushFECGroup();
+    // FEC wrapping only. Adapt the FEC overhead (initially the one of setFECProtection) to the loss the receiver reports
+    // on the back channel (see AdaptiveFEC.hpp). The feedback is received on the sending socket by an extra thread
+    void enableAdaptiveFEC(int minOverheadPercent,int maxOverheadPercent);
+    // Send synthetic GOPs (SPS,PPS,IDR, reference and non-reference P frames) with FEC wrapping over the loopback interface
+    // to a receiver with Gilbert-Elliott (burst) loss, once with a flat FEC ratio and once with unequal error protection
+    // at the same overhead. Reports the n of frames that could be decoded (e.g. the frame and all its references were received)
+    static std::string testUnequalErrorProtection(float geGoodToBad,float geBadToGood,int overheadPercent,int nGOPs);
+    // Send synthetic frames of nSlicesPerFrame slices with FEC wrapping over the loopback interface to a receiver with
+    // Gilbert-Elliott (burst) loss, once with one FEC group per NALU and once with one FEC group per frame at the same overhead.
+    // Reports the n of frames that were received completely
+    static std::string testFECFrameGrouping(float geGoodToBad,float geBadToGood,int overheadPercent,int nFrames,int nSlicesPerFrame);
+    // Replay a loss trace with clean and bursty phases on the FEC wrapped stream of synthetic frames, with the lowest and the
+    // highest fixed overhead and with adaptive FEC in between. The receiver reports its loss back to the transmitter.
+    // Reports the n of frames that were received completely and the overhead
+    static std::string testAdaptiveFEC(int minOverheadPercent,int maxOverheadPercent,int nFrames);
+    AvgCalculatorSize avgNALUSize;
+    // Do FEC over the RTP packets
+    bool DO_FEC_WRAPPING=false;
+    // Prepend each udp packets with 4 bytes of sequence numbers (for raw)
+    bool ADD_SEQUENCE_NR=false;
+    int SEND_EACH_RTP_PACKET_MULTIPLE_TIMES=0;
+private:
+    // RTP parser splits into packets of this maximum size
+    // (fits into one ethernet / wifi frame and into one FEC block)
+    static constexpr const size_t MY_RTP_PACKET_MAX_SIZE=1024;
+    UDPSender mUDPSender;
+    static constexpr const size_t MAX_VIDEO_DATA_PACKET_SIZE=1024-sizeof(uint32_t);
+    int32_t sequenceNumber=0;
+    std::array<uint8_t,UDPSender::UDP_PACKET_MAX_SIZE> workingBuffer;
+    AvgCalculator avgTimeBetweenVideoNALUS;
+    std::chrono::steady_clock::time_point lastForwardedPacket{};
+    // FEC wrapping: The rtp packets of one NALU (or one frame, see setFECFrameGrouping) are collected and sent as one FEC group
+    UnequalErrorProtection mUEP{UnequalErrorProtection::unequal(1.0f)};
+    // Reused for all groups, the blocks come from its pool
+    FECEncoder mFECEncoder{0,0,MY_RTP_PACKET_MAX_SIZE+2};
+    std::vector<FECBlockPtr> mFECGroupBlocks;
+    uint8_t mFECSequenceNumber=1;
+    long nFECDataBytes=0;
+    long nFECSentBytes=0;
+    // The group can contain at most 255 data and FEC blocks (and at most 128 data and 128 FEC blocks, see fec.c)
+    static constexpr const std::size_t MAX_FEC_GROUP_SIZE=128;
+    // Per NALU groups are split into groups of at most this many data blocks
+    static constexpr const std::size_t MAX_NALU_FEC_GROUP_SIZE=64;
+    std::size_t mMaxFrameGroupBlocks=0;
+    // Of the blocks in mFECGroupBlocks
+    NALUImportance mFECGroupImportance=NALUImportance::NON_REFERENCE;
+    int64_t mFECGroupCaptureTimeUs=-1;
+    // Called before the rtp packets of a NALU are added to the group
+    void beginFECNALU(NALUImportance importance,int64_t captureTimeUs);
+    // Called once all rtp packets of the NALU were added
+    void endFECNALU();
+    void sendFECGroup(NALUImportance importance);
+    //
+    RTPEncoder mEncodeRTP;
+    void newRTPPacket(const RTPEncoder::RTPPacketSG& packet);
+    void setCaptureTime(int64_t captureTimeUs);
+    void startFeedbackThread();
+    void receiveFeedbackLoop();
+    // RTCP messages from the receiver (NACKs and FEC loss reports)
+    void onFeedback(const uint8_t* data,std::size_t data_length,std::chrono::steady_clock::time_point now);
+    // Written by the send thread, read by the feedback thread
+    std::unique_ptr<RTPRetransmissionHistory> mRetransmissionHistory;
+    std::mutex mRetransmissionHistoryMutex;
+    std::unique_ptr<std::thread> mFeedbackThread;
+    std::atomic<bool> mReceivingFeedback{false};
+    std::atomic<long> nRetransmittedPackets{0};
+    std::atomic<long> nNotInHistoryPackets{0};
+    // Written by the feedback thread, the send thread applies a new overhead before the next FEC group
+    std::unique_ptr<AdaptiveFEC> mAdaptiveFEC;
+    std::mutex mAdaptiveFECMutex;
+    std::atomic<float> mAdaptiveFECOverhead{0};
+    // Send thread
+    void sendOnCurrentThread(const uint8_t* data,ssize_t data_length,int streamMode,int64_t captureTimeUs);
+    void sendLoop();
+    std::unique_ptr<NALUSendQueue> mSendQueue;
+    std::unique_ptr<std::thread> mSendThread;
+    std::atomic<bool> mSending{false};
+    std::atomic<std::size_t> mPeakQueuedBytes{0};
+    // Written by the encoder / send thread
+    mutable std::mutex mSendStatsMutex;
+    AvgCalculator avgEnqueueTime;
+    AvgCalculator avgQueueWaitTime;
+    AvgCalculator avgSendTime;
+};
+
+#endif //LIVEVIDEO10MS_VIDEOTRANSMITTER_H
@@ -24,6 +24,8 @@ struct Message {
     return ret;
   }
   std::vector<uint8_t> msg;
+  // Optional: the payload was received directly into this block of the encoder (msg is empty in this case)
+  FECBlockPtr block;
   uint8_t port;
   uint8_t priority;
   WifiOptions opts;
@@ -0,0 +1,106 @@
+#ifndef PRIORITY_SCHEDULER_HH
+#define PRIORITY_SCHEDULER_HH
+
+#include <deque>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+// Per priority FIFO queues of the raw send thread (a higher priority value is sent first).
+// pop() serves the highest priority queue, unless the oldest item of a lower priority queue waited longer than max_wait.
+// Such an aged item is served next, but only every other item, e.g. a saturated low priority link can not
+// starve the high priority ones again. Each queue holds at most max_class_size items, new items are dropped beyond that
+// (unless they are forced, e.g. the encoder flushes, which must never be lost).
+// Times are in seconds (see cur_time()). Not thread safe, only used by the send thread.
+template <typename tmpl__T>
+class PriorityScheduler {
+public:
+  PriorityScheduler(size_t max_class_size, double max_wait) :
+    m_max_class_size(max_class_size), m_max_wait(max_wait), m_size(0), m_last_aged(false), m_n_aged(0) {}
+
+  // Returns false if the queue of this priority is full and the item was dropped. A forced item is always queued.
+  bool push(tmpl__T item, uint8_t priority, double now, bool force = false) {
+    Class &c = m_classes[priority];
+    if (!force && (c.queue.size() >= m_max_class_size)) {
+      ++c.n_dropped;
+      return false;
+    }
+    c.queue.push_back(Entry{std::move(item), now});
+    ++m_size;
+    return true;
+  }
+
+  // Returns false if all queues are empty
+  bool pop(tmpl__T &item, uint8_t &priority, double now) {
+    if (m_size == 0) {
+      return false;
+    }
+    typename ClassMap::iterator next = m_classes.end();
+    typename ClassMap::iterator oldest = m_classes.end();
+    for (auto it = m_classes.begin(); it != m_classes.end(); ++it) {
+      if (it->second.queue.empty()) {
+        continue;
+      }
+      if (next == m_classes.end()) {
+        next = it;
+      } else if ((oldest == m_classes.end()) ||
+		 (it->second.queue.front().time < oldest->second.queue.front().time)) {
+        // The oldest item of the lower priorities
+        oldest = it;
+      }
+    }
+    if ((oldest != m_classes.end()) && !m_last_aged && ((now - oldest->second.queue.front().time) > m_max_wait)) {
+      next = oldest;
+      m_last_aged = true;
+      ++m_n_aged;
+    } else {
+      m_last_aged = false;
+    }
+    item = std::move(next->second.queue.front().item);
+    priority = next->first;
+    next->second.queue.pop_front();
+    --m_size;
+    return true;
+  }
+
+  bool empty() const {
+    return m_size == 0;
+  }
+  // The n of queued items of all / of one priority
+  size_t size() const {
+    return m_size;
+  }
+  size_t size(uint8_t priority) const {
+    auto it = m_classes.find(priority);
+    return (it == m_classes.end()) ? 0 : it->second.queue.size();
+  }
+  // The n of items of this priority that were dropped because its queue was full
+  size_t n_dropped(uint8_t priority) const {
+    auto it = m_classes.find(priority);
+    return (it == m_classes.end()) ? 0 : it->second.n_dropped;
+  }
+  // The n of items that were served before higher priority ones because they waited too long
+  size_t n_aged() const {
+    return m_n_aged;
+  }
+
+private:
+  struct Entry {
+    tmpl__T item;
+    double time;
+  };
+  struct Class {
+    std::deque<Entry> queue;
+    size_t n_dropped = 0;
+  };
+  typedef std::map<uint8_t, Class, std::greater<uint8_t> > ClassMap;
+
+  const size_t m_max_class_size;
+  const double m_max_wait;
+  ClassMap m_classes;
+  size_t m_size;
+  bool m_last_aged;
+  size_t m_n_aged;
+};
+
+#endif // PRIORITY_SCHEDULER_HH
@@ -7,9 +7,11 @@
 #include <wfb_bridge.hh>
 #include <log_thread.hh>
 
+// Sends the messages of the links with a higher priority first, see PriorityScheduler.
+// A message never waits much longer than max_priority_wait seconds behind the ones of higher priority.
 void raw_send_thread(SharedQueue<std::shared_ptr<Message> > &outqueue,
 		     RawSendSocket raw_send_sock, uint16_t max_queue_size,
-		     TransferStats &trans_stats, bool &terminate);
+		     TransferStats &trans_stats, bool &terminate, double max_priority_wait = 0.05);
 
 void raw_relay_thread(std::shared_ptr<SharedQueue<std::shared_ptr<monitor_message_t> > > outqueue,
                       RawSendSocket raw_send_sock, uint16_t max_queue_size,
@@ -1,50 +1,182 @@
 #ifndef SHARED_QUEUE_HH
 #define SHARED_QUEUE_HH
 
-#include <condition_variable>
-#include <deque>
-#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <thread>
 
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// A bounded queue for many producers (e.g. the UDP receive threads) and one consumer (e.g. the raw send thread).
+// The items are kept in a ring of slots with a sequence number each (Vyukov), push() and try_pop() do not lock.
+// If the queue holds max_size items a new item is dropped, or with clear_on_full the queued items are dropped first.
+// pop() spins for a while before it sleeps on a futex. The spin count adapts to how often spinning found an item.
+// The producers only wake the consumer (a syscall) if it is sleeping. size() counts each item from push() until it is popped.
 template <typename tmpl__T>
 class SharedQueue {
 public:
   SharedQueue(size_t max_size, bool clear_on_full = false)
-  : m_max_size(max_size), m_clear_on_full(clear_on_full) {}
+  : m_max_size(max_size), m_clear_on_full(clear_on_full), m_slots(ring_size(max_size)),
+    m_mask(m_slots.size() - 1) {
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+      m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
 
+  // Waits for the next item. Only one thread may wait at a time
   tmpl__T pop() {
-    std::unique_lock<std::mutex> lock_guard(m_mutex);
-
-    while (m_queue.empty()) {
-      m_cond.wait(lock_guard);
+    tmpl__T item;
+    int spins = m_spin_limit;
+    for (int i = 0; i < spins; ++i) {
+      if (try_pop(item)) {
+        m_spin_limit = std::min(spins * 2, MAX_SPINS);
+        return item;
+      }
+      cpu_relax();
+    }
+    // Spinning on a single core only delays the producers
+    static const bool multi_core = std::thread::hardware_concurrency() > 1;
+    m_spin_limit = multi_core ? std::max(spins / 2, MIN_SPINS) : 0;
+    while (true) {
+      uint32_t signal = m_signal.load(std::memory_order_acquire);
+      m_sleeping.store(true, std::memory_order_seq_cst);
+      // Pairs with the fence in push(): either push() sees the sleeper or we see the item
+      if (try_pop(item)) {
+        m_sleeping.store(false, std::memory_order_relaxed);
+        return item;
+      }
+      futex(FUTEX_WAIT_PRIVATE, signal);
+      m_sleeping.store(false, std::memory_order_relaxed);
+      if (try_pop(item)) {
+        return item;
+      }
     }
+  }
 
-    auto item = m_queue.front();
-    m_queue.pop_front();
-    return item;
+  // Returns false if the queue is empty
+  bool try_pop(tmpl__T &item) {
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = m_slots[pos & m_mask];
+      intptr_t dif = static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire)) -
+	static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        // Only contended by a producer that clears the queue
+        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          item = std::move(slot.value);
+          slot.value = tmpl__T();
+          slot.seq.store(pos + m_slots.size(), std::memory_order_release);
+          m_size.fetch_sub(1, std::memory_order_release);
+          return true;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
   }
 
   void push(tmpl__T item) {
-    std::unique_lock<std::mutex> lock_guard(m_mutex);
-    if ((m_queue.size() >= m_max_size) && m_clear_on_full) {
-      m_queue.clear();
+    if (!reserve()) {
+      if (!m_clear_on_full) {
+        m_n_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      tmpl__T dropped;
+      while (try_pop(dropped)) {
+        m_n_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (!reserve()) {
+        m_n_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    // A slot is free for every reserved item, but its last consumer might not have released it yet
+    size_t pos = m_enqueue_pos.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = m_slots[pos & m_mask];
+    while (slot.seq.load(std::memory_order_acquire) != pos) {
+      cpu_relax();
     }
-    if (m_queue.size() < m_max_size) {
-      m_queue.push_back(item);
+    slot.value = std::move(item);
+    slot.seq.store(pos + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Only the first producer that sees the sleeping consumer wakes it up
+    if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false, std::memory_order_relaxed)) {
+      m_signal.fetch_add(1, std::memory_order_release);
+      futex(FUTEX_WAKE_PRIVATE, 1);
     }
-    lock_guard.unlock();
-    m_cond.notify_one();
   }
 
+  // The n of items that were pushed (or are being pushed) and not popped yet
   size_t size() const {
-    return m_queue.size();
+    return m_size.load(std::memory_order_acquire);
+  }
+
+  // The n of items that were dropped because the queue was full
+  size_t n_dropped() const {
+    return m_n_dropped.load(std::memory_order_relaxed);
   }
 
 private:
-  size_t m_max_size;
-  bool m_clear_on_full;
-  std::deque<tmpl__T> m_queue;
-  std::mutex m_mutex;
-  std::condition_variable m_cond;
+  struct Slot {
+    std::atomic<size_t> seq;
+    tmpl__T value;
+  };
+  static constexpr int MIN_SPINS = 16;
+  static constexpr int MAX_SPINS = 4096;
+
+  static size_t ring_size(size_t max_size) {
+    size_t size = 1;
+    while (size < max_size) {
+      size *= 2;
+    }
+    return size;
+  }
+
+  // Counts the item in the depth, returns false if the queue is full
+  bool reserve() {
+    size_t size = m_size.load(std::memory_order_relaxed);
+    do {
+      if (size >= m_max_size) {
+        return false;
+      }
+    } while (!m_size.compare_exchange_weak(size, size + 1, std::memory_order_acquire,
+					   std::memory_order_relaxed));
+    return true;
+  }
+
+  static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+  }
+
+  void futex(int op, uint32_t value) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_signal), op, value, nullptr, nullptr, 0);
+  }
+
+  const size_t m_max_size;
+  const bool m_clear_on_full;
+  std::vector<Slot> m_slots;
+  const size_t m_mask;
+  // Producer and consumer positions on separate cache lines
+  alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+  alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+  alignas(64) std::atomic<size_t> m_size{0};
+  std::atomic<size_t> m_n_dropped{0};
+  // Incremented by push() to wake up a sleeping pop()
+  alignas(64) std::atomic<uint32_t> m_signal{0};
+  std::atomic<bool> m_sleeping{false};
+  // Only used by the consumer
+  int m_spin_limit = MIN_SPINS;
 };
 
 #endif // SHARED_QUEUE_HH
@@ -20,6 +20,18 @@ void fec_encode(unsigned int blockSize,
 		unsigned char **fec_blocks,
 		unsigned int nrFecBlocks);
 
+/*
+ * Computes only the FEC blocks firstFecBlock..firstFecBlock+nrFecBlocks-1 of fec_encode,
+ * fec_blocks points to the first of them. Thread safe, e.g. the rows of one group can be
+ * encoded on different threads.
+ */
+void fec_encode_rows(unsigned int blockSize,
+		     unsigned char **data_blocks,
+		     unsigned int nrDataBlocks,
+		     unsigned char **fec_blocks,
+		     unsigned int firstFecBlock,
+		     unsigned int nrFecBlocks);
+
 void fec_decode(unsigned int blockSize,
 		unsigned char **data_blocks,
 		unsigned int nr_data_blocks,
@@ -30,6 +42,34 @@ void fec_decode(unsigned int blockSize,
 
 void fec_print(fec_code_t code, int width);
 
+/*
+ * fec_decode keeps the inverted decode matrices of the last few loss patterns
+ * in an LRU cache. Only used for groups of up to 16 data blocks, the loss patterns
+ * of bigger groups rarely repeat. At most 32 entries (e.g. 16), 0 disables the cache
+ * (the default). Clears the cache, returns -1 if out of range.
+ */
+int fec_set_decode_cache_size(int entries);
+/* Cumulative n of cache lookups that were hits / misses (not cached: single erasures) */
+void fec_get_decode_cache_stats(unsigned long *hits, unsigned long *misses);
+
+/*
+ * GF(256) multiply kernels used by fec_encode / fec_decode. All of them are
+ * bit-exact. fec_init() selects the fastest one the CPU supports.
+ */
+enum fec_simd_t {
+    FEC_SIMD_NONE = 0, /* 256x256 multiplication table */
+    FEC_SIMD_SSSE3,
+    FEC_SIMD_AVX2,
+    FEC_SIMD_AVX512,
+    FEC_SIMD_NEON
+};
+/* Non-zero if this build and CPU can use the kernel */
+int fec_simd_supported(int simd);
+/* Use this kernel from now on (e.g. for benchmarking). Returns -1 if not supported */
+int fec_set_simd(int simd);
+int fec_get_simd(void);
+const char *fec_simd_name(int simd);
+
 void fec_license(void);
 
 #ifdef __cplusplus  
@@ -9,6 +9,13 @@
 #include <iostream>
 #include <set>
 #include <queue>
+#include <atomic>
+#include <mutex>
+#include <bitset>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <condition_variable>
 
 #include <wifibroadcast/fec.h>
 
@@ -27,34 +34,35 @@ struct __attribute__((__packed__)) FECHeader {
   uint16_t length;
 };
 
+class FECBlockPool;
+
+// A data or FEC block with an intrusive reference count (see FECBlockPtr).
+// Blocks are created by a FECBlockPool and return to it once the last FECBlockPtr is released,
+// such that no memory is allocated per packet once the pool has warmed up.
 class FECBlock {
 public:
-  FECBlock(uint8_t seq_num, uint8_t block, uint8_t nblocks, uint8_t nfec_blocks,
-	   uint16_t max_block_len, uint16_t data_length) {
-    m_data_length = max_block_len + sizeof(FECHeader) - 2;
-    m_data.reset(new uint8_t[m_data_length]);
-    std::fill(m_data.get(), m_data.get() + m_data_length, 0);
+  FECBlock(const FECBlock&) = delete;
+  FECBlock &operator=(const FECBlock&) = delete;
+
+  // Initialize a data or FEC block of a sequence
+  void init(uint8_t seq_num, uint8_t block, uint8_t nblocks, uint8_t nfec_blocks,
+	    uint16_t data_length) {
     FECHeader *h = header();
     h->seq_num = seq_num;
     h->block = block;
     h->n_blocks = nblocks;
     h->n_fec_blocks = nfec_blocks;
-    h->length = data_length;
+    this->data_length(data_length);
   }
 
-  // Create a block from a packet buffer
-  FECBlock(const uint8_t *buf, uint16_t pkt_length) {
-    m_data_length = pkt_length;
-    m_data.reset(new uint8_t[m_data_length]);
-    std::fill(m_data.get(), m_data.get() + m_data_length, 0);
+  // Initialize the block from a packet buffer
+  void init(const uint8_t *buf, uint16_t pkt_length) {
     std::copy(buf, buf + pkt_length, m_data.get());
+    m_pkt_length = pkt_length;
   }
 
-  // Create a block from an existing header
-  FECBlock(const FECHeader &h, uint16_t block_length) {
-    m_data_length = block_length + sizeof(FECHeader) - 2;
-    m_data.reset(new uint8_t[m_data_length]);
-    std::fill(m_data.get(), m_data.get() + m_data_length, 0);
+  // Initialize the block from an existing header
+  void init(const FECHeader &h, uint16_t block_length) {
     *header() = h;
     data_length(block_length - 2);
   }
@@ -65,9 +73,18 @@ public:
   }
 
   // Change the block size to the desired FEC block size, which could be
-  // smaller than the maximum block size.
-  void adjust_block_size(uint16_t block_size) {
-    m_data_length = block_size + sizeof(FECHeader) - 2;
+  // bigger than the size of the data. The padding is zero filled.
+  // Returns false if the block cannot hold a block of this size.
+  bool adjust_block_size(uint16_t block_size) {
+    uint32_t pkt_length = block_size + sizeof(FECHeader) - 2;
+    if (pkt_length > m_capacity) {
+      return false;
+    }
+    if (pkt_length > m_pkt_length) {
+      std::fill(m_data.get() + m_pkt_length, m_data.get() + pkt_length, 0);
+    }
+    m_pkt_length = pkt_length;
+    return true;
   }
 
   // A pointer to the data (does not include the header or length fields)
@@ -75,15 +92,17 @@ public:
     return m_data.get() + sizeof(FECHeader);
   }
   const uint8_t *data() const {
-    return data();
+    return m_data.get() + sizeof(FECHeader);
   }
 
   // The length of data (does not include the header or length fields)
   uint16_t data_length() const {
     return header()->length;
   }
+  // Also sets the packet length to header + length + data
   void data_length(uint16_t len) {
     header()->length = len;
+    m_pkt_length = len + sizeof(FECHeader);
   }
 
   // A pointer to the data that should be included in FEC (everything except the header)
@@ -91,7 +110,7 @@ public:
     return m_data.get() + sizeof(FECHeader) - 2;
   }
   const uint8_t *fec_data() const {
-    return fec_data();
+    return m_data.get() + sizeof(FECHeader) - 2;
   }
 
   // A pointer to the header
@@ -112,7 +131,15 @@ public:
 
   // The length of the entire packet (header + length + data)
   uint16_t pkt_length() const {
-    return m_data_length;
+    return m_pkt_length;
+  }
+  // Set the packet length after a packet was received into pkt_data()
+  void pkt_length(uint16_t len) {
+    m_pkt_length = len;
+  }
+  // The maximum packet length this block can hold
+  uint16_t pkt_capacity() const {
+    return m_capacity;
   }
 
   // What type of block is this, data or FEC?
@@ -128,60 +155,272 @@ public:
     return header()->seq_num;
   }
 
+  void ref() {
+    m_refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  void unref();
+
+private:
+  friend class FECBlockPool;
+  explicit FECBlock(uint16_t capacity) :
+    m_data(new uint8_t[capacity]), m_capacity(capacity), m_pkt_length(0), m_refs(0) {}
+  ~FECBlock() = default;
+
+  std::unique_ptr<uint8_t[]> m_data;
+  uint16_t m_capacity;
+  uint16_t m_pkt_length;
+  std::atomic<uint32_t> m_refs;
+  // Set while the block is in use, e.g. a pool cannot be destroyed before all its blocks were released
+  std::shared_ptr<FECBlockPool> m_pool;
+};
+
+// Reference counting pointer to a FECBlock, used like a std::shared_ptr but without the
+// separate control block allocation
+class FECBlockPtr {
+public:
+  FECBlockPtr() : m_block(nullptr) {}
+  explicit FECBlockPtr(FECBlock *block) : m_block(block) {
+    if (m_block) {
+      m_block->ref();
+    }
+  }
+  FECBlockPtr(const FECBlockPtr &other) : FECBlockPtr(other.m_block) {}
+  FECBlockPtr(FECBlockPtr &&other) noexcept : m_block(other.m_block) {
+    other.m_block = nullptr;
+  }
+  ~FECBlockPtr() {
+    reset();
+  }
+  FECBlockPtr &operator=(FECBlockPtr other) {
+    std::swap(m_block, other.m_block);
+    return *this;
+  }
+
+  void reset() {
+    if (m_block) {
+      m_block->unref();
+      m_block = nullptr;
+    }
+  }
+  FECBlock *get() const {
+    return m_block;
+  }
+  FECBlock *operator->() const {
+    return m_block;
+  }
+  FECBlock &operator*() const {
+    return *m_block;
+  }
+  explicit operator bool() const {
+    return m_block != nullptr;
+  }
+
+private:
+  FECBlock *m_block;
+};
+
+// A thread safe pool of FECBlocks of the same capacity.
+// Blocks are allocated on demand and kept (up to max_free_blocks) once released.
+// Requests for blocks bigger than the capacity are served by a one-off allocation.
+// Has to be created with std::make_shared.
+class FECBlockPool : public std::enable_shared_from_this<FECBlockPool> {
+public:
+  explicit FECBlockPool(uint16_t block_capacity, size_t max_free_blocks = 1024) :
+    m_block_capacity(block_capacity), m_max_free_blocks(max_free_blocks), m_n_allocated(0) {}
+  ~FECBlockPool();
+
+  // Get a block that can hold a packet of pkt_length bytes. The content of the block is undefined.
+  FECBlockPtr acquire(uint16_t pkt_length);
+
+  uint16_t block_capacity() const {
+    return m_block_capacity;
+  }
+  // The n of blocks that were allocated on the heap so far
+  size_t n_allocated() const {
+    return m_n_allocated;
+  }
+
 private:
-  std::unique_ptr<uint8_t> m_data;
-  uint16_t m_data_length;
+  friend class FECBlock;
+  static void recycle(FECBlock *block);
+
+  const uint16_t m_block_capacity;
+  const size_t m_max_free_blocks;
+  std::mutex m_mutex;
+  std::vector<FECBlock*> m_free;
+  std::atomic<size_t> m_n_allocated;
 };
 
+inline void FECBlock::unref() {
+  if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    FECBlockPool::recycle(this);
+  }
+}
+
 class FECEncoder {
 public:
 
   FECEncoder(uint8_t num_blocks = 8, uint8_t num_fec_blocks = 4, uint16_t max_block_size = 1500,
 	     uint8_t start_seq_num = 1);
 
-  // Get a new data block
-  std::shared_ptr<FECBlock> new_block() {
-    return std::shared_ptr<FECBlock>(new FECBlock(0, 0, m_num_blocks, m_num_fec_blocks,
-						  m_max_block_size, 0));
+  // Get a new (empty) data block from the block pool. Thread safe, e.g. the payload can be
+  // received / built directly in data() on another thread. Set data_length() before add_block().
+  FECBlockPtr new_block() {
+    FECBlockPtr block = m_pool->acquire(m_max_block_size + sizeof(FECHeader) - 2);
+    block->init(0, 0, 0, 0, 0);
+    return block;
   }
 
   // Allocate and initialize the next data block.
-  std::shared_ptr<FECBlock> get_next_block(uint16_t length = 0);
+  FECBlockPtr get_next_block(uint16_t length = 0);
 
   // Add an incoming data block to be encoded
-  void add_block(std::shared_ptr<FECBlock> block);
+  void add_block(FECBlockPtr block);
 
   // Retrieve the next data/fec block
-  std::shared_ptr<FECBlock> get_block();
+  FECBlockPtr get_block();
   size_t n_output_blocks() const {
-    return m_out_blocks.size();
+    return m_out_blocks.size() - m_out_pos;
   }
 
   // Complete the sequence with the current set of blocks
   void flush();
 
+  // Start a new sequence with different parameters, e.g. to reuse the encoder (and its block pool)
+  // for groups of different size. Blocks that were not encoded yet are dropped.
+  void reset(uint8_t num_blocks, uint8_t num_fec_blocks, uint8_t seq_num);
+
+  // The n of blocks the block pool allocated so far
+  size_t n_allocated_blocks() const {
+    return m_pool->n_allocated();
+  }
+
 private:
   uint8_t m_seq_num;
   uint8_t m_num_blocks;
   uint8_t m_num_fec_blocks;
   uint16_t m_max_block_size;
-  std::vector<std::shared_ptr<FECBlock> > m_in_blocks;
-  std::queue<std::shared_ptr<FECBlock> > m_out_blocks;
+  std::shared_ptr<FECBlockPool> m_pool;
+  std::vector<FECBlockPtr> m_in_blocks;
+  // Blocks before m_out_pos were retrieved already, the vector is only cleared once empty to keep its capacity
+  std::vector<FECBlockPtr> m_out_blocks;
+  size_t m_out_pos;
+  // Reused for each sequence
+  std::vector<uint8_t*> m_data_ptrs;
+  std::vector<uint8_t*> m_fec_ptrs;
 
   void encode_blocks();
-  //
-  //static bool hasFECInitialized;
+  void push_output(FECBlockPtr block);
 };
 
 
+// Same interface and (bit-exact) output as FECEncoder, but the FEC blocks of each sequence are encoded on a pool of
+// worker threads while the caller fills the next sequence. The output stays in sequence order. The parity rows of big
+// sequences are split across the workers. With n_threads=0 the sequences are encoded on the calling thread.
+// Apart from new_block() only one thread may use the encoder.
+class ParallelFECEncoder {
+public:
+
+  ParallelFECEncoder(uint8_t num_blocks = 8, uint8_t num_fec_blocks = 4, uint16_t max_block_size = 1500,
+		     unsigned int n_threads = 2, uint8_t start_seq_num = 1);
+  // Waits for the sequences that are being encoded
+  ~ParallelFECEncoder();
+
+  // Get a new (empty) data block from the block pool. Thread safe, see FECEncoder::new_block()
+  FECBlockPtr new_block() {
+    FECBlockPtr block = m_pool->acquire(m_max_block_size + sizeof(FECHeader) - 2);
+    block->init(0, 0, 0, 0, 0);
+    return block;
+  }
+
+  // Allocate and initialize the next data block.
+  FECBlockPtr get_next_block(uint16_t length = 0);
+
+  // Add an incoming data block to be encoded. Hands the sequence to the workers once it is complete
+  void add_block(FECBlockPtr block);
+
+  // Retrieve the next data/fec block. The data blocks of a sequence are available at once, its FEC blocks once
+  // they are encoded. Returns an empty block if there is none or the next one is still being encoded.
+  FECBlockPtr get_block();
+  // Same as get_block(), but waits until the next FEC block is encoded
+  FECBlockPtr wait_block();
+  // The n of blocks of all completed sequences that were not retrieved yet, including the ones that are still being encoded
+  size_t n_output_blocks() const {
+    return m_n_output_blocks;
+  }
+
+  // Complete the sequence with the current set of blocks and wait until all sequences are encoded
+  void flush();
+
+  // Start a new sequence with different parameters, see FECEncoder::reset()
+  void reset(uint8_t num_blocks, uint8_t num_fec_blocks, uint8_t seq_num);
+
+  // The n of blocks the block pool allocated so far
+  size_t n_allocated_blocks() const {
+    return m_pool->n_allocated();
+  }
+  unsigned int n_threads() const {
+    return m_workers.size();
+  }
+
+private:
+  struct Sequence {
+    // The data blocks followed by the FEC blocks
+    std::vector<FECBlockPtr> blocks;
+    uint8_t n_data_blocks;
+    uint16_t block_size;
+    std::vector<uint8_t*> data_ptrs;
+    std::vector<uint8_t*> fec_ptrs;
+    // Row ranges that were not encoded yet, guarded by m_mutex
+    unsigned int n_open_tasks;
+    // Only used by the caller
+    bool encoded;
+    size_t out_pos;
+  };
+  // The FEC blocks first_row..first_row+n_rows-1 of a sequence
+  struct Task {
+    Sequence *seq;
+    unsigned int first_row;
+    unsigned int n_rows;
+  };
+  // Below this amount of GF(256) multiplications (data blocks x FEC blocks x block size) a sequence is one task,
+  // e.g. waking up more workers costs more than it saves
+  static constexpr size_t MIN_SPLIT_WORK = 256 * 1024;
+
+  uint8_t m_seq_num;
+  uint8_t m_num_blocks;
+  uint8_t m_num_fec_blocks;
+  uint16_t m_max_block_size;
+  std::shared_ptr<FECBlockPool> m_pool;
+  std::vector<FECBlockPtr> m_in_blocks;
+  // Completed sequences in output order and recycled ones (to keep the capacity of their vectors), only used by the caller
+  std::deque<std::unique_ptr<Sequence>> m_sequences;
+  std::vector<std::unique_ptr<Sequence>> m_free_sequences;
+  size_t m_n_output_blocks;
+
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_task_cv;
+  std::condition_variable m_done_cv;
+  std::deque<Task> m_tasks;
+  bool m_stop;
+
+  Sequence &new_sequence();
+  void encode_blocks();
+  void encode(const Task &task);
+  bool is_encoded(Sequence &seq, bool wait);
+  FECBlockPtr next_block(bool wait);
+  void worker();
+};
+
 class FECBufferEncoder {
 public:
   FECBufferEncoder(uint32_t maximum_block_size = 1460, float fec_ratio = 0.5) :
     m_max_block_size(maximum_block_size), m_fec_ratio(fec_ratio), m_seq_num(1) { }
 
-  std::vector<std::shared_ptr<FECBlock> >
+  std::vector<FECBlockPtr>
   encode_buffer(const uint8_t* buf, size_t length);
-  std::vector<std::shared_ptr<FECBlock> >
+  std::vector<FECBlockPtr>
   encode_buffer(const std::vector<uint8_t> &buf) {
     return encode_buffer(buf.data(), buf.size());
   }
@@ -198,53 +437,136 @@ private:
 
 struct FECDecoderStats {
   FECDecoderStats() : total_blocks(0), total_packets(0), dropped_blocks(0), dropped_packets(0),
-		      lost_sync(0), bytes(0) {}
+		      lost_sync(0), bytes(0), late_blocks(0), duplicate_blocks(0), recovered_blocks(0) {}
   size_t total_blocks;
   size_t total_packets;
   size_t dropped_blocks;
   size_t dropped_packets;
   size_t lost_sync;
   size_t bytes;
+  // Blocks of a sequence that was released before all its data blocks were available
+  size_t late_blocks;
+  // Blocks that were received more than once
+  size_t duplicate_blocks;
+  // Data blocks that were recovered from FEC blocks
+  size_t recovered_blocks;
 };
 
 FECDecoderStats operator-(const FECDecoderStats& s1, const FECDecoderStats &s2);
 FECDecoderStats operator+(const FECDecoderStats& s1, const FECDecoderStats &s2);
 
+// Decodes the sequences (FEC groups) of a FECEncoder.
+// Up to max_open_groups consecutive sequences are open at the same time, such that blocks that arrive out of order
+// (e.g. over multiple paths or radios) are still used. A sequence is decoded as soon as enough blocks arrived.
+// The data blocks are output in order, each one as soon as all earlier data blocks were output or declared lost
+// (FEC blocks only fill the gaps). A missing data block is declared lost
+// - once more than max_reorder_blocks later blocks arrived and its sequence can not be decoded anymore
+//   (255 practically only leaves the other two)
+// - once a later data block waited for it for max_latency
+// - once a block arrives that is max_open_groups or more sequences ahead.
+// Like the encoders, the decoder skips sequence number 0 on wrap around.
 class FECDecoder {
 public:
+  static constexpr uint8_t MAX_OPEN_GROUPS = 32;
 
-  FECDecoder();
+  // Blocks up to max_block_size (like the FECEncoder) come from the block pool
+  explicit FECDecoder(uint16_t max_block_size = 1500, uint8_t max_open_groups = 8,
+		      std::chrono::milliseconds max_latency = std::chrono::milliseconds(20),
+		      uint8_t max_reorder_blocks = 3);
 
   void add_block(const uint8_t *buf, uint16_t block_length);
   // Make sure to use pkt_data and pkt_length instead of data / data_length
-  void add_block(std::shared_ptr<FECBlock> blk){
+  void add_block(const FECBlockPtr &blk){
     add_block(blk->pkt_data(), blk->pkt_length());
   }
 
+  // Zero copy ingest: Receive a packet directly into new_block()->pkt_data() (at most pkt_capacity() bytes)
+  // and pass the block with the packet length to add_block.
+  FECBlockPtr new_block() {
+    return m_pool->acquire(m_pool->block_capacity());
+  }
+  void add_block(FECBlockPtr blk, uint16_t block_length);
+
+  // Release the sequences that waited for longer than max_latency. Only needs to be called
+  // if no blocks are received for a while, add_block does the same.
+  void release_expired();
+
+  // Release all open sequences, e.g. at the end of a stream
+  void flush();
+
   // Retrieve the next data/fec block
-  std::shared_ptr<FECBlock> get_block();
+  FECBlockPtr get_block();
 
   const FECDecoderStats &stats() const {
     return m_stats;
   }
 
+  // The n of blocks the block pool allocated so far
+  size_t n_allocated_blocks() const {
+    return m_pool->n_allocated();
+  }
+
 private:
-  // The block size of the current sequence (0 on restart)
-  uint16_t m_block_size;
-  // The previous sequence number
-  FECHeader m_prev_header;
-  // The blocks that have been received previously for this sequence
-  std::vector<std::shared_ptr<FECBlock> > m_blocks;
-  // The FEC blocks that have been received previously for this sequence
-  std::vector<std::shared_ptr<FECBlock> > m_fec_blocks;
-  // The output queue of blocks
-  std::queue<std::shared_ptr<FECBlock> > m_out_blocks;
+  // The state of one sequence, indexed by the sequence number
+  struct Group {
+    // Set with the first block of the sequence
+    bool has_params;
+    // All data blocks were received or recovered
+    bool complete;
+    bool released;
+    // A data block is waiting for an earlier block (since waiting_since)
+    bool waiting;
+    // A block without FEC is a sequence with a single data block
+    uint8_t n_blocks;
+    uint8_t n_fec_blocks;
+    // The n of data blocks that were received or recovered
+    uint8_t n_present;
+    // The data blocks before n_released were output or lost, the missing data blocks before n_declared are lost
+    uint8_t n_released;
+    uint8_t n_declared;
+    // The highest block number received so far, blocks of later sequences count as if they followed the last block
+    int max_position;
+    // The size of the largest block
+    uint16_t block_size;
+    std::chrono::steady_clock::time_point waiting_since;
+    // Indexed by the block number, missing blocks are empty
+    std::vector<FECBlockPtr> blocks;
+    std::vector<std::chrono::steady_clock::time_point> arrival;
+    std::vector<FECBlockPtr> fec_blocks;
+    std::bitset<256> received;
+
+    void reset();
+  };
+
+  std::shared_ptr<FECBlockPool> m_pool;
+  const uint8_t m_max_open_groups;
+  const std::chrono::milliseconds m_max_latency;
+  const uint8_t m_max_reorder_blocks;
+  std::vector<Group> m_groups;
+  // False until the first block arrived (or after a flush)
+  bool m_synced;
+  // The oldest open sequence and the sequence after the newest open sequence
+  uint8_t m_head;
+  uint8_t m_end;
+  uint8_t m_n_open;
+  // The output queue of blocks, see FECEncoder
+  std::vector<FECBlockPtr> m_out_blocks;
+  size_t m_out_pos;
   // The running total of the decoder status
   FECDecoderStats m_stats;
-  // Used for tracking dropped packets/sequences
-  std::vector<uint8_t> m_block_numbers;
-
-  void decode();
+  // Reused by decode()
+  std::vector<uint8_t*> m_block_ptrs;
+  std::vector<unsigned int> m_erased_block_idxs;
+  std::vector<uint8_t*> m_fec_block_ptrs;
+  std::vector<unsigned int> m_fec_block_idxs;
+
+  void decode(Group &g, std::chrono::steady_clock::time_point now);
+  void declare_overtaken_lost(Group &g);
+  void release_groups(std::chrono::steady_clock::time_point now);
+  void release_data_blocks(Group &g);
+  void release_head();
+  bool expired(std::chrono::steady_clock::time_point now) const;
+  void push_output(FECBlockPtr blk);
 };
 
 #endif //FEC_ENCODER_HH
@@ -48,6 +48,8 @@
 #include <string.h>
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "wifibroadcast/fec.h"
 
 /*
@@ -178,6 +180,13 @@ __attribute__((aligned (256)))
 
 #define gf_mul(x,y) gf_mul_table[(x<<8)+y]
 
+/*
+ * Split nibble tables for the SIMD kernels: c*x = gf_mul_lo[c][x & 15] ^ gf_mul_hi[c][x >> 4]
+ * (multiplication is linear over xor). 16 entries fit into one PSHUFB / TBL register.
+ */
+static gf gf_mul_lo[GF_SIZE + 1][16] __attribute__((aligned (16)));
+static gf gf_mul_hi[GF_SIZE + 1][16] __attribute__((aligned (16)));
+
 #define USE_GF_MULC register gf * __gf_mulc_
 #define GF_MULC0(c) __gf_mulc_ = &gf_mul_table[(c)<<8]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
@@ -193,6 +202,12 @@ init_mul_table(void)
 
     for (j=0; j< GF_SIZE+1; j++)
 	gf_mul_table[j] = gf_mul_table[j<<8] = 0;
+
+    for (i=0; i< GF_SIZE+1; i++)
+	for (j=0; j< 16; j++) {
+	    gf_mul_lo[i][j] = gf_mul(i, j);
+	    gf_mul_hi[i][j] = gf_mul(i, (j<<4));
+	}
 }
 
 /*
@@ -401,11 +416,6 @@ addmul1(gf *dst1, gf *src1, gf c, int sz)
 # define addmul1 slow_addmul1
 #endif
 
-static void addmul(gf *dst, gf *src, gf c, int sz) {
-    // fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
-    if (c != 0) addmul1(dst, src, c, sz);
-}
-
 /*
  * mul() computes dst[] = c * src[]
  * This is used often, so better optimize it! Currently the loop is
@@ -527,9 +537,228 @@ mul1(gf *dst1, gf *src1, gf c, int sz)
 # define mul1 slow_mul1
 #endif
 
+/*
+ * SIMD versions of addmul1() and mul1() (split nibble multiplication, see
+ * gf_mul_lo / gf_mul_hi). They are bit-exact with the table versions above.
+ * Each ISA is compiled with a target attribute, the fastest one the CPU
+ * supports is selected at runtime by fec_init(). The bytes that do not fill
+ * a whole vector are handled by the next smaller kernel.
+ */
+typedef void (*gf_mul_fn)(gf *dst, gf *src, gf c, int sz);
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FEC_SIMD_X86
+
+static inline __attribute__((always_inline, target("ssse3"))) void
+ssse3_mul(gf *dst, gf *src, gf c, int sz, const int add)
+{
+    const __m128i lo = _mm_load_si128((const __m128i *) gf_mul_lo[c]);
+    const __m128i hi = _mm_load_si128((const __m128i *) gf_mul_hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+    for (; i + 16 <= sz; i += 16) {
+	const __m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+	__m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+				  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+	if (add)
+	    p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i *) &dst[i]));
+	_mm_storeu_si128((__m128i *) &dst[i], p);
+    }
+    if (i < sz) {
+	if (add) slow_addmul1(&dst[i], &src[i], c, sz - i);
+	else slow_mul1(&dst[i], &src[i], c, sz - i);
+    }
+}
+
+static __attribute__((target("ssse3"))) void
+ssse3_addmul1(gf *dst, gf *src, gf c, int sz) { ssse3_mul(dst, src, c, sz, 1); }
+static __attribute__((target("ssse3"))) void
+ssse3_mul1(gf *dst, gf *src, gf c, int sz) { ssse3_mul(dst, src, c, sz, 0); }
+
+static inline __attribute__((always_inline, target("avx2"))) void
+avx2_mul(gf *dst, gf *src, gf c, int sz, const int add)
+{
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_lo[c]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+    for (; i + 32 <= sz; i += 32) {
+	const __m256i s = _mm256_loadu_si256((const __m256i *) &src[i]);
+	__m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+				     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+	if (add)
+	    p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i *) &dst[i]));
+	_mm256_storeu_si256((__m256i *) &dst[i], p);
+    }
+    if (i < sz)
+	ssse3_mul(&dst[i], &src[i], c, sz - i, add);
+}
+
+static __attribute__((target("avx2"))) void
+avx2_addmul1(gf *dst, gf *src, gf c, int sz) { avx2_mul(dst, src, c, sz, 1); }
+static __attribute__((target("avx2"))) void
+avx2_mul1(gf *dst, gf *src, gf c, int sz) { avx2_mul(dst, src, c, sz, 0); }
+
+static inline __attribute__((always_inline, target("avx512f,avx512bw"))) void
+avx512_mul(gf *dst, gf *src, gf c, int sz, const int add)
+{
+    const __m512i lo = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *) gf_mul_lo[c]));
+    const __m512i hi = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *) gf_mul_hi[c]));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    int i = 0;
+    for (; i + 64 <= sz; i += 64) {
+	const __m512i s = _mm512_loadu_si512((const void *) &src[i]);
+	__m512i p = _mm512_xor_si512(_mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask)),
+				     _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask)));
+	if (add)
+	    p = _mm512_xor_si512(p, _mm512_loadu_si512((const void *) &dst[i]));
+	_mm512_storeu_si512((void *) &dst[i], p);
+    }
+    if (i < sz)
+	avx2_mul(&dst[i], &src[i], c, sz - i, add);
+}
+
+static __attribute__((target("avx512f,avx512bw"))) void
+avx512_addmul1(gf *dst, gf *src, gf c, int sz) { avx512_mul(dst, src, c, sz, 1); }
+static __attribute__((target("avx512f,avx512bw"))) void
+avx512_mul1(gf *dst, gf *src, gf c, int sz) { avx512_mul(dst, src, c, sz, 0); }
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define FEC_SIMD_NEON
+
+/* 16 entry table lookup, TBL on aarch64 and two 8 byte VTBL on armv7 */
+static inline uint8x16_t neon_lookup(const uint8x16_t table, const uint8x16_t idx)
+{
+#if defined(__aarch64__)
+    return vqtbl1q_u8(table, idx);
+#else
+    uint8x8x2_t t;
+    t.val[0] = vget_low_u8(table);
+    t.val[1] = vget_high_u8(table);
+    return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)), vtbl2_u8(t, vget_high_u8(idx)));
+#endif
+}
+
+static inline void
+neon_mul(gf *dst, gf *src, gf c, int sz, const int add)
+{
+    const uint8x16_t lo = vld1q_u8(gf_mul_lo[c]);
+    const uint8x16_t hi = vld1q_u8(gf_mul_hi[c]);
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    int i = 0;
+    for (; i + 16 <= sz; i += 16) {
+	const uint8x16_t s = vld1q_u8(&src[i]);
+	uint8x16_t p = veorq_u8(neon_lookup(lo, vandq_u8(s, mask)),
+				neon_lookup(hi, vshrq_n_u8(s, 4)));
+	if (add)
+	    p = veorq_u8(p, vld1q_u8(&dst[i]));
+	vst1q_u8(&dst[i], p);
+    }
+    if (i < sz) {
+	if (add) slow_addmul1(&dst[i], &src[i], c, sz - i);
+	else slow_mul1(&dst[i], &src[i], c, sz - i);
+    }
+}
+
+static void neon_addmul1(gf *dst, gf *src, gf c, int sz) { neon_mul(dst, src, c, sz, 1); }
+static void neon_mul1(gf *dst, gf *src, gf c, int sz) { neon_mul(dst, src, c, sz, 0); }
+#endif
+
+static int fec_simd = FEC_SIMD_NONE;
+static gf_mul_fn addmul1_fn = addmul1;
+static gf_mul_fn mul1_fn = mul1;
+
+int fec_simd_supported(int simd)
+{
+    switch (simd) {
+    case FEC_SIMD_NONE:
+	return 1;
+#ifdef FEC_SIMD_X86
+    case FEC_SIMD_SSSE3:
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3");
+    case FEC_SIMD_AVX2:
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+    case FEC_SIMD_AVX512:
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+#ifdef FEC_SIMD_NEON
+    case FEC_SIMD_NEON:
+	/* Part of aarch64, and the NDK builds armeabi-v7a with NEON */
+	return 1;
+#endif
+    default:
+	return 0;
+    }
+}
+
+int fec_set_simd(int simd)
+{
+    if (!fec_simd_supported(simd))
+	return -1;
+    switch (simd) {
+#ifdef FEC_SIMD_X86
+    case FEC_SIMD_SSSE3:
+	addmul1_fn = ssse3_addmul1; mul1_fn = ssse3_mul1;
+	break;
+    case FEC_SIMD_AVX2:
+	addmul1_fn = avx2_addmul1; mul1_fn = avx2_mul1;
+	break;
+    case FEC_SIMD_AVX512:
+	addmul1_fn = avx512_addmul1; mul1_fn = avx512_mul1;
+	break;
+#endif
+#ifdef FEC_SIMD_NEON
+    case FEC_SIMD_NEON:
+	addmul1_fn = neon_addmul1; mul1_fn = neon_mul1;
+	break;
+#endif
+    default:
+	addmul1_fn = addmul1; mul1_fn = mul1;
+	break;
+    }
+    fec_simd = simd;
+    return 0;
+}
+
+int fec_get_simd(void)
+{
+    return fec_simd;
+}
+
+const char *fec_simd_name(int simd)
+{
+    static const char *names[] = { "table", "ssse3", "avx2", "avx512", "neon" };
+    if (simd < 0 || simd >= (int) (sizeof(names) / sizeof(names[0])))
+	return "unknown";
+    return names[simd];
+}
+
+/* The fastest kernel this CPU supports */
+static void select_simd(void)
+{
+    static const int preferred[] = { FEC_SIMD_AVX512, FEC_SIMD_AVX2, FEC_SIMD_SSSE3, FEC_SIMD_NEON };
+    unsigned int i;
+    for (i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+	if (fec_set_simd(preferred[i]) == 0)
+	    return;
+    }
+    fec_set_simd(FEC_SIMD_NONE);
+}
+
+static void addmul(gf *dst, gf *src, gf c, int sz) {
+    // fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
+    if (c != 0) addmul1_fn(dst, src, c, sz);
+}
+
 static inline void mul(gf *dst, gf *src, gf c, int sz) {
     /*fprintf(stderr, "%p = %02x * %p\n", dst, c, src);*/
-    if (c != 0) mul1(dst, src, c, sz); else memset(dst, 0, sz);
+    if (c != 0) mul1_fn(dst, src, c, sz); else memset(dst, 0, sz);
 }
 
 /*
@@ -664,6 +893,10 @@ static int fec_initialized = 0 ;
 
 void fec_init(void)
 {
+    /* Called by every FECEncoder / FECDecoder. Do not rebuild the tables
+     * (or reset the kernel) while another instance is using them */
+    if (fec_initialized)
+	return;
     TICK(ticks[0]);
     generate_gf();
     TOCK(ticks[0]);
@@ -672,6 +905,7 @@ void fec_init(void)
     init_mul_table();
     TOCK(ticks[0]);
     DDB(fprintf(stderr, "init_mul_table took %ldus\n", ticks[0]);)
+    select_simd();
 	fec_initialized = 1 ;
 }
 
@@ -777,23 +1011,35 @@ void fec_encode(unsigned int blockSize,
 		unsigned char **fec_blocks,
 		unsigned int nrFecBlocks)
 
+{
+    fec_encode_rows(blockSize, data_blocks, nrDataBlocks, fec_blocks, 0, nrFecBlocks);
+}
+
+void fec_encode_rows(unsigned int blockSize,
+		     unsigned char **data_blocks,
+		     unsigned int nrDataBlocks,
+		     unsigned char **fec_blocks,
+		     unsigned int firstFecBlock,
+		     unsigned int nrFecBlocks)
+
 {
     unsigned int blockNo; /* loop for block counter */
     unsigned int row, col;
 
     assert(fec_initialized);    
     assert(nrDataBlocks <= 128);    
-    assert(nrFecBlocks <= 128);
+    assert(firstFecBlock + nrFecBlocks <= 128);
 
     if(!nrDataBlocks)
 	return;
 
-    for(row=0; row < nrFecBlocks; row++)
-	mul(fec_blocks[row], data_blocks[0], inverse[128 ^ row], blockSize);
+    /* Each FEC block only depends on the data blocks and its own row of the matrix */
+    for(row=firstFecBlock; row < firstFecBlock + nrFecBlocks; row++)
+	mul(fec_blocks[row - firstFecBlock], data_blocks[0], inverse[128 ^ row], blockSize);
     
     for(col=129, blockNo=1; blockNo < nrDataBlocks; col++, blockNo ++) {
-	for(row=0; row < nrFecBlocks; row++)
-	    addmul(fec_blocks[row], data_blocks[blockNo],
+	for(row=firstFecBlock; row < firstFecBlock + nrFecBlocks; row++)
+	    addmul(fec_blocks[row - firstFecBlock], data_blocks[blockNo],
 		   inverse[row ^ col],
 		   blockSize);
     }
@@ -847,16 +1093,152 @@ long long resolveTime =0;
 long long invTime =0;
 #endif
 
+/*
+ * LRU cache of inverted decode matrices. The matrix of the reduced system only
+ * depends on which data blocks were erased and which FEC blocks are used to
+ * recover them (not on k or n), on a steady link the same few patterns repeat.
+ * A single erasure is not cached (its inverse is one table lookup).
+ * With more data blocks the loss patterns rarely repeat (k=32: ~1% hits, k=64:
+ * ~0.1% hits with a Gilbert-Elliott loss model), and the lookup / insert only
+ * adds to the decode time (k=64, n=96: +5..29%), such groups bypass the cache.
+ * Shared by all threads, the lock is only held for the lookup / insert.
+ * Disabled by default, enabled with fec_set_decode_cache_size().
+ */
+#define DECODE_CACHE_MAX_ENTRIES 32
+#define DECODE_CACHE_MAX_DATA_BLOCKS 16
+#define DECODE_CACHE_MAX_BLOCKS DECODE_CACHE_MAX_DATA_BLOCKS
+
+struct decode_cache_entry {
+    unsigned long last_used; /* 0 if unused */
+    unsigned int hash;
+    unsigned short nr_blocks;
+    unsigned char fec_block_nos[DECODE_CACHE_MAX_BLOCKS];
+    unsigned char erased_blocks[DECODE_CACHE_MAX_BLOCKS];
+    gf matrix[DECODE_CACHE_MAX_BLOCKS*DECODE_CACHE_MAX_BLOCKS];
+};
+
+static struct decode_cache_entry decode_cache[DECODE_CACHE_MAX_ENTRIES];
+/* Also read without the lock, to bypass the cache when it is disabled */
+static atomic_int decode_cache_size = 0;
+static unsigned long decode_cache_clock = 0;
+static unsigned long decode_cache_hits = 0;
+static unsigned long decode_cache_misses = 0;
+static pthread_mutex_t decode_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int decode_cache_hash(unsigned int *fec_block_nos,
+				      unsigned int *erased_blocks,
+				      int nr_blocks)
+{
+    unsigned int hash = 2166136261u; /* FNV-1a */
+    int i;
+    for(i=0; i < nr_blocks; i++) {
+	hash = (hash ^ fec_block_nos[i]) * 16777619u;
+	hash = (hash ^ erased_blocks[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int decode_cache_matches(const struct decode_cache_entry *e,
+				unsigned int hash,
+				unsigned int *fec_block_nos,
+				unsigned int *erased_blocks,
+				int nr_blocks)
+{
+    int i;
+    if(!e->last_used || e->hash != hash || e->nr_blocks != nr_blocks)
+	return 0;
+    for(i=0; i < nr_blocks; i++) {
+	if(e->fec_block_nos[i] != fec_block_nos[i] ||
+	   e->erased_blocks[i] != erased_blocks[i])
+	    return 0;
+    }
+    return 1;
+}
+
+/* Copies the cached inverted matrix into matrix, returns 0 if not cached */
+static int decode_cache_lookup(unsigned int hash,
+			       unsigned int *fec_block_nos,
+			       unsigned int *erased_blocks,
+			       int nr_blocks,
+			       gf *matrix)
+{
+    int i, found = 0;
+    pthread_mutex_lock(&decode_cache_mutex);
+    for(i=0; i < decode_cache_size; i++) {
+	struct decode_cache_entry *e = &decode_cache[i];
+	if(decode_cache_matches(e, hash, fec_block_nos, erased_blocks, nr_blocks)) {
+	    e->last_used = ++decode_cache_clock;
+	    memcpy(matrix, e->matrix, nr_blocks*nr_blocks);
+	    found = 1;
+	    break;
+	}
+    }
+    if(found)
+	decode_cache_hits++;
+    else
+	decode_cache_misses++;
+    pthread_mutex_unlock(&decode_cache_mutex);
+    return found;
+}
+
+/* Replaces the least recently used entry */
+static void decode_cache_insert(unsigned int hash,
+				unsigned int *fec_block_nos,
+				unsigned int *erased_blocks,
+				int nr_blocks,
+				const gf *matrix)
+{
+    int i;
+    struct decode_cache_entry *victim = NULL;
+    pthread_mutex_lock(&decode_cache_mutex);
+    for(i=0; i < decode_cache_size; i++) {
+	struct decode_cache_entry *e = &decode_cache[i];
+	if(victim == NULL || e->last_used < victim->last_used)
+	    victim = e;
+    }
+    if(victim != NULL) {
+	victim->last_used = ++decode_cache_clock;
+	victim->hash = hash;
+	victim->nr_blocks = nr_blocks;
+	for(i=0; i < nr_blocks; i++) {
+	    victim->fec_block_nos[i] = fec_block_nos[i];
+	    victim->erased_blocks[i] = erased_blocks[i];
+	}
+	memcpy(victim->matrix, matrix, nr_blocks*nr_blocks);
+    }
+    pthread_mutex_unlock(&decode_cache_mutex);
+}
+
+int fec_set_decode_cache_size(int entries)
+{
+    if(entries < 0 || entries > DECODE_CACHE_MAX_ENTRIES)
+	return -1;
+    pthread_mutex_lock(&decode_cache_mutex);
+    memset(decode_cache, 0, sizeof(decode_cache));
+    decode_cache_size = entries;
+    pthread_mutex_unlock(&decode_cache_mutex);
+    return 0;
+}
+
+void fec_get_decode_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+    pthread_mutex_lock(&decode_cache_mutex);
+    *hits = decode_cache_hits;
+    *misses = decode_cache_misses;
+    pthread_mutex_unlock(&decode_cache_mutex);
+}
+
 /**
  * Resolves reduced system. Constructs "mini" encoding matrix, inverts
  * it, and multiply reduced vector by it.
  */
 static inline void resolve(int blockSize,
 			   unsigned char **data_blocks,
+			   unsigned int nr_data_blocks,
 			   unsigned char **fec_blocks,
 			   unsigned int *fec_block_nos,
 			   unsigned int *erased_blocks,
-			   short nr_fec_blocks)
+			   unsigned short nr_fec_blocks)
 {
 #ifdef PROFILE
     long long begin;
@@ -866,6 +1248,15 @@ static inline void resolve(int blockSize,
     unsigned char matrix[nr_fec_blocks*nr_fec_blocks];
     int ptr;
     int r;
+    int cacheable = nr_fec_blocks > 1 && nr_data_blocks <= DECODE_CACHE_MAX_DATA_BLOCKS &&
+	atomic_load_explicit(&decode_cache_size, memory_order_relaxed) > 0;
+    unsigned int hash = 0;
+
+    if(cacheable) {
+	hash = decode_cache_hash(fec_block_nos, erased_blocks, nr_fec_blocks);
+	if(decode_cache_lookup(hash, fec_block_nos, erased_blocks, nr_fec_blocks, matrix))
+	    goto multiply;
+    }
 
     /* we pick the submatrix of code that keeps colums corresponding to
      * the erased data blocks, and rows corresponding to the present FEC
@@ -902,7 +1293,10 @@ static inline void resolve(int blockSize,
 	fprintf(stderr, "\n");
 	assert(0);
     }
+    if(cacheable)
+	decode_cache_insert(hash, fec_block_nos, erased_blocks, nr_fec_blocks, matrix);
 
+ multiply:
     /* do the multiplication with the reduced code vector */
     for(row = 0, ptr=0; row < nr_fec_blocks; row++) {
 	int col;
@@ -938,7 +1332,7 @@ void fec_decode(unsigned int blockSize,
     reduceTime += end - begin;
     begin = end;
 #endif
-    resolve(blockSize, data_blocks,
+    resolve(blockSize, data_blocks, nr_data_blocks,
 	    fec_blocks, fec_block_nos, erased_blocks,
 	    nr_fec_blocks);
 #ifdef PROFILE
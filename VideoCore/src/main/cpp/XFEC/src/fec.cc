@@ -9,44 +9,89 @@
 #include <wifibroadcast/fec.hh>
 
 /*******************************************************************************
- * FECEncoder
+ * FECBlockPool
  ******************************************************************************/
 
-static bool hasFECInitialized=false;
+FECBlockPool::~FECBlockPool() {
+  for (FECBlock *block : m_free) {
+    delete block;
+  }
+}
+
+FECBlockPtr FECBlockPool::acquire(uint16_t pkt_length) {
+  FECBlock *block = nullptr;
+  if (pkt_length <= m_block_capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_free.empty()) {
+      block = m_free.back();
+      m_free.pop_back();
+    }
+  }
+  if (!block) {
+    block = new FECBlock(std::max(pkt_length, m_block_capacity));
+    ++m_n_allocated;
+  }
+  // Oversized blocks are not returned to the pool
+  if (block->m_capacity == m_block_capacity) {
+    block->m_pool = shared_from_this();
+  }
+  return FECBlockPtr(block);
+}
+
+void FECBlockPool::recycle(FECBlock *block) {
+  // Keeps the pool alive until the block was returned, even if the owner of the pool is gone
+  std::shared_ptr<FECBlockPool> pool = std::move(block->m_pool);
+  if (!pool) {
+    delete block;
+    return;
+  }
+  std::lock_guard<std::mutex> lock(pool->m_mutex);
+  if (pool->m_free.size() < pool->m_max_free_blocks) {
+    pool->m_free.push_back(block);
+  } else {
+    delete block;
+  }
+}
+
+/*******************************************************************************
+ * FECEncoder
+ ******************************************************************************/
 
 FECEncoder::FECEncoder(uint8_t num_blocks, uint8_t num_fec_blocks, uint16_t max_block_size,
 		       uint8_t start_seq_num) :
   m_num_blocks(num_blocks), m_num_fec_blocks(num_fec_blocks), m_max_block_size(max_block_size),
-  m_seq_num(start_seq_num) {
-  // Ensure that the FEC library is initialized
-  // This may not work with multiple threads!
-  // Modification by C
-  if(!hasFECInitialized){
-    fec_init();
-    hasFECInitialized=true;
-  }
+  m_seq_num(start_seq_num),
+  m_pool(std::make_shared<FECBlockPool>(max_block_size + sizeof(FECHeader) - 2)),
+  m_out_pos(0) {
+  // Ensure that the FEC library is initialized (only done once)
+  fec_init();
 }
 
 // Allocate and initialize the next data block.
-std::shared_ptr<FECBlock> FECEncoder::get_next_block(uint16_t length) {
-  return std::shared_ptr<FECBlock>(new FECBlock(m_seq_num, m_in_blocks.size(), m_num_blocks,
-						m_num_fec_blocks, m_max_block_size, length));
+FECBlockPtr FECEncoder::get_next_block(uint16_t length) {
+  FECBlockPtr block = m_pool->acquire(std::max(m_max_block_size, static_cast<uint16_t>(length + 2)) +
+                                      sizeof(FECHeader) - 2);
+  block->init(m_seq_num, m_in_blocks.size(), m_num_blocks, m_num_fec_blocks, length);
+  return block;
 }
 
 // Add an incoming data block to be encoded
-void FECEncoder::add_block(std::shared_ptr<FECBlock> block) {
+void FECEncoder::add_block(FECBlockPtr block) {
   FECHeader *h = block->header();
+  h->seq_num = m_seq_num;
   h->block = m_in_blocks.size();
+  h->n_blocks = m_num_blocks;
+  h->n_fec_blocks = m_num_fec_blocks;
 
   // Just output the block if we're not actually encoding.
   if ((m_num_fec_blocks == 0) || (m_num_blocks == 0)) {
-    m_out_blocks.push(block);
+    push_output(std::move(block));
     ++m_seq_num;
     if(m_seq_num == 0) {
       ++m_seq_num;
     }
   } else {
-    m_in_blocks.push_back(block);
+    m_in_blocks.push_back(std::move(block));
 
     // Calculate the FEC blocks when we've received enough blocks.
     if ((m_num_fec_blocks > 0) && (h->block == (m_num_blocks - 1))) {
@@ -56,13 +101,17 @@ void FECEncoder::add_block(std::shared_ptr<FECBlock> block) {
 }
 
 // Retrieve the next data/fec block
-std::shared_ptr<FECBlock> FECEncoder::get_block() {
-  if (m_out_blocks.empty()) {
-    return std::shared_ptr<FECBlock>();
+FECBlockPtr FECEncoder::get_block() {
+  if (m_out_pos == m_out_blocks.size()) {
+    m_out_blocks.clear();
+    m_out_pos = 0;
+    return FECBlockPtr();
   }
-  std::shared_ptr<FECBlock> ret = m_out_blocks.front();
-  m_out_blocks.pop();
-  return ret;
+  return std::move(m_out_blocks[m_out_pos++]);
+}
+
+void FECEncoder::push_output(FECBlockPtr block) {
+  m_out_blocks.push_back(std::move(block));
 }
 
 // Complete the sequence with the current set of blocks
@@ -70,270 +119,696 @@ void FECEncoder::flush() {
   encode_blocks();
 }
 
-void FECEncoder::encode_blocks() {
-  uint8_t num_blocks = m_in_blocks.size();
-  if (num_blocks == 0) {
-    return;
-  }
+void FECEncoder::reset(uint8_t num_blocks, uint8_t num_fec_blocks, uint8_t seq_num) {
+  m_num_blocks = num_blocks;
+  m_num_fec_blocks = num_fec_blocks;
+  m_seq_num = seq_num;
+  m_in_blocks.clear();
+}
+
+// Pads the data blocks of a sequence to the size of the biggest one, moves them to out and appends the (not yet encoded)
+// FEC blocks. Fills the pointers for fec_encode and returns the FEC block size.
+static uint16_t prepare_sequence(std::vector<FECBlockPtr> &in_blocks, uint8_t seq_num, uint8_t num_fec_blocks,
+				 FECBlockPool &pool, std::vector<FECBlockPtr> &out,
+				 std::vector<uint8_t*> &data_ptrs, std::vector<uint8_t*> &fec_ptrs) {
+  uint8_t num_blocks = in_blocks.size();
 
   // The block size will be calculated as the size of the largest block in the sequence
   uint16_t block_size = 0;
   for (uint8_t i = 0; i < num_blocks; ++i) {
-    std::shared_ptr<FECBlock> block = m_in_blocks[i];
-    block_size = std::max(block_size, block->block_size());
+    block_size = std::max(block_size, in_blocks[i]->block_size());
   }
   
   // Create the FEC arrays of pointers to the data blocks.
-  std::vector<uint8_t*> data_blocks(m_num_blocks);
+  data_ptrs.resize(num_blocks);
   for (uint8_t i = 0; i < num_blocks; ++i) {
-    std::shared_ptr<FECBlock> block = m_in_blocks[i];
-    block->adjust_block_size(block_size);
-    data_blocks[i] = block->fec_data();
+    FECBlockPtr &block = in_blocks[i];
+    // Zero the padding (the blocks are reused). Only a block next to an oversized block does not fit.
+    if (!block->adjust_block_size(block_size)) {
+      FECBlockPtr bigger = pool.acquire(block_size + sizeof(FECHeader) - 2);
+      bigger->init(block->pkt_data(), block->pkt_length());
+      bigger->adjust_block_size(block_size);
+      block = bigger;
+    }
+    data_ptrs[i] = block->fec_data();
     block->header()->n_blocks = num_blocks;
-    m_out_blocks.push(block);
+    out.push_back(std::move(block));
   }
 
   // Create the output FEC blocks
-  std::vector<uint8_t*> fec_blocks(m_num_fec_blocks);
-  for (uint8_t i = 0; i < m_num_fec_blocks; ++i) {
-    std::shared_ptr<FECBlock> block(new FECBlock(m_seq_num, num_blocks + i, num_blocks,
-						 m_num_fec_blocks, block_size, block_size - 2));
-    fec_blocks[i] = block->fec_data();
-    m_out_blocks.push(block);
+  fec_ptrs.resize(num_fec_blocks);
+  for (uint8_t i = 0; i < num_fec_blocks; ++i) {
+    FECBlockPtr block = pool.acquire(block_size + sizeof(FECHeader) - 2);
+    block->init(seq_num, num_blocks + i, num_blocks, num_fec_blocks, block_size - 2);
+    fec_ptrs[i] = block->fec_data();
+    out.push_back(std::move(block));
   }
+  in_blocks.clear();
+  return block_size;
+}
+
+void FECEncoder::encode_blocks() {
+  uint8_t num_blocks = m_in_blocks.size();
+  if (num_blocks == 0) {
+    return;
+  }
+
+  uint16_t block_size = prepare_sequence(m_in_blocks, m_seq_num, m_num_fec_blocks, *m_pool, m_out_blocks,
+					 m_data_ptrs, m_fec_ptrs);
 
   // Encode the blocks.
-  fec_encode(block_size, data_blocks.data(), num_blocks, fec_blocks.data(), m_num_fec_blocks);
+  fec_encode(block_size, m_data_ptrs.data(), num_blocks, m_fec_ptrs.data(), m_num_fec_blocks);
 
   // Prepare for the next set of blocks.
   ++m_seq_num;
   if(m_seq_num == 0) {
     ++m_seq_num;
   }
-  m_in_blocks.clear();
 }
 
 
 /*******************************************************************************
- * FECDecoderEncoder
+ * ParallelFECEncoder
  ******************************************************************************/
 
-FECDecoder::FECDecoder() : m_block_size(0) {
-  //fec_init();
-  // Mod by Consti
-    if(!hasFECInitialized){
-        fec_init();
-        hasFECInitialized=true;
+ParallelFECEncoder::ParallelFECEncoder(uint8_t num_blocks, uint8_t num_fec_blocks, uint16_t max_block_size,
+				       unsigned int n_threads, uint8_t start_seq_num) :
+  m_seq_num(start_seq_num), m_num_blocks(num_blocks), m_num_fec_blocks(num_fec_blocks),
+  m_max_block_size(max_block_size),
+  m_pool(std::make_shared<FECBlockPool>(max_block_size + sizeof(FECHeader) - 2)),
+  m_n_output_blocks(0), m_stop(false) {
+  fec_init();
+  for (unsigned int i = 0; i < n_threads; ++i) {
+    m_workers.emplace_back(&ParallelFECEncoder::worker, this);
+  }
+}
+
+ParallelFECEncoder::~ParallelFECEncoder() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_task_cv.notify_all();
+  // The workers finish the queued tasks before they exit
+  for (std::thread &t : m_workers) {
+    t.join();
+  }
+}
+
+FECBlockPtr ParallelFECEncoder::get_next_block(uint16_t length) {
+  FECBlockPtr block = m_pool->acquire(std::max(m_max_block_size, static_cast<uint16_t>(length + 2)) +
+                                      sizeof(FECHeader) - 2);
+  block->init(m_seq_num, m_in_blocks.size(), m_num_blocks, m_num_fec_blocks, length);
+  return block;
+}
+
+ParallelFECEncoder::Sequence &ParallelFECEncoder::new_sequence() {
+  if (m_free_sequences.empty()) {
+    m_sequences.emplace_back(new Sequence());
+  } else {
+    m_sequences.push_back(std::move(m_free_sequences.back()));
+    m_free_sequences.pop_back();
+  }
+  Sequence &seq = *m_sequences.back();
+  seq.n_data_blocks = 0;
+  seq.block_size = 0;
+  seq.n_open_tasks = 0;
+  seq.encoded = true;
+  seq.out_pos = 0;
+  return seq;
+}
+
+void ParallelFECEncoder::add_block(FECBlockPtr block) {
+  FECHeader *h = block->header();
+  h->seq_num = m_seq_num;
+  h->block = m_in_blocks.size();
+  h->n_blocks = m_num_blocks;
+  h->n_fec_blocks = m_num_fec_blocks;
+
+  // Just output the block if we're not actually encoding.
+  if ((m_num_fec_blocks == 0) || (m_num_blocks == 0)) {
+    Sequence &seq = new_sequence();
+    seq.blocks.push_back(std::move(block));
+    seq.n_data_blocks = 1;
+    ++m_n_output_blocks;
+    ++m_seq_num;
+    if(m_seq_num == 0) {
+      ++m_seq_num;
+    }
+  } else {
+    m_in_blocks.push_back(std::move(block));
+
+    // Hand the sequence to the workers when we've received enough blocks.
+    if (h->block == (m_num_blocks - 1)) {
+      encode_blocks();
     }
+  }
 }
 
-void FECDecoder::add_block(const uint8_t *buf, uint16_t block_length) {
-  std::shared_ptr<FECBlock> blk(new FECBlock(buf, block_length));
-  const FECHeader &h = *blk->header();
-  uint8_t n_blocks = h.n_blocks;
-  uint8_t n_fec_blocks = h.n_fec_blocks;
-  FECHeader &ph = m_prev_header;
-  uint16_t unrolled_prev_seq = static_cast<uint16_t>(ph.seq_num);
-  uint16_t unrolled_seq = static_cast<uint16_t>(h.seq_num);
-  if (unrolled_prev_seq > unrolled_seq) {
-    unrolled_seq += 256;
+void ParallelFECEncoder::encode_blocks() {
+  uint8_t num_blocks = m_in_blocks.size();
+  if (num_blocks == 0) {
+    return;
+  }
+  Sequence &seq = new_sequence();
+  seq.n_data_blocks = num_blocks;
+  seq.block_size = prepare_sequence(m_in_blocks, m_seq_num, m_num_fec_blocks, *m_pool, seq.blocks,
+				    seq.data_ptrs, seq.fec_ptrs);
+  m_n_output_blocks += seq.blocks.size();
+
+  ++m_seq_num;
+  if(m_seq_num == 0) {
+    ++m_seq_num;
   }
-  ++m_stats.total_packets;
-  m_stats.bytes += block_length;
 
-  // Just release the block of FEC is not being performed on this channel.
-  if ((n_blocks == 0) || (n_fec_blocks == 0)) {
-    uint16_t db = (unrolled_seq - unrolled_prev_seq - 1);
-    m_stats.dropped_packets += db;
-    m_stats.dropped_blocks += db;
-    ph = h;
-    m_out_blocks.push(blk);
+  if (m_workers.empty()) {
+    encode(Task{&seq, 0, m_num_fec_blocks});
     return;
   }
+  // Split the rows evenly if the sequence is big enough
+  unsigned int n_tasks = 1;
+  if (static_cast<size_t>(num_blocks) * m_num_fec_blocks * seq.block_size >= MIN_SPLIT_WORK) {
+    n_tasks = std::min<unsigned int>(m_workers.size(), m_num_fec_blocks);
+  }
+  seq.encoded = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    seq.n_open_tasks = n_tasks;
+    unsigned int first_row = 0;
+    for (unsigned int i = 0; i < n_tasks; ++i) {
+      unsigned int n_rows = (m_num_fec_blocks - first_row) / (n_tasks - i);
+      m_tasks.push_back(Task{&seq, first_row, n_rows});
+      first_row += n_rows;
+    }
+  }
+  if (n_tasks == 1) {
+    m_task_cv.notify_one();
+  } else {
+    m_task_cv.notify_all();
+  }
+}
 
-  // Are we actively processing a block?
-  if (m_block_size != 0) {
+void ParallelFECEncoder::encode(const Task &task) {
+  Sequence &seq = *task.seq;
+  fec_encode_rows(seq.block_size, seq.data_ptrs.data(), seq.n_data_blocks, seq.fec_ptrs.data() + task.first_row,
+		  task.first_row, task.n_rows);
+}
 
-    // Did we reach the end of a sequence without getting enough blocks?
-    if (unrolled_prev_seq != unrolled_seq) {
+void ParallelFECEncoder::worker() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_task_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+    if (m_tasks.empty()) {
+      return;
+    }
+    Task task = m_tasks.front();
+    m_tasks.pop_front();
+    lock.unlock();
+    encode(task);
+    lock.lock();
+    if (--task.seq->n_open_tasks == 0) {
+      m_done_cv.notify_all();
+    }
+  }
+}
 
-      // If se get a (unrolled) sequence number that is less than the previous sequence number
-      // we've obviously lost sync.
-      if (unrolled_seq < unrolled_prev_seq) {
-	++m_stats.lost_sync;
-        LOG_DEBUG << "Lost sync: seq=" << int(h.seq_num) << " pseq=" << int(ph.seq_num);
-      } else {
+bool ParallelFECEncoder::is_encoded(Sequence &seq, bool wait) {
+  if (!seq.encoded) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (wait) {
+      m_done_cv.wait(lock, [&seq] { return seq.n_open_tasks == 0; });
+    }
+    seq.encoded = (seq.n_open_tasks == 0);
+  }
+  return seq.encoded;
+}
 
-	// Calculate how many packets we dropped with this break in the sequence.
-        uint32_t db = unrolled_seq - unrolled_prev_seq;
-        if (db > 0) {
-          m_stats.dropped_blocks += db;
-          LOG_DEBUG << "Dropped block: pbn=" << unrolled_seq << " pseq=" << unrolled_prev_seq;
-        }
-
-	// Calculate how many packets we dropped.
-	uint64_t pbn = unrolled_prev_seq * static_cast<uint64_t>(n_blocks + n_fec_blocks) + ph.block;
-	uint64_t bn = unrolled_seq * static_cast<uint64_t>(n_blocks + n_fec_blocks) + h.block;
-	if (pbn < bn) {
-	  m_stats.dropped_packets += bn - pbn;
-          LOG_DEBUG << "Dropped packets: pbn=" << pbn << " pseq=" << bn;
-	}
-      }
+FECBlockPtr ParallelFECEncoder::next_block(bool wait) {
+  while (!m_sequences.empty()) {
+    Sequence &seq = *m_sequences.front();
+    if (seq.out_pos == seq.blocks.size()) {
+      // All FEC blocks were retrieved, e.g. no worker uses the sequence any more
+      seq.blocks.clear();
+      m_free_sequences.push_back(std::move(m_sequences.front()));
+      m_sequences.pop_front();
+      continue;
+    }
+    if (seq.out_pos >= seq.n_data_blocks && !is_encoded(seq, wait)) {
+      return FECBlockPtr();
+    }
+    --m_n_output_blocks;
+    if (!seq.encoded) {
+      // The workers may still read the data block, keep a reference until the sequence is encoded
+      return seq.blocks[seq.out_pos++];
+    }
+    return std::move(seq.blocks[seq.out_pos++]);
+  }
+  return FECBlockPtr();
+}
 
-      // Reset the sequence.
-      m_block_size = 0;
-      m_blocks.clear();
-      m_fec_blocks.clear();
+FECBlockPtr ParallelFECEncoder::get_block() {
+  return next_block(false);
+}
 
-    } else if(h.block <= ph.block) {
+FECBlockPtr ParallelFECEncoder::wait_block() {
+  return next_block(true);
+}
 
-      // This shouldn't happen.
-      ++m_stats.dropped_packets;
-      LOG_DEBUG << "FEC Decoder: This shouldn't happen";
-    } else {
+void ParallelFECEncoder::flush() {
+  encode_blocks();
+  for (std::unique_ptr<Sequence> &seq : m_sequences) {
+    is_encoded(*seq, true);
+  }
+}
+
+void ParallelFECEncoder::reset(uint8_t num_blocks, uint8_t num_fec_blocks, uint8_t seq_num) {
+  m_num_blocks = num_blocks;
+  m_num_fec_blocks = num_fec_blocks;
+  m_seq_num = seq_num;
+  m_in_blocks.clear();
+}
 
-      // Record any dropped packets from the last packet.
-      uint32_t dropped = (h.block - ph.block) - 1;
-      if (dropped > 0) {
-        m_stats.dropped_packets += dropped;
-        LOG_DEBUG << "Dropped prev: blk=" << int(h.block) << " pblk=" << int(ph.block);
-      }
-    }
 
-  } else if (unrolled_prev_seq == unrolled_seq) {
+/*******************************************************************************
+ * FECDecoderEncoder
+ ******************************************************************************/
 
-    // Are we skipping past the end if the current block that has been completed?
-    ph = h;
+// The encoders skip sequence number 0 on wrap around
+static inline uint8_t next_seq_num(uint8_t seq_num) {
+  return (seq_num == 255) ? 1 : seq_num + 1;
+}
+
+// The n of sequences from seq_num to seq_num2, values of 128 and above mean seq_num2 is before seq_num
+static inline uint8_t seq_num_distance(uint8_t seq_num, uint8_t seq_num2) {
+  uint8_t d = seq_num2 - seq_num;
+  if (seq_num2 < seq_num) {
+    --d;
+  }
+  return d;
+}
+
+void FECDecoder::Group::reset() {
+  has_params = false;
+  complete = false;
+  released = false;
+  waiting = false;
+  n_blocks = 0;
+  n_fec_blocks = 0;
+  n_present = 0;
+  n_released = 0;
+  n_declared = 0;
+  max_position = 0;
+  block_size = 0;
+  blocks.clear();
+  arrival.clear();
+  fec_blocks.clear();
+  received.reset();
+}
+
+FECDecoder::FECDecoder(uint16_t max_block_size, uint8_t max_open_groups,
+		       std::chrono::milliseconds max_latency, uint8_t max_reorder_blocks) :
+  m_pool(std::make_shared<FECBlockPool>(max_block_size + sizeof(FECHeader) - 2)),
+  m_max_open_groups(std::max<uint8_t>(1, std::min(max_open_groups, MAX_OPEN_GROUPS))),
+  m_max_latency(max_latency), m_max_reorder_blocks(max_reorder_blocks), m_groups(256), m_synced(false), m_head(0), m_end(0), m_n_open(0),
+  m_out_pos(0) {
+  // Ensure that the FEC library is initialized (only done once)
+  fec_init();
+  for (auto &g : m_groups) {
+    g.reset();
+  }
+}
+
+void FECDecoder::add_block(const uint8_t *buf, uint16_t block_length) {
+  FECBlockPtr blk = m_pool->acquire(block_length);
+  blk->init(buf, block_length);
+  add_block(std::move(blk), block_length);
+}
+
+void FECDecoder::add_block(FECBlockPtr blk, uint16_t block_length) {
+  blk->pkt_length(block_length);
+  // The length field of a data block has to be within the packet, else the block would expose stale data of the pool
+  // (the length field of a FEC block is part of the FEC data)
+  bool has_length = (blk->header()->n_fec_blocks == 0) || blk->is_data_block();
+  if ((block_length < sizeof(FECHeader)) ||
+      (has_length && (blk->data_length() + sizeof(FECHeader) > block_length)) ||
+      ((blk->header()->n_fec_blocks > 0) &&
+       (blk->header()->block >= blk->header()->n_blocks + blk->header()->n_fec_blocks))) {
+    ++m_stats.dropped_packets;
+    LOG_DEBUG << "Dropped malformed block";
     return;
   }
-  ph = h;
+  const FECHeader &h = *blk->header();
+  ++m_stats.total_packets;
+  m_stats.bytes += block_length;
+  const auto now = std::chrono::steady_clock::now();
+
+  // Blocks without FEC are a sequence of their own
+  bool pass_through = (h.n_blocks == 0) || (h.n_fec_blocks == 0);
+  uint8_t n_blocks = pass_through ? 1 : h.n_blocks;
+  uint8_t n_fec_blocks = pass_through ? 0 : h.n_fec_blocks;
+  uint8_t block = pass_through ? 0 : h.block;
 
-  // Record any packets we might have skipped at the beginning of the sequence.
-  if ((m_block_size == 0) && (h.block > 0)) {
-    m_stats.dropped_packets += h.block;
-    LOG_DEBUG << "Dropped begin: blk=" << int(h.block) << " pblk=" << int(ph.block);
+  // Sequence number 0 is only used by an encoder that (re)started
+  if (m_synced && (h.seq_num == 0) && (m_head != 0)) {
+    ++m_stats.lost_sync;
+    LOG_DEBUG << "Lost sync: seq=0 head=" << int(m_head);
+    flush();
+  }
+  if (!m_synced) {
+    m_head = m_end = h.seq_num;
+    m_n_open = 0;
+    m_synced = true;
   }
 
-  // The current block size is equal to the block size of the largest block.
-  if (blk->is_data_block()) {
-    m_block_size = std::max(m_block_size, blk->block_size());
+  uint8_t d = seq_num_distance(m_head, h.seq_num);
+  if (d >= 128) {
+    const Group &g = m_groups[h.seq_num];
+    if ((255 - d) > std::max(2 * m_max_open_groups, 32)) {
+      // Way behind the open sequences, the encoder probably restarted
+      ++m_stats.lost_sync;
+      LOG_DEBUG << "Lost sync: seq=" << int(h.seq_num) << " head=" << int(m_head);
+      flush();
+      m_head = m_end = h.seq_num;
+      m_synced = true;
+      d = 0;
+    } else if (g.received[block]) {
+      ++m_stats.duplicate_blocks;
+      return;
+    } else {
+      // Blocks of a complete sequence are not needed anymore
+      if (!g.complete) {
+        ++m_stats.late_blocks;
+        LOG_DEBUG << "Late block: seq=" << int(h.seq_num) << " blk=" << int(h.block);
+      }
+      return;
+    }
+  }
+
+  // Release the oldest sequences until this sequence is within the open sequences
+  while (d >= m_max_open_groups) {
+    release_head();
+    d = seq_num_distance(m_head, h.seq_num);
+  }
+  while (m_n_open <= d) {
+    m_groups[m_end].reset();
+    m_end = next_seq_num(m_end);
+    ++m_n_open;
+  }
+
+  const uint8_t seq_num = h.seq_num;
+  Group &g = m_groups[seq_num];
+  if (!g.has_params) {
+    g.has_params = true;
+    g.n_blocks = n_blocks;
+    g.n_fec_blocks = n_fec_blocks;
+    g.blocks.resize(n_blocks);
+    g.arrival.resize(n_blocks);
+  } else if ((g.n_blocks != n_blocks) || (g.n_fec_blocks != n_fec_blocks)) {
+    ++m_stats.dropped_packets;
+    LOG_DEBUG << "Dropped block with different sequence parameters: seq=" << int(h.seq_num);
+    return;
+  }
+  if (g.received[block]) {
+    ++m_stats.duplicate_blocks;
+    return;
   }
+  g.received[block] = true;
+  g.max_position = std::max<int>(g.max_position, block);
 
-  // Is this a data block or FEC block?
+  // The block size of the sequence is equal to the block size of the largest block.
+  // FEC blocks have the full block size, which matters if the largest data block was lost.
   if (blk->is_data_block()) {
+    g.block_size = std::max(g.block_size, blk->block_size());
+  } else {
+    g.block_size = std::max(g.block_size, static_cast<uint16_t>(block_length - sizeof(FECHeader) + 2));
+  }
 
-    // Add this block to the list of blocks.
-    m_blocks.push_back(blk);
+  if (!g.complete) {
+    if (pass_through || blk->is_data_block()) {
+      // Data blocks that were declared lost already are still used for decoding
+      if (block < g.n_released) {
+        ++m_stats.late_blocks;
+        LOG_DEBUG << "Late block: seq=" << int(seq_num) << " blk=" << int(block);
+      }
+      g.blocks[block] = std::move(blk);
+      g.arrival[block] = now;
+      ++g.n_present;
+    } else {
+      g.fec_blocks.push_back(std::move(blk));
+    }
+    if (g.n_present == g.n_blocks) {
+      g.complete = true;
+      g.fec_blocks.clear();
+      ++m_stats.total_blocks;
+    } else if ((g.n_present + g.fec_blocks.size()) == g.n_blocks) {
+      // Decode as soon as enough blocks arrived, independent of the earlier sequences
+      decode(g, now);
+      g.complete = true;
+      g.fec_blocks.clear();
+      ++m_stats.total_blocks;
+    } else {
+      declare_overtaken_lost(g);
+    }
+  }
 
-    // Release the block if we don't have a gap.
-    if ((m_blocks.size() - 1) == h.block) {
-      m_out_blocks.push(blk);
+  // The blocks of the earlier sequences were overtaken by this block (each sequence has at least one block)
+  uint8_t earlier_seq_num = m_head;
+  for (uint8_t i = 0; earlier_seq_num != seq_num; ++i, earlier_seq_num = next_seq_num(earlier_seq_num)) {
+    Group &e = m_groups[earlier_seq_num];
+    if (e.has_params && !e.complete) {
+      e.max_position = std::max<int>(e.max_position, e.n_blocks + e.n_fec_blocks + (d - i - 1) + block);
+      declare_overtaken_lost(e);
     }
+  }
 
-    // Have we reached the end of the data blocks without dropping a packet?
-    if (m_blocks.size() == n_blocks) {
-      m_block_size = 0;
-      m_blocks.clear();
-      m_fec_blocks.clear();
-      ++m_stats.total_blocks;
+  release_groups(now);
+
+  // The data blocks of a later sequence have to wait for the earlier sequences
+  if (!g.released && !g.waiting && (seq_num != m_head) && (g.n_present > 0)) {
+    g.waiting = true;
+    g.waiting_since = now;
+  }
+}
+
+void FECDecoder::declare_overtaken_lost(Group &g) {
+  const int n_total = g.n_blocks + g.n_fec_blocks;
+  // Blocks before first_pending were overtaken by more than max_reorder_blocks later blocks
+  const int first_pending = g.max_position - m_max_reorder_blocks;
+  if (first_pending <= g.n_declared) {
+    return;
+  }
+  int n_pending = std::max(n_total - 1 - g.max_position, 0);
+  for (int i = first_pending; i < std::min(g.max_position + 1, n_total); ++i) {
+    if (!g.received[i]) {
+      ++n_pending;
     }
+  }
+  // Parity can not fill the gaps anymore, only the blocks that might still arrive are waited for
+  if (g.n_present + g.fec_blocks.size() + n_pending < g.n_blocks) {
+    g.n_declared = std::min<int>(first_pending, g.n_blocks);
+  }
+}
 
-  } else {
+void FECDecoder::release_expired() {
+  if (m_n_open > 0) {
+    release_groups(std::chrono::steady_clock::now());
+  }
+}
 
-    // Add this block to the list of FEC blocks.
-    m_fec_blocks.push_back(blk);
+void FECDecoder::flush() {
+  while (m_n_open > 0) {
+    release_head();
+  }
+  m_synced = false;
+}
 
-    // Decode once we've received anough blocks + FEC blocks and have dropped a block.
-    if ((m_blocks.size() + m_fec_blocks.size()) == n_blocks) {
+void FECDecoder::release_groups(std::chrono::steady_clock::time_point now) {
+  while (m_n_open > 0) {
+    Group &g = m_groups[m_head];
+    release_data_blocks(g);
+    if (g.complete || (g.has_params && (g.n_released == g.n_blocks))) {
+      release_head();
+      continue;
+    }
 
-      // Decode the sequence
-      decode();
+    // Wait for the missing blocks unless a later data block waited for too long. Then the first missing
+    // data block of the oldest sequence is lost, or the whole sequence if none of its later data blocks arrived.
+    if (!expired(now)) {
+      break;
+    }
+    if (g.waiting) {
+      g.n_declared = g.n_released + 1;
+    } else {
+      release_head();
+    }
+  }
+}
 
-      // Start waiting for blocks from the next packet.
-      m_block_size = 0;
-      m_blocks.clear();
-      m_fec_blocks.clear();
-      ++m_stats.total_blocks;
+void FECDecoder::release_data_blocks(Group &g) {
+  // Output the data blocks up to the first gap that was not declared lost right away
+  // (and keep them until the sequence is decoded)
+  for (; g.n_released < g.blocks.size(); ++g.n_released) {
+    FECBlockPtr &block = g.blocks[g.n_released];
+    if (block) {
+      if (g.complete) {
+        push_output(std::move(block));
+      } else {
+        push_output(block);
+      }
+    } else if (g.n_released < g.n_declared) {
+      ++m_stats.dropped_packets;
+    } else {
+      break;
+    }
+  }
+
+  // The remaining data blocks wait since the oldest of them arrived
+  g.waiting = false;
+  for (size_t i = g.n_released; i < g.blocks.size(); ++i) {
+    if (g.blocks[i] && (!g.waiting || (g.arrival[i] < g.waiting_since))) {
+      g.waiting = true;
+      g.waiting_since = g.arrival[i];
     }
   }
 }
 
-void FECDecoder::decode() {
-  if (m_blocks.size() == 0) {
-    return;
+void FECDecoder::release_head() {
+  Group &g = m_groups[m_head];
+  if (m_n_open == 0) {
+    // Nothing was received for this sequence
+    g.reset();
+  }
+  if (!g.complete) {
+    ++m_stats.dropped_blocks;
+    if (g.has_params) {
+      LOG_DEBUG << "Dropped blocks: seq=" << int(m_head) << " missing=" << int(g.n_blocks - g.n_present);
+    }
   }
-  const FECHeader &h = *m_blocks[0]->header();
-  uint8_t n_blocks = h.n_blocks;
-  uint8_t n_fec_blocks = h.n_fec_blocks;
 
-  // Sanity check the number of blocks
-  if (n_blocks > (m_blocks.size() + m_fec_blocks.size())) {
-    ++m_stats.lost_sync;
-    return;
+  // Output the remainder of the data blocks, missing blocks are lost
+  for (; g.n_released < g.blocks.size(); ++g.n_released) {
+    if (g.blocks[g.n_released]) {
+      push_output(std::move(g.blocks[g.n_released]));
+    } else if (!g.complete) {
+      ++m_stats.dropped_packets;
+    }
   }
-  if ((n_blocks == 0) || (n_fec_blocks == 0)) {
-    return;
+  g.blocks.clear();
+  g.fec_blocks.clear();
+  g.released = true;
+  g.waiting = false;
+
+  m_head = next_seq_num(m_head);
+  if (m_n_open > 0) {
+    --m_n_open;
+  }
+  if (m_n_open == 0) {
+    m_end = m_head;
   }
+}
 
-  // Create the vector of data blocks.
-  std::vector<uint8_t*> block_ptrs(n_blocks, 0);
-  std::vector<std::shared_ptr<FECBlock> > blocks(n_blocks);
-  for (auto block : m_blocks) {
-    blocks[block->header()->block] = block;
-    block_ptrs[block->header()->block] = block->fec_data();
+bool FECDecoder::expired(std::chrono::steady_clock::time_point now) const {
+  uint8_t seq_num = m_head;
+  for (uint8_t i = 0; i < m_n_open; ++i, seq_num = next_seq_num(seq_num)) {
+    const Group &g = m_groups[seq_num];
+    if (g.waiting && (now - g.waiting_since >= m_max_latency)) {
+      return true;
+    }
   }
+  return false;
+}
 
-  // Create the erased blocks array
-  std::vector<std::shared_ptr<FECBlock> > fec_blocks;
-  std::vector<unsigned int> erased_block_idxs;
-  for (size_t i = 0; i < h.n_blocks; ++i) {
-    if (!block_ptrs[i]) {
-      std::shared_ptr<FECBlock> blk(new FECBlock(h, m_block_size));
-      erased_block_idxs.push_back(i);
-      fec_blocks.push_back(blk);
-      blocks[i] = blk;
-      block_ptrs[i] = blk->fec_data();
+void FECDecoder::decode(Group &g, std::chrono::steady_clock::time_point now) {
+  uint8_t n_blocks = g.n_blocks;
+
+  // Blocks that are shorter than the FEC block size are zero padded
+  m_block_ptrs.assign(n_blocks, 0);
+  const FECHeader *h = nullptr;
+  for (size_t i = 0; i < n_blocks; ++i) {
+    FECBlockPtr &block = g.blocks[i];
+    if (!block) {
+      continue;
     }
+    if ((block->pkt_length() < g.block_size + sizeof(FECHeader) - 2) &&
+        !block->adjust_block_size(g.block_size)) {
+      ++m_stats.lost_sync;
+      m_stats.dropped_packets += n_blocks - g.n_present;
+      return;
+    }
+    m_block_ptrs[i] = block->fec_data();
+    h = block->header();
   }
 
   // Create the FEC blocks array
-  std::vector<uint8_t*> fec_block_ptrs;
-  std::vector<unsigned int> fec_block_idxs;
-  for (auto block : m_fec_blocks) {
+  m_fec_block_ptrs.clear();
+  m_fec_block_idxs.clear();
+  for (auto &block : g.fec_blocks) {
+    if ((block->pkt_length() < g.block_size + sizeof(FECHeader) - 2) &&
+        !block->adjust_block_size(g.block_size)) {
+      ++m_stats.lost_sync;
+      m_stats.dropped_packets += n_blocks - g.n_present;
+      return;
+    }
     uint8_t fec_block_idx = block->header()->block - block->header()->n_blocks;
-    fec_block_ptrs.push_back(block->fec_data());
-    fec_block_idxs.push_back(fec_block_idx);
+    m_fec_block_ptrs.push_back(block->fec_data());
+    m_fec_block_idxs.push_back(fec_block_idx);
+    h = block->header();
+  }
+
+  // Create the erased blocks array
+  m_erased_block_idxs.clear();
+  for (size_t i = 0; i < n_blocks; ++i) {
+    if (!m_block_ptrs[i]) {
+      FECBlockPtr blk = m_pool->acquire(g.block_size + sizeof(FECHeader) - 2);
+      blk->init(*h, g.block_size);
+      blk->header()->block = i;
+      m_erased_block_idxs.push_back(i);
+      m_block_ptrs[i] = blk->fec_data();
+      g.blocks[i] = std::move(blk);
+    }
   }
 
   // Decode the blocks
-  fec_decode(m_block_size,
-	     block_ptrs.data(),
+  fec_decode(g.block_size,
+	     m_block_ptrs.data(),
 	     n_blocks,
-	     fec_block_ptrs.data(),
-	     fec_block_idxs.data(),
-	     erased_block_idxs.data(),
-	     erased_block_idxs.size());
-
-  // Send the remainder of blocks that have a reasonable length.
-  for (size_t i = erased_block_idxs[0]; i < n_blocks; ++i) {
-    uint16_t length = blocks[i]->data_length();
-    if (length <= m_block_size) {
-      m_out_blocks.push(blocks[i]);
+	     m_fec_block_ptrs.data(),
+	     m_fec_block_idxs.data(),
+	     m_erased_block_idxs.data(),
+	     m_erased_block_idxs.size());
+
+  // Keep the recovered blocks that have a reasonable length.
+  for (unsigned int i : m_erased_block_idxs) {
+    FECBlockPtr &block = g.blocks[i];
+    uint16_t length = block->data_length();
+    if (length <= g.block_size - 2) {
+      block->data_length(length);
+      g.arrival[i] = now;
+      ++g.n_present;
+      // Blocks that were declared lost already are not output anymore
+      if (i >= g.n_released) {
+        ++m_stats.recovered_blocks;
+      }
     } else {
-      ++m_stats.dropped_blocks;
+      block.reset();
+      ++m_stats.dropped_packets;
       LOG_DEBUG << "Dropped due to length";
     }
   }
 }
 
 // Retrieve the next data/fec block
-std::shared_ptr<FECBlock> FECDecoder::get_block() {
-  if (m_out_blocks.empty()) {
-    return std::shared_ptr<FECBlock>();
+FECBlockPtr FECDecoder::get_block() {
+  if (m_out_pos == m_out_blocks.size()) {
+    m_out_blocks.clear();
+    m_out_pos = 0;
+    return FECBlockPtr();
   }
-  std::shared_ptr<FECBlock> ret = m_out_blocks.front();
-  m_out_blocks.pop();
-  return ret;
+  return std::move(m_out_blocks[m_out_pos++]);
+}
+
+void FECDecoder::push_output(FECBlockPtr blk) {
+  m_out_blocks.push_back(std::move(blk));
 }
 
 FECDecoderStats operator-(const FECDecoderStats& s1, const FECDecoderStats &s2) {
@@ -344,6 +819,9 @@ FECDecoderStats operator-(const FECDecoderStats& s1, const FECDecoderStats &s2)
   ret.dropped_packets = s1.dropped_packets - s2.dropped_packets;
   ret.lost_sync = s1.lost_sync - s2.lost_sync;
   ret.bytes = s1.bytes - s2.bytes;
+  ret.late_blocks = s1.late_blocks - s2.late_blocks;
+  ret.duplicate_blocks = s1.duplicate_blocks - s2.duplicate_blocks;
+  ret.recovered_blocks = s1.recovered_blocks - s2.recovered_blocks;
   return ret;
 }
 
@@ -355,6 +833,9 @@ FECDecoderStats operator+(const FECDecoderStats& s1, const FECDecoderStats &s2)
   ret.dropped_packets = s1.dropped_packets + s2.dropped_packets;
   ret.lost_sync = s1.lost_sync + s2.lost_sync;
   ret.bytes = s1.bytes + s2.bytes;
+  ret.late_blocks = s1.late_blocks + s2.late_blocks;
+  ret.duplicate_blocks = s1.duplicate_blocks + s2.duplicate_blocks;
+  ret.recovered_blocks = s1.recovered_blocks + s2.recovered_blocks;
   return ret;
 }
 
@@ -362,9 +843,9 @@ FECDecoderStats operator+(const FECDecoderStats& s1, const FECDecoderStats &s2)
  * FECBufferEncoder
  ******************************************************************************/
 
-std::vector<std::shared_ptr<FECBlock> >
+std::vector<FECBlockPtr>
 FECBufferEncoder::encode_buffer(const uint8_t *buf, size_t len) {
-  std::vector<std::shared_ptr<FECBlock> > ret;
+  std::vector<FECBlockPtr> ret;
 
   // Divide the buffer into blocks as close to the maximum block size as possible
   uint32_t nblocks = static_cast<uint32_t>(std::ceil(static_cast<double>(len) / m_max_block_size));
@@ -399,14 +880,14 @@ FECBufferEncoder::encode_buffer(const uint8_t *buf, size_t len) {
     uint32_t start = b * block_size;
     uint32_t end = std::min(start + block_size, static_cast<uint32_t>(len));
     uint32_t length = end - start;
-    std::shared_ptr<FECBlock> blk = enc.get_next_block(length);
+    FECBlockPtr blk = enc.get_next_block(length);
     std::copy(buf + start, buf + end, blk->data());
     enc.add_block(blk);
     count += length;
   }
 
   // Pull all the blocks out of the encoder
-  for (std::shared_ptr<FECBlock> blk = enc.get_block(); blk; blk = enc.get_block()) {
+  for (FECBlockPtr blk = enc.get_block(); blk; blk = enc.get_block()) {
     ret.push_back(blk);
   }
 
@@ -3,17 +3,43 @@
 
 #include <wfb_bridge.hh>
 #include <raw_send_thread.hh>
+#include <priority_scheduler.hh>
 
 void raw_send_thread(SharedQueue<std::shared_ptr<Message> > &outqueue,
 		     RawSendSocket raw_send_sock, uint16_t max_queue_size,
-		     TransferStats &trans_stats, bool &terminate) {
+		     TransferStats &trans_stats, bool &terminate, double max_priority_wait) {
+
+  // The messages of all links are sorted into one queue per link priority
+  PriorityScheduler<std::shared_ptr<Message> > scheduler(max_queue_size, max_priority_wait);
+  size_t sched_dropped = 0;
 
   // Send message out of the send queue
   while(!terminate) {
 
-    // Pull the next packet off the queue
-    std::shared_ptr<Message> msg = outqueue.pop();
-    bool flush = (msg->msg.size() == 0);
+    // Move all packets that arrived into the priority queues, wait if there is nothing to send
+    // A flush (empty message without a block) bypasses the queue limit, dropping it would leave the last block of a frame
+    // in the encoder. Only dropped data counts as dropped blocks.
+    auto schedule = [&scheduler, &sched_dropped](std::shared_ptr<Message> &&m) {
+      bool is_flush = (m->msg.size() == 0) && !m->block;
+      uint8_t priority = m->priority;
+      if (!scheduler.push(std::move(m), priority, cur_time(), is_flush)) {
+	++sched_dropped;
+      }
+    };
+    std::shared_ptr<Message> msg;
+    if (scheduler.empty()) {
+      schedule(outqueue.pop());
+    }
+    while (outqueue.try_pop(msg)) {
+      schedule(std::move(msg));
+    }
+
+    // Pull the next packet of the highest priority (or one that waited too long)
+    uint8_t priority;
+    if (!scheduler.pop(msg, priority, cur_time())) {
+      continue;
+    }
+    bool flush = (msg->msg.size() == 0) && !msg->block;
 
     // FEC encode the packet if requested.
     double loop_start = cur_time();
@@ -26,26 +52,30 @@ void raw_send_thread(SharedQueue<std::shared_ptr<Message> > &outqueue,
       enc->flush();
     } else {
       double enc_start = cur_time();
-      // Get a FEC encoder block
-      std::shared_ptr<FECBlock> block = enc->get_next_block(msg->msg.size());
-      // Copy the data into the block
-      std::copy(msg->msg.data(), msg->msg.data() + msg->msg.size(), block->data());
+      // Use the block the data was received into, else copy the data into a FEC encoder block
+      FECBlockPtr block = std::move(msg->block);
+      if (!block) {
+        block = enc->get_next_block(msg->msg.size());
+        std::copy(msg->msg.data(), msg->msg.data() + msg->msg.size(), block->data());
+      }
       // Pass it off to the FEC encoder.
-      enc->add_block(block);
+      enc->add_block(std::move(block));
       trans_stats.add_encode_time(cur_time() - enc_start);
     }
 
     // Transmit any packets that are finished in the encoder.
-    size_t queue_size = outqueue.size() + enc->n_output_blocks();
-    uint16_t dropped_blocks = 0;
+    size_t queue_size = scheduler.size() + outqueue.size() + enc->n_output_blocks();
+    uint16_t dropped_blocks = sched_dropped;
+    sched_dropped = 0;
     size_t count = 0;
     size_t nblocks = 0;
-    for (std::shared_ptr<FECBlock> block = enc->get_block(); block;
+    for (FECBlockPtr block = enc->get_block(); block;
 	 block = enc->get_block()) {
       double send_start = cur_time();
       // If the link is slower than the data rate we need to drop some packets.
+      // Only the backlog of this priority counts, e.g. a saturated video link does not drop the FEC of the others.
       if (block->is_fec_block() &
-	  ((outqueue.size() + enc->n_output_blocks()) > max_queue_size)) {
+	  ((scheduler.size(priority) + enc->n_output_blocks()) > max_queue_size)) {
 	++dropped_blocks;
 	continue;
       }
@@ -145,7 +145,7 @@ int main(int argc, char** argv) {
       if (len > 0) {
         dec.add_block(msg.data.data(), msg.data.size());
       }
-      for (std::shared_ptr<FECBlock> block = dec.get_block(); block;
+      for (FECBlockPtr block = dec.get_block(); block;
            block = dec.get_block()) {
       }
       uint64_t t = time.usec();
@@ -188,7 +188,7 @@ int main(int argc, char** argv) {
       uint64_t t = time.usec();
       if ((t - send_time) >= period) {
         {
-          std::shared_ptr<FECBlock> block = enc.get_next_block(length);
+          FECBlockPtr block = enc.get_next_block(length);
           if (!message.empty()) {
             memcpy(block->data(), reinterpret_cast<const uint8_t*>(message.c_str()), message.size());
             length = message.size();
@@ -199,7 +199,7 @@ int main(int argc, char** argv) {
           }
           enc.add_block(block);
         }
-        for (std::shared_ptr<FECBlock> block = enc.get_block(); block;
+        for (FECBlockPtr block = enc.get_block(); block;
              block = enc.get_block()) {
           raw_send_sock.send(block->pkt_data(), block->pkt_length(), port, DATA_LINK,
                              datarate);
@@ -5,9 +5,20 @@
 #include <random>
 #include <list>
 #include <chrono>
+#include <sstream>
+#include <functional>
+#include <cstring>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <array>
 //#include <cxxopts.hpp>
 
 #include <wifibroadcast/fec.hh>
+#include <shared_queue.hh>
+#include <priority_scheduler.hh>
 #include <logging.hh>
 
 inline double cur_time() {
@@ -52,7 +63,7 @@ std::vector<std::vector<uint8_t>> createRandomDataBuffers(const ssize_t nBuffers
 }
 
 // Returns the cumulative size of all FECBlocks
-std::size_t cumulativeSizeBytes(const std::vector<std::shared_ptr<FECBlock>>& blocks){
+std::size_t cumulativeSizeBytes(const std::vector<FECBlockPtr>& blocks){
   std::size_t fecDataSize=0;
   for(const auto& block:blocks){
     fecDataSize+=block->block_size();
@@ -65,9 +76,9 @@ std::size_t cumulativeSizeBytes(const std::vector<std::shared_ptr<FECBlock>>& bl
 // @param RANDOMNESS: the smaller the value, the more packets are dropped
 // If RANDOMNESS is a negative value no packets are dropped,if RANDOMNESS is 0 all packets are dropped
 // If RANDOMNESS is 10 for example, roughly 10 % of the packets are dropped
-std::size_t sendDataLossy(FECDecoder& dec,const std::vector<std::shared_ptr<FECBlock>>& blks,const int RANDOMNESS=10){
+std::size_t sendDataLossy(FECDecoder& dec,const std::vector<FECBlockPtr>& blks,const int RANDOMNESS=10){
     std::size_t drop_count=0;
-    for (std::shared_ptr<FECBlock> blk : blks) {
+    for (FECBlockPtr blk : blks) {
         bool dropPacket=false;
         if(RANDOMNESS>0 && ((rand() % RANDOMNESS) == 0)){
             dropPacket=true;
@@ -83,11 +94,11 @@ std::size_t sendDataLossy(FECDecoder& dec,const std::vector<std::shared_ptr<FECB
 
 
 //same as above but also switch the order packets are sent
-std::size_t sendDataLossyAndOutOfOrder(FECDecoder&dec,const std::vector<std::shared_ptr<FECBlock>>& blks){
+std::size_t sendDataLossyAndOutOfOrder(FECDecoder&dec,const std::vector<FECBlockPtr>& blks){
     // we can copy a shared pointer without performance penalty
-    std::list<std::shared_ptr<FECBlock>> workingData{blks.begin(),blks.end()};
+    std::list<FECBlockPtr> workingData{blks.begin(),blks.end()};
     // shuffle the data a little bit
-    std::list<std::shared_ptr<FECBlock>>::iterator item(workingData.begin());
+    std::list<FECBlockPtr>::iterator item(workingData.begin());
     for(std::size_t i=0;i<workingData.size();i++){
         if ((rand() % 10) == 0) {
             // swap
@@ -102,7 +113,7 @@ std::size_t sendDataLossyAndOutOfOrder(FECDecoder&dec,const std::vector<std::sha
 std::vector<uint8_t> getDataFromDecoder(FECDecoder& dec){
     std::vector<uint8_t> obuf;
     obuf.reserve(1024*1024);
-    for (std::shared_ptr<FECBlock> sblk = dec.get_block(); sblk; sblk = dec.get_block()) {
+    for (FECBlockPtr sblk = dec.get_block(); sblk; sblk = dec.get_block()) {
         MLOGD<<"Blk size "<<sblk->block_size()<<" Data size "<<sblk->data_length();
         std::copy(sblk->data(), sblk->data() + sblk->data_length(),
                   std::back_inserter(obuf));
@@ -126,7 +137,7 @@ std::pair<uint32_t, double> run_test(FECBufferEncoder &enc,const uint32_t max_bl
     auto buf=createRandomDataBuffer(buf_size);
 
     // Encode the test data
-    std::vector<std::shared_ptr<FECBlock> > blks = enc.encode_buffer(buf);
+    std::vector<FECBlockPtr> blks = enc.encode_buffer(buf);
 
     // emulate transmission over a lossy link
     const uint32_t drop_count=sendDataLossy(dec,blks,10);
@@ -166,7 +177,7 @@ void run_test2(){
     for(int i=0; i < packets.size(); i++){
         const auto buff=packets.at(i);
         // Convert the current packet to FEC data
-        std::vector<std::shared_ptr<FECBlock> > blks = enc.encode_buffer(buff);
+        std::vector<FECBlockPtr> blks = enc.encode_buffer(buff);
         MLOGD<<"N created blocks "<<blks.size();
 
         for(const auto& blk:blks){
@@ -257,6 +268,765 @@ void test() {
 }
 
 
+// Encode k random data blocks into n-k FEC blocks with the currently selected GF(256) kernel
+static std::vector<std::vector<uint8_t>> encodeBlocks(const std::vector<std::vector<uint8_t>>& dataBlocks,const unsigned nFECBlocks){
+    const unsigned blockSize=dataBlocks[0].size();
+    std::vector<std::vector<uint8_t>> data=dataBlocks;
+    std::vector<std::vector<uint8_t>> fec(nFECBlocks,std::vector<uint8_t>(blockSize));
+    std::vector<uint8_t*> dataPtrs,fecPtrs;
+    for(auto& block:data)dataPtrs.push_back(block.data());
+    for(auto& block:fec)fecPtrs.push_back(block.data());
+    fec_encode(blockSize,dataPtrs.data(),dataPtrs.size(),fecPtrs.data(),fecPtrs.size());
+    return fec;
+}
+
+// Erase the first nErased data blocks and recover them from the first nErased FEC blocks
+static std::vector<std::vector<uint8_t>> decodeBlocks(std::vector<std::vector<uint8_t>> data,std::vector<std::vector<uint8_t>> fec,const unsigned nErased){
+    const unsigned blockSize=data[0].size();
+    std::vector<uint8_t*> dataPtrs,fecPtrs;
+    std::vector<unsigned int> fecBlockNos,erasedBlocks;
+    for(unsigned i=0;i<data.size();i++){
+        if(i<nErased){
+            std::fill(data[i].begin(),data[i].end(),0);
+            erasedBlocks.push_back(i);
+            fecBlockNos.push_back(i);
+            fecPtrs.push_back(fec[i].data());
+        }
+        dataPtrs.push_back(data[i].data());
+    }
+    fec_decode(blockSize,dataPtrs.data(),dataPtrs.size(),fecPtrs.data(),fecBlockNos.data(),erasedBlocks.data(),nErased);
+    return data;
+}
+
+/**
+ * Checks that every GF(256) kernel this CPU supports (see fec_simd_t) creates the same FEC blocks as the table version and
+ * recovers the original data (also for block sizes that do not fill a whole vector).
+ * Then measures the encode and decode throughput of each kernel on one core, in GB/s of data blocks,
+ * for different block sizes and k (data blocks) / n (data + FEC blocks)
+ */
+std::string benchmarkFECKernels(){
+    fec_init();
+    const int selectedSimd=fec_get_simd();
+    std::vector<int> kernels;
+    for(int simd=FEC_SIMD_NONE;simd<=FEC_SIMD_NEON;simd++){
+        if(fec_simd_supported(simd))kernels.push_back(simd);
+    }
+    std::stringstream ss;
+    ss<<"Selected kernel:"<<fec_simd_name(selectedSimd)<<"\n";
+    for(const int simd:kernels){
+        bool bitExact=true;
+        for(const unsigned blockSize:{1,15,16,17,31,33,63,64,65,127,1446}){
+            const auto data=createRandomDataBuffers(8,blockSize);
+            fec_set_simd(FEC_SIMD_NONE);
+            const auto expected=encodeBlocks(data,4);
+            fec_set_simd(simd);
+            const auto fec=encodeBlocks(data,4);
+            bitExact=bitExact && fec==expected && decodeBlocks(data,fec,4)==data;
+        }
+        ss<<fec_simd_name(simd)<<" bit-exact:"<<(bitExact ? "yes" : "no")<<"\n";
+    }
+    struct KN{unsigned k;unsigned n;};
+    // Measure for at least this long per kernel, block size and k/n
+    constexpr double MEASURE_TIME_S=0.02;
+    const auto gbPerSecond=[](const std::function<void()>& run,const std::size_t bytesPerRun){
+        std::size_t nRuns=0;
+        const double start=cur_time();
+        double elapsed=0;
+        while(elapsed<MEASURE_TIME_S){
+            run();
+            nRuns++;
+            elapsed=cur_time()-start;
+        }
+        return (double)(bytesPerRun*nRuns)/elapsed/1e9;
+    };
+    for(const unsigned blockSize:{256,1024,1446,4096}){
+        for(const KN kn:{KN{8,12},KN{32,48},KN{64,128},KN{100,128}}){
+            const unsigned nFECBlocks=kn.n-kn.k;
+            const unsigned nErased=std::min(kn.k,nFECBlocks);
+            auto data=createRandomDataBuffers(kn.k,blockSize);
+            std::vector<std::vector<uint8_t>> fec(nFECBlocks,std::vector<uint8_t>(blockSize));
+            std::vector<uint8_t*> dataPtrs,fecPtrs;
+            for(auto& block:data)dataPtrs.push_back(block.data());
+            for(auto& block:fec)fecPtrs.push_back(block.data());
+            ss<<"block size:"<<blockSize<<" k:"<<kn.k<<" n:"<<kn.n<<" GB/s encode/decode";
+            for(const int simd:kernels){
+                fec_set_simd(simd);
+                const double encode=gbPerSecond([&]{
+                    fec_encode(blockSize,dataPtrs.data(),kn.k,fecPtrs.data(),nFECBlocks);
+                },(std::size_t)kn.k*blockSize);
+                // fec_decode works in place, the used FEC blocks are restored for each run (a small part of the work)
+                const auto pristineFEC=fec;
+                std::vector<unsigned int> fecBlockNos,erasedBlocks;
+                for(unsigned i=0;i<nErased;i++){
+                    fecBlockNos.push_back(i);
+                    erasedBlocks.push_back(i);
+                }
+                auto recovered=data;
+                std::vector<uint8_t*> recoveredPtrs;
+                for(auto& block:recovered)recoveredPtrs.push_back(block.data());
+                const double decode=gbPerSecond([&]{
+                    for(unsigned i=0;i<nErased;i++){
+                        std::memcpy(fecPtrs[i],pristineFEC[i].data(),blockSize);
+                    }
+                    fec_decode(blockSize,recoveredPtrs.data(),kn.k,fecPtrs.data(),fecBlockNos.data(),erasedBlocks.data(),nErased);
+                },(std::size_t)kn.k*blockSize);
+                for(unsigned i=0;i<nFECBlocks;i++){
+                    std::memcpy(fecPtrs[i],pristineFEC[i].data(),blockSize);
+                }
+                ss<<" "<<fec_simd_name(simd)<<":"<<encode<<"/"<<decode;
+            }
+            ss<<"\n";
+        }
+    }
+    fec_set_simd(selectedSimd);
+    return ss.str();
+}
+
+/**
+ * Sends packets through a FECEncoder and a FECDecoder (k=8 n=12, one data block of each group lost) using the zero copy
+ * ingest of both: The payload is built directly in FECEncoder::new_block() and each packet is "received" directly into
+ * FECDecoder::new_block(). After a warm up, no more blocks should be allocated by the block pools of encoder and decoder.
+ */
+std::string benchmarkFECBlockPool(){
+    constexpr uint16_t MAX_PAYLOAD_SIZE=1446;
+    constexpr int K=8,N=12;
+    constexpr int N_WARMUP_GROUPS=100,N_GROUPS=20000;
+    FECEncoder enc(K,N-K,MAX_PAYLOAD_SIZE+2);
+    FECDecoder dec(MAX_PAYLOAD_SIZE+2);
+    const auto payload=createRandomDataBuffer(MAX_PAYLOAD_SIZE);
+    bool bitExact=true;
+    std::size_t nPackets=0,nBytes=0;
+    std::size_t allocatedEnc=0,allocatedDec=0;
+    double start=0;
+    for(int group=0;group<N_WARMUP_GROUPS+N_GROUPS;group++){
+        if(group==N_WARMUP_GROUPS){
+            allocatedEnc=enc.n_allocated_blocks();
+            allocatedDec=dec.n_allocated_blocks();
+            start=cur_time();
+        }
+        for(int i=0;i<K;i++){
+            // Different sizes per block, such that the padding is used
+            const uint16_t size=MAX_PAYLOAD_SIZE-(uint16_t)((group*K+i)%64);
+            FECBlockPtr block=enc.new_block();
+            std::memcpy(block->data(),payload.data(),size);
+            block->data_length(size);
+            enc.add_block(std::move(block));
+        }
+        int index=0;
+        for(FECBlockPtr block=enc.get_block();block;block=enc.get_block()){
+            // One data block per group is lost
+            if(index++ == group%K)continue;
+            FECBlockPtr rx=dec.new_block();
+            std::memcpy(rx->pkt_data(),block->pkt_data(),block->pkt_length());
+            dec.add_block(std::move(rx),block->pkt_length());
+            nPackets++;
+        }
+        for(FECBlockPtr block=dec.get_block();block;block=dec.get_block()){
+            bitExact=bitExact && std::memcmp(block->data(),payload.data(),block->data_length())==0;
+            nBytes+=block->data_length();
+        }
+    }
+    const double elapsed=cur_time()-start;
+    std::stringstream ss;
+    ss<<"FEC block pool: "<<(nPackets/elapsed/1000.0)<<" kPackets/s "<<(nBytes*8/elapsed/1e6)<<" MBit/s";
+    ss<<" steady-state block allocations encoder:"<<(enc.n_allocated_blocks()-allocatedEnc);
+    ss<<" decoder:"<<(dec.n_allocated_blocks()-allocatedDec);
+    ss<<" pooled blocks encoder:"<<allocatedEnc<<" decoder:"<<allocatedDec;
+    ss<<" bit-exact:"<<(bitExact && dec.stats().dropped_blocks==0 ? "yes" : "no");
+    return ss.str();
+}
+
+/**
+ * Decodes the same sequence of groups once without and once with the decode matrix cache of fec_decode.
+ * The loss follows a Gilbert-Elliott model (random loss in the good state, bursts in the bad state). Like the FECDecoder,
+ * the first received FEC blocks are used to recover the erased data blocks.
+ * Reports the cache hit ratio (groups with more than one erasure) and the decode time with / without the cache.
+ */
+std::string benchmarkFECDecodeCache(){
+    fec_init();
+    struct Scenario{unsigned k;unsigned n;unsigned blockSize;};
+    constexpr int N_GROUPS=20000;
+    std::stringstream ss;
+    bool bitExact=true;
+    for(const Scenario scenario:{Scenario{8,12,1024},Scenario{32,48,1024},Scenario{64,96,256}}){
+        const unsigned k=scenario.k,nFEC=scenario.n-scenario.k,blockSize=scenario.blockSize;
+        // Loss pattern of each group (true = lost)
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> uniform(0,1);
+        bool badState=false;
+        std::vector<std::vector<bool>> lost(N_GROUPS,std::vector<bool>(scenario.n));
+        for(auto& group:lost){
+            for(std::size_t i=0;i<group.size();i++){
+                badState= badState ? uniform(random)>=0.3f : uniform(random)<0.02f;
+                group[i]=uniform(random)<(badState ? 0.5f : 0.01f);
+            }
+        }
+        const auto data=createRandomDataBuffers(k,blockSize);
+        const auto fec=encodeBlocks(data,nFEC);
+        ss<<"k:"<<k<<" n:"<<scenario.n<<" block size:"<<blockSize;
+        double decodeTime[2]={0,0};
+        int nDecodes=0;
+        unsigned long hits[2],misses[2];
+        // The first round is only a warm up
+        for(const int cacheSize:{0,16,0,16}){
+            fec_set_decode_cache_size(cacheSize);
+            decodeTime[cacheSize>0]=0;
+            fec_get_decode_cache_stats(&hits[0],&misses[0]);
+            auto recovered=data;
+            auto working=fec;
+            std::vector<uint8_t*> dataPtrs,fecPtrs;
+            std::vector<unsigned int> fecBlockNos,erasedBlocks;
+            nDecodes=0;
+            for(const auto& group:lost){
+                erasedBlocks.clear();
+                fecBlockNos.clear();
+                for(unsigned i=0;i<k;i++){
+                    if(group[i])erasedBlocks.push_back(i);
+                }
+                for(unsigned i=0;i<nFEC && fecBlockNos.size()<erasedBlocks.size();i++){
+                    if(!group[k+i])fecBlockNos.push_back(i);
+                }
+                // Nothing to do or not recoverable
+                if(erasedBlocks.empty() || fecBlockNos.size()<erasedBlocks.size())continue;
+                dataPtrs.clear();
+                fecPtrs.clear();
+                for(unsigned i=0;i<k;i++){
+                    dataPtrs.push_back(recovered[i].data());
+                }
+                for(const auto i:erasedBlocks){
+                    std::fill(recovered[i].begin(),recovered[i].end(),0);
+                }
+                for(const auto i:fecBlockNos){
+                    std::memcpy(working[i].data(),fec[i].data(),blockSize);
+                    fecPtrs.push_back(working[i].data());
+                }
+                const auto start=std::chrono::steady_clock::now();
+                fec_decode(blockSize,dataPtrs.data(),k,fecPtrs.data(),fecBlockNos.data(),erasedBlocks.data(),erasedBlocks.size());
+                decodeTime[cacheSize>0]+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+                for(const auto i:erasedBlocks){
+                    bitExact=bitExact && recovered[i]==data[i];
+                }
+                nDecodes++;
+            }
+            fec_get_decode_cache_stats(&hits[1],&misses[1]);
+        }
+        const unsigned long nLookups=(hits[1]-hits[0])+(misses[1]-misses[0]);
+        ss<<" decodes:"<<nDecodes<<" hit ratio:"<<(nLookups>0 ? 100.0*(hits[1]-hits[0])/nLookups : 0.0)<<"%";
+        ss<<" us/decode without cache:"<<decodeTime[0]*1e6/std::max(nDecodes,1)<<" with cache:"<<decodeTime[1]*1e6/std::max(nDecodes,1);
+        ss<<" reduction:"<<(decodeTime[0]>0 ? 100.0*(1-decodeTime[1]/decodeTime[0]) : 0.0)<<"%\n";
+    }
+    fec_set_decode_cache_size(0);
+    ss<<"bit-exact:"<<(bitExact ? "yes" : "no");
+    return ss.str();
+}
+
+// The data blocks of the FECDecoder tests start with their index in the stream, followed by the same payload.
+// The length depends on the index, such that the padding is used
+static uint16_t indexedBlockLength(const uint32_t index,const std::vector<uint8_t>& payload){
+    return (uint16_t)(payload.size()-index%16);
+}
+
+static void encodeIndexedBlocks(FECEncoder& enc,const std::vector<uint8_t>& payload,const uint32_t firstIndex,const uint32_t nBlocks,
+                                std::vector<FECBlockPtr>& packets){
+    for(uint32_t i=firstIndex;i<firstIndex+nBlocks;i++){
+        FECBlockPtr block=enc.new_block();
+        std::memcpy(block->data(),payload.data(),payload.size());
+        std::memcpy(block->data(),&i,sizeof(i));
+        block->data_length(indexedBlockLength(i,payload));
+        enc.add_block(std::move(block));
+        for(FECBlockPtr packet=enc.get_block();packet;packet=enc.get_block()){
+            packets.push_back(std::move(packet));
+        }
+    }
+}
+
+// Returns the index of the data block or -1 if the block is corrupted
+static int64_t checkIndexedBlock(const FECBlock& block,const std::vector<uint8_t>& payload){
+    uint32_t index;
+    if(block.data_length()<sizeof(index))return -1;
+    std::memcpy(&index,block.data(),sizeof(index));
+    const bool bitExact=block.data_length()==indexedBlockLength(index,payload) &&
+        std::memcmp(block.data()+sizeof(index),payload.data()+sizeof(index),block.data_length()-sizeof(index))==0;
+    return bitExact ? index : -1;
+}
+
+/**
+ * Sends a stream of groups (k=8 n=12) over two emulated paths to FECDecoders with one and with multiple open sequences.
+ * Every second packet takes a path that is 2.5 groups behind, both paths lose 3% of the packets and 1% of the packets
+ * are sent over both paths. Each data block starts with its index, the output has to be in order and bit-exact.
+ * Also checks that an incomplete sequence is released once a later data block waited for the deadline.
+ */
+std::string testFECDecoderReorder(){
+    constexpr uint16_t PAYLOAD_SIZE=1024;
+    constexpr int K=8,N=12,N_GROUPS=2000;
+    constexpr int DELAY_PACKETS=30;
+    const auto payload=createRandomDataBuffer(PAYLOAD_SIZE);
+    // Returns the n of data blocks, inOrderAndBitExact is cleared if they are not in order or corrupted
+    auto receive=[&](FECDecoder& dec,int64_t& lastIndex,bool& inOrderAndBitExact){
+        int n=0;
+        for(FECBlockPtr block=dec.get_block();block;block=dec.get_block()){
+            const int64_t index=checkIndexedBlock(*block,payload);
+            inOrderAndBitExact=inOrderAndBitExact && index>lastIndex;
+            lastIndex=index;
+            n++;
+        }
+        return n;
+    };
+    std::vector<FECBlockPtr> packets;
+    FECEncoder enc(K,N-K,PAYLOAD_SIZE+2);
+    encodeIndexedBlocks(enc,payload,0,N_GROUPS*K,packets);
+    // Arrival time (in packets) of each packet that is not lost
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> uniform(0,1);
+    std::vector<std::pair<std::size_t,const FECBlockPtr*>> arrivals;
+    for(std::size_t i=0;i<packets.size();i++){
+        const bool duplicate=uniform(random)<0.01f;
+        for(int path=0;path<2;path++){
+            if((duplicate || (int)(i%2)==path) && uniform(random)>=0.03f){
+                arrivals.emplace_back(i+path*DELAY_PACKETS,&packets[i]);
+            }
+        }
+    }
+    std::stable_sort(arrivals.begin(),arrivals.end(),[](const auto& a,const auto& b){
+        return a.first<b.first;
+    });
+    std::stringstream ss;
+    bool inOrderAndBitExact=true;
+    int nReceived[2]={0,0};
+    for(const int maxOpenGroups:{1,8}){
+        // The blocks of the second path are overtaken by the blocks of more than two groups
+        FECDecoder dec(PAYLOAD_SIZE+2,maxOpenGroups,std::chrono::milliseconds(1000),255);
+        int64_t lastIndex=-1;
+        int& n=nReceived[maxOpenGroups>1];
+        for(const auto& arrival:arrivals){
+            dec.add_block(*arrival.second);
+            n+=receive(dec,lastIndex,inOrderAndBitExact);
+        }
+        dec.flush();
+        n+=receive(dec,lastIndex,inOrderAndBitExact);
+        const FECDecoderStats& stats=dec.stats();
+        ss<<"open groups:"<<maxOpenGroups<<" data blocks:"<<(100.0f*n/(N_GROUPS*K))<<"%";
+        ss<<" recovered:"<<stats.recovered_blocks<<" late:"<<stats.late_blocks<<" duplicates:"<<stats.duplicate_blocks;
+        ss<<" dropped:"<<stats.dropped_packets<<"\n";
+    }
+    // Only the first data block of the first group arrives, the second group has to be released once it waited for
+    // the deadline (the missing blocks are not declared lost by being overtaken)
+    bool deadline;
+    {
+        FECDecoder dec(PAYLOAD_SIZE+2,8,std::chrono::milliseconds(5),255);
+        FECEncoder enc2(K,N-K,PAYLOAD_SIZE+2);
+        std::vector<FECBlockPtr> lost,received;
+        encodeIndexedBlocks(enc2,payload,0,K,lost);
+        encodeIndexedBlocks(enc2,payload,K,K,received);
+        int64_t lastIndex=-1;
+        dec.add_block(lost.front());
+        for(const auto& packet:received){
+            dec.add_block(packet);
+        }
+        const int nBefore=receive(dec,lastIndex,inOrderAndBitExact);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        dec.release_expired();
+        deadline=nBefore==1 && receive(dec,lastIndex,inOrderAndBitExact)==K;
+    }
+    ss<<"deadline:"<<(deadline ? "yes" : "no");
+    ss<<" more data with multiple open groups:"<<(nReceived[1]>nReceived[0] ? "yes" : "no");
+    ss<<" in-order:"<<(inOrderAndBitExact ? "yes" : "no");
+    return ss.str();
+}
+
+/**
+ * Measures how long the FECDecoder holds back the data blocks with the impairment patterns of sendDataLossy (10% random
+ * loss) and sendDataLossyAndOutOfOrder (here 10% of the packets are also swapped with the next one).
+ * The delay is counted in packets, e.g. the n of packets that arrived after a data block until it was output.
+ * Compares the cut-through decoder (a gap that can not be filled anymore is declared lost once it was overtaken by more
+ * than 3 blocks) with a decoder that waits for such gaps until the sequence is released (max_reorder_blocks=255) and with
+ * releasing each group once its last block arrived.
+ */
+std::string benchmarkFECDecoderCutThrough(){
+    constexpr uint16_t PAYLOAD_SIZE=1024;
+    constexpr int K=8,N=12,N_GROUPS=5000;
+    const auto payload=createRandomDataBuffer(PAYLOAD_SIZE);
+    std::vector<FECBlockPtr> packets;
+    FECEncoder enc(K,N-K,PAYLOAD_SIZE+2);
+    encodeIndexedBlocks(enc,payload,0,N_GROUPS*K,packets);
+    std::stringstream ss;
+    bool inOrderAndBitExact=true,lessDelay=true;
+    for(const bool outOfOrder:{false,true}){
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int> percent(0,99);
+        // The packets in the order they arrive
+        std::vector<std::size_t> arrivals;
+        for(std::size_t i=0;i<packets.size();i++){
+            if(percent(random)>=10)arrivals.push_back(i);
+        }
+        if(outOfOrder){
+            for(std::size_t i=0;i+1<arrivals.size();i++){
+                if(percent(random)<10){
+                    std::swap(arrivals[i],arrivals[i+1]);
+                    i++;
+                }
+            }
+        }
+        // When each data block and the last block of each group arrived
+        std::vector<int64_t> arrival(N_GROUPS*K,-1),groupClosed(N_GROUPS,0);
+        for(std::size_t t=0;t<arrivals.size();t++){
+            const FECBlockPtr& packet=packets[arrivals[t]];
+            const std::size_t group=arrivals[t]/N;
+            groupClosed[group]=std::max(groupClosed[group],(int64_t)t);
+            if(packet->is_data_block()){
+                arrival[group*K+packet->header()->block]=t;
+            }
+        }
+        ss<<(outOfOrder ? "loss 10% + reordering 10%:\n" : "loss 10%:\n");
+        double meanDelay[2];
+        for(const uint8_t maxReorderBlocks:{(uint8_t)3,(uint8_t)255}){
+            FECDecoder dec(PAYLOAD_SIZE+2,8,std::chrono::milliseconds(1000),maxReorderBlocks);
+            int64_t lastIndex=-1,maxDelay=0;
+            std::size_t nReceived=0,nRecovered=0,nInstant=0;
+            double delay=0,storeAndForwardDelay=0;
+            auto receive=[&](const int64_t t){
+                for(FECBlockPtr block=dec.get_block();block;block=dec.get_block()){
+                    const int64_t index=checkIndexedBlock(*block,payload);
+                    inOrderAndBitExact=inOrderAndBitExact && index>lastIndex;
+                    lastIndex=index;
+                    if(index<0)continue;
+                    if(arrival[index]<0){
+                        nRecovered++;
+                        continue;
+                    }
+                    const int64_t d=t-arrival[index];
+                    nReceived++;
+                    nInstant+= d==0 ? 1 : 0;
+                    delay+=d;
+                    maxDelay=std::max(maxDelay,d);
+                    storeAndForwardDelay+=groupClosed[index/K]-arrival[index];
+                }
+            };
+            for(std::size_t t=0;t<arrivals.size();t++){
+                dec.add_block(packets[arrivals[t]]);
+                receive(t);
+            }
+            dec.flush();
+            receive(arrivals.size());
+            meanDelay[maxReorderBlocks==255]=delay/std::max(nReceived,(std::size_t)1);
+            ss<<"  "<<(maxReorderBlocks==255 ? "wait for gaps" : "cut-through")<<" data blocks:"<<100.0f*(nReceived+nRecovered)/(N_GROUPS*K)<<"%";
+            ss<<" recovered:"<<nRecovered<<" released instantly:"<<100.0f*nInstant/std::max(nReceived,(std::size_t)1)<<"%";
+            ss<<" added delay mean:"<<meanDelay[maxReorderBlocks==255]<<" max:"<<maxDelay<<" packets";
+            ss<<" (release on group end mean:"<<storeAndForwardDelay/std::max(nReceived,(std::size_t)1)<<")\n";
+        }
+        lessDelay=lessDelay && meanDelay[0]<meanDelay[1];
+    }
+    ss<<"less delay:"<<(lessDelay ? "yes" : "no")<<" in-order:"<<(inOrderAndBitExact ? "yes" : "no");
+    return ss.str();
+}
+
+// ParallelFECEncoder::wait_block() / FECEncoder::get_block() (the FECEncoder has encoded everything once flushed)
+static FECBlockPtr waitBlock(FECEncoder& enc){
+    return enc.get_block();
+}
+static FECBlockPtr waitBlock(ParallelFECEncoder& enc){
+    return enc.wait_block();
+}
+
+// Encodes nGroups groups of random data blocks (of different size, such that the padding is used) and retrieves the output
+// after each group like the send thread does. Returns the elapsed time, hash is a FNV-1a hash of all output packets in order
+template<class Encoder>
+static double encodeGroups(Encoder& enc,const std::vector<uint8_t>& payload,const int k,const int nGroups,uint64_t& hash){
+    hash=14695981039346656037ULL;
+    const auto consume=[&hash](const FECBlockPtr& block){
+        for(uint16_t i=0;i<block->pkt_length();i++){
+            hash=(hash^block->pkt_data()[i])*1099511628211ULL;
+        }
+    };
+    const double start=cur_time();
+    for(int group=0;group<nGroups;group++){
+        for(int i=0;i<k;i++){
+            const uint16_t size=payload.size()-(uint16_t)((group*k+i)%64);
+            FECBlockPtr block=enc.new_block();
+            std::memcpy(block->data(),payload.data(),size);
+            block->data_length(size);
+            enc.add_block(std::move(block));
+        }
+        for(FECBlockPtr block=enc.get_block();block;block=enc.get_block()){
+            consume(block);
+        }
+    }
+    enc.flush();
+    for(FECBlockPtr block=waitBlock(enc);block;block=waitBlock(enc)){
+        consume(block);
+    }
+    return cur_time()-start;
+}
+
+/**
+ * Encodes the same groups with the FECEncoder (on the calling thread) and with the ParallelFECEncoder using 1 to N worker
+ * threads (N = the n of cores, at most 8). Small groups are only pipelined, the parity rows of big groups are also split
+ * across the workers. Reports the throughput in MBit/s of data blocks, the speedup over the FECEncoder and checks that
+ * all encoders create the same packets in the same order.
+ */
+std::string benchmarkParallelFECEncoder(){
+    struct Scenario{int k;int nFEC;uint16_t payloadSize;int nGroups;};
+    const std::vector<Scenario> scenarios={{8,4,1446,4000},{32,16,1446,1000},{100,50,1446,200}};
+    const unsigned maxThreads=std::max(1u,std::min(std::thread::hardware_concurrency(),8u));
+    bool bitExact=true;
+    std::stringstream ss;
+    for(const Scenario& scenario:scenarios){
+        const auto payload=createRandomDataBuffer(scenario.payloadSize);
+        const double dataMBit=(double)scenario.nGroups*scenario.k*scenario.payloadSize*8/1e6;
+        uint64_t referenceHash;
+        double serialTime;
+        {
+            FECEncoder enc(scenario.k,scenario.nFEC,scenario.payloadSize+2);
+            // Warm up the block pool
+            encodeGroups(enc,payload,scenario.k,10,referenceHash);
+            enc.reset(scenario.k,scenario.nFEC,1);
+            serialTime=encodeGroups(enc,payload,scenario.k,scenario.nGroups,referenceHash);
+        }
+        ss<<"k="<<scenario.k<<" n="<<(scenario.k+scenario.nFEC)<<" "<<scenario.payloadSize<<"B FECEncoder:"<<(dataMBit/serialTime)<<" MBit/s\n";
+        for(unsigned nThreads=1;nThreads<=maxThreads;nThreads++){
+            ParallelFECEncoder enc(scenario.k,scenario.nFEC,scenario.payloadSize+2,nThreads);
+            uint64_t hash;
+            encodeGroups(enc,payload,scenario.k,10,hash);
+            enc.reset(scenario.k,scenario.nFEC,1);
+            const double elapsed=encodeGroups(enc,payload,scenario.k,scenario.nGroups,hash);
+            bitExact=bitExact && hash==referenceHash;
+            ss<<"  "<<nThreads<<" threads:"<<(dataMBit/elapsed)<<" MBit/s speedup:"<<(serialTime/elapsed)<<"\n";
+        }
+    }
+    ss<<"bit-exact:"<<(bitExact ? "yes" : "no");
+    return ss.str();
+}
+
+// The SharedQueue before it was lock-free: a std::deque under one mutex, push() notifies on every item
+template <typename T>
+class MutexQueue {
+public:
+    MutexQueue(size_t max_size,bool clear_on_full=false):m_max_size(max_size),m_clear_on_full(clear_on_full){}
+    T pop(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock,[this]{return !m_queue.empty();});
+        T item=m_queue.front();
+        m_queue.pop_front();
+        return item;
+    }
+    void push(T item){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_queue.size()>=m_max_size && m_clear_on_full){
+            m_n_dropped+=m_queue.size();
+            m_queue.clear();
+        }
+        if(m_queue.size()<m_max_size){
+            m_queue.push_back(item);
+        }else{
+            m_n_dropped++;
+        }
+        lock.unlock();
+        m_cond.notify_one();
+    }
+    size_t n_dropped(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_dropped;
+    }
+private:
+    const size_t m_max_size;
+    const bool m_clear_on_full;
+    std::deque<T> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_n_dropped=0;
+};
+
+struct QueueBenchmarkResult{
+    // push() calls of all producers / items that reached the consumer
+    double pushesPerSecond;
+    double itemsPerSecond;
+    double droppedPercent;
+    bool consistent;
+};
+
+// nProducers threads push nItems each (the producer id in the upper bits of the value), one consumer pops them.
+// The items are shared_ptrs like the Messages of the wfb threads.
+// Checks that each item arrived at most once, in order per producer and that no item got lost without being counted
+template<class Queue>
+static QueueBenchmarkResult runQueueBenchmark(const unsigned nProducers,const uint64_t nItems,const size_t maxSize,const bool clearOnFull){
+    Queue queue(maxSize,clearOnFull);
+    const uint64_t SENTINEL=UINT64_MAX;
+    std::vector<uint64_t> nextSeq(nProducers,0);
+    uint64_t nReceived=0;
+    bool consistent=true;
+    std::thread consumer([&]{
+        while(true){
+            const std::shared_ptr<uint64_t> item=queue.pop();
+            if(*item==SENTINEL)return;
+            const unsigned producer=(unsigned)(*item>>48);
+            const uint64_t seq=*item & 0xFFFFFFFFFFFFULL;
+            consistent=consistent && producer<nProducers && seq>=nextSeq[producer];
+            if(producer<nProducers)nextSeq[producer]=seq+1;
+            nReceived++;
+        }
+    });
+    // Allocate before starting the clock
+    std::vector<std::vector<std::shared_ptr<uint64_t>>> items(nProducers);
+    for(unsigned p=0;p<nProducers;p++){
+        for(uint64_t i=0;i<nItems;i++){
+            items[p].push_back(std::make_shared<uint64_t>(((uint64_t)p<<48) | i));
+        }
+    }
+    const double start=cur_time();
+    std::vector<std::thread> producers;
+    for(unsigned p=0;p<nProducers;p++){
+        producers.emplace_back([&queue,&items,p]{
+            for(auto& item:items[p]){
+                queue.push(std::move(item));
+            }
+        });
+    }
+    for(auto& producer:producers){
+        producer.join();
+    }
+    const double pushTime=cur_time()-start;
+    const size_t nDropped=queue.n_dropped();
+    // The sentinel itself might be dropped if the queue is (still) full
+    std::atomic<bool> done{false};
+    std::thread stopper([&]{
+        while(!done){
+            queue.push(std::make_shared<uint64_t>(SENTINEL));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    consumer.join();
+    const double elapsed=cur_time()-start;
+    done=true;
+    stopper.join();
+    consistent=consistent && nReceived+nDropped==nProducers*nItems;
+    return {nProducers*nItems/pushTime,nReceived/elapsed,100.0*nDropped/(nProducers*nItems),consistent};
+}
+
+/**
+ * Pushes items from 1 to 4 producer threads into one consumer with the lock-free SharedQueue and with the mutex / condition
+ * variable queue it replaced. With a small queue (dropping on full) the producers are faster than the consumer, with a big
+ * one nothing is dropped. Reports the push() calls per second, the items per second that reached the consumer and the drop rate.
+ */
+std::string benchmarkSharedQueue(){
+    constexpr uint64_t N_ITEMS=200000;
+    bool consistent=true;
+    std::stringstream ss;
+    for(const size_t maxSize:{(size_t)64,(size_t)(4*N_ITEMS)}){
+        ss<<"max size:"<<maxSize<<"\n";
+        for(unsigned nProducers=1;nProducers<=4;nProducers++){
+            const auto lockFree=runQueueBenchmark<SharedQueue<std::shared_ptr<uint64_t>>>(nProducers,N_ITEMS,maxSize,false);
+            const auto mutex=runQueueBenchmark<MutexQueue<std::shared_ptr<uint64_t>>>(nProducers,N_ITEMS,maxSize,false);
+            consistent=consistent && lockFree.consistent && mutex.consistent;
+            for(const auto& result:{std::make_pair("lock-free",lockFree),std::make_pair("mutex",mutex)}){
+                ss<<"  "<<nProducers<<" producers "<<result.first<<": push:"<<(result.second.pushesPerSecond/1e6)<<" MOps/s";
+                ss<<" received:"<<(result.second.itemsPerSecond/1e6)<<" MItems/s dropped:"<<result.second.droppedPercent<<"%\n";
+            }
+        }
+    }
+    // Clear on full drops whole batches instead of single items
+    for(unsigned nProducers=1;nProducers<=4;nProducers++){
+        consistent=consistent && runQueueBenchmark<SharedQueue<std::shared_ptr<uint64_t>>>(nProducers,N_ITEMS,64,true).consistent;
+    }
+    ss<<"consistent:"<<(consistent ? "yes" : "no");
+    return ss.str();
+}
+
+struct SchedulingResult{
+    // Queueing delay in ms per flow, percentiles 50 / 99 / 100
+    std::array<double,3> delayMs[2];
+    // Packets per second that were sent per flow
+    double sentPerSecond[2];
+};
+
+// Percentile p (0..1) of the sorted values
+static double percentile(const std::vector<double>& sorted,const double p){
+    if(sorted.empty())return 0;
+    return sorted[std::min((size_t)(p*sorted.size()),sorted.size()-1)];
+}
+
+/**
+ * Emulates the raw send thread in virtual time: A link sends one packet every 0.5ms (2000 packets/s) out of a
+ * PriorityScheduler. Flow 0 is a saturating video link (a burst of 50 packets per frame at 60fps, 3000 packets/s), flow 1
+ * a telemetry link (one packet every 20ms). With the same priority for both flows the scheduler is a single FIFO like the
+ * send queue before. Both queues hold up to maxQueueSize packets.
+ */
+static SchedulingResult runSchedulingTest(const uint8_t videoPriority,const uint8_t telemetryPriority,const size_t maxQueueSize,
+                                          const double maxWait){
+    constexpr double DURATION=10,SLOT=0.0005;
+    constexpr double FRAME_INTERVAL=1.0/60,TELEMETRY_INTERVAL=0.02;
+    constexpr int PACKETS_PER_FRAME=50;
+    struct Packet{int flow;double arrival;};
+    std::vector<Packet> arrivals;
+    for(double t=0;t<DURATION;t+=FRAME_INTERVAL){
+        for(int i=0;i<PACKETS_PER_FRAME;i++)arrivals.push_back({0,t});
+    }
+    // Not aligned with the frames
+    for(double t=0.0013;t<DURATION;t+=TELEMETRY_INTERVAL){
+        arrivals.push_back({1,t});
+    }
+    std::stable_sort(arrivals.begin(),arrivals.end(),[](const Packet& a,const Packet& b){return a.arrival<b.arrival;});
+    PriorityScheduler<Packet> scheduler(maxQueueSize,maxWait);
+    std::vector<double> delays[2];
+    size_t next=0;
+    for(double now=0;now<DURATION;now+=SLOT){
+        for(;next<arrivals.size() && arrivals[next].arrival<=now;next++){
+            const Packet& packet=arrivals[next];
+            scheduler.push(packet,packet.flow==0 ? videoPriority : telemetryPriority,packet.arrival);
+        }
+        Packet packet;
+        uint8_t priority;
+        if(scheduler.pop(packet,priority,now)){
+            delays[packet.flow].push_back((now-packet.arrival)*1000);
+        }
+    }
+    SchedulingResult result;
+    for(int flow=0;flow<2;flow++){
+        std::sort(delays[flow].begin(),delays[flow].end());
+        result.delayMs[flow]={percentile(delays[flow],0.5),percentile(delays[flow],0.99),percentile(delays[flow],1.0)};
+        result.sentPerSecond[flow]=delays[flow].size()/DURATION;
+    }
+    return result;
+}
+
+/**
+ * Compares the queueing delay of a telemetry link next to a saturating video link with one FIFO for both (as before)
+ * and with the telemetry link at a higher priority. Then gives the video link the higher priority, such that only
+ * the aging bound keeps the telemetry delay low.
+ */
+std::string testPriorityScheduling(){
+    constexpr size_t MAX_QUEUE_SIZE=200;
+    constexpr double MAX_WAIT=0.05;
+    std::stringstream ss;
+    const auto print=[&ss](const std::string& name,const SchedulingResult& result){
+        ss<<name<<"\n";
+        for(int flow=0;flow<2;flow++){
+            ss<<"  "<<(flow==0 ? "video" : "telemetry")<<" delay p50:"<<result.delayMs[flow][0]<<"ms p99:"<<result.delayMs[flow][1];
+            ss<<"ms max:"<<result.delayMs[flow][2]<<"ms sent:"<<result.sentPerSecond[flow]<<" packets/s\n";
+        }
+    };
+    const auto fifo=runSchedulingTest(100,100,MAX_QUEUE_SIZE,MAX_WAIT);
+    const auto priority=runSchedulingTest(100,150,MAX_QUEUE_SIZE,MAX_WAIT);
+    const auto aging=runSchedulingTest(150,100,MAX_QUEUE_SIZE,MAX_WAIT);
+    print("single FIFO",fifo);
+    print("telemetry priority 150, video 100",priority);
+    print("telemetry priority 100, video 150 (aging)",aging);
+    // At most two packets (one aged) in front of the telemetry packet
+    const bool lowerTail=priority.delayMs[1][2]<=2*0.5+1e-6 && fifo.delayMs[1][1]>10*priority.delayMs[1][1];
+    // The telemetry packets are still sent and the link stays saturated
+    const bool videoThroughput=priority.sentPerSecond[0]+priority.sentPerSecond[1]>=0.99*2000;
+    // Served in the first slot after it waited longer than MAX_WAIT
+    const bool agingBound=aging.delayMs[1][2]<=MAX_WAIT*1000+0.5+1e-6;
+    ss<<"lower tail latency:"<<(lowerTail ? "yes" : "no")<<" link saturated:"<<(videoThroughput ? "yes" : "no");
+    ss<<" aging bound:"<<(agingBound ? "yes" : "no");
+    // A forced item (encoder flush) is queued even if its queue is full and is not counted as dropped
+    PriorityScheduler<int> full(1,MAX_WAIT);
+    full.push(0,100,0);
+    const bool dataDropped=!full.push(1,100,0);
+    const bool flushKept=full.push(2,100,0,true) && full.size(100)==2 && full.n_dropped(100)==1;
+    ss<<" flush kept:"<<(dataDropped && flushKept ? "yes" : "no");
+    return ss.str();
+}
+
 #ifdef __ANDROID__
 
 #include <jni.h>
@@ -274,6 +1044,62 @@ JNI_METHOD(void , nativeTestFec)
     run_test2();
 }
 
+JNI_METHOD(jstring , nativeBenchmarkFECBlockPool)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=benchmarkFECBlockPool();
+    MLOGD<<"BenchmarkFECBlockPool "<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeBenchmarkFECDecodeCache)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=benchmarkFECDecodeCache();
+    MLOGD<<"BenchmarkFECDecodeCache\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeTestFECDecoderReorder)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=testFECDecoderReorder();
+    MLOGD<<"TestFECDecoderReorder\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeBenchmarkFECDecoderCutThrough)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=benchmarkFECDecoderCutThrough();
+    MLOGD<<"BenchmarkFECDecoderCutThrough\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeBenchmarkFECKernels)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=benchmarkFECKernels();
+    MLOGD<<"BenchmarkFECKernels\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeBenchmarkParallelFECEncoder)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=benchmarkParallelFECEncoder();
+    MLOGD<<"BenchmarkParallelFECEncoder\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeBenchmarkSharedQueue)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=benchmarkSharedQueue();
+    MLOGD<<"BenchmarkSharedQueue\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
+JNI_METHOD(jstring , nativeTestPriorityScheduling)
+(JNIEnv *env, jclass jclass1) {
+    const std::string result=testPriorityScheduling();
+    MLOGD<<"TestPriorityScheduling\n"<<result;
+    return env->NewStringUTF(result.c_str());
+}
+
 }
 #endif
 
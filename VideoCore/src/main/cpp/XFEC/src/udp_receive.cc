@@ -90,27 +90,28 @@ void udp_raw_thread(int sock, uint16_t recv_udp_port, std::shared_ptr<FECEncoder
 
   while (1) {
 
-    // Receive the next message.
-    std::shared_ptr<Message> msg(new Message(blocksize, port, priority, opts, enc));
-    ssize_t count = recv(sock, msg->msg.data(), blocksize, 0);
+    // Receive the next message directly into a block of the FEC encoder.
+    std::shared_ptr<Message> msg(new Message(0, port, priority, opts, enc));
+    msg->block = enc->new_block();
+    ssize_t count = recv(sock, msg->block->data(), blocksize, 0);
 
     // Did we receive a message to send?
     if (count > 0) {
-      msg->msg.resize(count);
-
-      // Add the mesage to the output queue
-      outqueue.push(msg);
+      msg->block->data_length(count);
 
       // send the data to the archiver if requested.
       if (archive_inqueue) {
-        archive_inqueue->push(mkpacket(msg->msg));
+        archive_inqueue->push(mkpacket(msg->block->data(), msg->block->data() + count));
       }
 
+      // Add the mesage to the output queue
+      outqueue.push(msg);
+
       // Indicate that we have put data in the queue, so should flush if necessary
       flushed = false;
 
     } else {
-      msg->msg.resize(0);
+      msg->block.reset();
       outqueue.push(msg);
       flushed = true;
     }
@@ -246,23 +247,24 @@ bool create_udp_to_raw_threads(SharedQueue<std::shared_ptr<Message> > &outqueue,
 
             while (1) {
 
-              // Receive the next message.
-              std::shared_ptr<Message> msg(new Message(blocksize, port, priority, opts, enc));
-              ssize_t count = recv(udp_sock, msg->msg.data(), blocksize, 0);
+              // Receive the next message directly into a block of the FEC encoder.
+              std::shared_ptr<Message> msg(new Message(0, port, priority, opts, enc));
+              msg->block = enc->new_block();
+              ssize_t count = recv(udp_sock, msg->block->data(), blocksize, 0);
               double t = cur_time();
 
               // Did we receive a message to send?
               if (count > 0) {
-                msg->msg.resize(count);
-                outqueue.push(msg);
-                flushed = false;
+                msg->block->data_length(count);
 
                 // send the data to the archiver if requested.
                 if (archive_queue) {
-                  archive_queue->push(mkpacket(msg->msg));
+                  archive_queue->push(mkpacket(msg->block->data(), msg->block->data() + count));
                 }
+                outqueue.push(msg);
+                flushed = false;
               } else {
-                msg->msg.resize(0);
+                msg->block.reset();
                 outqueue.push(msg);
                 flushed = true;
               }
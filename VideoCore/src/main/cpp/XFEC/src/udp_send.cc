@@ -33,7 +33,7 @@ void fec_decode_thread(MessageQueue &inqueue, PacketQueues *output_queues,
     dec.add_block(msg->data.data(), msg->data.size());
 
     // Output any packets that are finished in the decoder.
-    for (std::shared_ptr<FECBlock> block = dec.get_block(); block; block = dec.get_block()) {
+    for (FECBlockPtr block = dec.get_block(); block; block = dec.get_block()) {
       if (block->data_length() > 0) {
         Packet pkt = mkpacket(block->data(), block->data() + block->data_length());
         for (auto q : output_queues[port]) {
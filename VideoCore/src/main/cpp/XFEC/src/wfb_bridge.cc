@@ -88,6 +88,8 @@ int main(int argc, char** argv) {
   uint32_t timeout = conf.GetInteger("global", "timeout", 1000);
 
   uint16_t max_queue_size = static_cast<uint16_t>(conf.GetInteger("global", "maxqueuesize", 200));
+  // Links with a higher 'priority' are sent first, but no packet waits much longer than this (seconds)
+  float max_priority_wait = conf.GetFloat("global", "maxprioritywait", 0.05);
 
   // Create the logger
   log4cpp::Appender *console = new log4cpp::OstreamAppender("console", &std::cout);
@@ -359,8 +361,9 @@ int main(int argc, char** argv) {
 
       // Create a thread to send raw socket packets.
       auto send_th =
-        [&outqueue, raw_send_sock, max_queue_size, &reset_wifi, &trans_stats]() {
-          raw_send_thread(outqueue, *raw_send_sock, max_queue_size, trans_stats, reset_wifi);
+        [&outqueue, raw_send_sock, max_queue_size, &reset_wifi, &trans_stats, max_priority_wait]() {
+          raw_send_thread(outqueue, *raw_send_sock, max_queue_size, trans_stats, reset_wifi,
+                          max_priority_wait);
           LOG_INFO << "Raw socket transmit thread exiting";
         };
       send_thread.reset(new std::thread(send_th));
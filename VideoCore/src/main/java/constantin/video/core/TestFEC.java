@@ -6,4 +6,28 @@ public class TestFEC {
     }
 
     public static native void nativeTestFec();
+    // Checks that all GF(256) kernels (table, SSSE3, AVX2, AVX-512, NEON) the CPU supports are bit-exact and
+    // returns their encode / decode throughput in GB/s for different block sizes and k/n
+    public static native String nativeBenchmarkFECKernels();
+    // Sends packets through a FEC encoder and decoder (with loss) using the pooled blocks and zero copy ingest.
+    // Reports the throughput and the n of blocks that were allocated after the warm up (should be 0)
+    public static native String nativeBenchmarkFECBlockPool();
+    // Decodes FEC groups with bursty (Gilbert-Elliott) loss with and without the decode matrix cache.
+    // Reports the cache hit ratio and the decode time per group
+    public static native String nativeBenchmarkFECDecodeCache();
+    // Sends FEC groups over two emulated paths (one of them delayed) to FECDecoders with one and with multiple open groups.
+    // Reports the n of received data blocks and checks the order and the latency deadline
+    public static native String nativeTestFECDecoderReorder();
+    // Measures how long the FECDecoder holds back the data blocks (in packets) with random loss and reordering.
+    // Compares the cut-through release with waiting for the gaps until the group is released
+    public static native String nativeBenchmarkFECDecoderCutThrough();
+    // Encodes FEC groups of different size with the FECEncoder and with the ParallelFECEncoder using 1 to N worker threads.
+    // Reports the throughput and speedup per n of threads and checks that the output is the same
+    public static native String nativeBenchmarkParallelFECEncoder();
+    // Pushes items from 1 to 4 producer threads into one consumer with the lock-free SharedQueue and a mutex queue.
+    // Reports the push / receive rate and drop rate, checks that no item got lost uncounted, duplicated or reordered
+    public static native String nativeBenchmarkSharedQueue();
+    // Emulates the raw send thread with a saturating video link and a telemetry link, with one FIFO and with priorities.
+    // Reports the queueing delay percentiles per link and checks the tail latency of the high priority link and the aging bound
+    public static native String nativeTestPriorityScheduling();
 }
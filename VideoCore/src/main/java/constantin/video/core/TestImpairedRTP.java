@@ -0,0 +1,15 @@
+package constantin.video.core;
+
+import android.content.Context;
+
+// Replays a raw h264 or h265 test video (asset) trough a simulated bad link (rtp encode -> impairment -> rtp decode).
+// Deterministic: the same asset, seed and options always produce the same report
+// aggregateParameterSets (h265 only): send VPS,SPS and PPS in one rtp aggregation packet
+public class TestImpairedRTP {
+    static {
+        System.loadLibrary("VideoNative");
+    }
+
+    public static native String nativeRunReplay(Context context,String assetFilename,boolean isH265,boolean aggregateParameterSets,int seed,float lossProbability,float geGoodToBad,float geBadToGood,
+                                                float reorderProbability,int reorderDepth,float duplicateProbability,int jitterUs);
+}
@@ -0,0 +1,16 @@
+package constantin.video.core;
+
+// Tests of the UDP receive side with real sockets on the loopback interface
+public class TestUDPReceiver {
+    static {
+        System.loadLibrary("VideoNative");
+    }
+
+    // Overflow the socket receive buffer with a burst of nBurstPackets (1KB each) while the receiver thread is blocked,
+    // and check the drops reported by the OS and the growth of the receive buffer (up to maxRcvBufSizeKB)
+    public static native String nativeTestKernelDrops(int nBurstPackets,int maxRcvBufSizeKB);
+
+    // Send the same rtp stream with losses, duplicates and a delay to the two ports of a DiversityReceiver
+    // and check that each packet is forwarded once, in the order its first copy arrived
+    public static native String nativeTestDiversityReceiver(int nPackets);
+}
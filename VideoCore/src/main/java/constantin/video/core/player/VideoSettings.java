@@ -44,6 +44,12 @@ public class VideoSettings {
         SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
         sharedPreferences.edit().putInt(context.getString(R.string.VS_SOURCE),val.ordinal()).commit();
     }
+    // How the UDP source is interpreted, same values as VideoPlayer.VIDEO_DATA_TYPE (0=rtp h264, 5=rtp inside FEC)
+    @SuppressLint("ApplySharedPref")
+    public static void setVS_PROTOCOL(final Context context, final int protocol){
+        SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
+        sharedPreferences.edit().putInt(context.getString(R.string.VS_PROTOCOL),protocol).commit();
+    }
 
     @SuppressLint("ApplySharedPref")
     public static void setVS_ASSETS_FILENAME_TEST_ONLY(final Context context, final String filename){
@@ -55,6 +61,42 @@ public class VideoSettings {
         SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
         sharedPreferences.edit().putInt(context.getString(R.string.VS_FILE_ONLY_LIMIT_FPS),limitFPS).commit();
     }
+    // 0 = disabled. Otherwise the same rtp stream is also received on this port and merged with the default one
+    @SuppressLint("ApplySharedPref")
+    public static void setVS_DIVERSITY_PORT(final Context context, final int port){
+        SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
+        sharedPreferences.edit().putInt(context.getString(R.string.VS_DIVERSITY_PORT),port).commit();
+    }
+    // Comma separated list of ip:port, empty = disabled. The received video stream is forwarded to all of them
+    @SuppressLint("ApplySharedPref")
+    public static void setVS_REBROADCAST_DESTINATIONS(final Context context, final String destinations){
+        SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
+        sharedPreferences.edit().putString(context.getString(R.string.VS_REBROADCAST_DESTINATIONS),destinations).commit();
+    }
+    // Replaying network captures (.pcap / .pcapng): Only UDP packets with this destination port are used (0=all),
+    // the payload is interpreted as payloadType (same values as VideoPlayer.VIDEO_DATA_TYPE, 0=rtp h264)
+    // and replayed with speed (1=original timing, 0=as fast as possible)
+    @SuppressLint("ApplySharedPref")
+    public static void setVS_PCAP_OPTIONS(final Context context, final int udpPort,final int payloadType,final float speed){
+        SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
+        sharedPreferences.edit().putInt(context.getString(R.string.VS_PCAP_UDP_PORT),udpPort)
+                .putInt(context.getString(R.string.VS_PCAP_PAYLOAD_TYPE),payloadType)
+                .putFloat(context.getString(R.string.VS_PCAP_SPEED),speed).commit();
+    }
+    // Request lost rtp packets from the sender with RTCP NACKs (the sender has to support it).
+    // Packets behind a gap are held back at most maxDelayMs (0=disabled)
+    @SuppressLint("ApplySharedPref")
+    public static void setVS_RTP_NACK_MAX_DELAY_MS(final Context context, final int maxDelayMs){
+        SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
+        sharedPreferences.edit().putInt(context.getString(R.string.VS_RTP_NACK_MAX_DELAY_MS),maxDelayMs).commit();
+    }
+    // Report the loss of the 'rtp inside FEC' stream to the sender every intervalMs, such that it can adapt its FEC overhead
+    // (the sender has to support it). 0=disabled
+    @SuppressLint("ApplySharedPref")
+    public static void setVS_FEC_LOSS_REPORT_INTERVAL_MS(final Context context, final int intervalMs){
+        SharedPreferences sharedPreferences=context.getSharedPreferences("pref_video", MODE_PRIVATE);
+        sharedPreferences.edit().putInt(context.getString(R.string.VS_FEC_LOSS_REPORT_INTERVAL_MS),intervalMs).commit();
+    }
 
     public static String getVS_PLAYBACK_FILENAME(final Context context){
         final String tmp=context.getSharedPreferences("pref_video",Context.MODE_PRIVATE).
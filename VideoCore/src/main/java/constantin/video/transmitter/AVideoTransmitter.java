@@ -91,13 +91,16 @@ public class AVideoTransmitter extends AppCompatActivity{
                                 if(timeToManuallySendKeyFrame ==0){
                                     //Log.d(TAG,"Manually inserting SPS & PPS");
                                     //Log.d(TAG,"csd0"+currentCSD0.isDirect());
-                                    mUDPSender.sendOnCurrentThread(currentCSD0);
-                                    mUDPSender.sendOnCurrentThread(currentCSD1);
+                                    // SPS & PPS belong to the same access unit as the following frame
+                                    mUDPSender.sendOnCurrentThread(currentCSD0,bufferInfo.presentationTimeUs);
+                                    if(currentCSD1!=null){
+                                        mUDPSender.sendOnCurrentThread(currentCSD1,bufferInfo.presentationTimeUs);
+                                    }
                                 }
                                 timeToManuallySendKeyFrame++;
                                 timeToManuallySendKeyFrame = timeToManuallySendKeyFrame % 10;
                             }
-                            mUDPSender.sendOnCurrentThread(outputBuffer);
+                            mUDPSender.sendOnCurrentThread(outputBuffer,bufferInfo.presentationTimeUs);
                             codec.releaseOutputBuffer(outputBufferId,false);
                         } else if (outputBufferId == MediaCodec.INFO_OUTPUT_FORMAT_CHANGED) {
                             // Subsequent data will conform to new format.
@@ -111,7 +114,9 @@ public class AVideoTransmitter extends AppCompatActivity{
                                 SEND_SPS_PPS_EVERY_N_FRAMES=true;
                             }
                             currentCSD0= VideoTransmitter.createDirectByteBuffer(Objects.requireNonNull(currentOutputFormat.getByteBuffer("csd-0")));
-                            currentCSD1= VideoTransmitter.createDirectByteBuffer(Objects.requireNonNull(currentOutputFormat.getByteBuffer("csd-1")));
+                            // For h265, csd-0 holds VPS,SPS and PPS and there is no csd-1
+                            currentCSD1= currentOutputFormat.containsKey("csd-1") ?
+                                    VideoTransmitter.createDirectByteBuffer(Objects.requireNonNull(currentOutputFormat.getByteBuffer("csd-1"))) : null;
                         }
                     }
                 }
@@ -119,11 +124,12 @@ public class AVideoTransmitter extends AppCompatActivity{
         });
         //Create Encoder. We don't have to wait for anything here
         try {
-            codec= MediaCodec.createEncoderByType("video/avc");
+            final String mime=AVideoTransmitterSettings.getVIDEO_TRANSMITTER_STREAM_MODE(this)==VideoTransmitter.STREAM_MODE_RTP_H265 ?
+                    "video/hevc" : "video/avc";
+            codec= MediaCodec.createEncoderByType(mime);
             final int W=AVideoTransmitterSettings.getVIDEO_TRANSMITTER_CAMERA_ENCODER_W_PX(this);
             final int H=AVideoTransmitterSettings.getVIDEO_TRANSMITTER_CAMERA_ENCODER_H_PX(this);
-            MediaFormat format = MediaFormat.createVideoFormat("video/avc",W,H);
-            //MediaFormat format = MediaFormat.createVideoFormat("video/hevc",W,H);
+            MediaFormat format = MediaFormat.createVideoFormat(mime,W,H);
             format.setInteger(MediaFormat.KEY_COLOR_FORMAT, MediaCodecInfo.CodecCapabilities.COLOR_FormatSurface);
 
             //final int MDEIACODEC_TARGET_KEY_BIT_RATE=5*1024*1024;
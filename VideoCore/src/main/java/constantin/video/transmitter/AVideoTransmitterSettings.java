@@ -63,6 +63,44 @@ public class AVideoTransmitterSettings extends AppCompatActivity {
                 getInt(context.getString(R.string.VIDEO_TRANSMITTER_CAMERA_ENCODER_H_PX),720);
     }
 
+    // 0 means no pacing
+    public static int getVIDEO_TRANSMITTER_PACING_MBITS(final Context context){
+        return getSharedPreferences(context).
+                getInt(context.getString(R.string.VIDEO_TRANSMITTER_PACING_MBITS),0);
+    }
+    public static int getVIDEO_TRANSMITTER_PACING_BURST_KB(final Context context){
+        return getSharedPreferences(context).
+                getInt(context.getString(R.string.VIDEO_TRANSMITTER_PACING_BURST_KB),16);
+    }
+    // Retransmit lost rtp packets when the receiver requests them (RTCP NACK)
+    public static boolean getVIDEO_TRANSMITTER_RTP_NACK(final Context context){
+        return getSharedPreferences(context).
+                getBoolean(context.getString(R.string.VIDEO_TRANSMITTER_RTP_NACK),false);
+    }
+    // Only used in the 'RTP inside FEC' stream mode
+    public static int getVIDEO_TRANSMITTER_FEC_OVERHEAD_PERCENT(final Context context){
+        return getSharedPreferences(context).
+                getInt(context.getString(R.string.VIDEO_TRANSMITTER_FEC_OVERHEAD_PERCENT),100);
+    }
+    public static boolean getVIDEO_TRANSMITTER_FEC_UNEQUAL_PROTECTION(final Context context){
+        return getSharedPreferences(context).
+                getBoolean(context.getString(R.string.VIDEO_TRANSMITTER_FEC_UNEQUAL_PROTECTION),true);
+    }
+    // 0 means one FEC group per NALU
+    public static int getVIDEO_TRANSMITTER_FEC_FRAME_GROUP_BLOCKS(final Context context){
+        return getSharedPreferences(context).
+                getInt(context.getString(R.string.VIDEO_TRANSMITTER_FEC_FRAME_GROUP_BLOCKS),64);
+    }
+    // Adapt the FEC overhead to the loss reported by the receiver, the configured overhead is the upper bound
+    public static boolean getVIDEO_TRANSMITTER_FEC_ADAPTIVE(final Context context){
+        return getSharedPreferences(context).
+                getBoolean(context.getString(R.string.VIDEO_TRANSMITTER_FEC_ADAPTIVE),false);
+    }
+    // 0 means no send thread
+    public static int getVIDEO_TRANSMITTER_SEND_THREAD_BACKLOG_KB(final Context context){
+        return getSharedPreferences(context).
+                getInt(context.getString(R.string.VIDEO_TRANSMITTER_SEND_THREAD_BACKLOG_KB),512);
+    }
 
     public static class MSettingsFragment extends PreferenceFragmentCompat {
 
@@ -14,13 +14,56 @@ public class VideoTransmitter {
     private static final String TAG="VideoTransmitter";
     // Port is hard coded, since 5600 is generally the port to use for live video
     private static final int PORT=5600;
+    // Same order as entriesVideoTransmitterStreamMode
+    public static final int STREAM_MODE_RTP_H265=4;
     static {
         System.loadLibrary("VideoTransmitter");
     }
     native long nativeConstruct(String IP,int port);
     native void nativeDelete(long p);
     //Called by sendAsync / sendOnCurrentThread
-    native void nativeSend(long p,ByteBuffer data,int dataSize,int mode);
+    // captureTimeUs: -1 if unknown
+    native void nativeSend(long p,ByteBuffer data,int dataSize,int mode,long captureTimeUs);
+    // Compares the contiguous and the scatter-gather (zero copy) rtp packetization, returns a human readable result
+    public static native String nativeBenchmarkRTPPacketization(int naluSize,int nNALUs);
+    // 0 disables pacing
+    native void nativeSetPacing(long p,int rateMBits,int burstKB);
+    // Sends synthetic frames over the loopback interface with and without pacing, returns a human readable result
+    public static native String nativeTestPacing(int bitrateMBits,int burstKB,int nFrames);
+    // Sends synthetic frames over the loopback interface per packet, batched (sendmmsg) and batched with UDP GSO,
+    // returns a human readable result
+    public static native String nativeTestBatchSend(int nFrames);
+    // Keep a history of the sent rtp packets and retransmit them on RTCP NACKs from the receiver
+    native void nativeEnableRetransmission(long p);
+    // Sends synthetic frames over the loopback interface to a receiver with injected loss, with and without retransmission.
+    // Returns a human readable result
+    public static native String nativeTestRetransmission(float lossProbability,int nFrames,int maxDelayMs);
+    // FEC overhead and flat / unequal (by NALU importance) protection for the 'RTP inside FEC' stream mode
+    native void nativeSetFECProtection(long p,int overheadPercent,boolean unequal);
+    // Sends synthetic GOPs with FEC over the loopback interface to a receiver with burst loss, with a flat FEC ratio and with
+    // unequal error protection at the same overhead. Returns a human readable result
+    public static native String nativeTestUnequalErrorProtection(float geGoodToBad,float geBadToGood,int overheadPercent,int nGOPs);
+    // 0: one FEC group per NALU, else the NALUs of one frame form one FEC group of at most maxFrameGroupBlocks (<=128) packets
+    native void nativeSetFECFrameGrouping(long p,int maxFrameGroupBlocks);
+    // Sends synthetic frames of nSlicesPerFrame slices with FEC over the loopback interface to a receiver with burst loss, with one
+    // FEC group per NALU and with one FEC group per frame. Returns a human readable result
+    public static native String nativeTestFECFrameGrouping(float geGoodToBad,float geBadToGood,int overheadPercent,int nFrames,int nSlicesPerFrame);
+    // Adapt the FEC overhead to the loss the receiver reports, within [minOverheadPercent,maxOverheadPercent]
+    native void nativeEnableAdaptiveFEC(long p,int minOverheadPercent,int maxOverheadPercent);
+    // Replays a loss trace with clean and bursty phases with the min / max fixed FEC overhead and with adaptive FEC.
+    // Returns a human readable result
+    public static native String nativeTestAdaptiveFEC(int minOverheadPercent,int maxOverheadPercent,int nFrames);
+    // Sends the NALUs of a test video (asset) through the VideoTransmitter over the loopback interface into the receive stack
+    // of the VideoPlayer. mode: 0=raw 1=rtp 2=rtp inside FEC. fps==0: as fast as possible. Returns a human readable result
+    public static native String nativeBenchmarkLoopback(Context context,String assetFilename,int mode,boolean isH265,int fps);
+
+    // Packetize, FEC encode and send on a native thread with a bounded backlog. 0 disables (send on the calling thread)
+    native void nativeStartSendThread(long p,int maxBacklogKB);
+    // Queue depth, dropped NALUs and per stage timings of the send thread
+    native String nativeGetSendThreadStats(long p);
+    // Sends synthetic frames to a link that is slower than the video bitrate, once inline and once with the send thread.
+    // Returns a human readable result
+    public static native String nativeTestSendThread(int linkRateMBits,int maxBacklogKB,int nFrames);
 
     private final long nativeInstance;
     private final int streamMode;
@@ -31,6 +74,23 @@ public class VideoTransmitter {
         Log.d("UDPSender","Sending to IP "+IP);
         nativeInstance=nativeConstruct(IP,PORT);
         streamMode= AVideoTransmitterSettings.getVIDEO_TRANSMITTER_STREAM_MODE(context);
+        nativeSetPacing(nativeInstance,AVideoTransmitterSettings.getVIDEO_TRANSMITTER_PACING_MBITS(context),
+                AVideoTransmitterSettings.getVIDEO_TRANSMITTER_PACING_BURST_KB(context));
+        if(AVideoTransmitterSettings.getVIDEO_TRANSMITTER_RTP_NACK(context)){
+            nativeEnableRetransmission(nativeInstance);
+        }
+        nativeSetFECProtection(nativeInstance,AVideoTransmitterSettings.getVIDEO_TRANSMITTER_FEC_OVERHEAD_PERCENT(context),
+                AVideoTransmitterSettings.getVIDEO_TRANSMITTER_FEC_UNEQUAL_PROTECTION(context));
+        nativeSetFECFrameGrouping(nativeInstance,AVideoTransmitterSettings.getVIDEO_TRANSMITTER_FEC_FRAME_GROUP_BLOCKS(context));
+        if(AVideoTransmitterSettings.getVIDEO_TRANSMITTER_FEC_ADAPTIVE(context)){
+            // The configured overhead is the upper bound
+            nativeEnableAdaptiveFEC(nativeInstance,10,AVideoTransmitterSettings.getVIDEO_TRANSMITTER_FEC_OVERHEAD_PERCENT(context));
+        }
+        nativeStartSendThread(nativeInstance,AVideoTransmitterSettings.getVIDEO_TRANSMITTER_SEND_THREAD_BACKLOG_KB(context));
+    }
+
+    public String getSendThreadStats(){
+        return nativeGetSendThreadStats(nativeInstance);
     }
 
     //Send the UDP data on another thread,since networking is strictly forbidden on the UI thread
@@ -43,15 +103,21 @@ public class VideoTransmitter {
         });
     }
 
+    public void sendOnCurrentThread(final ByteBuffer data){
+        sendOnCurrentThread(data,-1);
+    }
+
     //When using a special Handler for the Encoder's callbacks
     //We do not need to create an extra thread
-    public void sendOnCurrentThread(final ByteBuffer data){
+    //captureTimeUs: MediaCodec.BufferInfo.presentationTimeUs of the frame the data belongs to.
+    //All data with the same capture time gets the same rtp timestamp
+    public void sendOnCurrentThread(final ByteBuffer data,final long captureTimeUs){
         if(!data.isDirect()){
             // We need to create a direct byte buffer such that the native code can access it
             //final ByteBuffer tmpDirectByteBuffer=ByteBuffer.allocateDirect(data.remaining());
             Log.e(TAG,"Cannot send non-direct byte buffer.Convert to direct first.");
         }
-        nativeSend(nativeInstance,data,data.remaining(),streamMode);
+        nativeSend(nativeInstance,data,data.remaining(),streamMode,captureTimeUs);
     }
 
 